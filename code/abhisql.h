@@ -4,10 +4,24 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
 #include "file_utils.h"
 #include "bplus_tree.h"
+#include "bulk_loader.h"
+#include "parallel_scan.h"
+#include "aggregates.h"
+#include "hash_aggregate.h"
+#include "external_sort.h"
+#include "top_k.h"
+#include "hash_join.h"
+#include "merge_join.h"
+#include "record_printer.h"
+#include "table_statistics.h"
+#include "query_planner.h"
+#include "sql_lexer.h"
 using namespace std;
 
 
@@ -25,7 +39,13 @@ public:
 } column_type;
 
 
-// a condition datatype
+// codes of the operators joining the operands of a compound condition
+#define WHERE_AND 1
+#define WHERE_OR 2
+#define WHERE_NOT 3
+
+
+// a condition datatype: a comparison, or AND / OR / NOT over other conditions
 class where_condition{
 public:
     string column_name;             // the column whose values will be used for comparison
@@ -33,12 +53,23 @@ public:
     string value;                   // the value in construct: column_name comp_code value
     bool value_is_null;             // true if value is to be interpreted as NULL
     
+    uint8_t logic_code;             // 0 for a comparison, otherwise WHERE_AND, WHERE_OR or WHERE_NOT over the operands
+    vector<where_condition> operands;
+    
+    int ordinal_position;           // 0-based position of the column in a record, -1 for row_id; set on resolving
+    int64_t row_id_value;           // value of a row_id comparison; set on resolving
+    int parameter;                  // which ? of a prepared statement stands for value, -1 for none
+    
     // default condition is where (row_id > 0)
     where_condition(){
         column_name = "row_id";
         comp_code = 3;
         value = "0";
         value_is_null = false;
+        logic_code = 0;
+        ordinal_position = -1;
+        row_id_value = 0;
+        parameter = -1;
     }
     
     where_condition(string c, uint8_t o, string v){
@@ -46,25 +77,141 @@ public:
         comp_code = o;
         value = v;
         value_is_null = false;
+        logic_code = 0;
+        ordinal_position = -1;
+        row_id_value = 0;
+        parameter = -1;
+    }
+    
+    where_condition(uint8_t logic, const vector<where_condition> &conditions){
+        comp_code = 0;
+        value_is_null = false;
+        logic_code = logic;
+        operands = conditions;
+        ordinal_position = -1;
+        row_id_value = 0;
+        parameter = -1;
+    }
+    
+    
+    // Call visit on every comparison of the condition, stops at the first one it returns false for
+    bool each_comparison(const function<bool(where_condition&)> &visit){
+        if(logic_code == 0)
+            return visit(*this);
+        for(size_t i = 0; i < operands.size(); i++){
+            if(!operands[i].each_comparison(visit))
+                return false;
+        }
+        return true;
+    }
+    
+    
+    // the condition written out, compound operands in parentheses
+    string text() const{
+        if(logic_code == 0){
+            if(value_is_null)
+                return column_name + (comp_code == 6 ? " is null" : " is not null");
+            const char *operators[] = {"=", "!=", "<", ">", "<=", ">="};
+            return column_name + " " + operators[comp_code] + " " + value;
+        }
+        string joined = (logic_code == WHERE_NOT) ? "not " : "";
+        for(size_t i = 0; i < operands.size(); i++){
+            if(i > 0)
+                joined += (logic_code == WHERE_AND) ? " and " : " or ";
+            bool compound = (operands[i].logic_code == WHERE_AND || operands[i].logic_code == WHERE_OR);
+            joined += compound ? "(" + operands[i].text() + ")" : operands[i].text();
+        }
+        return joined;
+    }
+    
+    
+    // Narrow [low, high] down to the row_ids the condition can hold for, going by the row_id comparisons every
+    // selected row has to satisfy. Only meaningful once resolved.
+    void row_id_range(int64_t &low, int64_t &high) const{
+        if(logic_code == WHERE_AND){
+            for(size_t i = 0; i < operands.size(); i++){
+                operands[i].row_id_range(low, high);
+            }
+            return;
+        }
+        if(logic_code != 0 || ordinal_position != -1 || value_is_null)
+            return;
+        switch(comp_code){
+            case 0:
+                low = max(low, row_id_value);
+                high = min(high, row_id_value);
+                break;
+            case 2:
+                high = min(high, row_id_value - 1);
+                break;
+            case 3:
+                low = max(low, row_id_value + 1);
+                break;
+            case 4:
+                high = min(high, row_id_value);
+                break;
+            case 5:
+                low = max(low, row_id_value);
+                break;
+        }
     }
     
 };
 
 
 
+// a parsed SELECT
+struct select_statement{
+    string table_name;
+    string join_table, join_left_column, join_right_column;     // join_table is empty without a JOIN
+    where_condition cond;
+    vector<string> projection_columns;
+    vector<pair<string, bool> > order_columns;                  // (column, descending)
+    string group_column;
+    bool has_aggregates;
+    long limit;                                                 // -1 without a LIMIT
+};
+
+
+// Where an incremental scan of the rows of a SELECT stands. It follows the leaf chain of the table one leaf at a
+// time; splits only move rows to the right along the chain, so what writers do meanwhile cannot make it skip a row.
+struct scan_cursor{
+    string table_file_path;
+    where_condition cond;                                       // resolved against the catalog
+    bool all_columns;
+    vector<int> projection_ordinal_positions;
+    uint32_t leaf_addr;                                         // the next leaf to read, 0xffffffff past the end
+    uint32_t high_key;                                          // no row_id above it satisfies cond
+    scan_cursor() : all_columns(true), leaf_addr(0xffffffff), high_key(0){}
+};
+
+
+
 // SQL Engine class
 class Abhi_sql_engine{
-    // tmp variables
-    char tmp_page[PAGE_SIZE];
-    string tmp_string;
-    uint8_t tmp8;
-    uint16_t tmp16;
-    uint32_t tmp32;
-    uint64_t tmp64;
-    
     // text to code mapping for datatypes
     unordered_map<string, uint8_t> data_type_map;
     
+    // serializes the catalog row_id counters between concurrent CREATE TABLEs
+    static mutex& catalog_mutex(){
+        static mutex catalog_lock;
+        return catalog_lock;
+    }
+    
+    // the rows of database_columns as last read, and the version of the catalog file they were read at
+    struct catalog_snapshot{
+        mutex snapshot_mutex;
+        bool valid;
+        uint64_t version;
+        vector<record_type> column_records;
+        catalog_snapshot() : valid(false), version(0){}
+    };
+    
+    static catalog_snapshot& catalog_cache(){
+        static catalog_snapshot snapshot;
+        return snapshot;
+    }
+    
 public:
     Abhi_sql_engine(){
         data_type_map["tinyint"] = 0x04;
@@ -78,10 +225,66 @@ public:
         data_type_map["text"] = 0x0c;
     }
     
+    
+    // Start a transaction: pages modified by the following statements stay in memory until COMMIT
+    bool begin_transaction(){
+        if(!file_utils::begin_transaction()){
+            console::out() << "[Error] A transaction is already open\n";
+            return false;
+        }
+        console::out() << "Transaction started\n";
+        return true;
+    }
+    
+    
+    // Write all the pages modified within the transaction
+    bool commit_transaction(){
+        if(!in_transaction()){
+            console::out() << "[Error] No transaction is open\n";
+            return false;
+        }
+        size_t pages_written;
+        bool written = file_utils::commit_transaction(pages_written);
+        console::out() << "Transaction committed, " << pages_written << " pages written\n";
+        return written;
+    }
+    
+    
+    // Discard all the pages modified within the transaction
+    bool rollback_transaction(){
+        if(!in_transaction()){
+            console::out() << "[Error] No transaction is open\n";
+            return false;
+        }
+        // cached right spines may point at pages that were never written; drop them while the tables are still held
+        file_utils::transaction_state &txn = file_utils::transaction();
+        map<string, map<uint32_t, vector<uint8_t> > >::iterator file_it;
+        for(file_it = txn.dirty_pages.begin(); file_it != txn.dirty_pages.end(); ++file_it){
+            btree_utils::forget_append_hint(file_it->first);
+        }
+        file_utils::rollback_transaction();
+        console::out() << "Transaction rolled back\n";
+        return true;
+    }
+    
+    
+    bool in_transaction(){
+        return file_utils::transaction().active;
+    }
+    
+    
+    // Schema changes work on the files directly, so they end the open transaction first
+    void commit_before_ddl(){
+        if(in_transaction()){
+            console::out() << "[Warning] Committing the open transaction before changing the schema\n";
+            commit_transaction();
+        }
+    }
+    
 
     // Show a list of all the saved tables (catalog + user_data)
     void show_tables(){
-        cout << "Following tables in the database:\n";
+        console::out() << "Following tables in the database:\n";
         where_condition cond;
         vector<record_type> recs = get_all_records("database_tables");
         for(int i = 0; i < recs.size(); i++){
@@ -99,42 +302,66 @@ public:
             }
             */
             
-            cout << table_name << "\n";
+            console::out() << table_name << "\n";
         }
-        cout << "\n";
+        console::out() << "\n";
     }
     
     
     // Drop a user-table from the database
-    void drop_table(string table_name){
-        cout << "Deleting user-table \'" << table_name << "\'\n";
+    bool drop_table(string table_name){
+        commit_before_ddl();
+        string table_file_path = string("user_data/") + table_name + ".tbl";
+        write_gate gate(table_file_path);
+        if(!gate.entered()){
+            console::out() << "[Error] Table \'" << table_name << "\' is held by another transaction\n";
+            return false;
+        }
+        table_lock lock(table_file_path, true);
+        console::out() << "Deleting user-table \'" << table_name << "\'\n";
         // 1. Delete record from database files
         // 2. Delete file from the user_data (cannot delete database file)
         
         where_condition cond1("table_name", 0, table_name);
         vector<record_type> recs = select_records(get_all_records("database_tables"), "database_tables", cond1);
         if(recs.size() == 0){
-            cout << "No such table found\n";
-            return;
+            console::out() << "[Error] No such table found\n";
+            return false;
         }
         where_condition cond2("table_name", 0, table_name);
         update_records("database_tables", "table_name", "-", cond2, true);
         
         where_condition cond3("table_name", 0, table_name);
         update_records("database_columns", "-", "-", cond3, true);
+        
+        // statistics too, if the catalog has them
+        if(statistics_installed()){
+            where_condition cond4("table_name", 0, table_name);
+            update_records("database_statistics", "-", "-", cond4, true);
+        }
 
+        btree_utils::forget_append_hint(table_file_path);
+        file_utils::forget_table_file(table_file_path);
         string command;
         command = string("rm -f user_data/") + table_name + ".tbl";
         std::system(command.c_str());
         command = string("rm -f user_data/") + table_name + ".tbr";
         std::system(command.c_str());
-        cout << "\n";
+        console::out() << "\n";
+        return true;
     }
     
     
     
     // Insert a full-qualified record in a table (catalog / user_data)
     bool insert(std::string table_name, record_type record, bool system_table = false){
+        vector<record_type> records(1, record);
+        return insert(table_name, records, system_table);
+    }
+    
+    
+    // Insert a batch of full-qualified records in a table (catalog / user_data), writing each affected page once
+    bool insert(std::string table_name, vector<record_type> &records, bool system_table = false){
         // find table path
         std::string table_file_path;
         if(!system_table){
@@ -145,74 +372,107 @@ public:
         }
         
         // check if a table exists with this name
+        write_gate gate(table_file_path);
+        if(!gate.entered()){
+            console::out() << "[Error] Table \'" << table_name << "\' is held by another transaction\n";
+            return false;
+        }
+        table_lock lock(table_file_path);
         fstream f;
         f.open(table_file_path, ios::in);
         if(!f.is_open()){
-            cout << "[Error] Cannot insert. No such table exists\n";
+            console::out() << "[Error] Cannot insert. No such table exists\n";
             return false;
         }
         f.close();
         
-        // btree insert record in the table
-        btree_utils::btree_insert(table_file_path, record);
-        return true;
+        // btree insert records in the table
+        if(records.size() == 1)
+            return btree_utils::btree_insert(table_file_path, records[0]);
+        return btree_utils::btree_insert(table_file_path, records);
     }
     
     
     // Insert a half-qualified record in a user-table by converting to full-qualified record first
     bool insert(string table_name, vector<string> &insert_values, vector<string> &insert_columns){
+        vector<vector<string> > insert_values_list(1, insert_values);
+        return insert(table_name, insert_values_list, insert_columns);
+    }
+    
+    
+    // Insert several half-qualified records in a user-table, with a single catalog lookup for all of them
+    bool insert(string table_name, vector<vector<string> > &insert_values_list, vector<string> &insert_columns){
         
         // obtain columns info about table
         where_condition cond("table_name", 0, table_name);
-        vector<record_type> column_info = select_records(get_all_records("database_columns"), "database_columns", cond);
+        vector<record_type> column_info = select_records(catalog_columns(), "database_columns", cond);
 
         
         // if insert_columns is empty, all values were input:
         if(insert_columns.size() == 0){
-            // Ensure insert_values.size() == total_columns and first column is row_id
-            if(insert_values.size() != column_info.size() + 1){
-                cout << "[Error] Insufficient values for " << column_info.size() + 1 << " columns including row_id\n";
-                return false;
-            }
-            
             // fill all the columns in insert_columns in ordinal order
             insert_columns.resize(column_info.size() + 1);
             insert_columns[0] = "row_id";
             for(int i = 0; i < column_info.size(); i++){
-                int col_position, col_type;
-                bool is_nullable;
+                int col_position;
                 stringstream(column_info[i].second[3].second) >> col_position;
-                stringstream(column_info[i].second[2].second) >> col_type;
-                stringstream(column_info[i].second[4].second) >> is_nullable;
                 insert_columns[col_position - 1 + 1] = column_info[i].second[1].second;
             }
         }
-
         
-        // fill the hashmap
-        unordered_map<string, string> col_values_map;
+        
+        // map each column to its position in the values
+        unordered_map<string, size_t> col_index_map;
         for(int i = 0; i < insert_columns.size(); i++){
-            if(col_values_map.find(insert_columns[i]) != col_values_map.end()){
-                cout << "[Error] Value assigned to column \'" << insert_columns[i] << "\' multiple times\n";
+            if(col_index_map.find(insert_columns[i]) != col_index_map.end()){
+                console::out() << "[Error] Value assigned to column \'" << insert_columns[i] << "\' multiple times\n";
                 return false;
             }
-            col_values_map[insert_columns[i]] = insert_values[i];
+            col_index_map[insert_columns[i]] = i;
+        }
+        if(col_index_map.find("row_id") == col_index_map.end()){
+            console::out() << "[Error] No value provided for column \'row_id\'\n";
+            return false;
         }
-
         
-        // prepare the record to be outputted
-        record_type record;
-        stringstream(col_values_map["row_id"]) >> record.first;
         
-        for(int i = 0; i < column_info.size(); i++){
+        // prepare the records to be outputted
+        vector<record_type> records;
+        records.reserve(insert_values_list.size());
+        for(size_t v = 0; v < insert_values_list.size(); v++){
+            // Ensure insert_values.size() == total_columns
+            if(insert_values_list[v].size() != insert_columns.size()){
+                console::out() << "[Error] Insufficient values for " << insert_columns.size() << " columns including row_id\n";
+                return false;
+            }
+            
+            record_type record;
+            if(!make_record(column_info, col_index_map, insert_values_list[v], record))
+                return false;
+            records.push_back(record);
+        }
+        
+        
+        // insert the records, sorted by row_id
+        return insert(table_name, records);
+    }
+    
+    
+    // Convert the values of a row (indexed through col_index_map) to a full-qualified record of the table. A
+    // value "null" is NULL, unless quoted says it was quoted.
+    bool make_record(vector<record_type> &column_info, unordered_map<string, size_t> &col_index_map, vector<string> &insert_values, record_type &record, const vector<bool> *quoted = NULL){
+        stringstream(insert_values[col_index_map["row_id"]]) >> record.first;
+        
+        for(size_t i = 0; i < column_info.size(); i++){
             int col_type;
             bool is_nullable;
             stringstream(column_info[i].second[2].second) >> col_type;
             stringstream(column_info[i].second[4].second) >> is_nullable;
             string col_name = column_info[i].second[1].second;
             
-            if(col_values_map.find(col_name) != col_values_map.end() && col_values_map[col_name] != "null"){
-                string col_value = col_values_map[col_name];
+            unordered_map<string, size_t>::iterator index = col_index_map.find(col_name);
+            if(index != col_index_map.end() && (insert_values[index->second] != "null" || (quoted != NULL && (*quoted)[index->second]))){
+                string col_value = insert_values[col_index_map[col_name]];
                 if(col_type >= 0x0c){
                     col_type = 0x0c + (int) col_value.size();
                 }
@@ -220,7 +480,7 @@ public:
             }
             else{
                 if(!is_nullable){
-                    cout << "[Error] Column \'" << col_name << "\' cannot be null\n";
+                    console::out() << "[Error] Column \'" << col_name << "\' cannot be null\n";
                     return false;
                 }
                 else{
@@ -236,33 +496,129 @@ public:
                 }
             }
         }
+        return true;
+    }
+    
+    
+    // Bulk load rows into a user-table and rebuild its b+ tree bottom-up, together with the rows it already has.
+    // Each line holds the values of one row in column order, starting with row_id, written as in VALUES (...);
+    // a quoted 'null' is text.
+    bool load_table(string table_name, istream &rows, double fill_factor = 1.0){
+        commit_before_ddl();
+        string table_file_path = string("user_data/") + table_name + ".tbl";
+        write_gate gate(table_file_path);
+        if(!gate.entered()){
+            console::out() << "[Error] Table \'" << table_name << "\' is held by another transaction\n";
+            return false;
+        }
+        table_lock lock(table_file_path, true);
+        fstream f;
+        f.open(table_file_path, ios::in);
+        if(!f.is_open()){
+            console::out() << "[Error] Cannot load. No such table exists\n";
+            return false;
+        }
+        f.close();
+        if(fill_factor <= 0 || fill_factor > 1){
+            console::out() << "[Error] Fill factor must be in (0, 1]\n";
+            return false;
+        }
+        
+        // obtain columns info about table, values come in ordinal order
+        where_condition cond("table_name", 0, table_name);
+        vector<record_type> column_info = select_records(catalog_columns(), "database_columns", cond);
+        unordered_map<string, size_t> col_index_map;
+        col_index_map["row_id"] = 0;
+        for(size_t i = 0; i < column_info.size(); i++){
+            int col_position;
+            stringstream(column_info[i].second[3].second) >> col_position;
+            col_index_map[column_info[i].second[1].second] = col_position;
+        }
         
+        bulk_loader loader(table_file_path, fill_factor);
+        string line;
+        size_t line_number = 0;
+        vector<string> values;
+        vector<bool> quoted;
+        while(getline(rows, line)){
+            ++line_number;
+            if(line.find_first_not_of(" \t\r") == string::npos)
+                continue;
+            
+            // split the row into values as the parser splits those of VALUES (...): quoted text unquoted, its
+            // '' made ', and unquoted words in lowercase
+            values.clear();
+            quoted.clear();
+            sql_lexer lexer(line);
+            sql_token token = lexer.next();
+            while(true){
+                if(token.type == TOKEN_STRING)
+                    values.push_back(token.unquoted());
+                else if(token.type == TOKEN_WORD)
+                    values.push_back(token.lowercase());
+                else{
+                    if(token.type == TOKEN_UNTERMINATED)
+                        console::out() << "[Error] Line " << line_number << ": closing quote not found for value\n";
+                    else
+                        console::out() << "[Error] Line " << line_number << ": missing value for a column\n";
+                    return false;
+                }
+                quoted.push_back(token.type == TOKEN_STRING);
+                token = lexer.next();
+                if(!token.is(","))
+                    break;
+                token = lexer.next();
+            }
+            if(token.type != TOKEN_END){
+                console::out() << "[Error] Line " << line_number << ": expected ',' in place of \'" << token.text << "\'\n";
+                return false;
+            }
+            if(values.size() != column_info.size() + 1){
+                console::out() << "[Error] Line " << line_number << ": expected " << column_info.size() + 1 << " values including row_id\n";
+                return false;
+            }
+            
+            record_type record;
+            if(!make_record(column_info, col_index_map, values, record, &quoted)){
+                console::out() << "[Error] Line " << line_number << ": invalid row\n";
+                return false;
+            }
+            loader.add(record);
+        }
         
-        // ensure that the row_id value is strictly greater than the max_row_id so far
-        // insert the record
-        return insert(table_name, record);
+        loader.finish();
+        console::out() << "Table \'" << table_name << "\' now holds " << loader.records_loaded() << " records\n";
+        return loader.records_skipped() == 0;
     }
     
     
     // Create a user-table (catalog too, if required) with columns info provided
     bool create_table(string table_name, vector<column_type> &columns, bool system_table = false){
+        commit_before_ddl();
+        
         // Check if table does not already exist
         fstream ftmp;
         string table_file_path = string("user_data/") + table_name + ".tbl";
+        write_gate gate(table_file_path);
+        if(!gate.entered()){
+            console::out() << "[Error] Table \'" << table_name << "\' is held by another transaction\n";
+            return false;
+        }
+        table_lock lock(table_file_path, true);
         FILE *table_file = fopen(table_file_path.c_str(), "r");
         if(table_file){
-            cout << "[Error] User table already exists\n";
+            console::out() << "[Error] User table already exists\n";
             fclose(table_file);
             return false;
         }
         
         // sanity checks
         if(table_name == ""){
-            cout << "[Error] Cannot read a valid table name\n";
+            console::out() << "[Error] Cannot read a valid table name\n";
             return false;
         }
         if(columns.size() == 0){
-            cout << "[Warning] Are you sure, you want to create a table with no columns but row_id though?\n";
+            console::out() << "[Warning] Are you sure, you want to create a table with no columns but row_id though?\n";
         }
         
         // Create table file
@@ -284,6 +640,7 @@ public:
         
 
         // read max_rowid in tables
+        lock_guard<mutex> catalog_guard(catalog_mutex());
         uint32_t tables_max_row_id;
         ftmp.open("catalog/database_tables_max_rowid.txt", ios::in);
         ftmp >> tables_max_row_id;
@@ -305,144 +662,1490 @@ public:
         //insert a record for each column
         for(int i = 0; i < columns.size(); i++){
             if(columns[i].column_name == "" || data_type_map.find(columns[i].data_type) == data_type_map.end()){
-                cout << "[Error] Invalid column information to create_tables() method\n";
+                console::out() << "[Error] Invalid column information to create_tables() method\n";
+                return false;
+            }
+            record.clear();
+            record.push_back(make_pair(0x0c + table_name.size(), table_name));
+            record.push_back(make_pair(0x0c + columns[i].column_name.size(), columns[i].column_name));
+            record.push_back(make_pair(0x04, to_string((int) data_type_map[columns[i].data_type])));
+            record.push_back(make_pair(0x04, to_string(i + 1)));
+            record.push_back(make_pair(0x04, to_string((int) !columns[i].not_null)));
+            insert("database_columns", make_pair(columns_max_row_id + 1 + i, record), true);
+        }
+        // update max row id
+        ftmp.open("catalog/database_columns_max_rowid.txt", ios::out);
+        ftmp << columns_max_row_id + columns.size();
+        ftmp.close();
+        
+        return true;
+    }
+    
+    
+    // ANALYZE: gather the statistics of a table into database_statistics, replacing those it had. Only a sample
+    // of evenly spread leaves is read; the row count is exact when that is every leaf, otherwise scaled up from
+    // the rows per sampled leaf.
+    bool analyze_table(string table_name){
+        commit_before_ddl();
+        if(!statistics_installed()){
+            console::out() << "[Error] The catalog has no database_statistics table, reinstall to create it\n";
+            return false;
+        }
+        
+        string table_file_path, table_root_path;
+        if(!table_files(table_name, table_file_path, table_root_path))
+            return false;
+        
+        // row_id first, then the columns of the table
+        vector<record_type> column_records = catalog_columns();
+        vector<string> column_names(1, "row_id");
+        vector<sort_column> columns(1, sort_column());
+        columns[0].ordinal_position = -1;
+        columns[0].data_type = 0x06;
+        columns[0].descending = false;
+        for(size_t i = 0; i < column_records.size(); i++){
+            if(column_records[i].second[0].second != table_name)
+                continue;
+            sort_column column;
+            column.ordinal_position = stoi(column_records[i].second[3].second) - 1;
+            column.data_type = stoi(column_records[i].second[2].second);
+            column.descending = false;
+            column_names.push_back(column_records[i].second[1].second);
+            columns.push_back(column);
+        }
+        
+        // read the sampled leaves in parallel
+        work_stealing_pool &pool = work_stealing_pool::shared();
+        vector<leaf_morsel> leaves;
+        vector<size_t> sample;
+        vector<vector<record_type> > sample_rows;
+        {
+            table_lock lock(table_file_path);
+            uint32_t root_page_addr;
+            {
+                shared_latch root_latch(table_file_path, ROOT_LATCH);
+                root_page_addr = file_utils::read_root_page_addr(table_root_path);
+            }
+            leaves = parallel_scan::leaf_morsels(table_file_path, root_page_addr, 1, pool);
+            sample = statistics_sampler::sample_leaves(leaves.size(), STATS_SAMPLE_LEAVES);
+            sample_rows.resize(sample.size());
+            pool.run(sample.size(), [&](size_t s){
+                page_reader reader(table_file_path);
+                uint8_t leaf_page[PAGE_SIZE];
+                if(reader.read(leaves[sample[s]].first_leaf_addr, leaf_page) && leaf_page[0] == 0x0d)
+                    file_utils::read_records_from_page(leaf_page, sample_rows[s]);
+            });
+        }
+        vector<record_type> rows;
+        for(size_t s = 0; s < sample_rows.size(); s++){
+            rows.insert(rows.end(), make_move_iterator(sample_rows[s].begin()), make_move_iterator(sample_rows[s].end()));
+        }
+        
+        table_statistics stats;
+        stats.leaf_pages = leaves.size();
+        stats.row_count = rows.size();
+        if(sample.size() < leaves.size())
+            stats.row_count = (uint64_t) ((double) rows.size() / sample.size() * leaves.size() + 0.5);
+        stats.columns.resize(columns.size());
+        pool.run(columns.size(), [&](size_t c){
+            stats.columns[c] = statistics_sampler::column_from_sample(column_names[c], columns[c], rows, stats.row_count);
+        });
+        // row_ids are unique
+        stats.columns[0].distinct_count = stats.row_count;
+        
+        // one catalog row per column, in place of the previous ones
+        write_gate gate("catalog/database_statistics.tbl");
+        if(!gate.entered()){
+            console::out() << "[Error] Table \'database_statistics\' is held by another transaction\n";
+            return false;
+        }
+        lock_guard<mutex> catalog_guard(catalog_mutex());
+        where_condition cond("table_name", 0, table_name);
+        if(!update_records("database_statistics", "-", "-", cond, true))
+            return false;
+        uint32_t statistics_max_row_id;
+        fstream ftmp;
+        ftmp.open("catalog/database_statistics_max_rowid.txt", ios::in);
+        ftmp >> statistics_max_row_id;
+        ftmp.close();
+        vector<record_type> records;
+        for(size_t c = 0; c < stats.columns.size(); c++){
+            column_statistics &column = stats.columns[c];
+            string histogram = statistics_sampler::histogram_text(column.histogram);
+            record_type record;
+            record.first = statistics_max_row_id + 1 + c;
+            record.second.push_back(make_pair(0x0c + table_name.size(), table_name));
+            record.second.push_back(make_pair(0x0c + column.column_name.size(), column.column_name));
+            record.second.push_back(make_pair(0x07, to_string(stats.row_count)));
+            record.second.push_back(make_pair(0x06, to_string(stats.leaf_pages)));
+            record.second.push_back(make_pair(0x09, to_string(column.null_fraction)));
+            record.second.push_back(make_pair(0x0c + column.min_value.size(), column.min_value));
+            record.second.push_back(make_pair(0x0c + column.max_value.size(), column.max_value));
+            record.second.push_back(make_pair(0x07, to_string(column.distinct_count)));
+            record.second.push_back(make_pair(0x0c + histogram.size(), histogram));
+            records.push_back(record);
+        }
+        insert("database_statistics", records, true);
+        ftmp.open("catalog/database_statistics_max_rowid.txt", ios::out);
+        ftmp << statistics_max_row_id + records.size();
+        ftmp.close();
+        
+        console::out() << "Analyzed table \'" << table_name << "\': " << stats.row_count << " rows in " << stats.leaf_pages << " leaf pages, "
+            << sample.size() << " of them sampled\n";
+        return true;
+    }
+    
+    
+    // catalogs installed before ANALYZE existed have no statistics table
+    bool statistics_installed(){
+        FILE *statistics_file = fopen("catalog/database_statistics.tbl", "r");
+        if(!statistics_file)
+            return false;
+        fclose(statistics_file);
+        return true;
+    }
+    
+    
+    // Statistics ANALYZE stored for a table, false if it has none
+    bool read_statistics(string table_name, table_statistics &stats){
+        if(!statistics_installed())
+            return false;
+        where_condition cond("table_name", 0, table_name);
+        vector<record_type> recs = select_records(get_all_records("database_statistics"), "database_statistics", cond);
+        if(recs.size() == 0)
+            return false;
+        stats.columns.clear();
+        for(size_t i = 0; i < recs.size(); i++){
+            vector<pair<uint8_t, string> > &values = recs[i].second;
+            stats.row_count = stoull(values[2].second);
+            stats.leaf_pages = stoul(values[3].second);
+            column_statistics column;
+            column.column_name = values[1].second;
+            column.null_fraction = stod(values[4].second);
+            column.min_value = values[5].second;
+            column.max_value = values[6].second;
+            column.distinct_count = stoull(values[7].second);
+            column.histogram = statistics_sampler::parse_histogram(values[8].second);
+            stats.columns.push_back(column);
+        }
+        return true;
+    }
+    
+    
+    // statistics for the planner: those of the last ANALYZE, or guesses from the size of the table file
+    table_statistics planner_statistics(string table_name, string table_file_path, bool &analyzed){
+        table_statistics stats;
+        analyzed = read_statistics(table_name, stats);
+        if(!analyzed)
+            stats = query_planner::default_statistics(file_utils::table_file_size(table_file_path));
+        return stats;
+    }
+    
+    
+    // ANALYZE without a table: every user-table
+    bool analyze_all_tables(){
+        vector<record_type> recs = get_all_records("database_tables");
+        for(size_t i = 0; i < recs.size(); i++){
+            string table_name = recs[i].second[0].second;
+            FILE *table_file = fopen((string("user_data/") + table_name + ".tbl").c_str(), "r");
+            if(!table_file)
+                continue;
+            fclose(table_file);
+            if(!analyze_table(table_name))
+                return false;
+        }
+        return true;
+    }
+    
+    
+    // 0-based position of a table's column within its records, -1 if the table has no such column
+    int column_position(const vector<record_type> &column_records, string table_name, string column_name){
+        int ordinal_position = -1;
+        for(size_t i = 0; i < column_records.size(); i++){
+            // check first and second column
+            if(column_records[i].second[0].second == table_name && column_records[i].second[1].second == column_name){
+                stringstream(column_records[i].second[3].second) >> ordinal_position;
+                break;
+            }
+        }
+        return (ordinal_position == -1) ? -1 : ordinal_position - 1;
+    }
+    
+    
+    // type code of a table's column, 0 if the table has no such column
+    uint8_t column_data_type(const vector<record_type> &column_records, string table_name, string column_name){
+        int data_type = 0;
+        for(size_t i = 0; i < column_records.size(); i++){
+            if(column_records[i].second[0].second == table_name && column_records[i].second[1].second == column_name){
+                stringstream(column_records[i].second[2].second) >> data_type;
+                break;
+            }
+        }
+        return (uint8_t) data_type;
+    }
+    
+    
+    // record_selected as a stage of its own for EXPLAIN ANALYZE
+    bool selected(const record_type &record, const where_condition &cond){
+        bool is_selected;
+        {
+            profile_scope predicate(STAGE_PREDICATE);
+            is_selected = record_selected(record, cond);
+        }
+        query_profile::count_rows(STAGE_PREDICATE, 1, is_selected);
+        return is_selected;
+    }
+    
+    
+    // Check a record against a resolved condition. The operands of AND and OR are tried in their order and
+    // stop as soon as one of them settles the result.
+    bool record_selected(const record_type &record, const where_condition &cond){
+        switch(cond.logic_code){
+            case WHERE_AND:{
+                for(size_t i = 0; i < cond.operands.size(); i++){
+                    if(!record_selected(record, cond.operands[i]))
+                        return false;
+                }
+                return true;
+            }
+            case WHERE_OR:{
+                for(size_t i = 0; i < cond.operands.size(); i++){
+                    if(record_selected(record, cond.operands[i]))
+                        return true;
+                }
+                return false;
+            }
+            case WHERE_NOT:
+                return !record_selected(record, cond.operands[0]);
+        }
+        
+        if(cond.ordinal_position != -1)
+            return check_cond(record.second[cond.ordinal_position], cond);
+        int64_t rid = record.first;
+        switch(cond.comp_code){
+            case 0:
+                return (rid == cond.row_id_value);
+            case 1:
+                return (rid != cond.row_id_value);
+            case 2:
+                return (rid < cond.row_id_value);
+            case 3:
+                return (rid > cond.row_id_value);
+            case 4:
+                return (rid <= cond.row_id_value);
+            case 5:
+                return (rid >= cond.row_id_value);
+            default:
+                return false;
+        }
+    }
+    
+    
+    // Rough cost of checking a condition against a row, and the fraction of rows it holds for. Comparisons on
+    // row_id need no column value and text compares dearer than numbers. The fraction goes by the statistics
+    // of the table if given, otherwise equality is taken to be selective.
+    void estimate_condition(const vector<record_type> &column_records, string table_name, const where_condition &cond, double &cost, double &selectivity, const table_statistics *stats = NULL){
+        if(cond.logic_code == WHERE_NOT){
+            estimate_condition(column_records, table_name, cond.operands[0], cost, selectivity, stats);
+            selectivity = 1 - selectivity;
+            return;
+        }
+        if(cond.logic_code != 0){
+            // an operand is only reached by the rows the ones before it did not settle
+            double reach = 1;
+            cost = 0;
+            for(size_t i = 0; i < cond.operands.size(); i++){
+                double operand_cost, operand_selectivity;
+                estimate_condition(column_records, table_name, cond.operands[i], operand_cost, operand_selectivity, stats);
+                cost += reach * operand_cost;
+                reach *= (cond.logic_code == WHERE_AND) ? operand_selectivity : 1 - operand_selectivity;
+            }
+            selectivity = (cond.logic_code == WHERE_AND) ? reach : 1 - reach;
+            return;
+        }
+        
+        cost = 1;
+        uint8_t data_type = 0x06;
+        if(cond.ordinal_position != -1){
+            data_type = column_data_type(column_records, table_name, cond.column_name);
+            cost = (data_type >= 0x0c) ? 4 : 2;
+        }
+        const column_statistics *column = stats ? query_planner::column(*stats, cond.column_name) : NULL;
+        selectivity = query_planner::comparison_selectivity(column, data_type, cond.ordinal_position == -1, cond.comp_code, cond.value);
+    }
+    
+    
+    // Resolve the columns of a condition against a table, false once an error is printed. The operands of
+    // every AND and OR are put in the order that settles a row soonest for the least work: by cost over the
+    // fraction of rows the operand settles.
+    bool resolve_condition(const vector<record_type> &column_records, string table_name, where_condition &cond){
+        if(cond.logic_code == 0){
+            cond.ordinal_position = -1;
+            if(cond.column_name == "row_id"){
+                if(!cond.value_is_null && !(stringstream(cond.value) >> cond.row_id_value)){
+                    console::out() << "[Error] row_id can only be compared with a whole number\n";
+                    return false;
+                }
+                return true;
+            }
+            cond.ordinal_position = column_position(column_records, table_name, cond.column_name);
+            if(cond.ordinal_position == - 1){
+                console::out() << "[Error] Column does not exist with name " << cond.column_name << " in table " << table_name << "\n";
+                return false;
+            }
+            return true;
+        }
+        
+        vector<pair<double, size_t> > ranks(cond.operands.size());
+        for(size_t i = 0; i < cond.operands.size(); i++){
+            if(!resolve_condition(column_records, table_name, cond.operands[i]))
+                return false;
+            double cost, selectivity;
+            estimate_condition(column_records, table_name, cond.operands[i], cost, selectivity);
+            double settles = (cond.logic_code == WHERE_OR) ? selectivity : 1 - selectivity;
+            ranks[i] = make_pair(settles > 0 ? cost / settles : 1e300, i);
+        }
+        stable_sort(ranks.begin(), ranks.end());
+        vector<where_condition> operands;
+        for(size_t i = 0; i < ranks.size(); i++){
+            operands.push_back(cond.operands[ranks[i].second]);
+        }
+        cond.operands.swap(operands);
+        return true;
+    }
+    
+    
+    // Obtain 0-based positions for the projection columns, all_columns is set if every column is asked for
+    vector<int> projection_positions(const vector<record_type> &column_records, string table_name, vector<string> &projection_columns, bool &all_columns){
+        vector<int> projection_ordinal_positions;
+        all_columns = (projection_columns.size() == 0);
+        for(size_t j = 0; j < projection_columns.size() && !all_columns; j++){
+            if(projection_columns[j] == "*"){
+                all_columns = true;
+                break;
+            }
+            int ordinal_position = column_position(column_records, table_name, projection_columns[j]);
+            if(ordinal_position == -1){
+                console::out() << "[Warning] Cannot find projection column \'" << projection_columns[j] << "\'\n";
+                continue;
+            }
+            projection_ordinal_positions.push_back(ordinal_position);
+        }
+        return projection_ordinal_positions;
+    }
+    
+    
+    // keep only the projection columns of a record
+    record_type project_record(const record_type &record, const vector<int> &projection_ordinal_positions){
+        record_type r;
+        r.first = record.first;
+        for(size_t j = 0; j < projection_ordinal_positions.size(); j++){
+            r.second.push_back(record.second[projection_ordinal_positions[j]]);
+        }
+        return r;
+    }
+    
+    
+    vector<record_type> select_records(const vector<record_type> &all_records, string table_name, where_condition cond, vector<string> projection_columns = vector<string>()){
+        
+        // Obtain position info of condition columns
+        vector<record_type> column_records = catalog_columns();
+        if(!resolve_condition(column_records, table_name, cond))
+            return vector<record_type>();
+        
+        
+        // Choose records satisfying the condition
+        vector<record_type> selected_records;
+        for(int i = 0; i < all_records.size(); i++){
+            
+            // add header unconditionally
+            if(all_records[i].first == (uint32_t) -1 || record_selected(all_records[i], cond)){
+                selected_records.push_back(all_records[i]);
+            }
+        }
+        
+        
+        // if no specific projection columns were asked
+        bool all_columns;
+        vector<int> projection_ordinal_positions = projection_positions(column_records, table_name, projection_columns, all_columns);
+        if(all_columns)
+            return selected_records;
+        
+        // project the columns and output
+        vector<record_type> output_records;
+        for(size_t i = 0; i < selected_records.size(); i++){
+            output_records.push_back(project_record(selected_records[i], projection_ordinal_positions));
+        }
+        return output_records;
+        
+    }
+    
+    
+    // Range of row_ids a resolved condition can hold for, which is all of the primary key index a query has to
+    // read; false if no row_id can satisfy the condition
+    bool key_range(const where_condition &cond, uint32_t &low_key, uint32_t &high_key){
+        int64_t low = 0, high = 0xffffffff;
+        cond.row_id_range(low, high);
+        if(low > high)
+            return false;
+        low_key = (uint32_t) low;
+        high_key = (uint32_t) high;
+        return true;
+    }
+        
+    
+    // Look for the table file (user_data first, then catalog) and its root file
+    bool table_files(string table_name, string &table_file_path, string &table_root_path){
+        fstream table_file;
+        table_file_path = string("user_data/") + table_name + ".tbl";
+        table_root_path = string("user_data/") + table_name + ".tbr";
+        table_file.open(table_file_path, ios::in);
+        if(!table_file.is_open()){
+            table_file_path = string("catalog/") + table_name + ".tbl";
+            table_root_path = string("catalog/") + table_name + ".tbr";
+            table_file.open(table_file_path, ios::in);
+        }
+        if(!table_file.is_open()){
+            console::out() << "[Error] No such table exists\n";
+            return false;
+        }
+        table_file.close();
+        return true;
+    }
+    
+    
+    // Visit the records of a table that satisfy the condition. The leaves are split into morsels that the shared
+    // pool visits in parallel: start(n) learns the number of morsels, then visit(m, record) sees the records
+    // of morsel m in row_id order. Returns false if the table or the condition column does not exist.
+    bool scan_table(string table_name, where_condition cond, const vector<record_type> &column_records, const function<void(size_t)> &start, const function<void(size_t, record_type&)> &visit){
+        
+        if(!resolve_condition(column_records, table_name, cond))
+            return false;
+        
+        string table_file_path, table_root_path;
+        if(!table_files(table_name, table_file_path, table_root_path))
+            return false;
+        
+        // a transaction's own pages are not on disk yet, read them the sequential way
+        file_utils::transaction_state &tx = file_utils::transaction();
+        if(tx.dirty_pages.count(table_file_path) > 0 || tx.root_page_addrs.count(table_root_path) > 0){
+            vector<record_type> all_records = get_all_records(table_name);
+            start(1);
+            for(size_t i = 0; i < all_records.size(); i++){
+                if(selected(all_records[i], cond))
+                    visit(0, all_records[i]);
+            }
+            return true;
+        }
+        
+        // DDL cannot swap the tree out while the table lock is held
+        table_lock lock(table_file_path);
+        uint32_t root_page_addr;
+        {
+            shared_latch root_latch(table_file_path, ROOT_LATCH);
+            root_page_addr = file_utils::read_root_page_addr(table_root_path);
+        }
+        
+        // only the leaves in the row_id range of the condition are read
+        work_stealing_pool &pool = work_stealing_pool::shared();
+        vector<leaf_morsel> morsels;
+        uint32_t low_key, high_key;
+        if(key_range(cond, low_key, high_key))
+            morsels = parallel_scan::leaf_morsels(table_file_path, root_page_addr, SCAN_MORSEL_LEAVES, pool, low_key, high_key);
+        start(morsels.size());
+        pool.run(morsels.size(), [&](size_t m){
+            parallel_scan::scan_morsel(table_file_path, morsels[m], [&](record_type &record){
+                if(selected(record, cond))
+                    visit(m, record);
+            });
+        });
+        return true;
+    }
+    
+    
+    // header record with the names of a table's columns
+    record_type table_header(const vector<record_type> &column_records, string table_name){
+        record_type header;
+        header.first = -1;
+        for(size_t i = 0; i < column_records.size(); i++){
+            if(column_records[i].second[0].second == table_name){
+                string col_name = column_records[i].second[1].second;
+                header.second.push_back(make_pair(0x0c + col_name.size(), col_name));
+            }
+        }
+        return header;
+    }
+    
+    
+    // Select and project the records of a table, the same as select_records over get_all_records but without
+    // materializing the table first
+    vector<record_type> scan_records(string table_name, where_condition cond, vector<string> projection_columns = vector<string>(), bool add_header_at_top = false){
+        
+        vector<record_type> column_records = catalog_columns();
+        bool all_columns = true;
+        vector<int> projection_ordinal_positions;
+        vector<record_type> output_records;
+        vector<vector<record_type> > morsel_records;
+        
+        bool found = scan_table(table_name, cond, column_records, [&](size_t morsels){
+            projection_ordinal_positions = projection_positions(column_records, table_name, projection_columns, all_columns);
+            if(add_header_at_top){
+                record_type header = table_header(column_records, table_name);
+                output_records.push_back(all_columns ? header : project_record(header, projection_ordinal_positions));
+            }
+            morsel_records.resize(morsels);
+        }, [&](size_t m, record_type &record){
+            profile_scope projection(STAGE_PROJECTION);
+            if(all_columns)
+                morsel_records[m].push_back(record);
+            else
+                morsel_records[m].push_back(project_record(record, projection_ordinal_positions));
+            query_profile::count_rows(STAGE_PROJECTION, 1, 1);
+        });
+        if(!found)
+            return vector<record_type>();
+        
+        // morsels cover consecutive key ranges, so their results joined in order are in row_id order
+        for(size_t m = 0; m < morsel_records.size(); m++){
+            output_records.insert(output_records.end(), make_move_iterator(morsel_records[m].begin()), make_move_iterator(morsel_records[m].end()));
+        }
+        return output_records;
+    }
+    
+    
+    // Start an incremental scan of a SELECT with no JOIN, ORDER BY, GROUP BY or aggregates, the header record
+    // of its result in header. False once an error is printed.
+    bool open_scan(const select_statement &select, scan_cursor &cursor, record_type &header){
+        vector<record_type> column_records = catalog_columns();
+        cursor.cond = select.cond;
+        if(!resolve_condition(column_records, select.table_name, cursor.cond))
+            return false;
+        string table_root_path;
+        if(!table_files(select.table_name, cursor.table_file_path, table_root_path))
+            return false;
+        vector<string> projection_columns = select.projection_columns;
+        cursor.projection_ordinal_positions = projection_positions(column_records, select.table_name, projection_columns, cursor.all_columns);
+        header = table_header(column_records, select.table_name);
+        if(!cursor.all_columns)
+            header = project_record(header, cursor.projection_ordinal_positions);
+        cursor.leaf_addr = 0xffffffff;
+        uint32_t low_key;
+        if(!key_range(cursor.cond, low_key, cursor.high_key))
+            return true;
+        
+        // down to the leaf that holds low_key, if the table has it
+        table_lock lock(cursor.table_file_path);
+        uint32_t page_addr;
+        {
+            shared_latch root_latch(cursor.table_file_path, ROOT_LATCH);
+            page_addr = file_utils::read_root_page_addr(table_root_path);
+        }
+        uint8_t page[PAGE_SIZE];
+        btree_utils::read_page_shared(cursor.table_file_path, page_addr, page);
+        while(page[0] == 0x05){
+            vector<uint32_t> children, keys;
+            btree_utils::read_interior_cells(page, children, keys);
+            size_t child = lower_bound(keys.begin(), keys.end(), low_key) - keys.begin();
+            if(child >= children.size())
+                return true;
+            page_addr = children[child];
+            btree_utils::read_page_shared(cursor.table_file_path, page_addr, page);
+        }
+        if(page[0] == 0x0d)
+            cursor.leaf_addr = page_addr;
+        return true;
+    }
+    
+    
+    // The rows of the scan's next leaf that satisfy its condition, projected, in place of those in rows. False
+    // once the scan is past its last leaf; rows may come back empty before that.
+    bool next_scan_rows(scan_cursor &cursor, vector<record_type> &rows){
+        rows.clear();
+        if(cursor.leaf_addr == 0xffffffff)
+            return false;
+        
+        // the table may have been dropped or rebuilt smaller since the last leaf was read
+        table_lock lock(cursor.table_file_path);
+        if(file_utils::table_file_size(cursor.table_file_path) == 0){
+            cursor.leaf_addr = 0xffffffff;
+            return false;
+        }
+        uint8_t leaf_page[PAGE_SIZE] = {0};
+        btree_utils::read_page_shared(cursor.table_file_path, cursor.leaf_addr, leaf_page);
+        if(leaf_page[0] != 0x0d){
+            cursor.leaf_addr = 0xffffffff;
+            return false;
+        }
+        vector<record_type> records;
+        file_utils::read_records_from_page(leaf_page, records);
+        file_utils::page_read(leaf_page, 4, cursor.leaf_addr);
+        for(size_t i = 0; i < records.size(); i++){
+            if(records[i].first > cursor.high_key){
+                cursor.leaf_addr = 0xffffffff;
+                break;
+            }
+            if(!selected(records[i], cursor.cond))
+                continue;
+            if(cursor.all_columns)
+                rows.push_back(move(records[i]));
+            else
+                rows.push_back(project_record(records[i], cursor.projection_ordinal_positions));
+        }
+        return true;
+    }
+    
+    
+    // Obtain position info of the (column, descending) order columns, false once an error is printed
+    bool resolve_sort_columns(const vector<record_type> &column_records, string table_name, const vector<pair<string, bool> > &order_columns, vector<sort_column> &columns){
+        columns.assign(order_columns.size(), sort_column());
+        for(size_t i = 0; i < order_columns.size(); i++){
+            columns[i].ordinal_position = -1;
+            columns[i].data_type = 0x06;
+            columns[i].descending = order_columns[i].second;
+            if(order_columns[i].first == "row_id")
+                continue;
+            columns[i].ordinal_position = column_position(column_records, table_name, order_columns[i].first);
+            if(columns[i].ordinal_position == -1){
+                console::out() << "[Error] Column does not exist with name " << order_columns[i].first << " in table " << table_name << "\n";
+                return false;
+            }
+            columns[i].data_type = column_data_type(column_records, table_name, order_columns[i].first);
+        }
+        return true;
+    }
+    
+    
+    // SELECT ... ORDER BY: the selected records sorted on the (column, descending) order columns, row_id breaking
+    // ties. Rows go through an external merge sort on normalized keys, spilling sorted runs past the memory budget.
+    vector<record_type> sort_records(string table_name, where_condition cond, vector<string> projection_columns, vector<pair<string, bool> > order_columns){
+        
+        vector<record_type> column_records = catalog_columns();
+        vector<sort_column> columns;
+        if(!resolve_sort_columns(column_records, table_name, order_columns, columns))
+            return vector<record_type>();
+        
+        bool all_columns = true;
+        vector<int> projection_ordinal_positions;
+        vector<record_type> output_records;
+        work_stealing_pool &pool = work_stealing_pool::shared();
+        external_sorter sorter(SORT_MEMORY_BYTES / pool.size());
+        
+        bool found = scan_table(table_name, cond, column_records, [&](size_t morsels){
+            projection_ordinal_positions = projection_positions(column_records, table_name, projection_columns, all_columns);
+            record_type header = table_header(column_records, table_name);
+            output_records.push_back(all_columns ? header : project_record(header, projection_ordinal_positions));
+            sorter.start(morsels);
+        }, [&](size_t m, record_type &record){
+            if(all_columns)
+                sorter.add(m, columns, record, record);
+            else
+                sorter.add(m, columns, record, project_record(record, projection_ordinal_positions));
+        });
+        if(!found)
+            return vector<record_type>();
+        
+        sorter.finish(pool, [&](record_type &record){
+            output_records.push_back(record);
+        });
+        return output_records;
+    }
+    
+    
+    // SELECT ... ORDER BY ... LIMIT k: the first k records sort_records would return. Scan threads keep bounded
+    // heaps of k rows instead of sorting everything. A full scan also notes the range of the first order column
+    // in every leaf; while the table is not written to, later queries read the leaves best range first and skip
+    // those that cannot hold a row better than the k already found.
+    vector<record_type> top_k_records(string table_name, where_condition cond, vector<string> projection_columns, vector<pair<string, bool> > order_columns, size_t k){
+        if(k > TOP_K_MAX_ROWS){
+            vector<record_type> output_records = sort_records(table_name, cond, projection_columns, order_columns);
+            if(output_records.size() > k + 1)
+                output_records.resize(k + 1);
+            return output_records;
+        }
+        
+        vector<record_type> column_records = catalog_columns();
+        vector<sort_column> columns;
+        string table_file_path, table_root_path;
+        if(!resolve_sort_columns(column_records, table_name, order_columns, columns) || !resolve_condition(column_records, table_name, cond)
+            || !table_files(table_name, table_file_path, table_root_path))
+            return vector<record_type>();
+        
+        bool all_columns = true;
+        vector<int> projection_ordinal_positions = projection_positions(column_records, table_name, projection_columns, all_columns);
+        vector<record_type> output_records;
+        record_type header = table_header(column_records, table_name);
+        output_records.push_back(all_columns ? header : project_record(header, projection_ordinal_positions));
+        function<record_type(const record_type&)> make_row = [&](const record_type &record){
+            return all_columns ? record : project_record(record, projection_ordinal_positions);
+        };
+        
+        // a transaction's own pages are not on disk yet, and a row_id range only needs some of the leaves: leave
+        // the reading to scan_table
+        file_utils::transaction_state &tx = file_utils::transaction();
+        uint32_t low_key = 0, high_key = 0;
+        bool whole_table = key_range(cond, low_key, high_key) && low_key <= 1 && high_key == 0xffffffff;
+        if(tx.dirty_pages.count(table_file_path) > 0 || tx.root_page_addrs.count(table_root_path) > 0 || !whole_table){
+            top_k_selector selector(k);
+            scan_table(table_name, cond, column_records, [&](size_t morsels){
+                selector.start(morsels);
+            }, [&](size_t m, record_type &record){
+                selector.add(m, columns, record, make_row);
+            });
+            vector<record_type> top_records = selector.finish();
+            output_records.insert(output_records.end(), top_records.begin(), top_records.end());
+            return output_records;
+        }
+        
+        table_lock lock(table_file_path);
+        work_stealing_pool &pool = work_stealing_pool::shared();
+        sort_column zone_column = columns[0];
+        zone_column.descending = false;
+        bool stable;
+        uint64_t version = file_utils::table_file_version(table_file_path, stable);
+        
+        shared_ptr<const vector<leaf_zone> > zones;
+        if(stable)
+            zones = zone_maps::find(table_file_path, zone_column.ordinal_position, version);
+        if(zones){
+            // leaves by the lowest key they can hold, dealt round robin so that every morsel starts with good ones
+            vector<pair<string, uint32_t> > leaves(zones->size());
+            for(size_t i = 0; i < zones->size(); i++){
+                leaves[i] = make_pair(zone_maps::lowest_key((*zones)[i], columns[0]), (*zones)[i].leaf_addr);
+            }
+            sort(leaves.begin(), leaves.end());
+            size_t morsels = (leaves.size() + SCAN_MORSEL_LEAVES - 1) / SCAN_MORSEL_LEAVES;
+            
+            top_k_selector selector(k);
+            selector.start(morsels);
+            pool.run(morsels, [&](size_t m){
+                page_reader reader(table_file_path);
+                uint8_t leaf_page[PAGE_SIZE];
+                vector<record_type> records;
+                for(size_t i = m; i < leaves.size(); i += morsels){
+                    // the leaves of a morsel only get worse
+                    if(selector.excludes(m, leaves[i].first))
+                        break;
+                    if(!reader.read(leaves[i].second, leaf_page) || leaf_page[0] != 0x0d)
+                        continue;
+                    records.clear();
+                    file_utils::read_records_from_page(leaf_page, records);
+                    for(size_t r = 0; r < records.size(); r++){
+                        if(record_selected(records[r], cond))
+                            selector.add(m, columns, records[r], make_row);
+                    }
+                }
+            });
+            
+            // rows may have moved between leaves if the table was written to meanwhile, then scan it again
+            if(file_utils::table_file_version(table_file_path, stable) == version){
+                vector<record_type> top_records = selector.finish();
+                output_records.insert(output_records.end(), top_records.begin(), top_records.end());
+                return output_records;
+            }
+            version = file_utils::table_file_version(table_file_path, stable);
+        }
+        
+        uint32_t root_page_addr;
+        {
+            shared_latch root_latch(table_file_path, ROOT_LATCH);
+            root_page_addr = file_utils::read_root_page_addr(table_root_path);
+        }
+        vector<leaf_morsel> morsels = parallel_scan::leaf_morsels(table_file_path, root_page_addr, SCAN_MORSEL_LEAVES, pool);
+        top_k_selector selector(k);
+        selector.start(morsels.size());
+        vector<vector<leaf_zone> > morsel_zones(morsels.size());
+        atomic<bool> zones_complete(true);
+        pool.run(morsels.size(), [&](size_t m){
+            string value;
+            parallel_scan::scan_morsel_leaves(table_file_path, morsels[m], [&](uint32_t leaf_addr, vector<record_type> &records, bool whole_leaf){
+                // a leaf split across morsels means writers moved rows meanwhile
+                if(!whole_leaf && records.size() > 0)
+                    zones_complete = false;
+                if(whole_leaf && records.size() > 0){
+                    leaf_zone zone;
+                    zone.leaf_addr = leaf_addr;
+                    for(size_t r = 0; r < records.size(); r++){
+                        value.clear();
+                        sort_key::append_column(value, zone_column, records[r]);
+                        if(r == 0 || value < zone.min_value)
+                            zone.min_value = value;
+                        if(r == 0 || value > zone.max_value)
+                            zone.max_value = value;
+                    }
+                    morsel_zones[m].push_back(zone);
+                }
+                for(size_t r = 0; r < records.size(); r++){
+                    if(record_selected(records[r], cond))
+                        selector.add(m, columns, records[r], make_row);
+                }
+            });
+        });
+        
+        bool still_stable;
+        if(stable && zones_complete && file_utils::table_file_version(table_file_path, still_stable) == version){
+            shared_ptr<vector<leaf_zone> > table_zones(new vector<leaf_zone>());
+            for(size_t m = 0; m < morsel_zones.size(); m++){
+                table_zones->insert(table_zones->end(), make_move_iterator(morsel_zones[m].begin()), make_move_iterator(morsel_zones[m].end()));
+            }
+            zone_maps::store(table_file_path, zone_column.ordinal_position, version, table_zones);
+        }
+        
+        vector<record_type> top_records = selector.finish();
+        output_records.insert(output_records.end(), top_records.begin(), top_records.end());
+        return output_records;
+    }
+    
+    
+    // Resolve aggregate items such as avg(marks) against the catalog, false once an error is printed
+    bool resolve_aggregates(const vector<record_type> &column_records, string table_name, vector<string> &aggregate_items, vector<aggregate_spec> &specs){
+        specs.resize(aggregate_items.size());
+        for(size_t j = 0; j < aggregate_items.size(); j++){
+            if(aggregate_items[j].find('(') == string::npos){
+                console::out() << "[Error] Column \'" << aggregate_items[j] << "\' must appear inside an aggregate function\n";
+                return false;
+            }
+            if(!aggregate_state::parse(aggregate_items[j], specs[j]))
+                return false;
+            if(specs[j].column_name != "*" && specs[j].column_name != "row_id"){
+                specs[j].ordinal_position = column_position(column_records, table_name, specs[j].column_name);
+                if(specs[j].ordinal_position == -1){
+                    console::out() << "[Error] Column does not exist with name " << specs[j].column_name << " in table " << table_name << "\n";
+                    return false;
+                }
+                specs[j].data_type = column_data_type(column_records, table_name, specs[j].column_name);
+            }
+            if(!aggregate_state::applies_to(specs[j]))
+                return false;
+        }
+        return true;
+    }
+    
+    
+    // Compute aggregate functions such as count(*) or avg(marks) over the records satisfying the condition.
+    // Each morsel is folded into its own partial states, the rows themselves are never collected.
+    vector<record_type> aggregate_records(string table_name, where_condition cond, vector<string> aggregate_items){
+        
+        vector<record_type> column_records = catalog_columns();
+        vector<aggregate_spec> specs;
+        if(!resolve_aggregates(column_records, table_name, aggregate_items, specs))
+                return vector<record_type>();
+        
+        vector<vector<aggregate_state> > partial_states;
+        vector<byte_arena> partial_arenas;
+        bool found = scan_table(table_name, cond, column_records, [&](size_t morsels){
+            partial_states.assign(morsels, vector<aggregate_state>(specs.size()));
+            partial_arenas = vector<byte_arena>(morsels);
+        }, [&](size_t m, record_type &record){
+            for(size_t j = 0; j < specs.size(); j++){
+                partial_states[m][j].add(specs[j], record, partial_arenas[m]);
+            }
+        });
+        if(!found)
+            return vector<record_type>();
+        
+        // merge the partial states
+        record_type header, result;
+        header.first = -1;
+        result.first = 1;
+        byte_arena arena;
+        for(size_t j = 0; j < specs.size(); j++){
+            aggregate_state state;
+            for(size_t m = 0; m < partial_states.size(); m++){
+                state.merge(specs[j], partial_states[m][j], arena);
+            }
+            header.second.push_back(make_pair(0x0c + specs[j].text.size(), specs[j].text));
+            result.second.push_back(state.result(specs[j]));
+        }
+        
+        vector<record_type> output_records;
+        output_records.push_back(header);
+        output_records.push_back(result);
+        return output_records;
+    }
+    
+    
+    // GROUP BY group_column: a record per distinct value of the column (NULLs forming one group), holding the
+    // selected items in order, each either the group column or an aggregate over the group's records
+    vector<record_type> group_records(string table_name, where_condition cond, vector<string> items, string group_column){
+        
+        vector<record_type> column_records = catalog_columns();
+        
+        // Obtain position info of the group column
+        int group_position = -1;
+        uint8_t group_type = 0x06;
+        if(group_column != "row_id"){
+            group_position = column_position(column_records, table_name, group_column);
+            if(group_position == -1){
+                console::out() << "[Error] Column does not exist with name " << group_column << " in table " << table_name << "\n";
+                return vector<record_type>();
+            }
+            group_type = column_data_type(column_records, table_name, group_column);
+        }
+        
+        // item i comes from value item_sources[i] of a group row, the group column being value 0
+        vector<string> aggregate_items;
+        vector<size_t> item_sources;
+        for(size_t i = 0; i < items.size(); i++){
+            if(items[i] == group_column){
+                item_sources.push_back(0);
+                continue;
+            }
+            if(items[i].find('(') == string::npos){
+                console::out() << "[Error] Column \'" << items[i] << "\' must appear in the GROUP BY clause or inside an aggregate function\n";
+                return vector<record_type>();
+            }
+            aggregate_items.push_back(items[i]);
+            item_sources.push_back(aggregate_items.size());
+        }
+        vector<aggregate_spec> specs;
+        if(!resolve_aggregates(column_records, table_name, aggregate_items, specs))
+            return vector<record_type>();
+        
+        work_stealing_pool &pool = work_stealing_pool::shared();
+        hash_aggregator aggregator(specs, group_position, group_type, GROUP_BY_MEMORY_BYTES / pool.size());
+        bool found = scan_table(table_name, cond, column_records, [&](size_t morsels){
+            aggregator.start(morsels);
+        }, [&](size_t m, record_type &record){
+            aggregator.add(m, record);
+        });
+        if(!found)
+            return vector<record_type>();
+        vector<record_type> groups = aggregator.finish(pool);
+        
+        vector<record_type> output_records(groups.size() + 1);
+        output_records[0].first = -1;
+        for(size_t i = 0; i < items.size(); i++){
+            output_records[0].second.push_back(make_pair(0x0c + items[i].size(), items[i]));
+        }
+        for(size_t g = 0; g < groups.size(); g++){
+            record_type &r = output_records[g + 1];
+            r.first = g + 1;
+            for(size_t i = 0; i < item_sources.size(); i++){
+                r.second.push_back(groups[g].second[item_sources[i]]);
+            }
+        }
+        return output_records;
+    }
+    
+    
+    // Split a join's condition into its AND-ed parts. A part on the columns of one table is checked as that table
+    // is read, a bare row_id comparison as both are; parts on both tables are checked on the joined rows. False
+    // once an error is printed.
+    bool split_join_condition(const vector<record_type> &column_records, const string tables[2], const where_condition &cond, where_condition conds[2], vector<where_condition> &joined_parts){
+        vector<where_condition> parts = (cond.logic_code == WHERE_AND) ? cond.operands : vector<where_condition>(1, cond);
+        vector<where_condition> side_parts[2];
+        for(size_t i = 0; i < parts.size(); i++){
+            if(parts[i].logic_code == 0 && parts[i].column_name == "row_id"){
+                side_parts[0].push_back(parts[i]);
+                side_parts[1].push_back(parts[i]);
+                continue;
+            }
+            bool part_sides[2] = {false, false};
+            if(!parts[i].each_comparison([&](where_condition &c){
+                int s;
+                string column_name;
+                if(!join_column(column_records, tables, c.column_name, s, column_name))
+                    return false;
+                part_sides[s] = true;
+                return true;
+            }))
                 return false;
+            if(part_sides[0] && part_sides[1]){
+                joined_parts.push_back(parts[i]);
+                continue;
             }
-            record.clear();
-            record.push_back(make_pair(0x0c + table_name.size(), table_name));
-            record.push_back(make_pair(0x0c + columns[i].column_name.size(), columns[i].column_name));
-            record.push_back(make_pair(0x04, to_string((int) data_type_map[columns[i].data_type])));
-            record.push_back(make_pair(0x04, to_string(i + 1)));
-            record.push_back(make_pair(0x04, to_string((int) !columns[i].not_null)));
-            insert("database_columns", make_pair(columns_max_row_id + 1 + i, record), true);
+            parts[i].each_comparison([&](where_condition &c){
+                int s;
+                return join_column(column_records, tables, c.column_name, s, c.column_name);
+            });
+            side_parts[part_sides[0] ? 0 : 1].push_back(parts[i]);
+        }
+        for(int s = 0; s < 2; s++){
+            if(side_parts[s].size() == 1)
+                conds[s] = side_parts[s][0];
+            else if(side_parts[s].size() > 1)
+                conds[s] = where_condition(WHERE_AND, side_parts[s]);
+        }
+        return true;
+    }
+    
+    
+    // Resolve a column of a join, written as table.column or as column alone, to the side (0 left, 1 right) of
+    // the table it belongs to; false once an error is printed
+    bool join_column(const vector<record_type> &column_records, const string tables[2], string item, int &side, string &column_name){
+        size_t dot = item.find('.');
+        if(dot != string::npos){
+            string table_name = item.substr(0, dot);
+            column_name = item.substr(dot + 1);
+            side = (table_name == tables[0]) ? 0 : (table_name == tables[1]) ? 1 : -1;
+            if(side == -1){
+                console::out() << "[Error] Table \'" << table_name << "\' is not part of the join\n";
+                return false;
+            }
+            if(column_name != "row_id" && column_position(column_records, tables[side], column_name) == -1){
+                console::out() << "[Error] Column does not exist with name " << column_name << " in table " << tables[side] << "\n";
+                return false;
+            }
+            return true;
         }
-        // update max row id
-        ftmp.open("catalog/database_columns_max_rowid.txt", ios::out);
-        ftmp << columns_max_row_id + columns.size();
-        ftmp.close();
         
+        column_name = item;
+        bool in_left = (column_name == "row_id" || column_position(column_records, tables[0], column_name) != -1);
+        bool in_right = (column_name == "row_id" || column_position(column_records, tables[1], column_name) != -1);
+        if(in_left && in_right){
+            console::out() << "[Error] Column \'" << item << "\' is in both tables, write it as table.column\n";
+            return false;
+        }
+        if(!in_left && !in_right){
+            console::out() << "[Error] Column \'" << item << "\' is in neither table of the join\n";
+            return false;
+        }
+        side = in_left ? 0 : 1;
         return true;
     }
     
     
-    vector<record_type> select_records(const vector<record_type> &all_records, string table_name, where_condition cond, vector<string> projection_columns = vector<string>()){
+    // Key bytes of the join column of a record, false for NULL which matches nothing
+    static bool join_key(const sort_column &column, const record_type &record, string &key){
+        if(column.ordinal_position != -1 && record.second[column.ordinal_position].first <= 0x03)
+            return false;
+        key.clear();
+        sort_key::append_column(key, column, record);
+        return true;
+    }
+    
+    
+    // SELECT ... FROM left_table JOIN right_table ON left_column = right_column: a record for every pair of rows
+    // with equal values in the join columns, holding the projection items. The condition filters the rows of the
+    // table its column belongs to, a bare row_id those of both. The smaller table is put into a hash join and
+    // the other one streams past it; records go to emit as they are found, after a header, in no set order.
+    bool join_records(string left_table, string right_table, string left_column, string right_column, where_condition cond, vector<string> projection_columns, const function<void(record_type&)> &emit){
         
-        // Obtain position info of condition column
-        int ordinal_position = -1;
-        int data_type = -1;
-        vector<record_type> column_records = get_all_records("database_columns");
+        vector<record_type> column_records = catalog_columns();
+        string tables[2] = {left_table, right_table};
+        string table_file_paths[2], table_root_paths[2];
+        for(int s = 0; s < 2; s++){
+            if(!table_files(tables[s], table_file_paths[s], table_root_paths[s]))
+                return false;
+        }
+        if(left_table == right_table){
+            console::out() << "[Error] Cannot join a table with itself\n";
+            return false;
+        }
         
-        if(cond.column_name != "row_id"){
-            for(int i = 0; i < column_records.size(); i++){
-                // check first and second column
-                if(column_records[i].second[0].second == table_name && column_records[i].second[1].second == cond.column_name){
-                    stringstream(column_records[i].second[2].second) >> data_type;
-                    stringstream(column_records[i].second[3].second) >> ordinal_position;
-                    break;
-                }
-            }
-            if(ordinal_position == - 1){
-                cout << "Column does not exist with name " << cond.column_name << " in table " << table_name << "\n";
-                return vector<record_type>();
+        // Obtain the join column of each side
+        string join_items[2] = {left_column, right_column};
+        sort_column keys[2];
+        bool sides_seen[2] = {false, false};
+        for(int i = 0; i < 2; i++){
+            int s;
+            string column_name;
+            if(!join_column(column_records, tables, join_items[i], s, column_name))
+                return false;
+            if(sides_seen[s]){
+                console::out() << "[Error] The ON condition must compare a column of each table\n";
+                return false;
             }
-            ordinal_position -= 1;      // Convert to 0 base
+            sides_seen[s] = true;
+            keys[s].descending = false;
+            keys[s].ordinal_position = (column_name == "row_id") ? -1 : column_position(column_records, tables[s], column_name);
+            keys[s].data_type = (column_name == "row_id") ? 0x06 : column_data_type(column_records, tables[s], column_name);
         }
         
+        // equal values have equal keys whatever the column types: integers next to reals compare as reals,
+        // anything else next to a different kind as text
+        bool integers = true, numbers = true;
+        for(int s = 0; s < 2; s++){
+            integers = integers && (keys[s].data_type >= 0x04 && keys[s].data_type <= 0x07);
+            numbers = numbers && (keys[s].data_type >= 0x04 && keys[s].data_type <= 0x09);
+        }
+        uint8_t key_type = integers ? 0x07 : (numbers ? 0x09 : 0x0c);
+        keys[0].data_type = keys[1].data_type = key_type;
         
-        // Choose records with record at ordinal position satisfying the condition
-        vector<record_type> selected_records;
-        for(int i = 0; i < all_records.size(); i++){
-            
-            // add header unconditionally
-            if(all_records[i].first == -1){
-                selected_records.push_back(all_records[i]);
-                continue;
-            }
-            
-            if(cond.column_name == "row_id"){
-                uint32_t rid;
-                stringstream(cond.value) >> rid;
-                bool select;
-                switch(cond.comp_code){
-                    case 0:
-                        select = (all_records[i].first == rid);
-                        break;
-                    case 1:
-                        select = (all_records[i].first != rid);
-                        break;
-                    case 2:
-                        select = (all_records[i].first < rid);
-                        break;
-                    case 3:
-                        select = (all_records[i].first > rid);
-                        break;
-                    case 4:
-                        select = (all_records[i].first <= rid);
-                        break;
-                    case 5:
-                        select = (all_records[i].first >= rid);
-                        break;
-                    default:
-                        select = false;
-                        break;
-                }
-                
-                if(select){
-                    selected_records.push_back(all_records[i]);
+        // conditions for either side, and parts on both tables to check on the joined rows
+        where_condition conds[2];
+        vector<where_condition> joined_parts;
+        if(!split_join_condition(column_records, tables, cond, conds, joined_parts))
+            return false;
+        for(int s = 0; s < 2; s++){
+            if(!resolve_condition(column_records, tables[s], conds[s]))
+                return false;
+        }
+        
+        // Obtain (side, index in the rows kept of the side) of every projection item, -1 for row_id. The rows of
+        // each side keep only the columns some item needs.
+        vector<pair<int, int> > items;
+        vector<int> side_positions[2];
+        record_type header;
+        header.first = -1;
+        for(size_t i = 0; i < projection_columns.size(); i++){
+            vector<pair<int, int> > item_columns;
+            if(projection_columns[i] == "*"){
+                for(int s = 0; s < 2; s++){
+                    record_type side_header = table_header(column_records, tables[s]);
+                    for(size_t j = 0; j < side_header.second.size(); j++){
+                        item_columns.push_back(make_pair(s, (int) j));
+                        header.second.push_back(side_header.second[j]);
+                    }
                 }
             }
             else{
-                if(check_cond(all_records[i].second[ordinal_position], cond)){
-                    selected_records.push_back(all_records[i]);
+                int s;
+                string column_name;
+                if(!join_column(column_records, tables, projection_columns[i], s, column_name))
+                    return false;
+                item_columns.push_back(make_pair(s, (column_name == "row_id") ? -1 : column_position(column_records, tables[s], column_name)));
+                header.second.push_back(make_pair(0x0c + projection_columns[i].size(), projection_columns[i]));
+            }
+            for(size_t j = 0; j < item_columns.size(); j++){
+                int s = item_columns[j].first, position = item_columns[j].second;
+                int index = -1;
+                if(position != -1){
+                    index = find(side_positions[s].begin(), side_positions[s].end(), position) - side_positions[s].begin();
+                    if(index == (int) side_positions[s].size())
+                        side_positions[s].push_back(position);
                 }
+                items.push_back(make_pair(s, index));
             }
         }
         
+        // Point the comparisons of the parts on both tables at the joined rows: the kept columns of the left
+        // table, then those of the right one, then the right row_id
+        where_condition joined_cond(WHERE_AND, joined_parts);
+        vector<pair<int, int> > joined_columns;
+        if(!joined_cond.each_comparison([&](where_condition &c){
+            int s;
+            string column_name;
+            join_column(column_records, tables, c.column_name, s, column_name);
+            int position = (column_name == "row_id") ? -1 : column_position(column_records, tables[s], column_name);
+            if(position != -1 && find(side_positions[s].begin(), side_positions[s].end(), position) == side_positions[s].end())
+                side_positions[s].push_back(position);
+            if(column_name == "row_id" && !(stringstream(c.value) >> c.row_id_value)){
+                console::out() << "[Error] row_id can only be compared with a whole number\n";
+                return false;
+            }
+            joined_columns.push_back(make_pair(s, position));
+            return true;
+        }))
+            return false;
+        size_t next_comparison = 0;
+        joined_cond.each_comparison([&](where_condition &c){
+            int s = joined_columns[next_comparison].first, position = joined_columns[next_comparison].second;
+            next_comparison++;
+            if(position != -1)
+                c.ordinal_position = (s == 0 ? 0 : side_positions[0].size()) + (find(side_positions[s].begin(), side_positions[s].end(), position) - side_positions[s].begin());
+            else
+                c.ordinal_position = (s == 0) ? -1 : side_positions[0].size() + side_positions[1].size();
+            return true;
+        });
         
+        // the side expected to keep fewer bytes builds the hash table, or leads the merge join
+        plan_node side_plans[2];
+        table_statistics side_stats[2];
+        int build = join_build_side(column_records, tables, table_file_paths, conds, side_plans, side_stats);
+        int probe = 1 - build;
+        work_stealing_pool &pool = work_stealing_pool::shared();
+        hash_joiner::match_function match = [&](const record_type &build_row, const record_type &probe_row){
+            const record_type *side_rows[2];
+            side_rows[build] = &build_row;
+            side_rows[probe] = &probe_row;
+            if(joined_parts.size() > 0){
+                record_type joined = *side_rows[0];
+                joined.second.insert(joined.second.end(), side_rows[1]->second.begin(), side_rows[1]->second.end());
+                joined.second.push_back(make_pair(0x06, to_string(side_rows[1]->first)));
+                if(!record_selected(joined, joined_cond))
+                    return;
+            }
+            record_type r;
+            r.first = side_rows[0]->first;
+            for(size_t i = 0; i < items.size(); i++){
+                const record_type &side_row = *side_rows[items[i].first];
+                if(items[i].second == -1)
+                    r.second.push_back(make_pair(0x06, to_string(side_row.first)));
+                else
+                    r.second.push_back(side_row.second[items[i].second]);
+            }
+            emit(r);
+        };
         
-        // if no specific projection columns were asked
-        if(projection_columns.size() == 0)
-            return selected_records;
-
-        
-        // Obtain ordinal positions for the projection columns
-        vector<int> projection_ordinal_positions;
-        for(int j = 0; j < projection_columns.size(); j++){
-            if(projection_columns[j] == "*"){
-                return selected_records;
+        // Rows of both trees are in row_id order already: a join on row_id walks them side by side, the smaller
+        // table as the outer one. A transaction's own pages are not on disk yet, those joins hash instead.
+        file_utils::transaction_state &tx = file_utils::transaction();
+        bool merge = (keys[0].ordinal_position == -1 && keys[1].ordinal_position == -1);
+        for(int s = 0; s < 2; s++){
+            if(tx.dirty_pages.count(table_file_paths[s]) > 0 || tx.root_page_addrs.count(table_root_paths[s]) > 0)
+                merge = false;
+        }
+        if(merge){
+            uint32_t low_key, high_key;
+            if(!key_range(conds[build], low_key, high_key)){
+                emit(header);
+                return true;
             }
-            ordinal_position = -1;
-            data_type = -1;
-            for(int i = 0; i < column_records.size(); i++){
-                if(column_records[i].second[0].second == table_name && column_records[i].second[1].second == projection_columns[j]){
-                    stringstream(column_records[i].second[3].second) >> ordinal_position;
-                    break;
-                }
+            
+            // DDL cannot swap either tree out while the table locks are held
+            table_lock build_lock(table_file_paths[build]), probe_lock(table_file_paths[probe]);
+            uint32_t root_page_addrs[2];
+            for(int s = 0; s < 2; s++){
+                shared_latch root_latch(table_file_paths[s], ROOT_LATCH);
+                root_page_addrs[s] = file_utils::read_root_page_addr(table_root_paths[s]);
             }
-            if(ordinal_position == - 1){
-                cout << "[Warning] Cannot find projection column \'" << projection_columns[j] << "\'\n";
-                continue;
+            
+            emit(header);
+            merge_join::join(table_file_paths[build], root_page_addrs[build], table_file_paths[probe], root_page_addrs[probe], pool, low_key, high_key, [&](record_type &build_record, record_type &probe_record){
+                if(record_selected(build_record, conds[build]) && record_selected(probe_record, conds[probe]))
+                    match(project_record(build_record, side_positions[build]), project_record(probe_record, side_positions[probe]));
+            });
+            return true;
+        }
+        
+        hash_joiner joiner(JOIN_MEMORY_BYTES, pool.size());
+        
+        bool found = scan_table(tables[build], conds[build], column_records, [&](size_t morsels){
+            joiner.start_build(morsels);
+        }, [&](size_t m, record_type &record){
+            string key;
+            if(join_key(keys[build], record, key))
+                joiner.add_build(m, key, project_record(record, side_positions[build]));
+        });
+        if(!found)
+            return false;
+        joiner.finish_build(pool);
+        
+        emit(header);
+        found = scan_table(tables[probe], conds[probe], column_records, [&](size_t morsels){
+            joiner.start_probe(morsels);
+        }, [&](size_t m, record_type &record){
+            string key;
+            if(!join_key(keys[probe], record, key))
+                return;
+            record_type row = project_record(record, side_positions[probe]);
+            joiner.add_probe(m, key, row, match);
+        });
+        if(!found)
+            return false;
+        joiner.finish_probe(pool, match);
+        return true;
+    }
+    
+    
+    
+    // true if a resolved condition only compares row_id, which the range a scan reads settles
+    bool row_id_only(const where_condition &cond){
+        if(cond.logic_code == WHERE_AND){
+            for(size_t i = 0; i < cond.operands.size(); i++){
+                if(!row_id_only(cond.operands[i]))
+                    return false;
             }
-            projection_ordinal_positions.push_back(ordinal_position - 1);
+            return true;
+        }
+        return cond.logic_code == 0 && cond.ordinal_position == -1 && !cond.value_is_null && cond.comp_code != 1;
+    }
+    
+    
+    // Plan the reading of a table for a resolved condition: the cheaper access path for its row_id range, and a
+    // filter over it unless the range settles the condition
+    plan_node plan_scan(const vector<record_type> &column_records, string table_name, const where_condition &cond, const table_statistics &stats, bool analyzed){
+        uint32_t low_key, high_key;
+        if(!key_range(cond, low_key, high_key))
+            return plan_node("No scan", table_name + ", no row_id satisfies the condition", 0, 0, 0);
+        plan_node scan = query_planner::access_path(table_name, stats, low_key, high_key);
+        if(!analyzed)
+            scan.detail += " (not analyzed)";
+        if(row_id_only(cond))
+            return scan;
+        double cost, selectivity;
+        estimate_condition(column_records, table_name, cond, cost, selectivity, &stats);
+        return plan_node::over(scan, "Filter", cond.text(), min(scan.rows, selectivity * stats.row_count), scan.rows * cost * PLAN_ROW_COST);
+    }
+    
+    
+    // Plan the reading of both sides of a join for their resolved conditions, and pick the side expected to keep
+    // fewer bytes to build the hash table, or lead the merge join
+    int join_build_side(const vector<record_type> &column_records, const string tables[2], const string table_file_paths[2], const where_condition conds[2], plan_node side_plans[2], table_statistics side_stats[2]){
+        double side_bytes[2];
+        for(int s = 0; s < 2; s++){
+            bool analyzed;
+            side_stats[s] = planner_statistics(tables[s], table_file_paths[s], analyzed);
+            side_plans[s] = plan_scan(column_records, tables[s], conds[s], side_stats[s], analyzed);
+            side_bytes[s] = side_plans[s].rows * file_utils::table_file_size(table_file_paths[s]) / max((double) side_stats[s].row_count, 1.0);
+        }
+        return (side_bytes[0] <= side_bytes[1]) ? 0 : 1;
+    }
+    
+    
+    // Plan a join the way join_records runs it: on row_id the two leaf chains are merged, otherwise the smaller
+    // side builds a hash table the other one probes
+    bool plan_join(const vector<record_type> &column_records, const select_statement &statement, plan_node &plan){
+        string tables[2] = {statement.table_name, statement.join_table};
+        string table_file_paths[2], table_root_paths[2];
+        for(int s = 0; s < 2; s++){
+            if(!table_files(tables[s], table_file_paths[s], table_root_paths[s]))
+                return false;
+        }
+        if(tables[0] == tables[1]){
+            console::out() << "[Error] Cannot join a table with itself\n";
+            return false;
         }
         
-        // project the columns and output
-        vector<record_type> output_records;
-        for(int i = 0; i < selected_records.size(); i++){
-            record_type r;
-            r.first = selected_records[i].first;
-            for(int j = 0; j < projection_ordinal_positions.size(); j++){
-                r.second.push_back(selected_records[i].second[projection_ordinal_positions[j]]);
+        string join_items[2] = {statement.join_left_column, statement.join_right_column};
+        string key_columns[2];
+        for(int i = 0; i < 2; i++){
+            int s;
+            string column_name;
+            if(!join_column(column_records, tables, join_items[i], s, column_name))
+                return false;
+            key_columns[s] = column_name;
+        }
+        where_condition conds[2];
+        vector<where_condition> joined_parts;
+        if(!split_join_condition(column_records, tables, statement.cond, conds, joined_parts))
+            return false;
+        for(int s = 0; s < 2; s++){
+            if(!resolve_condition(column_records, tables[s], conds[s]))
+                return false;
+        }
+        plan_node side_plans[2];
+        table_statistics side_stats[2];
+        int build = join_build_side(column_records, tables, table_file_paths, conds, side_plans, side_stats);
+        int probe = 1 - build;
+        
+        // a row matches as many rows of the other side as the other side has per distinct key value
+        double distinct = 1;
+        for(int s = 0; s < 2; s++){
+            const column_statistics *column = query_planner::column(side_stats[s], key_columns[s]);
+            if(key_columns[s] == "row_id")
+                distinct = max(distinct, (double) side_stats[s].row_count);
+            else
+                distinct = max(distinct, column ? (double) column->distinct_count : side_plans[s].rows);
+        }
+        double rows = side_plans[0].rows * side_plans[1].rows / distinct;
+        bool on_row_id = (key_columns[0] == "row_id" && key_columns[1] == "row_id");
+        
+        file_utils::transaction_state &tx = file_utils::transaction();
+        bool merge = on_row_id;
+        for(int s = 0; s < 2; s++){
+            if(tx.dirty_pages.count(table_file_paths[s]) > 0 || tx.root_page_addrs.count(table_root_paths[s]) > 0)
+                merge = false;
+        }
+        double pages = side_plans[0].pages + side_plans[1].pages;
+        double cost = side_plans[0].cost + side_plans[1].cost;
+        string on = statement.join_left_column + " = " + statement.join_right_column;
+        if(merge)
+            plan = plan_node("Merge join", "on " + on + ", " + tables[build] + " leads", rows, pages, cost + (side_plans[0].rows + side_plans[1].rows) * PLAN_ROW_COST);
+        else
+            plan = plan_node("Hash join", "on " + on + ", " + tables[build] + " builds", rows, pages, cost + (side_plans[0].rows + side_plans[1].rows) * PLAN_HASH_ROW_COST);
+        plan.children.push_back(side_plans[build]);
+        plan.children.push_back(side_plans[probe]);
+        
+        if(joined_parts.size() > 0){
+            where_condition joined_cond = (joined_parts.size() == 1) ? joined_parts[0] : where_condition(WHERE_AND, joined_parts);
+            plan = plan_node::over(plan, "Filter", joined_cond.text(), rows * pow(0.33, joined_parts.size()), rows * PLAN_ROW_COST);
+        }
+        return true;
+    }
+    
+    
+    // Plan a SELECT as the operators that run it, each with its estimated rows and pages; false once an error
+    // is printed
+    bool plan_select(const select_statement &statement, plan_node &plan){
+        vector<record_type> column_records = catalog_columns();
+        table_statistics stats;
+        if(statement.join_table != ""){
+            if(!plan_join(column_records, statement, plan))
+                return false;
+        }
+        else{
+            string table_file_path, table_root_path;
+            if(!table_files(statement.table_name, table_file_path, table_root_path))
+                return false;
+            where_condition cond = statement.cond;
+            if(!resolve_condition(column_records, statement.table_name, cond))
+                return false;
+            bool analyzed;
+            stats = planner_statistics(statement.table_name, table_file_path, analyzed);
+            plan = plan_scan(column_records, statement.table_name, cond, stats, analyzed);
+        }
+        
+        string columns;
+        for(size_t i = 0; i < statement.projection_columns.size(); i++){
+            columns += (i > 0 ? ", " : "") + statement.projection_columns[i];
+        }
+        bool top_k = false;
+        double rows = plan.rows;
+        if(statement.order_columns.size() > 0){
+            string keys;
+            for(size_t i = 0; i < statement.order_columns.size(); i++){
+                keys += (i > 0 ? ", " : "") + statement.order_columns[i].first + (statement.order_columns[i].second ? " desc" : "");
             }
-            output_records.push_back(r);
+            top_k = (statement.limit != -1 && statement.limit <= TOP_K_MAX_ROWS);
+            if(top_k)
+                plan = plan_node::over(plan, "Top-K sort", "on " + keys + ", keeping " + to_string(statement.limit), min(rows, (double) statement.limit),
+                                       rows * log2(max(2.0, (double) statement.limit)) * PLAN_ROW_COST);
+            else
+                plan = plan_node::over(plan, "Sort", "on " + keys, rows, rows * log2(max(2.0, rows)) * PLAN_ROW_COST);
         }
-        return output_records;
+        if(statement.group_column != ""){
+            const column_statistics *column = query_planner::column(stats, statement.group_column);
+            double groups = column ? min(rows, column->distinct_count + (column->null_fraction > 0 ? 1.0 : 0.0)) : max(1.0, 0.1 * rows);
+            plan = plan_node::over(plan, "Hash group by", statement.group_column + " into " + columns, groups, rows * PLAN_HASH_ROW_COST);
+        }
+        else if(statement.has_aggregates){
+            plan = plan_node::over(plan, "Aggregate", columns, 1, rows * PLAN_ROW_COST);
+        }
+        else if(columns != "*"){
+            plan = plan_node::over(plan, "Project", columns, plan.rows, plan.rows * PLAN_ROW_COST);
+        }
+        if(statement.limit != -1 && !top_k)
+            plan = plan_node::over(plan, "Limit", to_string(statement.limit), min(plan.rows, (double) statement.limit), 0);
+        return true;
+    }
+    
+    
+    // EXPLAIN: print the plan of a SELECT without running it. False if it has none.
+    bool explain_select(const select_statement &statement){
+        plan_node plan;
+        if(!plan_select(statement, plan))
+            return false;
+        console::out() << "\n";
+        query_planner::print(plan);
+        return true;
+    }
+    
+    
+    // The records of a SELECT without a JOIN, the header record first and the rest cut to its LIMIT. Empty
+    // once an error is printed.
+    vector<record_type> query_records(const select_statement &select){
+        vector<record_type> output_records;
+        if(select.order_columns.size() > 0 && select.limit != -1)
+            output_records = top_k_records(select.table_name, select.cond, select.projection_columns, select.order_columns, select.limit);
+        else if(select.order_columns.size() > 0)
+            output_records = sort_records(select.table_name, select.cond, select.projection_columns, select.order_columns);
+        else if(select.group_column != "")
+            output_records = group_records(select.table_name, select.cond, select.projection_columns, select.group_column);
+        else if(select.has_aggregates)
+            output_records = aggregate_records(select.table_name, select.cond, select.projection_columns);
+        else
+            output_records = scan_records(select.table_name, select.cond, select.projection_columns, true);
         
+        // the header record comes first
+        if(select.limit >= 0 && output_records.size() > (size_t) select.limit + 1)
+            output_records.resize((size_t) select.limit + 1);
+        return output_records;
     }
     
+    // The records of a SELECT with a JOIN, passed to emit as they are found, the header record first and the
+    // others from any number of threads at once. False once an error is printed.
+    bool query_join(const select_statement &select, const function<void(record_type&)> &emit){
+        if(select.order_columns.size() > 0 || select.group_column != "" || select.has_aggregates){
+            console::out() << "[Error] JOIN cannot be combined with ORDER BY, GROUP BY or aggregate functions\n";
+            return false;
+        }
+        return join_records(select.table_name, select.join_table, select.join_left_column, select.join_right_column, select.cond, select.projection_columns, emit);
+    }
     
     
-    bool check_cond(pair<uint8_t, string> type_value_pair, where_condition cond){
+    bool check_cond(const pair<uint8_t, string> &type_value_pair, const where_condition &cond){
         
         switch(type_value_pair.first){
             // null values
@@ -486,7 +2189,7 @@ public:
                     case 7:
                         return (col_value != comp_value);
                     default:{
-                        cout << "[Warning] Unknown comparison code\n";
+                        console::out() << "[Warning] Unknown comparison code\n";
                         return false;
                     }
                 }
@@ -516,7 +2219,7 @@ public:
                     case 7:
                         return (col_value != comp_value);
                     default:{
-                        cout << "[Warning] Unknown comparison code\n";
+                        console::out() << "[Warning] Unknown comparison code\n";
                         return false;
                     }
                 }
@@ -546,7 +2249,7 @@ public:
                     case 7:
                         return (col_value != comp_value);
                     default:{
-                        cout << "[Warning] Unknown comparison code\n";
+                        console::out() << "[Warning] Unknown comparison code\n";
                         return false;
                     }
                 }
@@ -622,7 +2325,7 @@ public:
                     case 7:
                         return difftime(col_value, comp_value) != 0;
                     default:{
-                        cout << "[Warning] Unknown comparison code\n";
+                        console::out() << "[Warning] Unknown comparison code\n";
                         return false;
                     }
                 }
@@ -676,7 +2379,7 @@ public:
                     case 7:
                         return difftime(col_value, comp_value) != 0;
                     default:{
-                        cout << "[Warning] Unknown comparison code\n";
+                        console::out() << "[Warning] Unknown comparison code\n";
                         return false;
                     }
                 }
@@ -734,7 +2437,7 @@ public:
                     case 7:
                         return difftime(col_value, comp_value) != 0;
                     default:{
-                        cout << "[Warning] Unknown comparison code\n";
+                        console::out() << "[Warning] Unknown comparison code\n";
                         return false;
                     }
                 }
@@ -765,6 +2468,34 @@ public:
     }
     
     
+    // The rows of database_columns, which every statement resolves its column names against. They are read
+    // again only once the catalog file has changed; statements in a transaction read them afresh, as they may
+    // see catalog pages of their own.
+    vector<record_type> catalog_columns(){
+        string catalog_file_path("catalog/database_columns.tbl");
+        catalog_snapshot &cache = catalog_cache();
+        bool stable;
+        uint64_t version = file_utils::table_file_version(catalog_file_path, stable);
+        if(!stable || file_utils::transaction().active)
+            return get_all_records("database_columns");
+        {
+            lock_guard<mutex> guard(cache.snapshot_mutex);
+            if(cache.valid && cache.version == version)
+                return cache.column_records;
+        }
+        
+        vector<record_type> column_records = get_all_records("database_columns");
+        bool still_stable;
+        if(column_records.size() > 0 && file_utils::table_file_version(catalog_file_path, still_stable) == version && still_stable){
+            lock_guard<mutex> guard(cache.snapshot_mutex);
+            cache.valid = true;
+            cache.version = version;
+            cache.column_records = column_records;
+        }
+        return column_records;
+    }
+    
+    
     // Obtain all the fully qualified records from a table
     vector<record_type> get_all_records(string table_name, bool add_header_at_top = false){
         
@@ -781,7 +2512,7 @@ public:
             cond.column_name = "table_name";
             cond.comp_code = 0;
             cond.value = table_name;
-            vector<record_type> column_info = select_records(get_all_records("database_columns"), "database_columns", cond);
+            vector<record_type> column_info = select_records(catalog_columns(), "database_columns", cond);
             for(int i = 0; i < column_info.size(); i++){
                 string col_name = column_info[i].second[1].second;
                 header.second.push_back(make_pair(0x0c + col_name.size(), col_name));
@@ -801,86 +2532,53 @@ public:
             table_file.open(table_file_path, ios::in);
         }
         if(!table_file.is_open()){
-            cout << "[Error] No such table exists\n";
+            console::out() << "[Error] No such table exists\n";
             return all_records;
         }
+        bool catalog_table = (table_file_path.compare(0, 8, "catalog/") == 0);
+        profile_scope reading(catalog_table ? STAGE_CATALOG : STAGE_LEAF_SCAN);
+        size_t header_records = all_records.size();
         
+        // each page is copied under a shared latch, splits only ever move rows to the right of it
+        table_lock lock(table_file_path);
         uint32_t root_page_addr;
-        fstream f;
-        f.open(table_root_path, ios::in);
-        f >> root_page_addr;
-        f.close();
+        {
+            shared_latch root_latch(table_file_path, ROOT_LATCH);
+            root_page_addr = file_utils::read_root_page_addr(table_root_path);
+        }
         
         
         // Obtain first page from the table
         uint8_t leaf_page[PAGE_SIZE];
-        file_utils::read_page_from_table_file(table_file_path, root_page_addr / PAGE_SIZE, leaf_page);
+        btree_utils::read_page_shared(table_file_path, root_page_addr, leaf_page);
         while(leaf_page[0] != 0x0d){
             string value_string;
             file_utils::read_value_within_page(leaf_page, PAGE_SIZE - 8, value_string, 0x06);
             uint32_t left_most_child_addr = (uint32_t) stol(value_string);
-            file_utils::read_page_from_table_file(table_file_path, left_most_child_addr / PAGE_SIZE, leaf_page);
+            btree_utils::read_page_shared(table_file_path, left_most_child_addr, leaf_page);
         }
         
         
         // traverse to a leaf page, if root is not leaf
         if(leaf_page[0] != 0x0d){
-            cout << "Root page is not a leaf page\n";
+            console::out() << "Root page is not a leaf page\n";
             return all_records;
         }
 
         
         // Scan through all the pages in the table
         while(leaf_page[0] == 0x0d){
-            
-            // total records in current page
-            uint8_t records_in_page;
-            file_utils::page_read(leaf_page, 1, records_in_page);
-            
-            // for each record
-            for(int i = 0; i < records_in_page; i++){
-                // obtain offset within the page of that record
-                uint16_t addr;
-                file_utils::page_read(leaf_page, 8 + 2 * i, addr);
-                
-                // obtain 4 byte row_id
-                uint32_t row_id;
-                file_utils::page_read(leaf_page, addr + 2, row_id);
-                
-                // obtain number of columns in the record
-                uint8_t tot_columns;
-                file_utils::page_read(leaf_page, addr + 6, tot_columns);
-
-                // obtain type_codes of all the columns
-                vector<uint8_t> type_codes;
-                for(int j = 0; j < tot_columns; j++){
-                    uint8_t type_code;
-                    file_utils::page_read(leaf_page, addr + 7 + j, type_code);
-                    type_codes.push_back(type_code);
-                }
-                
-                // Read values for all the columns
-                vector<pair<uint8_t, string> > record_columns;
-                size_t offset = addr + 7 + tot_columns;
-                for(int j = 0; j < tot_columns; j++){
-                    string data_string;
-                    offset = file_utils::read_value_within_page(leaf_page, offset, data_string, type_codes[j]);
-                    record_columns.push_back(make_pair(type_codes[j], data_string));
-                }
-                
-                // add the read record to the list of records
-                all_records.push_back(make_pair(row_id, record_columns));
-            }
-
+            file_utils::read_records_from_page(leaf_page, all_records);
             
             string value_string;
             file_utils::read_value_within_page(leaf_page, 4, value_string, 0x06);
             uint32_t right_page_addr = (uint32_t) stol(value_string);
             if(right_page_addr == 0xffffffff)
                 break;
-            file_utils::read_page_from_table_file(table_file_path, right_page_addr / PAGE_SIZE, leaf_page);
+            btree_utils::read_page_shared(table_file_path, right_page_addr, leaf_page);
         }
         
+        query_profile::count_rows(catalog_table ? STAGE_CATALOG : STAGE_LEAF_SCAN, 0, all_records.size() - header_records);
         return all_records;
     }
     
@@ -892,59 +2590,11 @@ public:
     
     // Display records to the console
     void display_records(const vector<record_type> &records){
-        if(records.size() == 0){
-            cout << "0 records to display\n\n";
-            return;
-        }
-        if(records.size() == 1 && records[0].first == -1){
-            cout << "0 records to display\n\n";
-            return;
-        }
-        cout << '\n';
-        vector<size_t> col_widths(records[0].second.size(), 0);
-        size_t width = 5;
-        for(int j = 0; j < col_widths.size(); j++){
-            for(int i = 0; i < records.size(); i++){
-                if(records[i].second[j].second.size() > col_widths[j]){
-                    col_widths[j] = records[i].second[j].second.size();
-                }
-            }
-            width += (col_widths[j] + 3);
-        }
-
-        cout << ' ';
-        cout << string(width, '-');
-        cout << '\n';
-        for(int i = 0; i < records.size(); i++){
-            cout << '|';
-            if(records[i].first == -1)
-                cout << tabulate_entry("id", 5) << '|';
-            else
-                cout << tabulate_entry(to_string(records[i].first), 5) << '|';
-            vector<pair<uint8_t, string> > rc = records[i].second;
-            for(int j = 0; j < rc.size(); j++){
-                cout << tabulate_entry(rc[j].second, col_widths[j] + 2) << '|';
-            }
-            cout << '\n';
-            
-            if(records[i].first == -1){
-                cout << '|';
-                cout << string(width, '-');
-                cout << "|\n";
-            }
-        }
-        cout << ' ';
-        cout << string(width, '-');
-        cout << '\n' << records.size() - ((records[0].first == -1) ? 1 : 0) << " records returned.\n";
-    }
-    
-    
-    string tabulate_entry(string entry, size_t width){
-        if(entry.size() >= width){
-            return entry;
+        record_printer printer(-1, records.size());
+        for(size_t i = 0; i < records.size(); i++){
+            printer.add(records[i]);
         }
-        size_t before = 1;
-        return string(before, ' ') + entry + string(width - before - entry.size(), ' ');
+        printer.finish();
     }
     
     
@@ -952,8 +2602,7 @@ public:
         
         // find ordinal positions of both columns
         where_condition col_cond("table_name", 0, table_name);
-        vector<record_type> column_info = select_records(get_all_records("database_columns"), "database_columns", col_cond);
-        int pos_c = -1;
+        vector<record_type> column_info = select_records(catalog_columns(), "database_columns", col_cond);
         int pos_u = -1;
         uint8_t new_dt = -1;
         for(int i = 0; i < column_info.size(); i++){
@@ -964,25 +2613,17 @@ public:
                 pos_u = col_position - 1;
                 new_dt = stoi(column_info[i].second[2].second);
             }
-            if(col_name == cond.column_name){
-                pos_c = col_position - 1;
-            }
-        }
-        if(cond.column_name == "row_id"){
-            pos_c = -2;
         }
         if(column_name == "row_id"){
             pos_u = -2;
-            cout << "[Error] Updating the row_id is not allowed\n";
+            console::out() << "[Error] Updating the row_id is not allowed\n";
             return false;
         }
         
-        if(pos_c == -1){
-            cout << "[Error] Invalid column name in condition\n";
+        if(!resolve_condition(catalog_columns(), table_name, cond))
             return false;
-        }
         if(pos_u == -1 && !delete_record){
-            cout << "[Error] No column named \'" << column_name << "\' in table \'" << table_name << "\'\n";
+            console::out() << "[Error] No column named \'" << column_name << "\' in table \'" << table_name << "\'\n";
             return false;
         }
         
@@ -999,31 +2640,46 @@ public:
             table_file.open(table_file_path, ios::in);
         }
         if(!table_file.is_open()){
-            cout << "[Error] No such table exists\n";
+            console::out() << "[Error] No such table exists\n";
             return false;
         }
         
+        write_gate gate(table_file_path);
+        if(!gate.entered()){
+            console::out() << "[Error] Table \'" << table_name << "\' is held by another transaction\n";
+            return false;
+        }
+        table_lock lock(table_file_path);
         uint32_t root_page_addr;
-        fstream f;
-        f.open(table_root_path, ios::in);
-        f >> root_page_addr;
-        f.close();
+        {
+            shared_latch root_latch(table_file_path, ROOT_LATCH);
+            root_page_addr = file_utils::read_root_page_addr(table_root_path);
+        }
         
         
-        // Obtain first page from the table
+        // Obtain the first page that can hold a row in the row_id range of the condition
+        uint32_t low_key, high_key;
+        if(!key_range(cond, low_key, high_key))
+            return true;
         uint8_t leaf_page[PAGE_SIZE];
-        file_utils::read_page_from_table_file(table_file_path, root_page_addr / PAGE_SIZE, leaf_page);
+        btree_utils::read_page_shared(table_file_path, root_page_addr, leaf_page);
         uint32_t leaf_addr = root_page_addr;
         while(leaf_page[0] != 0x0d){
-            string value_string;
-            file_utils::read_value_within_page(leaf_page, PAGE_SIZE - 8, value_string, 0x06);
-            leaf_addr = (uint32_t) stol(value_string);
-            file_utils::read_page_from_table_file(table_file_path, leaf_addr / PAGE_SIZE, leaf_page);
+            vector<uint32_t> children, keys;
+            btree_utils::read_interior_cells(leaf_page, children, keys);
+            leaf_addr = children[lower_bound(keys.begin(), keys.end(), low_key) - keys.begin()];
+            btree_utils::read_page_shared(table_file_path, leaf_addr, leaf_page);
         }
         
         
-        // Scan through all the pages in the table
-        while(leaf_page[0] == 0x0d){
+        // Scan through the pages up to the end of the range, each one modified in place under an exclusive latch
+        while(leaf_addr != 0xffffffff){
+            exclusive_latch leaf_latch(table_file_path, leaf_addr);
+            file_utils::read_page_from_table_file(table_file_path, leaf_addr / PAGE_SIZE, leaf_page);
+            if(leaf_page[0] != 0x0d)
+                break;
+            bool page_modified = false;
+            bool range_ends = (leaf_page[1] > 0 && btree_utils::leaf_max_key(leaf_page) >= high_key);
             
             if(delete_record){
                 bool item_deleted = true;
@@ -1052,16 +2708,11 @@ public:
                             offset = file_utils::read_value_within_page(leaf_page, offset, data_string, type_codes[j]);
                             record_columns.push_back(make_pair(type_codes[j], data_string));
                         }
-                        bool record_found = false;
-                        if(pos_c == -2){
-                            record_found = check_cond(make_pair(0x06, to_string(row_id)), cond);
-                        }
-                        else{
-                            record_found = check_cond(record_columns[pos_c], cond);
-                        }
+                        bool record_found = record_selected(make_pair(row_id, record_columns), cond);
                         if(record_found){
                             file_utils::delete_record_from_page(leaf_page, row_id);
                             item_deleted = true;
+                            page_modified = true;
                             break;
                         }
                     }
@@ -1105,13 +2756,7 @@ public:
                         offset = file_utils::read_value_within_page(leaf_page, offset, data_string, type_codes[j]);
                         record_columns.push_back(make_pair(type_codes[j], data_string));
                     }
-                    bool record_found = false;
-                    if(pos_c == -2){
-                        record_found = check_cond(make_pair(0x06, to_string(row_id)), cond);
-                    }
-                    else{
-                        record_found = check_cond(record_columns[pos_c], cond);
-                    }
+                    bool record_found = record_selected(make_pair(row_id, record_columns), cond);
                     
                     if(value == "null"){
                         if(new_dt == 0x07 || new_dt == 0x09 || new_dt == 0x0a || new_dt == 0x0b)
@@ -1125,6 +2770,7 @@ public:
                     }
                     
                     if(record_found){
+                        page_modified = true;
                         offset = addr + 7 + tot_columns;
                         for(int j = 0; j < tot_columns; j++){
                             string data_string;
@@ -1149,14 +2795,13 @@ public:
             }
 
             // update the page
-            
-            file_utils::write_page_to_table_file(table_file_path, leaf_addr / PAGE_SIZE, leaf_page);
+            if(page_modified)
+                file_utils::write_page_to_table_file(table_file_path, leaf_addr / PAGE_SIZE, leaf_page);
+            if(range_ends)
+                break;
             string value_string;
             file_utils::read_value_within_page(leaf_page, 4, value_string, 0x06);
             leaf_addr = (uint32_t) stol(value_string);
-            if(leaf_addr == 0xffffffff)
-                break;
-            file_utils::read_page_from_table_file(table_file_path, leaf_addr / PAGE_SIZE, leaf_page);
         }
         
         return true;
@@ -1176,7 +2821,7 @@ public:
 
 
 void Abhi_sql_engine::install(){
-    cout << "Installing and resetting..\n";
+    console::out() << "Installing and resetting..\n";
     
     // remove existing
     system("rm -rf catalog");
@@ -1200,9 +2845,11 @@ void Abhi_sql_engine::install(){
     
     string table_file_path("catalog/database_tables.tbl");
     string column_file_path("catalog/database_columns.tbl");
+    string statistics_file_path("catalog/database_statistics.tbl");
     
     file_utils::append_page_to_table_file(table_file_path, first_page);
     file_utils::append_page_to_table_file(column_file_path, first_page);
+    file_utils::append_page_to_table_file(statistics_file_path, first_page);
     
     
     // Add entries to the table
@@ -1213,6 +2860,8 @@ void Abhi_sql_engine::install(){
     records[0].second.push_back(make_pair(0x0c + 15, "database_tables"));
     records.push_back(make_pair(0x0002, vector<pair<uint8_t, string> >()));
     records[1].second.push_back(make_pair(0x0c + 16, "database_columns"));
+    records.push_back(make_pair(0x0003, vector<pair<uint8_t, string> >()));
+    records[2].second.push_back(make_pair(0x0c + 19, "database_statistics"));
     
     file_utils::read_page_from_table_file(table_file_path, 0, first_page);
     if(first_page[0] == 0x0d){
@@ -1270,15 +2919,19 @@ void Abhi_sql_engine::install(){
     file_utils::write_page_to_table_file(column_file_path, 0, first_page);
     
     // Add max row id files
-    int value = 2;
+    int value = 3;
     fstream ftmp;
     ftmp.open("catalog/database_tables_max_rowid.txt", ios::out);
     ftmp << value;
     ftmp.close();
-    value = 6;
+    value = 15;
     ftmp.open("catalog/database_columns_max_rowid.txt", ios::out);
     ftmp << value;
     ftmp.close();
+    value = 0;
+    ftmp.open("catalog/database_statistics_max_rowid.txt", ios::out);
+    ftmp << value;
+    ftmp.close();
     
     
     ftmp.open("catalog/database_columns.tbr", ios::out);
@@ -1289,7 +2942,69 @@ void Abhi_sql_engine::install(){
     ftmp << 0;
     ftmp.close();
     
-    cout << "Installed\n";
+    ftmp.open("catalog/database_statistics.tbr", ios::out);
+    ftmp << 0;
+    ftmp.close();
+    
+    // columns of the statistics table, more than the first page holds
+    vector<pair<uint32_t, vector<pair<uint8_t, string> > > > statistics_columns;
+    statistics_columns.push_back(make_pair(0x0007, vector<pair<uint8_t, string> >()));
+    statistics_columns[0].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[0].second.push_back(make_pair(0x0c + 10, "table_name"));
+    statistics_columns[0].second.push_back(make_pair(0x04, "12"));
+    statistics_columns[0].second.push_back(make_pair(0x04, "1"));
+    statistics_columns[0].second.push_back(make_pair(0x04, "0"));
+    statistics_columns.push_back(make_pair(0x0008, vector<pair<uint8_t, string> >()));
+    statistics_columns[1].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[1].second.push_back(make_pair(0x0c + 11, "column_name"));
+    statistics_columns[1].second.push_back(make_pair(0x04, "12"));
+    statistics_columns[1].second.push_back(make_pair(0x04, "2"));
+    statistics_columns[1].second.push_back(make_pair(0x04, "0"));
+    statistics_columns.push_back(make_pair(0x0009, vector<pair<uint8_t, string> >()));
+    statistics_columns[2].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[2].second.push_back(make_pair(0x0c + 9, "row_count"));
+    statistics_columns[2].second.push_back(make_pair(0x04, "7"));
+    statistics_columns[2].second.push_back(make_pair(0x04, "3"));
+    statistics_columns[2].second.push_back(make_pair(0x04, "0"));
+    statistics_columns.push_back(make_pair(0x000a, vector<pair<uint8_t, string> >()));
+    statistics_columns[3].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[3].second.push_back(make_pair(0x0c + 10, "leaf_pages"));
+    statistics_columns[3].second.push_back(make_pair(0x04, "6"));
+    statistics_columns[3].second.push_back(make_pair(0x04, "4"));
+    statistics_columns[3].second.push_back(make_pair(0x04, "0"));
+    statistics_columns.push_back(make_pair(0x000b, vector<pair<uint8_t, string> >()));
+    statistics_columns[4].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[4].second.push_back(make_pair(0x0c + 13, "null_fraction"));
+    statistics_columns[4].second.push_back(make_pair(0x04, "9"));
+    statistics_columns[4].second.push_back(make_pair(0x04, "5"));
+    statistics_columns[4].second.push_back(make_pair(0x04, "0"));
+    statistics_columns.push_back(make_pair(0x000c, vector<pair<uint8_t, string> >()));
+    statistics_columns[5].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[5].second.push_back(make_pair(0x0c + 9, "min_value"));
+    statistics_columns[5].second.push_back(make_pair(0x04, "12"));
+    statistics_columns[5].second.push_back(make_pair(0x04, "6"));
+    statistics_columns[5].second.push_back(make_pair(0x04, "1"));
+    statistics_columns.push_back(make_pair(0x000d, vector<pair<uint8_t, string> >()));
+    statistics_columns[6].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[6].second.push_back(make_pair(0x0c + 9, "max_value"));
+    statistics_columns[6].second.push_back(make_pair(0x04, "12"));
+    statistics_columns[6].second.push_back(make_pair(0x04, "7"));
+    statistics_columns[6].second.push_back(make_pair(0x04, "1"));
+    statistics_columns.push_back(make_pair(0x000e, vector<pair<uint8_t, string> >()));
+    statistics_columns[7].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[7].second.push_back(make_pair(0x0c + 14, "distinct_count"));
+    statistics_columns[7].second.push_back(make_pair(0x04, "7"));
+    statistics_columns[7].second.push_back(make_pair(0x04, "8"));
+    statistics_columns[7].second.push_back(make_pair(0x04, "0"));
+    statistics_columns.push_back(make_pair(0x000f, vector<pair<uint8_t, string> >()));
+    statistics_columns[8].second.push_back(make_pair(0x0c + 19, "database_statistics"));
+    statistics_columns[8].second.push_back(make_pair(0x0c + 9, "histogram"));
+    statistics_columns[8].second.push_back(make_pair(0x04, "12"));
+    statistics_columns[8].second.push_back(make_pair(0x04, "9"));
+    statistics_columns[8].second.push_back(make_pair(0x04, "1"));
+    btree_utils::btree_insert(column_file_path, statistics_columns);
+    
+    console::out() << "Installed\n";
 }
 
 
@@ -0,0 +1,282 @@
+#ifndef aggregates_h
+#define aggregates_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "file_utils.h"
+using namespace std;
+
+// aggregate functions
+#define AGGREGATE_COUNT 0
+#define AGGREGATE_SUM 1
+#define AGGREGATE_MIN 2
+#define AGGREGATE_MAX 3
+#define AGGREGATE_AVG 4
+
+#define GROUP_BY_ARENA_BLOCK (64 * 1024)
+
+
+// one aggregate function of a SELECT, e.g. avg(marks)
+struct aggregate_spec{
+    string text;                    // as written, used as the column header
+    string function;                // count, sum, min, max or avg
+    uint8_t function_code;          // AGGREGATE_ code of function
+    string column_name;             // "*" for count(*)
+    int ordinal_position;           // 0-based position in the records, -1 for row_id and *
+    uint8_t data_type;              // type code of the column
+};
+
+
+// Bytes of group keys and text aggregates carved out of large blocks, so that they cost no allocation of their
+// own
+class byte_arena{
+    vector<char*> blocks;
+    size_t used;                        // bytes taken from the last block
+    size_t block_size;                  // size of the last block
+    size_t total;
+
+public:
+    byte_arena() : used(0), block_size(0), total(0){}
+    byte_arena(const byte_arena&) = delete;
+    byte_arena& operator=(const byte_arena&) = delete;
+    
+    ~byte_arena(){
+        clear();
+    }
+    
+    // room for length bytes, written by the caller
+    char* allocate(size_t length){
+        if(used + length > block_size){
+            block_size = max((size_t) GROUP_BY_ARENA_BLOCK, length);
+            blocks.push_back(new char[block_size]);
+            total += block_size;
+            used = 0;
+        }
+        char *out = blocks.back() + used;
+        used += length;
+        return out;
+    }
+    
+    const char* copy(const char *bytes, size_t length){
+        char *out = allocate(length);
+        memcpy(out, bytes, length);
+        return out;
+    }
+    
+    size_t bytes(){
+        return total;
+    }
+    
+    void clear(){
+        for(size_t i = 0; i < blocks.size(); i++){
+            delete[] blocks[i];
+        }
+        blocks.clear();
+        used = block_size = total = 0;
+    }
+};
+
+
+// A text value in a byte_arena. A new value is written over the old one while it fits, so that a running
+// MIN or MAX takes more of the arena only as its longest value grows.
+struct arena_text{
+    char *bytes;
+    uint32_t length;
+    uint32_t capacity;
+    
+    arena_text() : bytes(NULL), length(0), capacity(0){}
+    
+    void assign(const char *value, size_t value_length, byte_arena &arena){
+        if(value_length > capacity){
+            capacity = max(value_length, 2 * (size_t) capacity);
+            bytes = arena.allocate(capacity);
+        }
+        if(value_length > 0)
+            memcpy(bytes, value, value_length);
+        length = value_length;
+    }
+    
+    // below zero, zero or above zero as the text orders before, with or after value, byte by byte
+    int compare(const char *value, size_t value_length) const{
+        size_t common = min((size_t) length, value_length);
+        int order = (common > 0) ? memcmp(bytes, value, common) : 0;
+        if(order != 0 || length == value_length)
+            return order;
+        return (length < value_length) ? -1 : 1;
+    }
+};
+
+
+// Running state of one aggregate over a part of a table. Every scan thread fills its own states, which are
+// merged once the scan is over. The text of a MIN or MAX lives in an arena given by the caller, which is to
+// outlive the state.
+class aggregate_state{
+    uint64_t count;                 // rows for count(*), non-null values otherwise
+    int64_t int_sum, int_min, int_max;
+    double real_sum, real_min, real_max;
+    arena_text text_min, text_max;
+    
+    static bool is_integer(uint8_t data_type){
+        return (data_type >= 0x04 && data_type <= 0x07);
+    }
+    
+    static bool is_real(uint8_t data_type){
+        return (data_type == 0x08 || data_type == 0x09);
+    }
+    
+    void add_integer(int64_t v){
+        int_sum += v;
+        if(count++ == 0 || v < int_min)
+            int_min = v;
+        if(count == 1 || v > int_max)
+            int_max = v;
+    }
+    
+    void add_real(double v){
+        real_sum += v;
+        if(count++ == 0 || v < real_min)
+            real_min = v;
+        if(count == 1 || v > real_max)
+            real_max = v;
+    }
+    
+    // dates print as YYYY-MM-DD, so they order like text; only the extreme the function asks for is kept
+    void add_text(uint8_t function_code, const char *v, size_t length, byte_arena &arena){
+        bool first = (count++ == 0);
+        if(function_code == AGGREGATE_MIN && (first || text_min.compare(v, length) > 0))
+            text_min.assign(v, length, arena);
+        else if(function_code == AGGREGATE_MAX && (first || text_max.compare(v, length) < 0))
+            text_max.assign(v, length, arena);
+    }
+
+public:
+    aggregate_state(){
+        count = 0;
+        int_sum = int_min = int_max = 0;
+        real_sum = real_min = real_max = 0;
+    }
+    
+    
+    // Read "name(column)" into a spec, the column is resolved by the caller
+    static bool parse(string text, aggregate_spec &spec){
+        size_t open = text.find('(');
+        if(open == string::npos || text[text.size() - 1] != ')'){
+            console::out() << "[Error] Invalid aggregate function \'" << text << "\'\n";
+            return false;
+        }
+        spec.text = text;
+        spec.function = text.substr(0, open);
+        spec.column_name = text.substr(open + 1, text.size() - open - 2);
+        spec.ordinal_position = -1;
+        spec.data_type = 0x06;
+        if(spec.function == "count")
+            spec.function_code = AGGREGATE_COUNT;
+        else if(spec.function == "sum")
+            spec.function_code = AGGREGATE_SUM;
+        else if(spec.function == "min")
+            spec.function_code = AGGREGATE_MIN;
+        else if(spec.function == "max")
+            spec.function_code = AGGREGATE_MAX;
+        else if(spec.function == "avg")
+            spec.function_code = AGGREGATE_AVG;
+        else{
+            console::out() << "[Error] Unknown aggregate function \'" << spec.function << "\'\n";
+            return false;
+        }
+        if(spec.column_name == "" || (spec.column_name == "*" && spec.function_code != AGGREGATE_COUNT)){
+            console::out() << "[Error] Invalid argument to aggregate function \'" << spec.function << "\'\n";
+            return false;
+        }
+        return true;
+    }
+    
+    
+    // false if the function cannot be computed over the column's type
+    static bool applies_to(aggregate_spec &spec){
+        if((spec.function_code == AGGREGATE_SUM || spec.function_code == AGGREGATE_AVG) && !is_integer(spec.data_type) && !is_real(spec.data_type)){
+            console::out() << "[Error] Cannot compute " << spec.function << " over non-numeric column \'" << spec.column_name << "\'\n";
+            return false;
+        }
+        return true;
+    }
+    
+    
+    // Fold one record in
+    void add(const aggregate_spec &spec, const record_type &record, byte_arena &arena){
+        
+        // row_id is not stored among the columns, and is never NULL: count(row_id) counts the rows as count(*)
+        if(spec.ordinal_position == -1){
+            if(spec.function_code == AGGREGATE_COUNT)
+                ++count;
+            else
+                add_integer(record.first);
+            return;
+        }
+        const pair<uint8_t, string> &value = record.second[spec.ordinal_position];
+        if(value.first <= 0x03)
+            return;
+        if(spec.function_code == AGGREGATE_COUNT)
+            ++count;
+        else if(is_integer(spec.data_type))
+            add_integer(strtoll(value.second.c_str(), NULL, 10));
+        else if(is_real(spec.data_type))
+            add_real(strtod(value.second.c_str(), NULL));
+        else
+            add_text(spec.function_code, value.second.data(), value.second.size(), arena);
+    }
+    
+    
+    // Fold in the state of another part of the table, its text copied to arena
+    void merge(const aggregate_spec &spec, const aggregate_state &other, byte_arena &arena){
+        if(other.count == 0)
+            return;
+        bool first = (count == 0);
+        count += other.count;
+        int_sum += other.int_sum;
+        real_sum += other.real_sum;
+        if(first || other.int_min < int_min)
+            int_min = other.int_min;
+        if(first || other.int_max > int_max)
+            int_max = other.int_max;
+        if(first || other.real_min < real_min)
+            real_min = other.real_min;
+        if(first || other.real_max > real_max)
+            real_max = other.real_max;
+        if(spec.function_code == AGGREGATE_MIN && (first || text_min.compare(other.text_min.bytes, other.text_min.length) > 0))
+            text_min.assign(other.text_min.bytes, other.text_min.length, arena);
+        else if(spec.function_code == AGGREGATE_MAX && (first || text_max.compare(other.text_max.bytes, other.text_max.length) < 0))
+            text_max.assign(other.text_max.bytes, other.text_max.length, arena);
+    }
+    
+    
+    // Final value as a (type code, value) pair, NULL over no values
+    pair<uint8_t, string> result(const aggregate_spec &spec){
+        if(spec.function_code == AGGREGATE_COUNT)
+            return make_pair(0x07, to_string(count));
+        if(count == 0)
+            return make_pair(0x03, string("NULL"));
+        if(spec.function_code == AGGREGATE_AVG){
+            double sum = is_integer(spec.data_type) ? (double) int_sum : real_sum;
+            return make_pair(0x09, to_string(sum / count));
+        }
+        if(is_integer(spec.data_type)){
+            if(spec.function_code == AGGREGATE_SUM)
+                return make_pair(0x07, to_string(int_sum));
+            return make_pair(spec.data_type, to_string(spec.function_code == AGGREGATE_MIN ? int_min : int_max));
+        }
+        if(is_real(spec.data_type)){
+            if(spec.function_code == AGGREGATE_SUM)
+                return make_pair(0x09, to_string(real_sum));
+            return make_pair(spec.data_type, to_string(spec.function_code == AGGREGATE_MIN ? real_min : real_max));
+        }
+        const arena_text &extreme = (spec.function_code == AGGREGATE_MIN) ? text_min : text_max;
+        string text = (extreme.length > 0) ? string(extreme.bytes, extreme.length) : string();
+        return make_pair(spec.data_type == 0x0c ? 0x0c + text.size() : spec.data_type, text);
+    }
+};
+
+
+#endif /* aggregates_h */
@@ -0,0 +1,122 @@
+#ifndef async_benchmark_h
+#define async_benchmark_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include "async_executor.h"
+using namespace std;
+
+// coroutines doing point lookups, and lookups each of them does, unless given
+#ifndef ASYNC_BENCH_CLIENTS
+#define ASYNC_BENCH_CLIENTS 32
+#endif
+
+#ifndef ASYNC_BENCH_LOOKUPS
+#define ASYNC_BENCH_LOOKUPS 100
+#endif
+
+
+// Latency of point lookups on the executor while full scans of the same table keep running beside them,
+// first with every thread taking scans too and then with EXECUTOR_SHORT_THREADS kept for short statements
+class async_benchmark{
+    
+    static double milliseconds_since(chrono::steady_clock::time_point start){
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e3;
+    }
+    
+    static query_task<int> lookups(async_executor &executor, string table_name, long rows, size_t count, unsigned seed, vector<double> &latencies, atomic<size_t> &running){
+        ultralite_db db;
+        ultralite_statement statement;
+        if(db.open(".") != ULTRALITE_OK || db.prepare(string("select * from ") + table_name + " where row_id = ?", statement) != ULTRALITE_OK){
+            running--;
+            co_return 0;
+        }
+        mt19937 random(seed);
+        uniform_int_distribution<long> row_ids(1, rows);
+        size_t found = 0;
+        for(size_t i = 0; i < count; i++){
+            statement.bind(0, (int64_t) row_ids(random));
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            int code = co_await executor.execute(statement);
+            while(code == ULTRALITE_ROW){
+                found++;
+                code = statement.step();
+            }
+            latencies.push_back(milliseconds_since(start));
+        }
+        running--;
+        co_return found;
+    }
+    
+    // full scans over and over, for as long as lookups are running
+    static query_task<int> scans(async_executor &executor, string table_name, vector<double> &milliseconds, atomic<size_t> &running){
+        ultralite_db db;
+        ultralite_statement statement;
+        if(db.open(".") != ULTRALITE_OK || db.prepare(string("select count(*) from ") + table_name, statement) != ULTRALITE_OK)
+            co_return 0;
+        int scanned = 0;
+        while(running > 0){
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            int code = co_await executor.execute(statement);
+            milliseconds.push_back(milliseconds_since(start));
+            scanned++;
+            while(code == ULTRALITE_ROW){
+                code = statement.step();
+            }
+        }
+        co_return scanned;
+    }
+    
+    static void run_once(const string &table_name, long rows, size_t clients, size_t scanners, size_t short_threads){
+        vector<vector<double> > latencies(clients);
+        vector<vector<double> > scan_milliseconds(scanners);
+        atomic<size_t> running(clients);
+        vector<query_task<int> > tasks;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        {
+            async_executor executor(EXECUTOR_THREADS, short_threads);
+            for(size_t s = 0; s < scanners; s++){
+                tasks.push_back(scans(executor, table_name, scan_milliseconds[s], running));
+            }
+            for(size_t c = 0; c < clients; c++){
+                tasks.push_back(lookups(executor, table_name, rows, ASYNC_BENCH_LOOKUPS, c + 1, latencies[c], running));
+            }
+            wait_all(tasks);
+        }
+        double total_milliseconds = milliseconds_since(start);
+        
+        vector<double> all;
+        for(size_t c = 0; c < clients; c++){
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        }
+        sort(all.begin(), all.end());
+        vector<double> scanned;
+        for(size_t s = 0; s < scanners; s++){
+            scanned.insert(scanned.end(), scan_milliseconds[s].begin(), scan_milliseconds[s].end());
+        }
+        sort(scanned.begin(), scanned.end());
+        char line[240];
+        snprintf(line, sizeof(line), "%zu short threads: %zu lookups, p50 %.2f ms, p99 %.2f ms, max %.2f ms; %zu scans, p50 %.0f ms; %.0f ms in all\n", short_threads, all.size(), all.empty() ? 0 : all[all.size() / 2], all.empty() ? 0 : all[(size_t) (0.99 * (all.size() - 1))], all.empty() ? 0 : all.back(), scanned.size(), scanned.empty() ? 0 : scanned[scanned.size() / 2], total_milliseconds);
+        cout << line;
+    }
+
+public:
+    // clients coroutines each looking up ASYNC_BENCH_LOOKUPS random row_ids from 1 to rows, beside scanners
+    // coroutines scanning the table
+    static void run(const string &table_name, long rows, size_t clients, size_t scanners){
+        char line[160];
+        snprintf(line, sizeof(line), "%d executor threads, %zu lookup coroutines, %zu scanning %s\n", EXECUTOR_THREADS, clients, scanners, table_name.c_str());
+        cout << line;
+        run_once(table_name, rows, clients, scanners, 0);
+        run_once(table_name, rows, clients, scanners, EXECUTOR_SHORT_THREADS);
+    }
+};
+
+
+#endif /* async_benchmark_h */
@@ -0,0 +1,291 @@
+#ifndef async_executor_h
+#define async_executor_h
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "ultralitesql.h"
+using namespace std;
+
+// threads of an executor, unless given
+#ifndef EXECUTOR_THREADS
+#define EXECUTOR_THREADS 4
+#endif
+
+// threads of an executor kept for short statements, so they never wait behind long ones
+#ifndef EXECUTOR_SHORT_THREADS
+#define EXECUTOR_SHORT_THREADS 1
+#endif
+
+// a statement reading at most this many row_ids of its table is short
+#ifndef EXECUTOR_SHORT_ROWS
+#define EXECUTOR_SHORT_ROWS 4096
+#endif
+
+
+// Counts the tasks started by a wait and not finished yet, and wakes the waiting thread at the last one
+struct task_waiter{
+    mutex done_mutex;
+    condition_variable done;
+    size_t remaining;
+    
+    task_waiter(size_t tasks) : remaining(tasks){}
+    
+    void finish(){
+        lock_guard<mutex> guard(done_mutex);
+        if(--remaining == 0)
+            done.notify_all();
+    }
+    
+    void wait(){
+        unique_lock<mutex> lock(done_mutex);
+        done.wait(lock, [this](){ return remaining == 0; });
+    }
+};
+
+
+// A coroutine returning a T: started by sync_wait or wait_all, or by a coroutine awaiting it, which resumes
+// once it returns
+template<typename T>
+class query_task{
+public:
+    struct promise_type{
+        T value;
+        exception_ptr error;
+        coroutine_handle<> continuation;
+        task_waiter *waiter;
+        
+        promise_type() : waiter(NULL){}
+        
+        query_task get_return_object(){
+            return query_task(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        
+        suspend_always initial_suspend() noexcept{
+            return suspend_always();
+        }
+        
+        // hand over to whoever awaits the task, or count it finished for the waiting thread
+        struct final_awaiter{
+            bool await_ready() noexcept{
+                return false;
+            }
+            
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> handle) noexcept{
+                promise_type &promise = handle.promise();
+                if(promise.continuation)
+                    return promise.continuation;
+                if(promise.waiter != NULL)
+                    promise.waiter->finish();
+                return noop_coroutine();
+            }
+            
+            void await_resume() noexcept{}
+        };
+        
+        final_awaiter final_suspend() noexcept{
+            return final_awaiter();
+        }
+        
+        void return_value(T result){
+            value = move(result);
+        }
+        
+        void unhandled_exception(){
+            error = current_exception();
+        }
+    };
+
+private:
+    coroutine_handle<promise_type> handle;
+
+public:
+    explicit query_task(coroutine_handle<promise_type> coroutine) : handle(coroutine){}
+    
+    query_task(query_task &&other) noexcept : handle(other.handle){
+        other.handle = NULL;
+    }
+    
+    query_task(const query_task&) = delete;
+    
+    ~query_task(){
+        if(handle)
+            handle.destroy();
+    }
+    
+    
+    // Awaiting a task runs it to its end, the awaiting coroutine suspended meanwhile
+    bool await_ready() const noexcept{
+        return false;
+    }
+    
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept{
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    
+    T await_resume(){
+        return result();
+    }
+    
+    
+    // Start the task on this thread, to run until it first waits; the waiter learns when it is finished
+    void start(task_waiter &waiter){
+        handle.promise().waiter = &waiter;
+        handle.resume();
+    }
+    
+    T result(){
+        if(handle.promise().error)
+            rethrow_exception(handle.promise().error);
+        return move(handle.promise().value);
+    }
+};
+
+
+// Start every task and block until they have all finished. They run interleaved: each one goes as far as
+// its next co_await before the next is started, and resumes on an executor thread.
+template<typename T>
+void wait_all(vector<query_task<T> > &tasks){
+    task_waiter waiter(tasks.size());
+    for(size_t i = 0; i < tasks.size(); i++){
+        tasks[i].start(waiter);
+    }
+    if(tasks.size() > 0)
+        waiter.wait();
+}
+
+// Run a task to its end from a thread that is not a coroutine, and give its result
+template<typename T>
+T sync_wait(query_task<T> &&task){
+    task_waiter waiter(1);
+    task.start(waiter);
+    waiter.wait();
+    return task.result();
+}
+
+
+// Runs the statements of coroutines on a few threads. co_await executor.execute(statement) suspends the
+// coroutine, runs the statement's first step on an executor thread, and resumes the coroutine there with the
+// ULTRALITE_ code of that step; its further steps run on that thread too. Page reads are not awaitable: a
+// statement waiting on one holds its thread. Statements are sorted into two lanes instead: short ones (by
+// row_id_span) go ahead of long ones, and EXECUTOR_SHORT_THREADS threads never take a long one, so lookups
+// keep a low latency while long scans run. Any thread may run a connection's statement, its transaction
+// going with the connection.
+class async_executor{
+    struct job{
+        ultralite_statement *statement;
+        coroutine_handle<> waiting;
+        int *code;
+    };
+    
+    vector<thread> threads;
+    size_t short_threads;
+    mutex jobs_mutex;
+    condition_variable jobs_ready;
+    deque<job> short_jobs, long_jobs;
+    bool stopping;
+    
+    bool take(size_t self, job &next){
+        deque<job> *queue = NULL;
+        if(!short_jobs.empty())
+            queue = &short_jobs;
+        else if(self >= short_threads && !long_jobs.empty())
+            queue = &long_jobs;
+        if(queue == NULL)
+            return false;
+        next = queue->front();
+        queue->pop_front();
+        return true;
+    }
+    
+    void work(size_t self){
+        while(true){
+            job next;
+            {
+                unique_lock<mutex> lock(jobs_mutex);
+                jobs_ready.wait(lock, [&](){ return take(self, next) || (stopping && short_jobs.empty() && long_jobs.empty()); });
+                if(!next.waiting)
+                    return;
+            }
+            *next.code = next.statement->step();
+            next.waiting.resume();
+        }
+    }
+    
+    void submit(const job &next){
+        {
+            lock_guard<mutex> guard(jobs_mutex);
+            if(next.statement->row_id_span() <= EXECUTOR_SHORT_ROWS)
+                short_jobs.push_back(next);
+            else
+                long_jobs.push_back(next);
+        }
+        jobs_ready.notify_all();
+    }
+
+public:
+    // What co_await executor.execute(statement) waits on
+    class execution{
+        async_executor &executor;
+        ultralite_statement &statement;
+        int code;
+    
+    public:
+        execution(async_executor &owner, ultralite_statement &prepared) : executor(owner), statement(prepared), code(ULTRALITE_MISUSE){}
+        
+        // a statement never prepared fails at once
+        bool await_ready() const noexcept{
+            return statement.connection() == NULL;
+        }
+        
+        void await_suspend(coroutine_handle<> waiting){
+            job next;
+            next.statement = &statement;
+            next.waiting = waiting;
+            next.code = &code;
+            executor.submit(next);
+        }
+        
+        int await_resume() const noexcept{
+            return code;
+        }
+    };
+    
+    
+    async_executor(size_t thread_count = EXECUTOR_THREADS, size_t short_thread_count = EXECUTOR_SHORT_THREADS){
+        thread_count = max(thread_count, (size_t) 1);
+        short_threads = min(short_thread_count, thread_count - 1);
+        stopping = false;
+        for(size_t i = 0; i < thread_count; i++){
+            threads.push_back(thread(&async_executor::work, this, i));
+        }
+    }
+    
+    // Finishes the statements submitted before returning
+    ~async_executor(){
+        {
+            lock_guard<mutex> guard(jobs_mutex);
+            stopping = true;
+        }
+        jobs_ready.notify_all();
+        for(size_t i = 0; i < threads.size(); i++){
+            threads[i].join();
+        }
+    }
+    
+    
+    // Run a prepared statement, its values bound, by its first step. A connection runs one statement at a
+    // time: a coroutine awaits each one before running the next on it.
+    execution execute(ultralite_statement &statement){
+        return execution(*this, statement);
+    }
+};
+
+
+#endif /* async_executor_h */
@@ -3,216 +3,602 @@
 
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
 #include "file_utils.h"
 using namespace std;
 
 #define MAX_NODES_ALLOWED 48
 
+
+// cached right spine of a table's b+ tree, lets appends skip the descent
+struct append_hint{
+    uint32_t root_page_addr;        // root the spine was read from
+    vector<uint32_t> spine;         // interior pages from the root down to the rightmost leaf's parent
+    uint32_t leaf_page_addr;        // rightmost leaf page
+    append_hint() : root_page_addr(0xffffffff), leaf_page_addr(0xffffffff){}
+};
+
+
 class btree_utils{
     
 public:
-
-    static pair<uint32_t, int32_t> btree_insert_util(string table_file_path, uint32_t root_page_addr, record_type &record){
-        uint32_t record_key = record.first;
-        string value_string;
+    
+    // right spine hints, keyed by table file path
+    static unordered_map<string, append_hint>& append_hints(){
+        static unordered_map<string, append_hint> hints;
+        return hints;
+    }
+    
+    static mutex& append_hints_mutex(){
+        static mutex hints_mutex;
+        return hints_mutex;
+    }
+    
+    
+    // the cached right spine of a table, only used under the table's ROOT_LATCH
+    static append_hint& append_hint_for(string table_file_path){
+        lock_guard<mutex> guard(append_hints_mutex());
+        return append_hints()[table_file_path];
+    }
+    
+    
+    // drop the cached right spine of a table (on drop / rebuild)
+    static void forget_append_hint(string table_file_path){
+        lock_guard<mutex> guard(append_hints_mutex());
+        append_hints().erase(table_file_path);
+    }
+    
+    
+    // read a page under a shared latch, so that it is never caught halfway through a write
+    static void read_page_shared(string table_file_path, uint32_t page_addr, uint8_t *page){
+        shared_latch page_latch(table_file_path, page_addr);
+        file_utils::read_page_from_table_file(table_file_path, page_addr / PAGE_SIZE, page);
+    }
+    
+    
+    // follow the right pointers from the root down to the rightmost leaf
+    static void load_right_spine(string table_file_path, uint32_t root_page_addr, append_hint &hint){
+        hint.root_page_addr = root_page_addr;
+        hint.spine.clear();
+        uint8_t page[PAGE_SIZE];
+        uint32_t page_addr = root_page_addr;
+        read_page_shared(table_file_path, page_addr, page);
+        while(page[0] == 0x05){
+            hint.spine.push_back(page_addr);
+            file_utils::page_read(page, 4, page_addr);
+            read_page_shared(table_file_path, page_addr, page);
+        }
+        hint.leaf_page_addr = page_addr;
+    }
+    
+    
+    // largest row_id stored in a leaf page (cells are kept sorted)
+    static uint32_t leaf_max_key(uint8_t *leaf_page){
+        uint16_t cell_offset;
+        uint32_t key;
+        file_utils::page_read(leaf_page, 8 + 2 * (leaf_page[1] - 1), cell_offset);
+        file_utils::page_read(leaf_page, cell_offset + 2, key);
+        return key;
+    }
+    
+    
+    // true if the record can be appended to leaf_page: the non-empty rightmost leaf, with smaller keys only
+    static bool appends_to_leaf(uint8_t *leaf_page, record_type &record){
+        uint32_t right_addr;
+        file_utils::page_read(leaf_page, 4, right_addr);
+        return leaf_page[0] == 0x0d && right_addr == 0xffffffff && leaf_page[1] > 0 && record.first > leaf_max_key(leaf_page);
+    }
+    
+    
+    // Insert a record whose row_id is larger than every key in the tree straight into the rightmost leaf.
+    // A full rightmost leaf is split asymmetrically: it stays full and the new key starts a fresh page.
+    // Returns false without touching the file if the record is not an append. The caller holds the ROOT_LATCH.
+    static bool btree_append(string table_file_path, uint32_t root_page_addr, record_type &record){
+        append_hint &hint = append_hint_for(table_file_path);
+        bool reloaded = false;
+        if(hint.root_page_addr != root_page_addr){
+            load_right_spine(table_file_path, root_page_addr, hint);
+            reloaded = true;
+        }
         
-        // read the page from the table file
-        uint8_t root_page[PAGE_SIZE];
-        file_utils::read_page_from_table_file(table_file_path, root_page_addr / PAGE_SIZE, root_page);
+        // the cached leaf must still be the non-empty rightmost leaf, and the key must go past its end
+        uint8_t leaf_page[PAGE_SIZE];
+        uint32_t right_addr;
+        while(true){
+            read_page_shared(table_file_path, hint.leaf_page_addr, leaf_page);
+            file_utils::page_read(leaf_page, 4, right_addr);
+            if(leaf_page[0] == 0x0d && right_addr == 0xffffffff)
+                break;
+            if(reloaded)
+                return false;
+            load_right_spine(table_file_path, root_page_addr, hint);
+            reloaded = true;
+        }
+        if(!appends_to_leaf(leaf_page, record))
+            return false;
         
-        // gather some general info about the root
-        int8_t number_of_records = root_page[1];
-        file_utils::read_value_within_page(root_page, 2, value_string, 0x05);
-        uint16_t content_offset = (uint16_t) stol(value_string);
-        //size_t remaining_bytes = content_offset - (8 + 2 * number_of_records);
+        // common case: room left in the rightmost leaf
+        {
+            exclusive_latch leaf_latch(table_file_path, hint.leaf_page_addr);
+            file_utils::read_page_from_table_file(table_file_path, hint.leaf_page_addr / PAGE_SIZE, leaf_page);
+            if(!appends_to_leaf(leaf_page, record))
+                return false;
+            if(file_utils::add_record_to_page(leaf_page, record) == 0){
+                file_utils::write_page_to_table_file(table_file_path, hint.leaf_page_addr / PAGE_SIZE, leaf_page);
+                return true;
+            }
+        }
         
-        // if it's a btree leaf page
-        if(root_page[0] == 0x0d){
-            
-            int status = file_utils::add_record_to_page(root_page, record);
-            if(status == 0 || status == 2){
-                file_utils::write_page_to_table_file(table_file_path, root_page_addr / PAGE_SIZE, root_page);
-                return make_pair(-1, -1);
+        // the leaf is full, so the parents will change: latch the cached spine top-down and make sure it still chains to the leaf
+        latch_set latches(table_file_path);
+        vector<uint8_t> spine_pages;
+        for(int attempt = 0; attempt < 2; attempt++){
+            for(size_t i = 0; i < hint.spine.size(); i++){
+                latches.acquire(hint.spine[i]);
             }
+            latches.acquire(hint.leaf_page_addr);
             
-            // if no more space, split below
-            uint32_t new_page_addr = file_utils::append_page_to_table_file(table_file_path);
-            uint8_t new_page[PAGE_SIZE];
-            file_utils::read_page_from_table_file(table_file_path, new_page_addr / PAGE_SIZE, new_page);
-            
-            // add new in linked list
-            uint32_t root_right;
-            file_utils::page_read(root_page, 4, root_right);
-            file_utils::add_value_within_page(new_page, 4, to_string(root_right), 0x06);
-            file_utils::add_value_within_page(root_page, 4, to_string(new_page_addr), 0x06);
-            
-            
-            // find where the new key goes
-            bool KeyInLeft;
-            uint32_t middleKey;
-            uint16_t middleKeyOffset;
-            file_utils::page_read(root_page, 8 + 2 * (number_of_records / 2), middleKeyOffset);
-            file_utils::page_read(root_page, middleKeyOffset + 2, middleKey);
-            size_t left_number_of_records, right_number_of_records;
-            if(record_key <= middleKey){
-                KeyInLeft = true;
-                left_number_of_records = (number_of_records / 2) - 1 + 1;
+            spine_pages.resize(hint.spine.size() * PAGE_SIZE);
+            bool valid = true;
+            for(size_t i = 0; i < hint.spine.size() && valid; i++){
+                uint8_t *page = &spine_pages[i * PAGE_SIZE];
+                file_utils::read_page_from_table_file(table_file_path, hint.spine[i] / PAGE_SIZE, page);
+                uint32_t child_addr;
+                file_utils::page_read(page, 4, child_addr);
+                uint32_t expected_child = (i + 1 < hint.spine.size()) ? hint.spine[i + 1] : hint.leaf_page_addr;
+                valid = (page[0] == 0x05 && child_addr == expected_child);
             }
-            else{
-                KeyInLeft = false;
-                left_number_of_records = (number_of_records / 2) + 1;
+            if(valid && (hint.spine.size() == 0 ? hint.leaf_page_addr : hint.spine[0]) == root_page_addr)
+                break;
+            if(attempt == 1)
+                return false;
+            latches.release_all();
+            uint32_t leaf_page_addr = hint.leaf_page_addr;
+            load_right_spine(table_file_path, root_page_addr, hint);
+            if(hint.leaf_page_addr != leaf_page_addr)
+                return false;
+        }
+        
+        // the leaf may have changed while it was not latched
+        file_utils::read_page_from_table_file(table_file_path, hint.leaf_page_addr / PAGE_SIZE, leaf_page);
+        if(!appends_to_leaf(leaf_page, record))
+            return false;
+        if(file_utils::add_record_to_page(leaf_page, record) == 0){
+            file_utils::write_page_to_table_file(table_file_path, hint.leaf_page_addr / PAGE_SIZE, leaf_page);
+            return true;
+        }
+        
+        // the new key alone goes to a fresh leaf chained after the full one
+        uint32_t separator = leaf_max_key(leaf_page);
+        uint32_t new_leaf_addr = file_utils::append_page_to_table_file(table_file_path);
+        uint8_t new_leaf[PAGE_SIZE];
+        file_utils::read_page_from_table_file(table_file_path, new_leaf_addr / PAGE_SIZE, new_leaf);
+        file_utils::add_record_to_page(new_leaf, record);
+        memcpy(leaf_page + 4, file_utils::byte_pattern(new_leaf_addr, 4), 4);
+        file_utils::write_page_to_table_file(table_file_path, hint.leaf_page_addr / PAGE_SIZE, leaf_page);
+        file_utils::write_page_to_table_file(table_file_path, new_leaf_addr / PAGE_SIZE, new_leaf);
+        hint.leaf_page_addr = new_leaf_addr;
+        
+        // push (separator, new right child) up the spine, opening empty interior pages on the right when full
+        uint32_t child_addr = new_leaf_addr;
+        int level = (int) hint.spine.size() - 1;
+        for(; level >= 0; level--){
+            uint8_t *page = &spine_pages[level * PAGE_SIZE];
+            if(page[1] < MAX_NODES_ALLOWED){
+                uint16_t content_offset;
+                uint32_t old_right;
+                file_utils::page_read(page, 2, content_offset);
+                file_utils::page_read(page, 4, old_right);
+                content_offset -= 8;
+                memcpy(page + content_offset, file_utils::byte_pattern(old_right, 4), 4);
+                memcpy(page + content_offset + 4, file_utils::byte_pattern(separator, 4), 4);
+                memcpy(page + 8 + 2 * page[1], file_utils::byte_pattern(content_offset, 2), 2);
+                memcpy(page + 2, file_utils::byte_pattern(content_offset, 2), 2);
+                memcpy(page + 4, file_utils::byte_pattern(child_addr, 4), 4);
+                ++page[1];
+                file_utils::write_page_to_table_file(table_file_path, hint.spine[level] / PAGE_SIZE, page);
+                break;
             }
-            right_number_of_records = number_of_records - left_number_of_records;
             
+            // full interior page keeps all its cells, its new sibling starts with just a right pointer
+            uint32_t new_interior_addr = file_utils::append_page_to_table_file(table_file_path, 0x05);
+            uint8_t new_interior[PAGE_SIZE];
+            file_utils::read_page_from_table_file(table_file_path, new_interior_addr / PAGE_SIZE, new_interior);
+            memcpy(new_interior + 4, file_utils::byte_pattern(child_addr, 4), 4);
+            file_utils::write_page_to_table_file(table_file_path, new_interior_addr / PAGE_SIZE, new_interior);
+            hint.spine[level] = new_interior_addr;
+            child_addr = new_interior_addr;
+        }
+        
+        // the split reached the root: grow the tree by one level
+        if(level < 0){
+            uint32_t new_root_addr = file_utils::append_page_to_table_file(table_file_path, 0x05);
+            uint8_t new_root[PAGE_SIZE];
+            file_utils::read_page_from_table_file(table_file_path, new_root_addr / PAGE_SIZE, new_root);
+            new_root[1] = 1;
+            memcpy(new_root + 2, file_utils::byte_pattern(PAGE_SIZE - 8, 2), 2);
+            memcpy(new_root + 4, file_utils::byte_pattern(child_addr, 4), 4);
+            memcpy(new_root + 8, file_utils::byte_pattern(PAGE_SIZE - 8, 2), 2);
+            memcpy(new_root + PAGE_SIZE - 8, file_utils::byte_pattern(root_page_addr, 4), 4);
+            memcpy(new_root + PAGE_SIZE - 4, file_utils::byte_pattern(separator, 4), 4);
+            file_utils::write_page_to_table_file(table_file_path, new_root_addr / PAGE_SIZE, new_root);
             
-            // update left node
-            root_page[1] = left_number_of_records;
-            uint16_t new_offset;
-            file_utils::page_read(root_page, 8 + 2 * (left_number_of_records - 1), new_offset);
-            file_utils::add_value_within_page(root_page, 2, to_string(new_offset), 0x05);
-            
-            new_page[1] = right_number_of_records;
-            uint16_t right_content_offset;
-            file_utils::page_read(new_page, 2, right_content_offset);
-            for(int i = 0; i < right_number_of_records; i++){
-                uint16_t tmp_offset;
-                file_utils::page_read(root_page, 8 + 2 * (left_number_of_records + i), tmp_offset);
-                uint16_t payload_size;
-                file_utils::page_read(root_page, tmp_offset, payload_size);
-                right_content_offset -= (payload_size + 6);
-                memcpy(new_page + right_content_offset, root_page + tmp_offset, payload_size + 6);
-                file_utils::add_value_within_page(new_page, 2, to_string(right_content_offset), 0x05);
-                file_utils::add_value_within_page(new_page, 8 + 2 * i, to_string(right_content_offset), 0x05);
-            }
-            
+            string table_root_path = table_file_path;
+            table_root_path[table_root_path.size() - 1] = 'r';
+            file_utils::write_root_page_addr(table_root_path, new_root_addr);
+            hint.spine.insert(hint.spine.begin(), new_root_addr);
+            hint.root_page_addr = new_root_addr;
+        }
+        return true;
+    }
+    
 
-            if(KeyInLeft){
-                status = file_utils::add_record_to_page(root_page, record);
-            }
-            else{
-                status = file_utils::add_record_to_page(new_page, record);
+    // a leaf cell: row_id and the raw bytes stored in the page (payload length, row_id, payload)
+    typedef pair<uint32_t, vector<uint8_t> > leaf_cell;
+    
+    
+    // leaf pages are full once the cell pointers and cells would run into the header slack
+    static bool leaf_cells_fit(size_t number_of_cells, size_t cell_bytes){
+        return 8 + 2 * number_of_cells + 4 + cell_bytes <= PAGE_SIZE;
+    }
+    
+    
+    // read all the cells of a leaf page, in key order
+    static void read_leaf_cells(uint8_t *page, vector<leaf_cell> &cells){
+        for(int i = 0; i < page[1]; i++){
+            uint16_t cell_offset, payload_size;
+            uint32_t key;
+            file_utils::page_read(page, 8 + 2 * i, cell_offset);
+            file_utils::page_read(page, cell_offset, payload_size);
+            file_utils::page_read(page, cell_offset + 2, key);
+            cells.push_back(make_pair(key, vector<uint8_t>(page + cell_offset, page + cell_offset + payload_size + 6)));
+        }
+    }
+    
+    
+    // encode a record the way add_record_to_page lays it out
+    static leaf_cell make_leaf_cell(record_type &record){
+        uint8_t page[PAGE_SIZE];
+        file_utils::init_page(page, 0x0d);
+        file_utils::add_record_to_page(page, record);
+        vector<leaf_cell> cells;
+        read_leaf_cells(page, cells);
+        return cells[0];
+    }
+    
+    
+    // lay out cells [begin, end) as a fresh leaf page chained to right_page_addr
+    static void write_leaf_cells(uint8_t *page, vector<leaf_cell> &cells, size_t begin, size_t end, uint32_t right_page_addr){
+        file_utils::init_page(page, 0x0d);
+        uint16_t content_offset = PAGE_SIZE;
+        for(size_t i = begin; i < end; i++){
+            content_offset -= cells[i].second.size();
+            memcpy(page + content_offset, &cells[i].second[0], cells[i].second.size());
+            memcpy(page + 8 + 2 * (i - begin), file_utils::byte_pattern(content_offset, 2), 2);
+        }
+        page[1] = end - begin;
+        memcpy(page + 2, file_utils::byte_pattern(content_offset, 2), 2);
+        memcpy(page + 4, file_utils::byte_pattern(right_page_addr, 4), 4);
+    }
+    
+    
+    // true if a leaf page holding count cells of bytes should be closed rather than take another cell
+    static bool leaf_page_closes(size_t count, size_t bytes, size_t next_cell_bytes, double fill_factor){
+        size_t target_bytes = (size_t) (fill_factor * (PAGE_SIZE - 12));
+        return count > 0 && (!leaf_cells_fit(count + 1, bytes + next_cell_bytes) || 2 * (count + 1) + bytes + next_cell_bytes > target_bytes);
+    }
+    
+    
+    // Split cells into consecutive leaf pages, filling each up to fill_factor of a page.
+    // Returns the end index of every page's run of cells.
+    static vector<size_t> group_leaf_cells(vector<leaf_cell> &cells, double fill_factor){
+        vector<size_t> group_ends;
+        size_t count = 0, bytes = 0;
+        for(size_t i = 0; i < cells.size(); i++){
+            size_t cell_bytes = cells[i].second.size();
+            if(leaf_page_closes(count, bytes, cell_bytes, fill_factor)){
+                group_ends.push_back(i);
+                count = 0;
+                bytes = 0;
             }
-            file_utils::write_page_to_table_file(table_file_path, root_page_addr / PAGE_SIZE, root_page);
-            file_utils::write_page_to_table_file(table_file_path, new_page_addr / PAGE_SIZE, new_page);
-            
-            if(status == 0){
-                // find max in left
-                uint16_t tmp_offset;
-                uint32_t left_max_val;
-                file_utils::page_read(root_page, 8 + 2 * (root_page[1] - 1), tmp_offset);
-                file_utils::page_read(root_page, tmp_offset + 2, left_max_val);
-                return make_pair(left_max_val, new_page_addr);
+            ++count;
+            bytes += cell_bytes;
+        }
+        if(count > 0 || group_ends.size() == 0)
+            group_ends.push_back(cells.size());
+        return group_ends;
+    }
+    
+    
+    // Fill factor that spreads cells evenly over the fewest pages that can hold them
+    static double balanced_leaf_fill(vector<leaf_cell> &cells){
+        size_t pages = group_leaf_cells(cells, 1.0).size();
+        size_t total_bytes = 0, max_bytes = 0;
+        for(size_t i = 0; i < cells.size(); i++){
+            total_bytes += 2 + cells[i].second.size();
+            max_bytes = max(max_bytes, 2 + cells[i].second.size());
+        }
+        return min(1.0, (double) (total_bytes / pages + max_bytes) / (PAGE_SIZE - 12));
+    }
+    
+    
+    // read the children and separator keys of an interior page; the right pointer is the last child
+    static void read_interior_cells(uint8_t *page, vector<uint32_t> &children, vector<uint32_t> &keys){
+        for(int i = 0; i < page[1]; i++){
+            uint16_t cell_offset;
+            uint32_t child, key;
+            file_utils::page_read(page, 8 + 2 * i, cell_offset);
+            file_utils::page_read(page, cell_offset, child);
+            file_utils::page_read(page, cell_offset + 4, key);
+            children.push_back(child);
+            keys.push_back(key);
+        }
+        uint32_t right_child;
+        file_utils::page_read(page, 4, right_child);
+        children.push_back(right_child);
+    }
+    
+    
+    // lay out children [begin, end) as a fresh interior page, the last one becoming the right pointer
+    static void write_interior_cells(uint8_t *page, vector<uint32_t> &children, vector<uint32_t> &keys, size_t begin, size_t end){
+        file_utils::init_page(page, 0x05);
+        uint16_t content_offset = PAGE_SIZE;
+        for(size_t i = begin; i + 1 < end; i++){
+            content_offset -= 8;
+            memcpy(page + content_offset, file_utils::byte_pattern(children[i], 4), 4);
+            memcpy(page + content_offset + 4, file_utils::byte_pattern(keys[i], 4), 4);
+            memcpy(page + 8 + 2 * (i - begin), file_utils::byte_pattern(content_offset, 2), 2);
+        }
+        page[1] = end - begin - 1;
+        memcpy(page + 2, file_utils::byte_pattern(content_offset, 2), 2);
+        memcpy(page + 4, file_utils::byte_pattern(children[end - 1], 4), 4);
+    }
+    
+    
+    // Split number_of_children children into consecutive interior pages of at most per_page children each.
+    // Returns the end index of every page's run of children.
+    static vector<size_t> group_interior_children(size_t number_of_children, size_t per_page){
+        per_page = max((size_t) 2, min(per_page, (size_t) MAX_NODES_ALLOWED + 1));
+        vector<size_t> group_ends;
+        for(size_t end = per_page; end < number_of_children; end += per_page)
+            group_ends.push_back(end);
+        group_ends.push_back(number_of_children);
+        return group_ends;
+    }
+    
+    
+    // Write the interior pages for children grouped by group_ends. The first page goes to first_page_addr,
+    // or is appended like the others if that is 0xffffffff. Returns (separator, page address) per page,
+    // where the first separator is unused.
+    static vector<pair<uint32_t, uint32_t> > write_interior_pages(string table_file_path, vector<uint32_t> &children, vector<uint32_t> &keys, vector<size_t> &group_ends, uint32_t first_page_addr){
+        vector<pair<uint32_t, uint32_t> > pages;
+        size_t new_pages = group_ends.size() - ((first_page_addr != 0xffffffff) ? 1 : 0);
+        uint32_t next_page_addr = (new_pages > 0) ? file_utils::allocate_pages(table_file_path, new_pages) : 0;
+        uint8_t page[PAGE_SIZE];
+        size_t begin = 0;
+        for(size_t g = 0; g < group_ends.size(); g++){
+            write_interior_cells(page, children, keys, begin, group_ends[g]);
+            uint32_t separator = (g > 0) ? keys[begin - 1] : 0;
+            if(g == 0 && first_page_addr != 0xffffffff){
+                file_utils::write_page_to_table_file(table_file_path, first_page_addr / PAGE_SIZE, page);
+                pages.push_back(make_pair(separator, first_page_addr));
             }
             else{
-                return make_pair(-1, -1);
+                file_utils::write_page_to_table_file(table_file_path, next_page_addr / PAGE_SIZE, page);
+                pages.push_back(make_pair(separator, next_page_addr));
+                next_page_addr += PAGE_SIZE;
+            }
+            begin = group_ends[g];
+        }
+        return pages;
+    }
+    
+    
+    // Stack interior levels over children (with keys[i] separating children[i] and children[i + 1])
+    // until a single root remains, appending every page. Returns the root page address.
+    static uint32_t build_interior_levels(string table_file_path, vector<uint32_t> children, vector<uint32_t> keys, size_t per_page){
+        while(children.size() > 1){
+            vector<size_t> group_ends = group_interior_children(children.size(), per_page);
+            vector<pair<uint32_t, uint32_t> > pages = write_interior_pages(table_file_path, children, keys, group_ends, 0xffffffff);
+            children.clear();
+            keys.clear();
+            for(size_t i = 0; i < pages.size(); i++){
+                if(i > 0)
+                    keys.push_back(pages[i].first);
+                children.push_back(pages[i].second);
             }
         }
+        return children[0];
+    }
+    
+    
+    // Insert the row_id-sorted records [begin, end) into the subtree under page_addr, modifying and
+    // writing every affected page once. Returns (separator, page address) for each new right sibling
+    // the page was split into, in key order.
+    // The caller latched page_addr exclusively in latches; it is released here. While the records all go
+    // down a single path, a page that cannot split lets go of the latches above it.
+    static vector<pair<uint32_t, uint32_t> > btree_insert_util(string table_file_path, uint32_t page_addr, vector<record_type> &records, size_t begin, size_t end, bool rightmost, latch_set &latches, bool single_path, size_t &duplicates){
+        vector<pair<uint32_t, uint32_t> > splits;
+        uint8_t page[PAGE_SIZE];
+        file_utils::read_page_from_table_file(table_file_path, page_addr / PAGE_SIZE, page);
         
-        // if it's a btree internal page
-        else if(root_page[0] == 0x05){
+        // if it's a btree leaf page
+        if(page[0] == 0x0d){
+            vector<leaf_cell> cells;
+            read_leaf_cells(page, cells);
+            uint32_t right_page_addr;
+            file_utils::page_read(page, 4, right_page_addr);
             
-            // find the branch to recurse on
-            uint32_t branch_addr;
-            uint16_t offset = 0;
-            uint32_t key;
-            int loc = 0;
-            while(loc < number_of_records){
-                file_utils::read_value_within_page(root_page, 8 + 2 * loc, value_string, 0x05);
-                offset = stoi(value_string);
-                file_utils::read_value_within_page(root_page, offset + 4, value_string, 0x06);
-                key = stoi(value_string);
-
-                // advance if key is less than target key, else break
-                if(key >= record_key)
-                    break;
-                ++loc;
-            }
-            if(loc < number_of_records){
-                file_utils::read_value_within_page(root_page, offset, value_string, 0x04);
-                branch_addr = stoi(value_string);
+            // merge the new records in
+            vector<leaf_cell> merged;
+            merged.reserve(cells.size() + end - begin);
+            bool appended_only = true;
+            size_t c = 0;
+            for(size_t r = begin; r < end; r++){
+                while(c < cells.size() && cells[c].first < records[r].first)
+                    merged.push_back(cells[c++]);
+                if((c < cells.size() && cells[c].first == records[r].first) || (merged.size() > 0 && merged.back().first == records[r].first)){
+                    console::out() << "[Error] Record with row_id already exists. Try using UPDATE\n";
+                    duplicates++;
+                    continue;
+                }
+                if(c < cells.size())
+                    appended_only = false;
+                merged.push_back(make_leaf_cell(records[r]));
             }
-            else{
-                file_utils::read_value_within_page(root_page, 4, value_string, 0x06);
-                branch_addr = stoi(value_string);
+            while(c < cells.size())
+                merged.push_back(cells[c++]);
+            if(merged.size() == cells.size()){
+                latches.release(page_addr);
+                return splits;
             }
             
-            // recurse on that branch address
-            pair<uint32_t, uint32_t> return_val = btree_insert_util(table_file_path, branch_addr, record);
-            if(return_val.second == -1)
-                return return_val;
+            // appends to the rightmost leaf keep pages full, anything else splits evenly
+            vector<size_t> group_ends = group_leaf_cells(merged, 1.0);
+            if(group_ends.size() > 1 && !(appended_only && rightmost))
+                group_ends = group_leaf_cells(merged, balanced_leaf_fill(merged));
+            if(single_path && group_ends.size() == 1)
+                latches.release_above(page_addr);
             
-            // check if more nodes can be added
-            if(number_of_records < MAX_NODES_ALLOWED){
-                // add the .first at loc
-                
-                // update existing loc's left pointer
-                uint16_t tmp_offset;
-                if(loc >= number_of_records){
-                    file_utils::add_value_within_page(root_page, 4, to_string(return_val.second), 0x06);
+            // the first run stays in this page, the rest go to new pages chained after it
+            uint32_t next_page_addr = (group_ends.size() > 1) ? file_utils::allocate_pages(table_file_path, group_ends.size() - 1) : 0;
+            size_t start = 0;
+            for(size_t g = 0; g < group_ends.size(); g++){
+                uint32_t right_addr = (g + 1 < group_ends.size()) ? next_page_addr + g * PAGE_SIZE : right_page_addr;
+                write_leaf_cells(page, merged, start, group_ends[g], right_addr);
+                if(g == 0){
+                    file_utils::write_page_to_table_file(table_file_path, page_addr / PAGE_SIZE, page);
                 }
                 else{
-                    file_utils::page_read(root_page, 8 + 2 * loc, tmp_offset);
-                    file_utils::add_value_within_page(root_page, tmp_offset, to_string(return_val.second), 0x06);
+                    file_utils::write_page_to_table_file(table_file_path, (next_page_addr + (g - 1) * PAGE_SIZE) / PAGE_SIZE, page);
+                    splits.push_back(make_pair(merged[start - 1].first, next_page_addr + (g - 1) * PAGE_SIZE));
                 }
-
-                // add the cell for new node
-                ++root_page[1];
-                file_utils::add_value_within_page(root_page, 2, to_string(content_offset - 8), 0x05);
-                file_utils::add_value_within_page(root_page, content_offset - 8, to_string(branch_addr), 0x06);
-                file_utils::add_value_within_page(root_page, content_offset - 4, to_string(return_val.first), 0x06);
-                
-                // shift all the nodes after loc to right and fill loc with (current_offset - 8)
-                for(int i = number_of_records - 1; i >= loc; i--){
-                    memcpy(root_page + 8 + 2 * (i + 1), root_page + 8 + 2 * i, 2);
+                start = group_ends[g];
+            }
+            latches.release(page_addr);
+            return splits;
+        }
+        
+        // if it's a btree internal page
+        else if(page[0] == 0x05){
+            vector<uint32_t> children, keys;
+            read_interior_cells(page, children, keys);
+            
+            // every new right sibling below holds at least one of the records, so this page cannot overflow
+            if(single_path && children.size() + (end - begin) <= MAX_NODES_ALLOWED + 1)
+                latches.release_above(page_addr);
+            
+            // route each run of records to its branch, splicing in the pages the branch split into
+            vector<uint32_t> new_children, new_keys;
+            bool changed = false, appended_only = true;
+            size_t r = begin;
+            for(size_t c = 0; c < children.size(); c++){
+                size_t run_end = r;
+                while(run_end < end && (c == keys.size() || records[run_end].first <= keys[c]))
+                    ++run_end;
+                new_children.push_back(children[c]);
+                if(run_end > r){
+                    latches.acquire(children[c]);
+                    bool child_single_path = single_path && r == begin && run_end == end;
+                    vector<pair<uint32_t, uint32_t> > child_splits = btree_insert_util(table_file_path, children[c], records, r, run_end, rightmost && c == keys.size(), latches, child_single_path, duplicates);
+                    for(size_t i = 0; i < child_splits.size(); i++){
+                        new_keys.push_back(child_splits[i].first);
+                        new_children.push_back(child_splits[i].second);
+                        changed = true;
+                        if(c < keys.size())
+                            appended_only = false;
+                    }
                 }
-                file_utils::add_value_within_page(root_page, 8 + 2 * loc, to_string(content_offset - 8), 0x05);
-                
-                file_utils::write_page_to_table_file(table_file_path, root_page_addr / PAGE_SIZE, root_page);
-                return make_pair(-1, -1);
+                if(c < keys.size())
+                    new_keys.push_back(keys[c]);
+                r = run_end;
             }
-            else{
-                // TODO: split internal node
-                return make_pair(-1, -1);
+            if(!changed){
+                latches.release(page_addr);
+                return splits;
+            }
+            
+            // split the page if it now has too many children
+            size_t per_page = MAX_NODES_ALLOWED + 1;
+            if(!(appended_only && rightmost)){
+                size_t pages = (new_children.size() + per_page - 1) / per_page;
+                per_page = (new_children.size() + pages - 1) / pages;
             }
+            vector<size_t> group_ends = group_interior_children(new_children.size(), per_page);
+            vector<pair<uint32_t, uint32_t> > pages = write_interior_pages(table_file_path, new_children, new_keys, group_ends, page_addr);
+            splits.assign(pages.begin() + 1, pages.end());
+            latches.release(page_addr);
+            return splits;
         }
         
         // if unrecognized btree page
         else{
-            //cout << "Huh? Wait, what? Huh?\n";
-            return make_pair(-1, -1);
+            latches.release(page_addr);
+            return splits;
         }
     }
-
-
-    static void btree_insert(string table_file_path, record_type &record){
-        uint32_t original_root_page_addr;
-        fstream f;
+    
+    
+    // false if the row_id is already in the table
+    static bool btree_insert(string table_file_path, record_type &record){
+        latch_set latches(table_file_path);
+        latches.acquire(ROOT_LATCH);
         string table_root_path = table_file_path;
         table_root_path[table_root_path.size() - 1] = 'r';
-        f.open(table_root_path, ios::in);
-        f >> original_root_page_addr;
-        f.close();
+        uint32_t original_root_page_addr = file_utils::read_root_page_addr(table_root_path);
         
-        pair<uint32_t, int32_t> return_val = btree_insert_util(table_file_path, original_root_page_addr, record);
-        if(return_val.first == -1)
-            return;
-        else{
-            uint32_t root_page_addr = file_utils::append_page_to_table_file(table_file_path, 0x05);
-            uint8_t root_page[PAGE_SIZE];
-            file_utils::read_page_from_table_file(table_file_path, root_page_addr / PAGE_SIZE, root_page);
-            root_page[1] = 1;
-            file_utils::add_value_within_page(root_page, 2, to_string(PAGE_SIZE - 8), 0x05);
-            file_utils::add_value_within_page(root_page, 8, to_string(PAGE_SIZE - 8), 0x05);
-            file_utils::add_value_within_page(root_page, PAGE_SIZE - 8, to_string(original_root_page_addr), 0x06);
-            file_utils::add_value_within_page(root_page, PAGE_SIZE - 4, to_string(return_val.first), 0x06);
-            file_utils::add_value_within_page(root_page, 4, to_string(return_val.second), 0x06);
-            file_utils::write_page_to_table_file(table_file_path, root_page_addr / PAGE_SIZE, root_page);
-            
-            // update root page addr
-            f.open(table_root_path, ios::out);
-            f << root_page_addr;
-            f.close();
+        // increasing row_ids skip the descent
+        if(btree_append(table_file_path, original_root_page_addr, record))
+            return true;
+        
+        vector<record_type> records(1, record);
+        return btree_insert_sorted(table_file_path, original_root_page_addr, records, latches);
+    }
+    
+    
+    // Insert a batch of records, each affected page is modified and written once; false if some row_id was
+    // already in the table, the other records are inserted all the same
+    static bool btree_insert(string table_file_path, vector<record_type> &records){
+        stable_sort(records.begin(), records.end(), comp_record_keys);
+        
+        latch_set latches(table_file_path);
+        latches.acquire(ROOT_LATCH);
+        string table_root_path = table_file_path;
+        table_root_path[table_root_path.size() - 1] = 'r';
+        uint32_t original_root_page_addr = file_utils::read_root_page_addr(table_root_path);
+        return btree_insert_sorted(table_file_path, original_root_page_addr, records, latches);
+    }
+    
+    
+    static bool comp_record_keys(const record_type &r1, const record_type &r2){
+        return (r1.first < r2.first);
+    }
+    
+    
+    // Insert row_id-sorted records from the root, growing the tree if the root splits. latches holds the
+    // ROOT_LATCH, which is let go as soon as the root is known to stay. False if some row_id was already there.
+    static bool btree_insert_sorted(string table_file_path, uint32_t root_page_addr, vector<record_type> &records, latch_set &latches){
+        if(records.size() == 0)
+            return true;
+        latches.acquire(root_page_addr);
+        size_t duplicates = 0;
+        vector<pair<uint32_t, uint32_t> > splits = btree_insert_util(table_file_path, root_page_addr, records, 0, records.size(), true, latches, true, duplicates);
+        if(splits.size() == 0)
+            return duplicates == 0;
+        
+        vector<uint32_t> children(1, root_page_addr), keys;
+        for(size_t i = 0; i < splits.size(); i++){
+            keys.push_back(splits[i].first);
+            children.push_back(splits[i].second);
         }
+        root_page_addr = build_interior_levels(table_file_path, children, keys, MAX_NODES_ALLOWED + 1);
+        
+        // update root page addr
+        string table_root_path = table_file_path;
+        table_root_path[table_root_path.size() - 1] = 'r';
+        file_utils::write_root_page_addr(table_root_path, root_page_addr);
+        return duplicates == 0;
     }
     
 };
@@ -0,0 +1,317 @@
+#ifndef bulk_loader_h
+#define bulk_loader_h
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <queue>
+#include <string>
+#include <cstdio>
+#include "file_utils.h"
+#include "bplus_tree.h"
+using namespace std;
+
+// bytes of rows sorted in memory before a run is spilled to disk
+#ifndef LOAD_RUN_BYTES
+#define LOAD_RUN_BYTES (64 * 1024 * 1024)
+#endif
+
+
+// a sorted source of leaf cells for the merge
+class cell_cursor{
+public:
+    virtual ~cell_cursor(){}
+    
+    // fetch the next cell, false once exhausted
+    virtual bool next(btree_utils::leaf_cell &cell) = 0;
+};
+
+
+// cells of a run that was sorted in memory
+class memory_cursor : public cell_cursor{
+    vector<btree_utils::leaf_cell> &cells;
+    size_t position;
+
+public:
+    memory_cursor(vector<btree_utils::leaf_cell> &c) : cells(c), position(0){}
+    
+    bool next(btree_utils::leaf_cell &cell){
+        if(position >= cells.size())
+            return false;
+        cell.first = cells[position].first;
+        cell.second.swap(cells[position].second);
+        ++position;
+        return true;
+    }
+};
+
+
+// cells of a sorted run spilled to disk, stored back to back as they are laid out in a page
+class run_file_cursor : public cell_cursor{
+    FILE *run_file;
+
+public:
+    run_file_cursor(string run_path){
+        run_file = fopen(run_path.c_str(), "r");
+    }
+    
+    ~run_file_cursor(){
+        if(run_file != NULL)
+            fclose(run_file);
+    }
+    
+    bool next(btree_utils::leaf_cell &cell){
+        uint8_t header[6];
+        if(run_file == NULL || fread(header, sizeof(uint8_t), 6, run_file) != 6)
+            return false;
+        uint16_t payload_size;
+        file_utils::page_read(header, 0, payload_size);
+        file_utils::page_read(header, 2, cell.first);
+        cell.second.resize(payload_size + 6);
+        memcpy(&cell.second[0], header, 6);
+        return fread(&cell.second[6], sizeof(uint8_t), payload_size, run_file) == payload_size;
+    }
+};
+
+
+// cells already in a table, walking its leaf chain
+class table_cursor : public cell_cursor{
+    FILE *table_file;
+    uint8_t leaf_page[PAGE_SIZE];
+    vector<btree_utils::leaf_cell> cells;
+    size_t position;
+    
+    void read_page(uint32_t page_addr){
+        fseek(table_file, page_addr, SEEK_SET);
+        if(fread(leaf_page, sizeof(uint8_t), PAGE_SIZE, table_file) != PAGE_SIZE)
+            leaf_page[0] = 0;
+    }
+
+public:
+    table_cursor(string table_file_path, uint32_t root_page_addr) : position(0){
+        table_file = fopen(table_file_path.c_str(), "r");
+        if(table_file == NULL){
+            leaf_page[0] = 0;
+            return;
+        }
+        
+        // descend to the leftmost leaf
+        read_page(root_page_addr);
+        while(leaf_page[0] == 0x05){
+            vector<uint32_t> children, keys;
+            btree_utils::read_interior_cells(leaf_page, children, keys);
+            read_page(children[0]);
+        }
+        if(leaf_page[0] == 0x0d)
+            btree_utils::read_leaf_cells(leaf_page, cells);
+    }
+    
+    ~table_cursor(){
+        if(table_file != NULL)
+            fclose(table_file);
+    }
+    
+    bool next(btree_utils::leaf_cell &cell){
+        while(position >= cells.size()){
+            if(leaf_page[0] != 0x0d)
+                return false;
+            uint32_t right_page_addr;
+            file_utils::page_read(leaf_page, 4, right_page_addr);
+            if(right_page_addr == 0xffffffff)
+                return false;
+            read_page(right_page_addr);
+            cells.clear();
+            position = 0;
+            if(leaf_page[0] == 0x0d)
+                btree_utils::read_leaf_cells(leaf_page, cells);
+        }
+        cell.first = cells[position].first;
+        cell.second.swap(cells[position].second);
+        ++position;
+        return true;
+    }
+};
+
+
+// Builds a table's b+ tree bottom-up from an unordered stream of records: records are sorted by row_id
+// (spilling sorted runs to disk past the memory budget), merged with the rows already in the table, packed
+// into leaves up to the fill factor and written sequentially, followed by the interior levels.
+class bulk_loader{
+    string table_file_path;
+    double fill_factor;
+    size_t run_bytes_budget;
+    
+    vector<btree_utils::leaf_cell> buffer;      // cells of the run being collected
+    size_t buffered_bytes;
+    vector<string> run_paths;                   // sorted runs spilled so far
+    
+    // leaf level being written
+    FILE *out_file;
+    vector<btree_utils::leaf_cell> page_cells;
+    size_t page_bytes;
+    vector<uint32_t> leaf_addrs;
+    vector<uint32_t> leaf_max_keys;
+    size_t records_written;
+    size_t records_duplicated;
+    
+    
+    static bool comp_cell_keys(const btree_utils::leaf_cell &c1, const btree_utils::leaf_cell &c2){
+        return (c1.first < c2.first);
+    }
+    
+    
+    // sort the buffered cells and write them out as a run
+    void spill_run(){
+        stable_sort(buffer.begin(), buffer.end(), comp_cell_keys);
+        string run_path = table_file_path + ".run" + to_string(run_paths.size());
+        FILE *run_file = fopen(run_path.c_str(), "w");
+        for(size_t i = 0; i < buffer.size(); i++){
+            fwrite(&buffer[i].second[0], sizeof(uint8_t), buffer[i].second.size(), run_file);
+        }
+        fclose(run_file);
+        run_paths.push_back(run_path);
+        buffer.clear();
+        buffered_bytes = 0;
+    }
+    
+    
+    // write the current leaf page, chained to the page written after it unless it is the last one
+    void flush_leaf(bool last_leaf){
+        uint32_t page_addr = (uint32_t) (leaf_addrs.size() * PAGE_SIZE);
+        uint8_t page[PAGE_SIZE];
+        btree_utils::write_leaf_cells(page, page_cells, 0, page_cells.size(), last_leaf ? 0xffffffff : page_addr + PAGE_SIZE);
+        fwrite(page, sizeof(uint8_t), PAGE_SIZE, out_file);
+        leaf_addrs.push_back(page_addr);
+        leaf_max_keys.push_back(page_cells.size() > 0 ? page_cells.back().first : 0);
+        page_cells.clear();
+        page_bytes = 0;
+    }
+    
+    
+    // add the next cell in key order to the leaf level
+    void emit(btree_utils::leaf_cell &cell){
+        if(btree_utils::leaf_page_closes(page_cells.size(), page_bytes, cell.second.size(), fill_factor))
+            flush_leaf(false);
+        page_bytes += cell.second.size();
+        page_cells.push_back(btree_utils::leaf_cell());
+        page_cells.back().first = cell.first;
+        page_cells.back().second.swap(cell.second);
+        ++records_written;
+    }
+    
+    
+    void remove_runs(){
+        for(size_t i = 0; i < run_paths.size(); i++){
+            remove(run_paths[i].c_str());
+        }
+        run_paths.clear();
+    }
+
+
+public:
+    bulk_loader(string table_path, double fill = 1.0, size_t run_bytes = LOAD_RUN_BYTES){
+        table_file_path = table_path;
+        fill_factor = fill;
+        run_bytes_budget = run_bytes;
+        buffered_bytes = 0;
+        out_file = NULL;
+        page_bytes = 0;
+        records_written = 0;
+        records_duplicated = 0;
+    }
+    
+    ~bulk_loader(){
+        remove_runs();
+    }
+    
+    
+    // number of records in the table after finish()
+    size_t records_loaded(){
+        return records_written;
+    }
+    
+    // records left out for a row_id the table already had
+    size_t records_skipped(){
+        return records_duplicated;
+    }
+    
+    
+    // queue a record for loading
+    void add(record_type &record){
+        buffer.push_back(btree_utils::make_leaf_cell(record));
+        buffered_bytes += buffer.back().second.size() + sizeof(btree_utils::leaf_cell);
+        if(buffered_bytes >= run_bytes_budget)
+            spill_run();
+    }
+    
+    
+    // Merge everything into a new table file, swap it in and return the new root page address
+    uint32_t finish(){
+        string table_root_path = table_file_path;
+        table_root_path[table_root_path.size() - 1] = 'r';
+        uint32_t old_root_page_addr = file_utils::read_root_page_addr(table_root_path);
+        
+        // the existing rows come first so that they win over duplicates in the load
+        vector<cell_cursor*> cursors;
+        cursors.push_back(new table_cursor(table_file_path, old_root_page_addr));
+        for(size_t i = 0; i < run_paths.size(); i++){
+            cursors.push_back(new run_file_cursor(run_paths[i]));
+        }
+        stable_sort(buffer.begin(), buffer.end(), comp_cell_keys);
+        cursors.push_back(new memory_cursor(buffer));
+        
+        // k-way merge on (row_id, source)
+        vector<btree_utils::leaf_cell> heads(cursors.size());
+        priority_queue<pair<uint32_t, size_t>, vector<pair<uint32_t, size_t> >, greater<pair<uint32_t, size_t> > > merge_heap;
+        for(size_t i = 0; i < cursors.size(); i++){
+            if(cursors[i]->next(heads[i]))
+                merge_heap.push(make_pair(heads[i].first, i));
+        }
+        
+        string load_file_path = table_file_path + ".load";
+        out_file = fopen(load_file_path.c_str(), "w");
+        bool emitted_any = false;
+        uint32_t last_key = 0;
+        while(!merge_heap.empty()){
+            size_t source = merge_heap.top().second;
+            merge_heap.pop();
+            if(emitted_any && heads[source].first == last_key){
+                console::out() << "[Error] Record with row_id " << last_key << " already exists. Skipped\n";
+                ++records_duplicated;
+            }
+            else{
+                last_key = heads[source].first;
+                emitted_any = true;
+                emit(heads[source]);
+            }
+            if(cursors[source]->next(heads[source]))
+                merge_heap.push(make_pair(heads[source].first, source));
+        }
+        flush_leaf(true);
+        fclose(out_file);
+        out_file = NULL;
+        for(size_t i = 0; i < cursors.size(); i++){
+            delete cursors[i];
+        }
+        remove_runs();
+        buffer.clear();
+        
+        // interior levels over the leaves, then swap the new tree in
+        vector<uint32_t> separators(leaf_max_keys.begin(), leaf_max_keys.end() - 1);
+        size_t per_page = (size_t) (fill_factor * (MAX_NODES_ALLOWED + 1));
+        uint32_t root_page_addr = btree_utils::build_interior_levels(load_file_path, leaf_addrs, separators, per_page);
+        rename(load_file_path.c_str(), table_file_path.c_str());
+        file_utils::forget_table_file(load_file_path);
+        file_utils::forget_table_file(table_file_path);
+        
+        file_utils::write_root_page_addr(table_root_path, root_page_addr);
+        
+        // prime the append path with the new right spine
+        btree_utils::load_right_spine(table_file_path, root_page_addr, btree_utils::append_hint_for(table_file_path));
+        return root_page_addr;
+    }
+};
+
+
+#endif /* bulk_loader_h */
@@ -0,0 +1,22 @@
+#ifndef console_h
+#define console_h
+
+#include <iostream>
+
+
+// Where the engine prints its messages, errors and results: cout, unless the thread running a statement has
+// set a stream of its own, as the library API does to keep the messages of each call from the console.
+class console{
+public:
+    static std::ostream*& stream(){
+        static thread_local std::ostream *thread_stream = &std::cout;
+        return thread_stream;
+    }
+    
+    static std::ostream& out(){
+        return *stream();
+    }
+};
+
+
+#endif /* console_h */
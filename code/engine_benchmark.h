@@ -0,0 +1,357 @@
+#ifndef engine_benchmark_h
+#define engine_benchmark_h
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include "abhisql.h"
+#include "ultralitesql.h"
+#include "console.h"
+using namespace std;
+
+// the table the benchmark creates, fills and drops in the current database
+#ifndef BENCH_TABLE
+#define BENCH_TABLE "bench_rows"
+#endif
+
+// timed calls of each short operation (single-row inserts, point and range selects), at most one per row
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 1000
+#endif
+
+// rows of each multi-row INSERT, and of each range SELECT
+#ifndef BENCH_BATCH_ROWS
+#define BENCH_BATCH_ROWS 100
+#endif
+
+// full scans of each column are repeated until they have read about this many rows, at most 10 times
+#ifndef BENCH_SCAN_ROWS
+#define BENCH_SCAN_ROWS 1000000
+#endif
+
+
+// The timings of one operation at one table size
+struct bench_result{
+    long table_rows;
+    string operation;
+    vector<double> latencies;       // microseconds, one per call
+    size_t rows_affected;           // rows loaded, inserted, returned, updated or deleted by all the calls
+    size_t errors;
+    string first_error;
+    double seconds;
+    
+    bench_result(long rows, string name) : table_rows(rows), operation(name), rows_affected(0), errors(0), seconds(0){}
+};
+
+
+// The rows of a table from one row_id to another, as lines load_table reads, made by make_line as they are
+// read instead of all at once
+class bench_row_source : public streambuf{
+    long next_row_id, last_row_id;
+    void (*make_line)(long, string&);
+    string lines;
+
+protected:
+    int underflow(){
+        if(gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if(next_row_id > last_row_id)
+            return traits_type::eof();
+        lines.clear();
+        for(size_t i = 0; i < 1024 && next_row_id <= last_row_id; i++){
+            make_line(next_row_id++, lines);
+            lines += '\n';
+        }
+        setg(&lines[0], &lines[0], &lines[0] + lines.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    bench_row_source(long first, long last, void (*line_maker)(long, string&) = row_line) : next_row_id(first), last_row_id(last), make_line(line_maker){}
+    
+    // The values of a row, row_id first and then one of each data type, in column order. Every column has a
+    // value repeating every so many rows, so that the filters of the benchmark select about as many rows at
+    // any table size.
+    static void row_values(long row_id, vector<string> &values){
+        char text[64];
+        values.clear();
+        values.push_back(to_string(row_id));
+        values.push_back(to_string(row_id % 100));
+        values.push_back(to_string(row_id % 10000));
+        values.push_back(to_string(row_id % 1000));
+        values.push_back(to_string(row_id * 1000003));
+        snprintf(text, sizeof(text), "%.2f", (row_id % 1000) / 4.0);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "%.3f", (row_id % 100000) / 8.0);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "2018-%02ld-%02ld_%02ld:%02ld:%02ld", row_id % 12 + 1, row_id % 28 + 1, row_id % 24, row_id % 60, row_id / 60 % 60);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "%ld-%02ld-%02ld", 1950 + row_id % 50, row_id % 12 + 1, row_id % 28 + 1);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "row %ld", row_id % 1000);
+        values.push_back(text);
+    }
+    
+    // those values as a line, the text quoted
+    static void row_line(long row_id, string &line){
+        vector<string> values;
+        row_values(row_id, values);
+        for(size_t v = 0; v < values.size(); v++){
+            line += (v == 0) ? "" : ", ";
+            line += (v == values.size() - 1) ? "'" + values[v] + "'" : values[v];
+        }
+    }
+};
+
+
+// End-to-end benchmark of the engine, called directly without the parser: at each table size, a bulk load,
+// single-row and multi-row inserts, point and range selects by row_id, a filtered full scan on a column of
+// each data type, updates and deletes selecting 0.1%, 1% and 10% of the rows, and the drop of the table.
+// The latencies and throughput of each are written as JSON.
+class engine_benchmark{
+    Abhi_sql_engine engine;
+    message_buffer messages;
+    ostream message_stream;
+    vector<bench_result> results;
+    
+    static double microseconds_since(chrono::steady_clock::time_point start){
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / 1e3;
+    }
+    
+    static double percentile(const vector<double> &sorted, double fraction){
+        if(sorted.empty())
+            return 0;
+        return sorted[(size_t) (fraction * (sorted.size() - 1) + 0.5)];
+    }
+    
+    // rows from row_id 1 to last_row_id whose c_int, row_id % 1000, is in [low, high)
+    static size_t rows_with_int(long last_row_id, long low, long high){
+        size_t rows = 0;
+        for(long value = low; value < high; value++){
+            rows += last_row_id / 1000 + ((value != 0 && value <= last_row_id % 1000) ? 1 : 0);
+        }
+        return rows;
+    }
+    
+    static select_statement select_all(const where_condition &cond){
+        select_statement select;
+        select.table_name = BENCH_TABLE;
+        select.cond = cond;
+        select.has_aggregates = false;
+        select.limit = -1;
+        return select;
+    }
+    
+    // time one call of an operation, which gives the rows it affected; the engine's console output is kept
+    // from the screen, and an error printed counts as a failed call
+    template<typename F>
+    void time_call(bench_result &result, F call){
+        messages.clear();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        size_t rows = call();
+        double microseconds = microseconds_since(start);
+        result.latencies.push_back(microseconds);
+        result.seconds += microseconds / 1e6;
+        result.rows_affected += rows;
+        if(messages.error_printed() && result.errors++ == 0)
+            result.first_error = messages.error_message();
+    }
+    
+    void finish(bench_result &result){
+        sort(result.latencies.begin(), result.latencies.end());
+        results.push_back(result);
+        char line[400];
+        snprintf(line, sizeof(line), "%9ld rows  %-20s %6zu calls  p50 %10.1f us  p99 %10.1f us  %10.0f rows/s%s%s\n", result.table_rows, result.operation.c_str(), result.latencies.size(), percentile(result.latencies, 0.50), percentile(result.latencies, 0.99), result.seconds > 0 ? result.rows_affected / result.seconds : 0, result.errors > 0 ? "  first error: " : "", result.first_error.c_str());
+        cerr << line;
+    }
+    
+    bool create_table(){
+        static const char *types[] = {"tinyint", "smallint", "int", "bigint", "real", "double", "datetime", "date", "text"};
+        vector<column_type> columns;
+        for(size_t i = 0; i < 9; i++){
+            column_type column;
+            column.column_name = string("c_") + types[i];
+            column.data_type = types[i];
+            columns.push_back(column);
+        }
+        FILE *table_file = fopen((string("user_data/") + BENCH_TABLE + ".tbl").c_str(), "r");
+        if(table_file){
+            fclose(table_file);
+            engine.drop_table(BENCH_TABLE);
+        }
+        return engine.create_table(BENCH_TABLE, columns);
+    }
+    
+    void run_size(long rows){
+        mt19937_64 random(rows);
+        uniform_int_distribution<long> row_ids(1, rows);
+        size_t samples = min((size_t) rows, (size_t) BENCH_SAMPLES);
+        long next_row_id = rows + 1;
+        
+        bench_result load(rows, "bulk_load");
+        time_call(load, [&](){
+            bench_row_source source(1, rows);
+            istream lines(&source);
+            return engine.load_table(BENCH_TABLE, lines) ? (size_t) rows : 0;
+        });
+        finish(load);
+        
+        bench_result point(rows, "point_select");
+        for(size_t i = 0; i < samples; i++){
+            select_statement select = select_all(where_condition("row_id", 0, to_string(row_ids(random))));
+            time_call(point, [&](){ return engine.query_records(select).size() - 1; });
+        }
+        finish(point);
+        
+        bench_result range(rows, "range_select");
+        for(size_t i = 0; i < samples; i++){
+            long low = row_ids(random);
+            vector<where_condition> bounds;
+            bounds.push_back(where_condition("row_id", 5, to_string(low)));
+            bounds.push_back(where_condition("row_id", 2, to_string(low + BENCH_BATCH_ROWS)));
+            select_statement select = select_all(where_condition(WHERE_AND, bounds));
+            time_call(range, [&](){ return engine.query_records(select).size() - 1; });
+        }
+        finish(range);
+        
+        // comparisons each selecting the row with row_id 7 and those repeating its value, or for datetime the
+        // first two days of the year
+        struct filter{
+            const char *column;
+            uint8_t comp_code;
+            const char *value;
+        };
+        static const filter filters[] = {{"c_tinyint", 0, "7"}, {"c_smallint", 0, "7"}, {"c_int", 0, "7"}, {"c_bigint", 0, "7000021"}, {"c_real", 0, "1.75"}, {"c_double", 0, "0.875"}, {"c_datetime", 2, "2018-01-03_00:00:00"}, {"c_date", 0, "1957-08-08"}, {"c_text", 0, "row 7"}};
+        size_t scans = max((long) 1, min((long) 10, BENCH_SCAN_ROWS / rows));
+        for(size_t f = 0; f < 9; f++){
+            bench_result scan(rows, string("scan_filter_") + (filters[f].column + 2));
+            select_statement select = select_all(where_condition(filters[f].column, filters[f].comp_code, filters[f].value));
+            for(size_t i = 0; i < scans; i++){
+                time_call(scan, [&](){ return engine.query_records(select).size() - 1; });
+            }
+            finish(scan);
+        }
+        
+        bench_result single(rows, "insert_single");
+        vector<string> values, columns;
+        for(size_t i = 0; i < samples; i++){
+            bench_row_source::row_values(next_row_id++, values);
+            time_call(single, [&](){ return engine.insert(BENCH_TABLE, values, columns) ? 1 : 0; });
+        }
+        finish(single);
+        
+        bench_result batch(rows, "insert_batch");
+        vector<vector<string> > batch_values(BENCH_BATCH_ROWS);
+        for(size_t i = 0; i < max(samples / 10, (size_t) 1); i++){
+            for(size_t r = 0; r < batch_values.size(); r++){
+                bench_row_source::row_values(next_row_id++, batch_values[r]);
+            }
+            time_call(batch, [&](){ return engine.insert(BENCH_TABLE, batch_values, columns) ? (size_t) BENCH_BATCH_ROWS : 0; });
+        }
+        finish(batch);
+        
+        // c_int repeats every 1000 rows: the ranges [0, 1), [1, 11) and [11, 111) of it hold 0.1%, 1% and 10%
+        // of them, so the deletes never meet the rows an earlier one took
+        static const char *selectivities[] = {"0.1pct", "1pct", "10pct"};
+        static const long bounds[] = {0, 1, 11, 111};
+        for(size_t s = 0; s < 3; s++){
+            bench_result update(rows, string("update_") + selectivities[s]);
+            size_t selected = rows_with_int(next_row_id - 1, bounds[s], bounds[s + 1]);
+            time_call(update, [&](){
+                vector<where_condition> range;
+                range.push_back(where_condition("c_int", 5, to_string(bounds[s])));
+                range.push_back(where_condition("c_int", 2, to_string(bounds[s + 1])));
+                return engine.update_records(BENCH_TABLE, "c_text", "updated", where_condition(WHERE_AND, range)) ? selected : 0;
+            });
+            finish(update);
+        }
+        for(size_t s = 0; s < 3; s++){
+            bench_result removal(rows, string("delete_") + selectivities[s]);
+            size_t selected = rows_with_int(next_row_id - 1, bounds[s], bounds[s + 1]);
+            time_call(removal, [&](){
+                vector<where_condition> range;
+                range.push_back(where_condition("c_int", 5, to_string(bounds[s])));
+                range.push_back(where_condition("c_int", 2, to_string(bounds[s + 1])));
+                return engine.update_records(BENCH_TABLE, "-", "0", where_condition(WHERE_AND, range), true) ? selected : 0;
+            });
+            finish(removal);
+        }
+        
+        bench_result drop(rows, "drop_table");
+        time_call(drop, [&](){
+            engine.drop_table(BENCH_TABLE);
+            return (size_t) 0;
+        });
+        finish(drop);
+    }
+    
+    static string json_text(const string &text){
+        string quoted = "\"";
+        for(size_t i = 0; i < text.size(); i++){
+            if(text[i] == '"' || text[i] == '\\')
+                quoted += '\\';
+            quoted += text[i];
+        }
+        return quoted + "\"";
+    }
+    
+    void write_json(ostream &json){
+        json << "{\n  \"benchmark\": \"ultralitesql engine\",\n  \"results\": [\n";
+        for(size_t i = 0; i < results.size(); i++){
+            const bench_result &result = results[i];
+            char fields[400];
+            snprintf(fields, sizeof(fields), "\"calls\": %zu, \"rows_affected\": %zu, \"errors\": %zu, \"seconds\": %.6f, \"calls_per_s\": %.1f, \"rows_per_s\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f", result.latencies.size(), result.rows_affected, result.errors, result.seconds, result.seconds > 0 ? result.latencies.size() / result.seconds : 0, result.seconds > 0 ? result.rows_affected / result.seconds : 0, percentile(result.latencies, 0.50), percentile(result.latencies, 0.90), percentile(result.latencies, 0.99), percentile(result.latencies, 0.999), result.latencies.empty() ? 0 : result.latencies.back());
+            json << "    {\"table_rows\": " << result.table_rows << ", \"operation\": " << json_text(result.operation) << ", " << fields << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        json << "  ]\n}\n";
+    }
+
+public:
+    engine_benchmark() : message_stream(&messages){}
+    
+    // Run every operation at each table size, printing a line per operation as it finishes to stderr, then
+    // write the results as JSON to json_path, or to stdout if it is empty
+    bool run(const vector<long> &table_sizes, const string &json_path){
+        FILE *catalog = fopen("catalog/database_tables.tbl", "r");
+        if(!catalog){
+            cout << "[Error] No database here, run ultralitesql install first\n";
+            return false;
+        }
+        fclose(catalog);
+        
+        ostream *console_stream = console::stream();
+        console::stream() = &message_stream;
+        bool created = true;
+        for(size_t i = 0; i < table_sizes.size() && created; i++){
+            created = create_table();
+            if(created)
+                run_size(table_sizes[i]);
+        }
+        console::stream() = console_stream;
+        if(!created){
+            cout << "[Error] Cannot create table " << BENCH_TABLE << ": " << messages.error_message() << "\n";
+            return false;
+        }
+        
+        if(json_path == ""){
+            write_json(cout);
+            return true;
+        }
+        ofstream json(json_path);
+        if(!json.is_open()){
+            cout << "[Error] Cannot write \'" << json_path << "\'\n";
+            return false;
+        }
+        write_json(json);
+        return true;
+    }
+};
+
+
+#endif /* engine_benchmark_h */
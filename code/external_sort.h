@@ -0,0 +1,297 @@
+#ifndef external_sort_h
+#define external_sort_h
+
+#include <vector>
+#include <string>
+#include <queue>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include "file_utils.h"
+#include "thread_pool.h"
+using namespace std;
+
+// bytes of sort entries an ORDER BY keeps in memory before it spills a sorted run to disk
+#ifndef SORT_MEMORY_BYTES
+#define SORT_MEMORY_BYTES (64 * 1024 * 1024)
+#endif
+
+
+// a column of an ORDER BY
+struct sort_column{
+    int ordinal_position;               // 0-based position in the records, -1 for row_id
+    uint8_t data_type;
+    bool descending;
+};
+
+
+// Sort keys normalized to bytes that memcmp orders the way the ORDER BY does. Each column is a NULL marker
+// followed by the value: integers and reals as order-preserving big-endian bit patterns, text and dates as
+// their bytes with 0 escaped and a 0 0 terminator. A descending column has its bytes inverted, marker
+// included, so NULL orders as the smallest value: first for ASC, last for DESC. The row_id closes every key,
+// so keys are unique and equal values keep row_id order.
+class sort_key{
+    static void append_big_endian(string &key, uint64_t bits, size_t bytes){
+        for(size_t i = bytes; i > 0; i--){
+            key += (char) (bits >> (8 * (i - 1)));
+        }
+    }
+    
+    static void append_text(string &key, const string &text){
+        for(size_t i = 0; i < text.size(); i++){
+            key += text[i];
+            if(text[i] == '\0')
+                key += '\xff';
+        }
+        key += '\0';
+        key += '\0';
+    }
+
+public:
+    // the bytes of one column of the key
+    static void append_column(string &key, const sort_column &column, const record_type &record){
+        size_t column_begin = key.size();
+        if(column.ordinal_position == -1){
+            key += '\1';
+            append_big_endian(key, record.first, 4);
+        }
+        else{
+            const pair<uint8_t, string> &value = record.second[column.ordinal_position];
+            if(value.first <= 0x03){
+                key += '\0';
+            }
+            else if(column.data_type >= 0x04 && column.data_type <= 0x07){
+                key += '\1';
+                append_big_endian(key, (uint64_t) strtoll(value.second.c_str(), NULL, 10) ^ (1ull << 63), 8);
+            }
+            else if(column.data_type == 0x08 || column.data_type == 0x09){
+                double real_value = strtod(value.second.c_str(), NULL);
+                uint64_t bits;
+                memcpy(&bits, &real_value, 8);
+                bits = (bits >> 63) ? ~bits : bits ^ (1ull << 63);
+                key += '\1';
+                append_big_endian(key, bits, 8);
+            }
+            else{
+                key += '\1';
+                append_text(key, value.second);
+            }
+        }
+        if(column.descending){
+            for(size_t i = column_begin; i < key.size(); i++){
+                key[i] = ~key[i];
+            }
+        }
+    }
+    
+    static void make(string &key, const vector<sort_column> &columns, const record_type &record){
+        key.clear();
+        for(size_t c = 0; c < columns.size(); c++){
+            append_column(key, columns[c], record);
+        }
+        append_big_endian(key, record.first, 4);
+    }
+};
+
+
+// ORDER BY over rows arriving from several scan threads. A thread packs (key, row) entries into a byte buffer
+// of its own; once the buffer outgrows its share of the memory budget it is sorted and written out as a run.
+// At the end the last buffers are sorted in parallel and all the runs, in memory or on disk, are merged k ways.
+class external_sorter{
+    size_t memory_budget;               // per thread
+    
+    // where an entry [key length 4][row length 4][key][row] starts in the buffer, with the first 8 key bytes
+    // in front so that most comparisons never leave the array
+    struct sort_entry{
+        uint64_t prefix;
+        size_t offset;
+    };
+    
+    struct run_builder{
+        string buffer;
+        vector<sort_entry> entries;
+        vector<FILE*> runs;
+        string key, row;                // scratch for the entry being added
+    };
+    
+    thread_states<run_builder> builders;
+    
+    
+    static bool key_less(const char *k1, uint32_t l1, const char *k2, uint32_t l2){
+        int c = memcmp(k1, k2, min(l1, l2));
+        return c < 0 || (c == 0 && l1 < l2);
+    }
+    
+    static void entry_lengths(const char *entry, uint32_t &key_length, uint32_t &row_length){
+        memcpy(&key_length, entry, 4);
+        memcpy(&row_length, entry + 4, 4);
+    }
+    
+    
+    static void sort_buffer(run_builder &b){
+        const char *base = b.buffer.data();
+        sort(b.entries.begin(), b.entries.end(), [base](const sort_entry &e1, const sort_entry &e2){
+            if(e1.prefix != e2.prefix)
+                return e1.prefix < e2.prefix;
+            uint32_t l1, l2, r;
+            entry_lengths(base + e1.offset, l1, r);
+            entry_lengths(base + e2.offset, l2, r);
+            return key_less(base + e1.offset + 8, l1, base + e2.offset + 8, l2);
+        });
+    }
+    
+    
+    // sort the buffer and write it out as a run
+    static void spill(run_builder &b){
+        sort_buffer(b);
+        FILE *run_file = tmpfile();
+        for(size_t i = 0; i < b.entries.size(); i++){
+            uint32_t key_length, row_length;
+            entry_lengths(b.buffer.data() + b.entries[i].offset, key_length, row_length);
+            fwrite(b.buffer.data() + b.entries[i].offset, sizeof(char), 8 + key_length + row_length, run_file);
+        }
+        b.runs.push_back(run_file);
+        b.buffer.clear();
+        b.entries.clear();
+    }
+    
+    
+    // a sorted run being merged
+    class run_cursor{
+    public:
+        const char *key, *row;
+        uint32_t key_length, row_length;
+        virtual ~run_cursor(){}
+        virtual bool next() = 0;
+    };
+    
+    class buffer_cursor : public run_cursor{
+        run_builder &b;
+        size_t position;
+    public:
+        buffer_cursor(run_builder &builder) : b(builder), position(0){}
+        
+        bool next(){
+            if(position >= b.entries.size())
+                return false;
+            const char *entry = b.buffer.data() + b.entries[position++].offset;
+            entry_lengths(entry, key_length, row_length);
+            key = entry + 8;
+            row = key + key_length;
+            return true;
+        }
+    };
+    
+    class file_cursor : public run_cursor{
+        FILE *run_file;
+        string entry;
+    public:
+        file_cursor(FILE *f) : run_file(f){
+            rewind(run_file);
+        }
+        
+        ~file_cursor(){
+            fclose(run_file);
+        }
+        
+        bool next(){
+            char lengths[8];
+            if(fread(lengths, sizeof(char), 8, run_file) != 8)
+                return false;
+            entry_lengths(lengths, key_length, row_length);
+            entry.resize(key_length + row_length);
+            if(fread(&entry[0], sizeof(char), entry.size(), run_file) != entry.size())
+                return false;
+            key = entry.data();
+            row = key + key_length;
+            return true;
+        }
+    };
+
+public:
+    external_sorter(size_t budget) : memory_budget(budget), builders([]{ return new run_builder(); }){}
+    
+    ~external_sorter(){
+        vector<run_builder*> &all = builders.all();
+        for(size_t i = 0; i < all.size(); i++){
+            for(size_t r = 0; r < all[i]->runs.size(); r++){
+                fclose(all[i]->runs[r]);
+            }
+        }
+    }
+    
+    
+    // the scan is about to visit this many morsels
+    void start(size_t morsels){
+        builders.start(morsels);
+    }
+    
+    
+    // Add a row of a morsel under the key of record, only ever called by the thread scanning that morsel
+    void add(size_t morsel, const vector<sort_column> &columns, const record_type &record, const record_type &row){
+        run_builder &b = builders.of_morsel(morsel);
+        sort_key::make(b.key, columns, record);
+        b.row.clear();
+        file_utils::append_record_bytes(b.row, row);
+        
+        sort_entry e;
+        e.prefix = 0;
+        for(size_t i = 0; i < 8 && i < b.key.size(); i++){
+            e.prefix |= (uint64_t) (uint8_t) b.key[i] << (8 * (7 - i));
+        }
+        e.offset = b.buffer.size();
+        uint32_t key_length = b.key.size(), row_length = b.row.size();
+        b.buffer.append((const char *) &key_length, 4);
+        b.buffer.append((const char *) &row_length, 4);
+        b.buffer += b.key;
+        b.buffer += b.row;
+        b.entries.push_back(e);
+        if(b.buffer.size() + b.entries.size() * sizeof(sort_entry) >= memory_budget)
+            spill(b);
+    }
+    
+    
+    // Hand out the rows in key order
+    void finish(work_stealing_pool &pool, const function<void(record_type&)> &emit){
+        vector<run_builder*> &all = builders.all();
+        pool.run(all.size(), [&](size_t i){
+            sort_buffer(*all[i]);
+        });
+        
+        vector<run_cursor*> cursors;
+        for(size_t i = 0; i < all.size(); i++){
+            cursors.push_back(new buffer_cursor(*all[i]));
+            for(size_t r = 0; r < all[i]->runs.size(); r++){
+                cursors.push_back(new file_cursor(all[i]->runs[r]));
+            }
+            all[i]->runs.clear();
+        }
+        
+        // k-way merge, smallest key on top
+        auto greater_key = [&cursors](size_t c1, size_t c2){
+            return key_less(cursors[c2]->key, cursors[c2]->key_length, cursors[c1]->key, cursors[c1]->key_length);
+        };
+        priority_queue<size_t, vector<size_t>, decltype(greater_key)> merge_heap(greater_key);
+        for(size_t c = 0; c < cursors.size(); c++){
+            if(cursors[c]->next())
+                merge_heap.push(c);
+        }
+        record_type row;
+        while(!merge_heap.empty()){
+            size_t c = merge_heap.top();
+            merge_heap.pop();
+            file_utils::read_record_bytes(cursors[c]->row, row);
+            emit(row);
+            if(cursors[c]->next())
+                merge_heap.push(c);
+        }
+        for(size_t c = 0; c < cursors.size(); c++){
+            delete cursors[c];
+        }
+    }
+};
+
+
+#endif /* external_sort_h */
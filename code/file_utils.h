@@ -2,9 +2,19 @@
 #define file_utils_h
 #include <iostream>
 #include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <fstream>
 #include <sstream>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
 #include <time.h>
+#include "console.h"
+#include "latches.h"
+#include "query_profile.h"
 
 #define PAGE_SIZE 512
 
@@ -14,6 +24,49 @@ class file_utils{
     
 public:
     
+    // Pages and table roots written since BEGIN by a transaction. They stay in memory, are served back to the
+    // reads of the same transaction and reach the files only at COMMIT.
+    struct transaction_state{
+        bool active;
+        std::map<std::string, std::map<uint32_t, std::vector<uint8_t> > > dirty_pages;     // by table file, then page number
+        std::map<std::string, uint32_t> root_page_addrs;                                 // by .tbr path
+        std::set<std::string> gated_tables;                                              // table files whose write gate it holds
+        transaction_state() : active(false){}
+    };
+    
+    // the transaction of the statements this thread runs: the thread's own, unless a transaction_scope has put
+    // a connection's in its place
+    static transaction_state*& current_transaction(){
+        static thread_local transaction_state own_state;
+        static thread_local transaction_state *state = &own_state;
+        return state;
+    }
+    
+    static transaction_state& transaction(){
+        return *current_transaction();
+    }
+    
+    // start buffering page writes
+    static bool begin_transaction();
+    
+    // write all the buffered pages and roots, one pass per file, counting the pages written; false if a table
+    // file could not be written
+    static bool commit_transaction(size_t &pages_written);
+    
+    // drop all the buffered pages and roots
+    static void rollback_transaction();
+    
+    // give back the write gates a transaction holds
+    static void release_write_gates(transaction_state &txn);
+    
+    
+    // root page address of a table, as stored in its .tbr file
+    static uint32_t read_root_page_addr(std::string table_root_path);
+    
+    // update the root page address of a table
+    static void write_root_page_addr(std::string table_root_path, uint32_t root_page_addr);
+    
+    
     // is big endian
     static bool is_big_endian();
     
@@ -28,30 +81,87 @@ public:
     static const uint8_t* byte_pattern(T value, size_t total_bytes);
     
     
+    // initialize an empty page in place
+    static void init_page(uint8_t *page, uint8_t btree_node_type = 0x0d){
+        memset(page, 0, PAGE_SIZE);
+        page[0] = btree_node_type;
+        memcpy(page + 2, file_utils::byte_pattern(512, 2), 2);
+        memcpy(page + 4, file_utils::byte_pattern(0xffffffff, 4), 4);
+    }
+    
+    
     // create, initialize and return a new page
     static uint8_t* create_new_page(uint8_t btree_node_type = 0x0d){
         uint8_t* new_page = new uint8_t[PAGE_SIZE];
-        memset(new_page, 0, PAGE_SIZE);
-        new_page[0] = btree_node_type;
-        memcpy(new_page + 2, file_utils::byte_pattern(512, 2), 2);
-        memcpy(new_page + 4, file_utils::byte_pattern(0xffffffff, 4), 4);
+        init_page(new_page, btree_node_type);
         return new_page;
     }
     
     
+    // size of the table file in bytes
+    static uint32_t table_file_size(std::string table_file_path){
+        FILE* table_file = fopen(table_file_path.c_str(), "r");
+        if(table_file == NULL)
+            return 0;
+        fseek(table_file, 0, SEEK_END);
+        uint32_t file_size = (uint32_t) ftell(table_file);
+        fclose(table_file);
+        return file_size;
+    }
+    
+    
+    // Reserve count consecutive pages at the end of the table file and return the address of the first.
+    // Writers on other pages may be extending the same file, so every new page address comes from here.
+    static uint32_t allocate_pages(std::string table_file_path, size_t count = 1){
+        std::lock_guard<std::mutex> guard(allocation_mutex());
+        std::unordered_map<std::string, uint32_t> &next_page_addrs = next_page_addresses();
+        if(next_page_addrs.find(table_file_path) == next_page_addrs.end())
+            next_page_addrs[table_file_path] = table_file_size(table_file_path);
+        uint32_t page_addr = next_page_addrs[table_file_path];
+        next_page_addrs[table_file_path] += count * PAGE_SIZE;
+        return page_addr;
+    }
+    
+    
+    // forget the allocation state of a table file that was removed, replaced or rolled back
+    static void forget_table_file(std::string table_file_path){
+        std::lock_guard<std::mutex> guard(allocation_mutex());
+        next_page_addresses().erase(table_file_path);
+        write_states()[table_file_path].version++;
+    }
+    
+    
+    // Version of the pages of a table file, changed by every write to them. What is worked out from the pages
+    // holds as long as the version stays the same; stable is false while a write is under way.
+    static uint64_t table_file_version(std::string table_file_path, bool &stable){
+        std::lock_guard<std::mutex> guard(allocation_mutex());
+        file_write_state &state = write_states()[table_file_path];
+        stable = (state.writers == 0);
+        return state.version;
+    }
+    
+    // writes of pages to a table file are bracketed by these
+    static void begin_file_write(std::string table_file_path){
+        std::lock_guard<std::mutex> guard(allocation_mutex());
+        file_write_state &state = write_states()[table_file_path];
+        state.writers++;
+        state.version++;
+    }
+    
+    static void end_file_write(std::string table_file_path){
+        std::lock_guard<std::mutex> guard(allocation_mutex());
+        file_write_state &state = write_states()[table_file_path];
+        state.writers--;
+        state.version++;
+    }
+    
+    
     // returns the page address of the newly added page
     static uint32_t append_page_to_table_file(std::string table_file_path, uint8_t btree_node_type = 0x0d){
-        // obtain a pointer to a freshly created page
-        uint8_t* new_page = create_new_page(btree_node_type);
-        
-        // seek to the end of the existing table file
-        FILE* table_file = fopen(table_file_path.c_str(), "a");
-        
-        // append the new page to the end of this file
-        uint32_t new_page_addr = (uint32_t) ftell(table_file);
-        fwrite(new_page, sizeof(uint8_t), PAGE_SIZE, table_file);
-        fclose(table_file);
-        return new_page_addr;
+        // a freshly initialized page
+        uint8_t new_page[PAGE_SIZE];
+        init_page(new_page, btree_node_type);
+        return append_page_to_table_file(table_file_path, (const uint8_t*) new_page);
     }
     
     
@@ -61,8 +171,8 @@ public:
     // write an entire page to the file
     static void write_page_to_table_file(std::string table_file_path, int page_number, const uint8_t *page);
     
-    // append an entire page to the file
-    static void append_page_to_table_file(std::string table_file_path, const uint8_t *page);
+    // append an entire page to the file, returns its address
+    static uint32_t append_page_to_table_file(std::string table_file_path, const uint8_t *page);
 
     
     
@@ -73,6 +183,21 @@ public:
     // add a record to a page
     static int add_record_to_page(uint8_t *table_leaf_page, std::pair<uint32_t, std::vector<std::pair<uint8_t, std::string> > > record);
     
+    // read all the records of a leaf page, in row_id order
+    static void read_records_from_page(uint8_t *table_leaf_page, std::vector<record_type> &records);
+    
+    // append a record to a byte buffer as it is held in memory, values as their strings
+    static void append_record_bytes(std::string &buffer, const record_type &record);
+    
+    // read back a record written by append_record_bytes, returns the bytes it took
+    static size_t read_record_bytes(const char *bytes, record_type &record);
+    
+    // write a record to a spill file in the format of append_record_bytes
+    static void write_record_to_file(FILE *spill_file, const record_type &record);
+    
+    // read back a record written by write_record_to_file, false at the end of the file
+    static bool read_record_from_file(FILE *spill_file, record_type &record);
+    
     
     
     // remove a record from a page
@@ -125,18 +250,44 @@ public:
         return (v1.first < v2.first);
     }
     
+private:
+    
+    static std::mutex& allocation_mutex(){
+        static std::mutex allocation_lock;
+        return allocation_lock;
+    }
+    
+    // address the next page of each table file will get
+    static std::unordered_map<std::string, uint32_t>& next_page_addresses(){
+        static std::unordered_map<std::string, uint32_t> next_page_addrs;
+        return next_page_addrs;
+    }
+    
+    struct file_write_state{
+        uint64_t version;
+        int writers;                    // writes under way
+        file_write_state() : version(0), writers(0){}
+    };
+    
+    static std::unordered_map<std::string, file_write_state>& write_states(){
+        static std::unordered_map<std::string, file_write_state> states;
+        return states;
+    }
+    
 };
 
 
 
 template <typename T>
 const uint8_t* file_utils::byte_pattern(T value, size_t total_bytes){
-    std::unique_ptr<uint8_t> bytes_arr (new uint8_t[total_bytes]);
-    *((T *) bytes_arr.get()) = value;
+    // per-thread scratch, valid until the next call on the same thread
+    static thread_local uint8_t bytes_arr[8];
+    memset(bytes_arr, 0, 8);
+    memcpy(bytes_arr, &value, sizeof(T));
     if(!is_big_endian()){
-        std::reverse(bytes_arr.get(), bytes_arr.get() + total_bytes);
+        std::reverse(bytes_arr, bytes_arr + total_bytes);
     }
-    return bytes_arr.get();
+    return bytes_arr;
 }
 
 
@@ -224,62 +375,176 @@ uint16_t file_utils::size_of_type_code(uint8_t type_code){
 }
 
 
+// Start a transaction; it takes the write gate of each table as it first writes it
+bool file_utils::begin_transaction(){
+    transaction_state &txn = transaction();
+    if(txn.active)
+        return false;
+    txn.active = true;
+    return true;
+}
+
+
+// Flush the pages of the transaction, each file opened once with its pages written in order, then the roots.
+// Readers keep going meanwhile, the pages of a file are latched while it is written.
+bool file_utils::commit_transaction(size_t &pages_written){
+    transaction_state &txn = transaction();
+    txn.active = false;
+    
+    bool written = true;
+    pages_written = 0;
+    std::map<std::string, std::map<uint32_t, std::vector<uint8_t> > >::iterator file_it;
+    for(file_it = txn.dirty_pages.begin(); file_it != txn.dirty_pages.end(); ++file_it){
+        FILE *table_file = fopen(file_it->first.c_str(), "r+");
+        if(table_file == NULL){
+            console::out() << "[Error] Cannot write to table file " << file_it->first << "\n";
+            written = false;
+            continue;
+        }
+        begin_file_write(file_it->first);
+        latch_set latches(file_it->first);
+        std::map<uint32_t, std::vector<uint8_t> >::iterator page_it;
+        for(page_it = file_it->second.begin(); page_it != file_it->second.end(); ++page_it){
+            latches.acquire(page_it->first * PAGE_SIZE);
+            fseek(table_file, page_it->first * PAGE_SIZE, SEEK_SET);
+            fwrite(&page_it->second[0], sizeof(uint8_t), PAGE_SIZE, table_file);
+            ++pages_written;
+        }
+        fclose(table_file);
+        latches.release_all();
+        end_file_write(file_it->first);
+    }
+    
+    std::map<std::string, uint32_t>::iterator root_it;
+    for(root_it = txn.root_page_addrs.begin(); root_it != txn.root_page_addrs.end(); ++root_it){
+        std::string table_file_path = root_it->first;
+        table_file_path[table_file_path.size() - 1] = 'l';
+        exclusive_latch root_latch(table_file_path, ROOT_LATCH);
+        write_root_page_addr(root_it->first, root_it->second);
+    }
+    
+    txn.dirty_pages.clear();
+    txn.root_page_addrs.clear();
+    release_write_gates(txn);
+    return written;
+}
+
+
+// Forget the pages of the transaction, the files still hold the state from before BEGIN
+void file_utils::rollback_transaction(){
+    transaction_state &txn = transaction();
+    txn.active = false;
+    
+    // no other writer touched these tables meanwhile, so the pages this transaction allocated are the last ones handed out
+    std::map<std::string, std::map<uint32_t, std::vector<uint8_t> > >::iterator file_it;
+    for(file_it = txn.dirty_pages.begin(); file_it != txn.dirty_pages.end(); ++file_it){
+        forget_table_file(file_it->first);
+    }
+    txn.dirty_pages.clear();
+    txn.root_page_addrs.clear();
+    release_write_gates(txn);
+}
+
+
+// let the other writers at the tables of a transaction that ended
+void file_utils::release_write_gates(transaction_state &txn){
+    std::set<std::string>::iterator table_it;
+    for(table_it = txn.gated_tables.begin(); table_it != txn.gated_tables.end(); ++table_it){
+        write_gates::give_back(*table_it);
+    }
+    txn.gated_tables.clear();
+}
+
+
+// callers hold the table's ROOT_LATCH
+uint32_t file_utils::read_root_page_addr(std::string table_root_path){
+    transaction_state &txn = transaction();
+    if(txn.active && txn.root_page_addrs.find(table_root_path) != txn.root_page_addrs.end())
+        return txn.root_page_addrs[table_root_path];
+    uint32_t root_page_addr = 0;
+    std::fstream f;
+    f.open(table_root_path, std::ios::in);
+    f >> root_page_addr;
+    f.close();
+    return root_page_addr;
+}
+
+
+void file_utils::write_root_page_addr(std::string table_root_path, uint32_t root_page_addr){
+    transaction_state &txn = transaction();
+    if(txn.active){
+        txn.root_page_addrs[table_root_path] = root_page_addr;
+        return;
+    }
+    std::fstream f;
+    f.open(table_root_path, std::ios::out);
+    f << root_page_addr;
+    f.close();
+}
+
+
 // Read an entire page from the table file, given the page number
 void file_utils::read_page_from_table_file(std::string table_file_path, int page_number, uint8_t *page){
+    // pages written in the open transaction are read back from memory
+    transaction_state &txn = transaction();
+    if(txn.active){
+        std::map<std::string, std::map<uint32_t, std::vector<uint8_t> > >::iterator file_it = txn.dirty_pages.find(table_file_path);
+        if(file_it != txn.dirty_pages.end()){
+            std::map<uint32_t, std::vector<uint8_t> >::iterator page_it = file_it->second.find(page_number);
+            if(page_it != file_it->second.end()){
+                memcpy(page, &page_it->second[0], PAGE_SIZE);
+                query_profile::count_page(true);
+                return;
+            }
+        }
+    }
+    
     FILE *table_file = fopen(table_file_path.c_str(), "r");
     fseek(table_file, page_number * PAGE_SIZE, SEEK_SET);
     fread(page, sizeof(uint8_t), PAGE_SIZE, table_file);
     fclose(table_file);
+    query_profile::count_page(false);
 }
 
 
-void file_utils::append_page_to_table_file(std::string table_file_path, const uint8_t* page){
-    FILE* table_file = fopen(table_file_path.c_str(), "a");
+uint32_t file_utils::append_page_to_table_file(std::string table_file_path, const uint8_t* page){
+    uint32_t page_addr = allocate_pages(table_file_path);
+    transaction_state &txn = transaction();
+    if(txn.active){
+        txn.dirty_pages[table_file_path][page_addr / PAGE_SIZE].assign(page, page + PAGE_SIZE);
+        return page_addr;
+    }
+    
+    // the file is created along with its first page
+    FILE* table_file = fopen(table_file_path.c_str(), "r+");
+    if(table_file == NULL)
+        table_file = fopen(table_file_path.c_str(), "w");
+    begin_file_write(table_file_path);
+    fseek(table_file, page_addr, SEEK_SET);
     fwrite(page, sizeof(uint8_t), PAGE_SIZE, table_file);
     fclose(table_file);
+    end_file_write(table_file_path);
+    return page_addr;
 }
 
 
 // Write an entire page to the table file, given the page number
 void file_utils::write_page_to_table_file(std::string table_file_path, int page_number, const uint8_t *page){
-    uint8_t tmp_page[PAGE_SIZE];
-    FILE *table_file = fopen(table_file_path.c_str(), "r");
-    
-    // copy former data
-    size_t read_pages = 0;
-    while(read_pages < page_number){
-        fread(tmp_page, sizeof(uint8_t), PAGE_SIZE, table_file);
-        append_page_to_table_file("tmp_file1", tmp_page);
-        ++read_pages;
+    transaction_state &txn = transaction();
+    if(txn.active){
+        txn.dirty_pages[table_file_path][page_number].assign(page, page + PAGE_SIZE);
+        return;
     }
     
-    // skip the desired page
-    fread(tmp_page, sizeof(uint8_t), PAGE_SIZE, table_file);
-    
-    // copy latter data
-    while(fread(tmp_page, sizeof(uint8_t), PAGE_SIZE, table_file) == PAGE_SIZE){
-        append_page_to_table_file("tmp_file2", tmp_page);
-    }
-    fclose(table_file);
-    
-    
-    table_file = fopen(table_file_path.c_str(), "w");
-    // write former data
-    FILE* former_file = fopen("tmp_file1", "r");
-    while(former_file != NULL && fread(tmp_page, sizeof(uint8_t), PAGE_SIZE, former_file) == PAGE_SIZE){
-        fwrite(tmp_page, sizeof(uint8_t), PAGE_SIZE, table_file);
-    }
-    fclose(former_file);
+    // overwrite the page in place
+    FILE *table_file = fopen(table_file_path.c_str(), "r+");
+    if(table_file == NULL)
+        return;
+    begin_file_write(table_file_path);
+    fseek(table_file, page_number * PAGE_SIZE, SEEK_SET);
     fwrite(page, sizeof(uint8_t), PAGE_SIZE, table_file);
-    FILE* latter_file = fopen("tmp_file2", "r");
-    while(latter_file != NULL && fread(tmp_page, sizeof(uint8_t), PAGE_SIZE, latter_file) == PAGE_SIZE){
-        fwrite(tmp_page, sizeof(uint8_t), PAGE_SIZE, table_file);
-    }
-    fclose(latter_file);
     fclose(table_file);
-    
-    system("rm -f tmp_file1");
-    system("rm -f tmp_file2");
+    end_file_write(table_file_path);
 }
 
 
@@ -306,7 +571,7 @@ int file_utils::add_record_to_page(uint8_t *table_leaf_page, std::pair<uint32_t,
         
         // return code 2 if key already exists
         if(key == record.first){
-            std::cout << "[Error] Record with row_id already exists. Try using UPDATE\n";
+            console::out() << "[Error] Record with row_id already exists. Try using UPDATE\n";
             return 2;
         }
     }
@@ -354,6 +619,102 @@ int file_utils::add_record_to_page(uint8_t *table_leaf_page, std::pair<uint32_t,
 }
 
 
+// Read all the records of a leaf page
+void file_utils::read_records_from_page(uint8_t *table_leaf_page, std::vector<record_type> &records){
+    // total records in the page
+    uint8_t records_in_page;
+    page_read(table_leaf_page, 1, records_in_page);
+    
+    // for each record
+    size_t bytes_decoded = 0;
+    for(int i = 0; i < records_in_page; i++){
+        // obtain offset within the page of that record
+        uint16_t addr;
+        page_read(table_leaf_page, 8 + 2 * i, addr);
+        
+        // obtain 4 byte row_id
+        uint32_t row_id;
+        page_read(table_leaf_page, addr + 2, row_id);
+        
+        // obtain number of columns in the record
+        uint8_t tot_columns;
+        page_read(table_leaf_page, addr + 6, tot_columns);
+        
+        // Read values for all the columns, their type codes come first
+        record_type record;
+        record.first = row_id;
+        record.second.resize(tot_columns);
+        size_t offset = addr + 7 + tot_columns;
+        for(int j = 0; j < tot_columns; j++){
+            record.second[j].first = table_leaf_page[addr + 7 + j];
+            offset = read_value_within_page(table_leaf_page, offset, record.second[j].second, record.second[j].first);
+        }
+        bytes_decoded += offset - addr;
+        records.push_back(record);
+    }
+    query_profile::count_bytes(bytes_decoded);
+}
+
+
+// Append a record to a byte buffer: row_id, column count, then (type code, length, value string) per column
+void file_utils::append_record_bytes(std::string &buffer, const record_type &record){
+    buffer.append((const char *) byte_pattern(record.first, 4), 4);
+    buffer += (char) record.second.size();
+    for(size_t i = 0; i < record.second.size(); i++){
+        buffer += (char) record.second[i].first;
+        buffer.append((const char *) byte_pattern((uint16_t) record.second[i].second.size(), 2), 2);
+        buffer += record.second[i].second;
+    }
+}
+
+
+// Read back a record written by append_record_bytes
+size_t file_utils::read_record_bytes(const char *bytes, record_type &record){
+    uint8_t *data = (uint8_t *) bytes;
+    size_t offset = page_read(data, 0, record.first);
+    record.second.resize(data[offset++]);
+    for(size_t i = 0; i < record.second.size(); i++){
+        uint16_t value_size;
+        record.second[i].first = data[offset];
+        offset = page_read(data, offset + 1, value_size);
+        record.second[i].second.assign(bytes + offset, value_size);
+        offset += value_size;
+    }
+    return offset;
+}
+
+
+// Write a record to a spill file
+void file_utils::write_record_to_file(FILE *spill_file, const record_type &record){
+    static thread_local std::string buffer;
+    buffer.clear();
+    append_record_bytes(buffer, record);
+    fwrite(buffer.data(), sizeof(char), buffer.size(), spill_file);
+}
+
+
+// Read back a record written by write_record_to_file
+bool file_utils::read_record_from_file(FILE *spill_file, record_type &record){
+    uint8_t header[5];
+    if(fread(header, sizeof(uint8_t), 5, spill_file) != 5)
+        return false;
+    page_read(header, 0, record.first);
+    record.second.resize(header[4]);
+    for(size_t i = 0; i < record.second.size(); i++){
+        uint8_t value_header[3];
+        if(fread(value_header, sizeof(uint8_t), 3, spill_file) != 3)
+            return false;
+        uint16_t value_size;
+        page_read(value_header, 1, value_size);
+        record.second[i].first = value_header[0];
+        record.second[i].second.resize(value_size);
+        if(value_size > 0 && fread(&record.second[i].second[0], sizeof(char), value_size, spill_file) != value_size)
+            return false;
+    }
+    return true;
+}
+
+
 size_t file_utils::add_value_within_page(uint8_t *page, size_t offset, std::string data_string, uint8_t type_code){
     switch(type_code){
         case 0x00:{
@@ -537,7 +898,8 @@ size_t file_utils::read_value_within_page(uint8_t *page, size_t offset, std::str
             page_read(page, offset, value);
             time_t time_value = value;
             char str_data[19];
-            strftime(str_data, 19, "%Y-%m-%d_%H:%M:%S", localtime(&time_value));
+            struct tm time_parts;
+            strftime(str_data, 19, "%Y-%m-%d_%H:%M:%S", localtime_r(&time_value, &time_parts));
             data_string = std::string(str_data, 19);
             return offset + 8;
         }
@@ -546,7 +908,8 @@ size_t file_utils::read_value_within_page(uint8_t *page, size_t offset, std::str
             page_read(page, offset, value);
             time_t time_value = value;
             char str_data[10];
-            strftime(str_data, 10, "%Y-%m-%d", localtime(&time_value));
+            struct tm time_parts;
+            strftime(str_data, 10, "%Y-%m-%d", localtime_r(&time_value, &time_parts));
             data_string = std::string(str_data, 10);
             return offset + 8;
         }
@@ -562,4 +925,52 @@ size_t file_utils::read_value_within_page(uint8_t *page, size_t offset, std::str
 
 
 
+// Runs the statements of this thread in a given transaction while it lives, so that a connection keeps its
+// transaction whichever thread serves it
+class transaction_scope{
+    file_utils::transaction_state *previous;
+
+public:
+    transaction_scope(file_utils::transaction_state &state){
+        previous = file_utils::current_transaction();
+        file_utils::current_transaction() = &state;
+    }
+    
+    ~transaction_scope(){
+        file_utils::current_transaction() = previous;
+    }
+};
+
+
+// A statement writing a table. Outside a transaction it shares the table's write gate while it runs; inside one
+// the transaction takes the gate for itself the first time and keeps it until COMMIT or ROLLBACK.
+class write_gate{
+    std::string table_file_path;
+    bool shared;
+    bool held;
+
+public:
+    write_gate(const std::string &path) : table_file_path(path), shared(false), held(true){
+        file_utils::transaction_state &txn = file_utils::transaction();
+        if(!txn.active)
+            held = shared = write_gates::enter(table_file_path);
+        else if(txn.gated_tables.count(table_file_path) == 0){
+            held = write_gates::take(table_file_path, &txn);
+            if(held)
+                txn.gated_tables.insert(table_file_path);
+        }
+    }
+    
+    ~write_gate(){
+        if(shared)
+            write_gates::leave(table_file_path);
+    }
+    
+    // false if another transaction kept the table, then the statement must not write it
+    bool entered() const{
+        return held;
+    }
+};
+
+
 #endif /* file_utils_h */
@@ -0,0 +1,313 @@
+#ifndef hash_aggregate_h
+#define hash_aggregate_h
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include "file_utils.h"
+#include "aggregates.h"
+#include "thread_pool.h"
+using namespace std;
+
+// bytes of groups a GROUP BY keeps in memory before rows of new groups spill to disk
+#ifndef GROUP_BY_MEMORY_BYTES
+#define GROUP_BY_MEMORY_BYTES (64 * 1024 * 1024)
+#endif
+
+#define GROUP_BY_PARTITION_BITS 4       // spilled rows are split 16 ways at every level
+#define GROUP_BY_MAX_LEVELS 8           // a partition this deep is aggregated in memory whatever its size
+
+
+// FNV-1a over the bytes of a key, with the high bits mixed down so that both ends of the hash can be used
+inline uint64_t hash_bytes(const char *bytes, size_t length){
+    uint64_t h = 14695981039346656037ull;
+    for(size_t i = 0; i < length; i++){
+        h = (h ^ (uint8_t) bytes[i]) * 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+
+// Open-addressing hash table from group keys to the aggregate states of the group. A slot holds only the
+// group number; key bytes and the text of the states live in an arena, the states of all groups in one flat
+// array.
+class group_table{
+    size_t states_per_group;
+    vector<uint32_t> slots;                             // group number + 1, 0 for an empty slot
+    vector<uint64_t> group_hashes;
+    vector<pair<const char*, uint32_t> > group_keys;
+    vector<aggregate_state> states;                     // states_per_group per group, group after group
+    byte_arena arena;
+    
+    
+    // double the slots (1024 to start with), keeping the load factor under 0.7
+    void grow(){
+        vector<uint32_t> new_slots(max((size_t) 1024, 2 * slots.size()), 0);
+        size_t mask = new_slots.size() - 1;
+        for(size_t g = 0; g < group_hashes.size(); g++){
+            size_t i = group_hashes[g] & mask;
+            while(new_slots[i] != 0){
+                i = (i + 1) & mask;
+            }
+            new_slots[i] = g + 1;
+        }
+        slots.swap(new_slots);
+    }
+
+public:
+    group_table(size_t per_group) : states_per_group(per_group){
+        grow();
+    }
+    
+    
+    size_t size(){
+        return group_hashes.size();
+    }
+    
+    
+    // bytes held by the table
+    size_t memory_bytes(){
+        return slots.size() * sizeof(uint32_t) + group_hashes.capacity() * sizeof(uint64_t)
+            + group_keys.capacity() * sizeof(pair<const char*, uint32_t>) + states.capacity() * sizeof(aggregate_state) + arena.bytes();
+    }
+    
+    
+    // Group number of a key; an absent key gets a new group if create is set, -1 otherwise
+    long find(const char *key, size_t length, uint64_t hash, bool create){
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while(slots[i] != 0){
+            size_t g = slots[i] - 1;
+            if(group_hashes[g] == hash && group_keys[g].second == length && memcmp(group_keys[g].first, key, length) == 0)
+                return g;
+            i = (i + 1) & mask;
+        }
+        if(!create)
+            return -1;
+        
+        size_t g = group_hashes.size();
+        slots[i] = g + 1;
+        group_hashes.push_back(hash);
+        group_keys.push_back(make_pair(arena.copy(key, length), (uint32_t) length));
+        states.resize(states.size() + states_per_group);
+        if(10 * group_hashes.size() > 7 * slots.size())
+            grow();
+        return g;
+    }
+    
+    
+    aggregate_state* group_states(size_t g){
+        return &states[g * states_per_group];
+    }
+    
+    byte_arena& group_arena(){
+        return arena;
+    }
+    
+    uint64_t group_hash(size_t g){
+        return group_hashes[g];
+    }
+    
+    const char* key_bytes(size_t g){
+        return group_keys[g].first;
+    }
+    
+    size_t key_length(size_t g){
+        return group_keys[g].second;
+    }
+    
+    
+    // drop every group and give the memory back
+    void clear(){
+        slots.clear();
+        vector<uint64_t>().swap(group_hashes);
+        vector<pair<const char*, uint32_t> >().swap(group_keys);
+        vector<aggregate_state>().swap(states);
+        arena.clear();
+        grow();
+    }
+};
+
+
+// GROUP BY on one column. Scan threads fold rows into group tables of their own. Once a thread's table
+// outgrows its share of the memory budget, rows of groups it does not hold spill to partition files by hash.
+// At the end each partition is aggregated on its own, in parallel, repartitioning whatever still does not fit.
+class hash_aggregator{
+    const vector<aggregate_spec> &specs;
+    int group_position;                 // 0-based position of the group column, -1 for row_id
+    uint8_t group_type;
+    size_t memory_budget;               // per group table
+    
+    // what a scan thread aggregated
+    struct partial{
+        group_table table;
+        vector<FILE*> spills;           // rows spilled per partition
+        string key;                     // scratch for the key of the current row
+        partial(size_t states_per_group) : table(states_per_group), spills((size_t) 1 << GROUP_BY_PARTITION_BITS, (FILE*) NULL){}
+    };
+    
+    thread_states<partial> partials;
+    
+    
+    // partitions take their bits from the top of the hash, table slots from the bottom
+    static size_t partition_of(uint64_t hash, int level){
+        return (hash >> (64 - GROUP_BY_PARTITION_BITS * (level + 1))) & (((size_t) 1 << GROUP_BY_PARTITION_BITS) - 1);
+    }
+    
+    
+    // key of the group of a record: one 0 byte for NULL, otherwise 1 followed by the value
+    void group_key(const record_type &record, string &key){
+        key.clear();
+        if(group_position == -1){
+            key += '\1';
+            key += to_string(record.first);
+            return;
+        }
+        const pair<uint8_t, string> &value = record.second[group_position];
+        if(value.first <= 0x03){
+            key += '\0';
+            return;
+        }
+        key += '\1';
+        key += value.second;
+    }
+    
+    
+    // Fold a record into the table, or spill it by its hash at level if its group is new and the table is full
+    void add_to(group_table &table, vector<FILE*> &spills, int level, const record_type &record, string &key){
+        group_key(record, key);
+        uint64_t hash = hash_bytes(key.data(), key.size());
+        bool full = (level < GROUP_BY_MAX_LEVELS && table.memory_bytes() >= memory_budget);
+        long g = table.find(key.data(), key.size(), hash, !full);
+        if(g == -1){
+            size_t p = partition_of(hash, level);
+            if(spills[p] == NULL)
+                spills[p] = tmpfile();
+            file_utils::write_record_to_file(spills[p], record);
+            return;
+        }
+        aggregate_state *states = table.group_states(g);
+        for(size_t j = 0; j < specs.size(); j++){
+            states[j].add(specs[j], record, table.group_arena());
+        }
+    }
+    
+    
+    // one row per group: the group value followed by the aggregates
+    void emit(group_table &table, vector<record_type> &out){
+        for(size_t g = 0; g < table.size(); g++){
+            record_type row;
+            row.first = 0;
+            if(table.key_bytes(g)[0] == '\0'){
+                row.second.push_back(make_pair(0x03, string("NULL")));
+            }
+            else{
+                string value(table.key_bytes(g) + 1, table.key_length(g) - 1);
+                row.second.push_back(make_pair(group_type == 0x0c ? 0x0c + value.size() : group_type, value));
+            }
+            aggregate_state *states = table.group_states(g);
+            for(size_t j = 0; j < specs.size(); j++){
+                row.second.push_back(states[j].result(specs[j]));
+            }
+            out.push_back(row);
+        }
+    }
+    
+    
+    // Aggregate the rows spilled to inputs at level on top of the groups already in the table, and emit them
+    void aggregate_partition(group_table &table, vector<FILE*> inputs, int level, vector<record_type> &out){
+        vector<FILE*> spills((size_t) 1 << GROUP_BY_PARTITION_BITS, (FILE*) NULL);
+        record_type record;
+        string key;
+        for(size_t i = 0; i < inputs.size(); i++){
+            if(inputs[i] == NULL)
+                continue;
+            rewind(inputs[i]);
+            while(file_utils::read_record_from_file(inputs[i], record)){
+                add_to(table, spills, level + 1, record, key);
+            }
+            fclose(inputs[i]);
+        }
+        emit(table, out);
+        table.clear();
+        
+        for(size_t p = 0; p < spills.size(); p++){
+            if(spills[p] != NULL)
+                aggregate_partition(table, vector<FILE*>(1, spills[p]), level + 1, out);
+        }
+    }
+    
+    
+public:
+    hash_aggregator(const vector<aggregate_spec> &s, int position, uint8_t type, size_t budget)
+        : specs(s), partials([&s]{ return new partial(s.size()); }){
+        group_position = position;
+        group_type = type;
+        memory_budget = budget;
+    }
+    
+    ~hash_aggregator(){
+        vector<partial*> &all = partials.all();
+        for(size_t i = 0; i < all.size(); i++){
+            for(size_t p = 0; p < all[i]->spills.size(); p++){
+                if(all[i]->spills[p] != NULL)
+                    fclose(all[i]->spills[p]);
+            }
+        }
+    }
+    
+    
+    // the scan is about to visit this many morsels
+    void start(size_t morsels){
+        partials.start(morsels);
+    }
+    
+    
+    // Fold in a record of a morsel, only ever called by the thread scanning that morsel
+    void add(size_t morsel, const record_type &record){
+        partial &local = partials.of_morsel(morsel);
+        add_to(local.table, local.spills, 0, record, local.key);
+    }
+    
+    
+    // Merge what the scan threads aggregated, one partition per task, and return a row per group
+    vector<record_type> finish(work_stealing_pool &pool){
+        size_t partitions = (size_t) 1 << GROUP_BY_PARTITION_BITS;
+        vector<partial*> &all = partials.all();
+        vector<vector<record_type> > partition_rows(partitions);
+        pool.run(partitions, [&](size_t p){
+            group_table table(specs.size());
+            vector<FILE*> inputs;
+            for(size_t i = 0; i < all.size(); i++){
+                // groups the thread held in memory
+                group_table &local = all[i]->table;
+                for(size_t g = 0; g < local.size(); g++){
+                    if(partition_of(local.group_hash(g), 0) != p)
+                        continue;
+                    long t = table.find(local.key_bytes(g), local.key_length(g), local.group_hash(g), true);
+                    aggregate_state *states = table.group_states(t);
+                    aggregate_state *local_states = local.group_states(g);
+                    for(size_t j = 0; j < specs.size(); j++){
+                        states[j].merge(specs[j], local_states[j], table.group_arena());
+                    }
+                }
+                inputs.push_back(all[i]->spills[p]);
+                all[i]->spills[p] = NULL;
+            }
+            aggregate_partition(table, inputs, 0, partition_rows[p]);
+        });
+        
+        vector<record_type> rows;
+        for(size_t p = 0; p < partitions; p++){
+            rows.insert(rows.end(), make_move_iterator(partition_rows[p].begin()), make_move_iterator(partition_rows[p].end()));
+        }
+        return rows;
+    }
+};
+
+
+#endif /* hash_aggregate_h */
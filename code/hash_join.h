@@ -0,0 +1,423 @@
+#ifndef hash_join_h
+#define hash_join_h
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <functional>
+#include "file_utils.h"
+#include "thread_pool.h"
+#include "hash_aggregate.h"
+using namespace std;
+
+// bytes of build rows a JOIN keeps in memory before both inputs are partitioned to disk
+#ifndef JOIN_MEMORY_BYTES
+#define JOIN_MEMORY_BYTES (64 * 1024 * 1024)
+#endif
+
+#define JOIN_PARTITION_BITS 4           // spilled inputs are split 16 ways at every level
+#define JOIN_MAX_LEVELS 4               // a partition this deep is joined in memory whatever its size
+#define JOIN_PROBE_BATCH 256            // probe rows hashed and prefetched together, their slots fit in L1
+
+
+// (key, row) entries of a join input, packed as [key length 4][row length 4][key][row bytes], both in memory
+// and in the partition files
+class join_entries{
+public:
+    static void append(string &buffer, const string &key, const string &row){
+        uint32_t key_length = key.size(), row_length = row.size();
+        buffer.append((const char *) &key_length, 4);
+        buffer.append((const char *) &row_length, 4);
+        buffer += key;
+        buffer += row;
+    }
+    
+    static void lengths(const char *entry, uint32_t &key_length, uint32_t &row_length){
+        memcpy(&key_length, entry, 4);
+        memcpy(&row_length, entry + 4, 4);
+    }
+    
+    static size_t size(const char *entry){
+        uint32_t key_length, row_length;
+        lengths(entry, key_length, row_length);
+        return 8 + key_length + row_length;
+    }
+    
+    // append the next entry of a partition file to buffer, false at the end of the file
+    static bool read(FILE *input, string &buffer){
+        char header[8];
+        if(fread(header, sizeof(char), 8, input) != 8)
+            return false;
+        uint32_t key_length, row_length;
+        lengths(header, key_length, row_length);
+        size_t begin = buffer.size();
+        buffer.append(header, 8);
+        buffer.resize(begin + 8 + key_length + row_length);
+        return fread(&buffer[begin + 8], sizeof(char), key_length + row_length, input) == key_length + row_length;
+    }
+};
+
+
+// Open-addressing hash table over build entries that stay where they are. A slot holds the hash next to the
+// entry, so a probe touches one cache line unless the hash matches. Equal keys take slots of their own.
+class join_table{
+    struct slot{
+        uint64_t hash;
+        const char *entry;              // NULL for an empty slot
+    };
+    
+    vector<slot> slots;
+    size_t mask;
+
+public:
+    // lay out the slots for count entries, keeping the load factor under 0.5
+    join_table(size_t count){
+        size_t n = 1024;
+        while(n < 2 * count){
+            n *= 2;
+        }
+        slot empty = {0, NULL};
+        slots.assign(n, empty);
+        mask = n - 1;
+    }
+    
+    void insert(uint64_t hash, const char *entry){
+        size_t i = hash & mask;
+        while(slots[i].entry != NULL){
+            i = (i + 1) & mask;
+        }
+        slots[i].hash = hash;
+        slots[i].entry = entry;
+    }
+    
+    void prefetch(uint64_t hash){
+        __builtin_prefetch(&slots[hash & mask]);
+    }
+    
+    // Hand every entry holding the key to match
+    template<typename F>
+    void find(uint64_t hash, const string &key, F match){
+        for(size_t i = hash & mask; slots[i].entry != NULL; i = (i + 1) & mask){
+            if(slots[i].hash != hash)
+                continue;
+            uint32_t key_length, row_length;
+            join_entries::lengths(slots[i].entry, key_length, row_length);
+            if(key_length == key.size() && memcmp(slots[i].entry + 8, key.data(), key_length) == 0)
+                match(slots[i].entry);
+        }
+    }
+};
+
+
+// Equi-join of two inputs on byte keys. The build input is scanned first: its rows go to per-thread buffers,
+// one per hash partition, and a hash table is laid over each partition. The probe input then streams past the
+// tables in cache-sized batches. If the build rows outgrow the memory budget, the buffers spill to partition
+// files and the probe rows are partitioned the same way (Grace hash join); partitions are then joined on their
+// own, in parallel, repartitioning whatever still does not fit.
+class hash_joiner{
+public:
+    // called for every (build row, probe row) pair with equal keys, from several threads at once
+    typedef function<void(const record_type&, const record_type&)> match_function;
+
+private:
+    size_t memory_budget;               // all the build rows in memory at once
+    size_t partition_budget;            // one spilled partition joined in memory
+    atomic<size_t> build_bytes;
+    atomic<bool> spilling;
+    vector<join_table*> tables;         // by partition, while nothing spilled
+    
+    struct probe_batch{
+        vector<uint64_t> hashes;
+        vector<string> keys;
+        vector<record_type> rows;
+        size_t size;
+        probe_batch() : hashes(JOIN_PROBE_BATCH), keys(JOIN_PROBE_BATCH), rows(JOIN_PROBE_BATCH), size(0){}
+    };
+    
+    // what a scan thread put aside of an input
+    struct partial{
+        vector<string> buffers;         // entries per partition
+        vector<FILE*> spills;           // entries per partition, once spilling
+        string row, entry;              // scratch for the current row and its entry
+        probe_batch batch;
+        record_type build_row;          // scratch for the build row of a match
+        partial() : buffers((size_t) 1 << JOIN_PARTITION_BITS), spills((size_t) 1 << JOIN_PARTITION_BITS, (FILE*) NULL){}
+    };
+    
+    thread_states<partial> build_partials, probe_partials;
+    
+    
+    static size_t partition_of(uint64_t hash, int level){
+        return (hash >> (64 - JOIN_PARTITION_BITS * (level + 1))) & (((size_t) 1 << JOIN_PARTITION_BITS) - 1);
+    }
+    
+    static void write_entry(vector<FILE*> &spills, size_t p, const char *entry, size_t length){
+        if(spills[p] == NULL)
+            spills[p] = tmpfile();
+        fwrite(entry, sizeof(char), length, spills[p]);
+    }
+    
+    // move the buffered entries of a thread to its partition files
+    static void flush(partial &local){
+        for(size_t p = 0; p < local.buffers.size(); p++){
+            if(local.buffers[p].size() > 0)
+                write_entry(local.spills, p, local.buffers[p].data(), local.buffers[p].size());
+            string().swap(local.buffers[p]);
+        }
+    }
+    
+    static void close_all(vector<FILE*> &files){
+        for(size_t i = 0; i < files.size(); i++){
+            if(files[i] != NULL)
+                fclose(files[i]);
+            files[i] = NULL;
+        }
+    }
+    
+    
+    // Probe a batch of rows: the slots of all of them are fetched before the first one is looked at.
+    // A single table serves every partition of a batch at a spilled partition.
+    void probe(probe_batch &batch, const vector<join_table*> &by_partition, int level, record_type &build_row, const match_function &match){
+        for(size_t i = 0; i < batch.size; i++){
+            by_partition[by_partition.size() == 1 ? 0 : partition_of(batch.hashes[i], level)]->prefetch(batch.hashes[i]);
+        }
+        for(size_t i = 0; i < batch.size; i++){
+            join_table *table = by_partition[by_partition.size() == 1 ? 0 : partition_of(batch.hashes[i], level)];
+            const record_type &probe_row = batch.rows[i];
+            table->find(batch.hashes[i], batch.keys[i], [&](const char *entry){
+                uint32_t key_length, row_length;
+                join_entries::lengths(entry, key_length, row_length);
+                file_utils::read_record_bytes(entry + 8 + key_length, build_row);
+                match(build_row, probe_row);
+            });
+        }
+        batch.size = 0;
+    }
+    
+    
+    // Join the build and probe entries spilled to one partition at level
+    void join_partition(vector<FILE*> build_inputs, vector<FILE*> probe_inputs, int level, const match_function &match){
+        size_t bytes = 0;
+        for(size_t i = 0; i < build_inputs.size(); i++){
+            if(build_inputs[i] != NULL)
+                bytes += ftell(build_inputs[i]);
+        }
+        if(bytes == 0){
+            close_all(build_inputs);
+            close_all(probe_inputs);
+            return;
+        }
+        
+        // too large still, split both sides on the next bits of the hash
+        if(bytes > partition_budget && level + 1 < JOIN_MAX_LEVELS){
+            size_t partitions = (size_t) 1 << JOIN_PARTITION_BITS;
+            vector<vector<FILE*> > sides(2);
+            vector<vector<FILE*> > outputs(2, vector<FILE*>(partitions, (FILE*) NULL));
+            sides[0] = build_inputs;
+            sides[1] = probe_inputs;
+            string entry;
+            for(size_t s = 0; s < 2; s++){
+                for(size_t i = 0; i < sides[s].size(); i++){
+                    if(sides[s][i] == NULL)
+                        continue;
+                    rewind(sides[s][i]);
+                    entry.clear();
+                    while(join_entries::read(sides[s][i], entry)){
+                        uint32_t key_length, row_length;
+                        join_entries::lengths(entry.data(), key_length, row_length);
+                        uint64_t hash = hash_bytes(entry.data() + 8, key_length);
+                        write_entry(outputs[s], partition_of(hash, level + 1), entry.data(), entry.size());
+                        entry.clear();
+                    }
+                    fclose(sides[s][i]);
+                }
+            }
+            for(size_t p = 0; p < partitions; p++){
+                join_partition(vector<FILE*>(1, outputs[0][p]), vector<FILE*>(1, outputs[1][p]), level + 1, match);
+            }
+            return;
+        }
+        
+        // build a table over the partition in memory
+        string buffer;
+        buffer.reserve(bytes);
+        size_t count = 0;
+        for(size_t i = 0; i < build_inputs.size(); i++){
+            if(build_inputs[i] == NULL)
+                continue;
+            rewind(build_inputs[i]);
+            while(join_entries::read(build_inputs[i], buffer)){
+                ++count;
+            }
+        }
+        close_all(build_inputs);
+        join_table table(count);
+        for(size_t offset = 0; offset < buffer.size(); offset += join_entries::size(buffer.data() + offset)){
+            uint32_t key_length, row_length;
+            join_entries::lengths(buffer.data() + offset, key_length, row_length);
+            table.insert(hash_bytes(buffer.data() + offset + 8, key_length), buffer.data() + offset);
+        }
+        
+        // and stream the probe rows past it
+        vector<join_table*> by_partition(1, &table);
+        probe_batch batch;
+        record_type build_row;
+        string entry;
+        for(size_t i = 0; i < probe_inputs.size(); i++){
+            if(probe_inputs[i] == NULL)
+                continue;
+            rewind(probe_inputs[i]);
+            entry.clear();
+            while(join_entries::read(probe_inputs[i], entry)){
+                uint32_t key_length, row_length;
+                join_entries::lengths(entry.data(), key_length, row_length);
+                batch.keys[batch.size].assign(entry.data() + 8, key_length);
+                batch.hashes[batch.size] = hash_bytes(entry.data() + 8, key_length);
+                file_utils::read_record_bytes(entry.data() + 8 + key_length, batch.rows[batch.size]);
+                if(++batch.size == JOIN_PROBE_BATCH)
+                    probe(batch, by_partition, level, build_row, match);
+                entry.clear();
+            }
+        }
+        probe(batch, by_partition, level, build_row, match);
+        close_all(probe_inputs);
+    }
+
+public:
+    hash_joiner(size_t budget, size_t threads) : build_partials([]{ return new partial(); }), probe_partials([]{ return new partial(); }){
+        memory_budget = budget;
+        partition_budget = budget / threads;
+        build_bytes = 0;
+        spilling = false;
+    }
+    
+    ~hash_joiner(){
+        for(size_t p = 0; p < tables.size(); p++){
+            delete tables[p];
+        }
+        vector<partial*> &builds = build_partials.all();
+        for(size_t i = 0; i < builds.size(); i++){
+            close_all(builds[i]->spills);
+        }
+        vector<partial*> &probes = probe_partials.all();
+        for(size_t i = 0; i < probes.size(); i++){
+            close_all(probes[i]->spills);
+        }
+    }
+    
+    
+    // the build scan is about to visit this many morsels
+    void start_build(size_t morsels){
+        build_partials.start(morsels);
+    }
+    
+    
+    // Put aside a build row of a morsel under its key, only ever called by the thread scanning that morsel
+    void add_build(size_t morsel, const string &key, const record_type &row){
+        partial &local = build_partials.of_morsel(morsel);
+        local.row.clear();
+        file_utils::append_record_bytes(local.row, row);
+        size_t p = partition_of(hash_bytes(key.data(), key.size()), 0);
+        if(spilling){
+            flush(local);
+            local.entry.clear();
+            join_entries::append(local.entry, key, local.row);
+            write_entry(local.spills, p, local.entry.data(), local.entry.size());
+            return;
+        }
+        join_entries::append(local.buffers[p], key, local.row);
+        
+        // the table takes up to two 16 byte slots per row on top of the entry
+        if((build_bytes += 8 + key.size() + local.row.size() + 32) > memory_budget)
+            spilling = true;
+    }
+    
+    
+    // Lay the hash tables over the build rows, or send all of them to disk if they do not fit
+    void finish_build(work_stealing_pool &pool){
+        vector<partial*> &all = build_partials.all();
+        if(spilling){
+            for(size_t i = 0; i < all.size(); i++){
+                flush(*all[i]);
+            }
+            return;
+        }
+        tables.assign((size_t) 1 << JOIN_PARTITION_BITS, (join_table*) NULL);
+        pool.run(tables.size(), [&](size_t p){
+            size_t count = 0;
+            for(size_t i = 0; i < all.size(); i++){
+                for(size_t offset = 0; offset < all[i]->buffers[p].size(); offset += join_entries::size(all[i]->buffers[p].data() + offset)){
+                    ++count;
+                }
+            }
+            tables[p] = new join_table(count);
+            for(size_t i = 0; i < all.size(); i++){
+                const string &buffer = all[i]->buffers[p];
+                for(size_t offset = 0; offset < buffer.size(); offset += join_entries::size(buffer.data() + offset)){
+                    uint32_t key_length, row_length;
+                    join_entries::lengths(buffer.data() + offset, key_length, row_length);
+                    tables[p]->insert(hash_bytes(buffer.data() + offset + 8, key_length), buffer.data() + offset);
+                }
+            }
+        });
+    }
+    
+    
+    // the probe scan is about to visit this many morsels
+    void start_probe(size_t morsels){
+        probe_partials.start(morsels);
+    }
+    
+    
+    // Match a probe row of a morsel, only ever called by the thread scanning that morsel. With the build rows
+    // spilled, the row is only put aside in its partition.
+    void add_probe(size_t morsel, const string &key, record_type &row, const match_function &match){
+        partial &local = probe_partials.of_morsel(morsel);
+        uint64_t hash = hash_bytes(key.data(), key.size());
+        if(spilling){
+            local.row.clear();
+            file_utils::append_record_bytes(local.row, row);
+            local.entry.clear();
+            join_entries::append(local.entry, key, local.row);
+            write_entry(local.spills, partition_of(hash, 0), local.entry.data(), local.entry.size());
+            return;
+        }
+        probe_batch &batch = local.batch;
+        batch.hashes[batch.size] = hash;
+        batch.keys[batch.size] = key;
+        batch.rows[batch.size].swap(row);
+        if(++batch.size == JOIN_PROBE_BATCH)
+            probe(batch, tables, 0, local.build_row, match);
+    }
+    
+    
+    // Match what is left: the last batches, or every partition of both inputs if the build rows spilled
+    void finish_probe(work_stealing_pool &pool, const match_function &match){
+        vector<partial*> &probes = probe_partials.all();
+        if(!spilling){
+            pool.run(probes.size(), [&](size_t i){
+                probe(probes[i]->batch, tables, 0, probes[i]->build_row, match);
+            });
+            return;
+        }
+        
+        vector<partial*> &builds = build_partials.all();
+        pool.run((size_t) 1 << JOIN_PARTITION_BITS, [&](size_t p){
+            vector<FILE*> build_inputs, probe_inputs;
+            for(size_t i = 0; i < builds.size(); i++){
+                build_inputs.push_back(builds[i]->spills[p]);
+                builds[i]->spills[p] = NULL;
+            }
+            for(size_t i = 0; i < probes.size(); i++){
+                probe_inputs.push_back(probes[i]->spills[p]);
+                probes[i]->spills[p] = NULL;
+            }
+            join_partition(build_inputs, probe_inputs, 0, match);
+        });
+    }
+};
+
+
+#endif /* hash_join_h */
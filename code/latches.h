@@ -0,0 +1,295 @@
+#ifndef latches_h
+#define latches_h
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// latches that guard something other than a page use addresses no page can have (pages sit at multiples of PAGE_SIZE)
+#define ROOT_LATCH 0xffffffff           // the table's root page address (.tbr) and its cached right spine
+#define TABLE_LOCK 0xfffffffe           // the whole table, only taken exclusively by DDL
+#define LATCH_SHARDS 64
+
+
+// Shared / exclusive latches on the pages of table files, keyed by (table file, page address).
+// A latch only exists while some thread holds it or waits for it.
+class page_latches{
+    struct latch{
+        std::shared_mutex page_mutex;
+        size_t users;                   // threads holding or waiting
+        latch() : users(0){}
+    };
+    
+    struct shard{
+        std::mutex shard_mutex;
+        std::unordered_map<std::string, std::unordered_map<uint32_t, latch*> > latches;
+    };
+    
+    
+    static shard& shard_of(const std::string &table_file_path, uint32_t page_addr){
+        static shard shards[LATCH_SHARDS];
+        size_t h = std::hash<std::string>()(table_file_path) ^ (page_addr / 512 * (size_t) 2654435761u);
+        return shards[h % LATCH_SHARDS];
+    }
+    
+    
+    // find or create the latch and register as one of its users
+    static latch* join(const std::string &table_file_path, uint32_t page_addr){
+        shard &s = shard_of(table_file_path, page_addr);
+        std::lock_guard<std::mutex> guard(s.shard_mutex);
+        latch *&l = s.latches[table_file_path][page_addr];
+        if(l == NULL)
+            l = new latch();
+        ++l->users;
+        return l;
+    }
+    
+    
+    // unlock the latch and drop it once nobody else uses it
+    static void leave(const std::string &table_file_path, uint32_t page_addr, bool exclusive){
+        shard &s = shard_of(table_file_path, page_addr);
+        std::lock_guard<std::mutex> guard(s.shard_mutex);
+        std::unordered_map<uint32_t, latch*> &table_latches = s.latches[table_file_path];
+        latch *l = table_latches[page_addr];
+        if(exclusive)
+            l->page_mutex.unlock();
+        else
+            l->page_mutex.unlock_shared();
+        if(--l->users == 0){
+            delete l;
+            table_latches.erase(page_addr);
+            if(table_latches.empty())
+                s.latches.erase(table_file_path);
+        }
+    }
+
+public:
+    
+    static void lock_shared(const std::string &table_file_path, uint32_t page_addr){
+        join(table_file_path, page_addr)->page_mutex.lock_shared();
+    }
+    
+    static void unlock_shared(const std::string &table_file_path, uint32_t page_addr){
+        leave(table_file_path, page_addr, false);
+    }
+    
+    static void lock(const std::string &table_file_path, uint32_t page_addr){
+        join(table_file_path, page_addr)->page_mutex.lock();
+    }
+    
+    static void unlock(const std::string &table_file_path, uint32_t page_addr){
+        leave(table_file_path, page_addr, true);
+    }
+};
+
+
+// shared latch on a page for the lifetime of the object
+class shared_latch{
+    std::string table_file_path;
+    uint32_t page_addr;
+
+public:
+    shared_latch(const std::string &path, uint32_t addr) : table_file_path(path), page_addr(addr){
+        page_latches::lock_shared(table_file_path, page_addr);
+    }
+    
+    ~shared_latch(){
+        page_latches::unlock_shared(table_file_path, page_addr);
+    }
+};
+
+
+// exclusive latch on a page for the lifetime of the object
+class exclusive_latch{
+    std::string table_file_path;
+    uint32_t page_addr;
+
+public:
+    exclusive_latch(const std::string &path, uint32_t addr) : table_file_path(path), page_addr(addr){
+        page_latches::lock(table_file_path, page_addr);
+    }
+    
+    ~exclusive_latch(){
+        page_latches::unlock(table_file_path, page_addr);
+    }
+};
+
+
+// Exclusive latches taken top-down by a writer. Once a page is known not to split, the latches above it
+// can be let go (latch crabbing), the rest are released with the set.
+class latch_set{
+    std::string table_file_path;
+    std::vector<uint32_t> held;         // root side first
+
+public:
+    latch_set(const std::string &path) : table_file_path(path){}
+    
+    ~latch_set(){
+        release_all();
+    }
+    
+    void acquire(uint32_t page_addr){
+        page_latches::lock(table_file_path, page_addr);
+        held.push_back(page_addr);
+    }
+    
+    // release one latch, if still held
+    void release(uint32_t page_addr){
+        for(size_t i = 0; i < held.size(); i++){
+            if(held[i] == page_addr){
+                page_latches::unlock(table_file_path, page_addr);
+                held.erase(held.begin() + i);
+                return;
+            }
+        }
+    }
+    
+    // release every latch taken before page_addr's
+    void release_above(uint32_t page_addr){
+        size_t i = 0;
+        while(i < held.size() && held[i] != page_addr){
+            page_latches::unlock(table_file_path, held[i]);
+            ++i;
+        }
+        held.erase(held.begin(), held.begin() + i);
+    }
+    
+    void release_all(){
+        for(size_t i = 0; i < held.size(); i++){
+            page_latches::unlock(table_file_path, held[i]);
+        }
+        held.clear();
+    }
+};
+
+
+// Table lock: shared by every statement that reads or writes the table's rows, exclusive for DDL.
+// A thread that already holds the lock of a table takes it again for free.
+class table_lock{
+    std::string table_file_path;
+    
+    // (depth, exclusive) of the table locks this thread holds
+    static std::unordered_map<std::string, std::pair<int, bool> >& held(){
+        static thread_local std::unordered_map<std::string, std::pair<int, bool> > held_locks;
+        return held_locks;
+    }
+
+public:
+    table_lock(const std::string &path, bool exclusive = false) : table_file_path(path){
+        std::pair<int, bool> &h = held()[table_file_path];
+        if(h.first++ > 0)
+            return;
+        h.second = exclusive;
+        if(exclusive)
+            page_latches::lock(table_file_path, TABLE_LOCK);
+        else
+            page_latches::lock_shared(table_file_path, TABLE_LOCK);
+    }
+    
+    ~table_lock(){
+        std::pair<int, bool> &h = held()[table_file_path];
+        if(--h.first > 0)
+            return;
+        if(h.second)
+            page_latches::unlock(table_file_path, TABLE_LOCK);
+        else
+            page_latches::unlock_shared(table_file_path, TABLE_LOCK);
+        held().erase(table_file_path);
+    }
+};
+
+
+// how long a writer waits for a table another transaction holds, before its statement fails
+#ifndef WRITE_GATE_WAIT_MS
+#define WRITE_GATE_WAIT_MS 5000
+#endif
+
+
+// Write gates, one per table file. Statements writing a table outside a transaction share its gate; an open
+// transaction writes its pages only at COMMIT, so it holds the gate of every table it writes for itself until
+// it ends. Readers never take a gate. The holder is the transaction and not the thread, and no wait lasts past
+// WRITE_GATE_WAIT_MS, so two transactions taking the same tables in different orders fail a statement instead
+// of waiting on each other.
+class write_gates{
+    struct gate{
+        size_t writers;                 // statements writing the table outside a transaction
+        const void *owner;              // the transaction holding the table, or NULL
+        gate() : writers(0), owner(NULL){}
+    };
+    
+    static std::mutex& gates_mutex(){
+        static std::mutex gates_guard;
+        return gates_guard;
+    }
+    
+    static std::condition_variable& released(){
+        static std::condition_variable gate_released;
+        return gate_released;
+    }
+    
+    // gates some statement or transaction holds or waits for
+    static std::unordered_map<std::string, gate>& gates(){
+        static std::unordered_map<std::string, gate> table_gates;
+        return table_gates;
+    }
+    
+    // wait until the gate of the table satisfies is_free, false if it does not in time
+    template <typename F>
+    static bool wait_for(std::unique_lock<std::mutex> &lock, const std::string &table_file_path, F is_free){
+        return released().wait_for(lock, std::chrono::milliseconds(WRITE_GATE_WAIT_MS), [&]{
+            return is_free(gates()[table_file_path]);
+        });
+    }
+    
+    // drop the gate once nobody holds it
+    static void forget(const std::string &table_file_path){
+        std::unordered_map<std::string, gate>::iterator it = gates().find(table_file_path);
+        if(it != gates().end() && it->second.writers == 0 && it->second.owner == NULL)
+            gates().erase(it);
+        released().notify_all();
+    }
+
+public:
+    
+    // share the gate of a table with the other statements writing it; false if a transaction keeps it
+    static bool enter(const std::string &table_file_path){
+        std::unique_lock<std::mutex> lock(gates_mutex());
+        if(!wait_for(lock, table_file_path, [](gate &g){ return g.owner == NULL; })){
+            forget(table_file_path);
+            return false;
+        }
+        gates()[table_file_path].writers++;
+        return true;
+    }
+    
+    static void leave(const std::string &table_file_path){
+        std::unique_lock<std::mutex> lock(gates_mutex());
+        gates()[table_file_path].writers--;
+        forget(table_file_path);
+    }
+    
+    // take the gate of a table for a transaction, once no statement writes the table; false if none did in time
+    static bool take(const std::string &table_file_path, const void *transaction){
+        std::unique_lock<std::mutex> lock(gates_mutex());
+        if(!wait_for(lock, table_file_path, [](gate &g){ return g.owner == NULL && g.writers == 0; })){
+            forget(table_file_path);
+            return false;
+        }
+        gates()[table_file_path].owner = transaction;
+        return true;
+    }
+    
+    static void give_back(const std::string &table_file_path){
+        std::unique_lock<std::mutex> lock(gates_mutex());
+        gates()[table_file_path].owner = NULL;
+        forget(table_file_path);
+    }
+};
+
+
+#endif /* latches_h */
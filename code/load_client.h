@@ -0,0 +1,217 @@
+#ifndef load_client_h
+#define load_client_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include "wire_protocol.h"
+using namespace std;
+
+// requests each client of the load generator sends, unless given
+#ifndef LOAD_CLIENT_REQUESTS
+#define LOAD_CLIENT_REQUESTS 10000
+#endif
+
+
+// A connection to the server from a client program: statements sent and their results read back as values
+class sql_client{
+    int fd;
+    string error;
+    
+    bool fail(string message){
+        error = message;
+        return false;
+    }
+    
+    // the answer to a statement run: its columns, its rows and the count of them, or an error
+    bool read_result(vector<string> *columns, vector<vector<wire_value> > *rows){
+        uint8_t type;
+        string message;
+        if(rows != NULL)
+            rows->clear();
+        if(!wire_socket::read_frame(fd, type, message))
+            return fail("Connection closed");
+        if(type == WIRE_ERROR){
+            wire_reader reader(message);
+            reader.get_u8();
+            return fail(string(reader.get_text()));
+        }
+        if(type != WIRE_COLUMNS)
+            return fail("Unexpected response");
+        wire_reader column_reader(message);
+        size_t column_count = column_reader.get_u16();
+        if(columns != NULL){
+            columns->clear();
+            for(size_t i = 0; i < column_count; i++){
+                columns->push_back(string(column_reader.get_text()));
+            }
+        }
+        while(true){
+            if(!wire_socket::read_frame(fd, type, message))
+                return fail("Connection closed");
+            if(type == WIRE_DONE)
+                return true;
+            if(type != WIRE_ROWS)
+                return fail("Unexpected response");
+            if(rows == NULL)
+                continue;
+            wire_reader reader(message);
+            uint32_t count = reader.get_u32();
+            for(uint32_t r = 0; r < count; r++){
+                vector<wire_value> row(column_count + 1);
+                row[0].kind = WIRE_INT;
+                row[0].int_value = reader.get_u32();
+                for(size_t i = 1; i <= column_count; i++){
+                    reader.get_value(row[i]);
+                }
+                rows->push_back(row);
+            }
+            if(!reader.ok())
+                return fail("Broken response");
+        }
+    }
+
+public:
+    sql_client() : fd(-1){}
+    
+    ~sql_client(){
+        disconnect();
+    }
+    
+    
+    bool connect(const string &address){
+        disconnect();
+        fd = wire_socket::connect_to(address);
+        return fd >= 0 || fail(string("Cannot connect to ") + address);
+    }
+    
+    void disconnect(){
+        if(fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+    
+    // Run a statement; its rows, each row_id first and then the columns, go to rows unless it is NULL
+    bool query(const string &text, vector<vector<wire_value> > *rows = NULL, vector<string> *columns = NULL){
+        string request;
+        wire_writer writer(request);
+        writer.put_text(text);
+        if(!wire_socket::write_frame(fd, WIRE_QUERY, request))
+            return fail("Connection closed");
+        return read_result(columns, rows);
+    }
+    
+    bool prepare(const string &text, uint32_t &statement_id, size_t &parameter_count){
+        string request;
+        wire_writer writer(request);
+        writer.put_text(text);
+        uint8_t type;
+        string message;
+        if(!wire_socket::write_frame(fd, WIRE_PREPARE, request) || !wire_socket::read_frame(fd, type, message))
+            return fail("Connection closed");
+        wire_reader reader(message);
+        if(type == WIRE_ERROR){
+            reader.get_u8();
+            return fail(string(reader.get_text()));
+        }
+        statement_id = reader.get_u32();
+        parameter_count = reader.get_u16();
+        return true;
+    }
+    
+    bool execute(uint32_t statement_id, const vector<wire_value> &values, vector<vector<wire_value> > *rows = NULL){
+        string request;
+        wire_writer writer(request);
+        writer.put_u32(statement_id);
+        writer.put_u16(values.size());
+        for(size_t i = 0; i < values.size(); i++){
+            writer.put_value(values[i]);
+        }
+        if(!wire_socket::write_frame(fd, WIRE_EXECUTE, request))
+            return fail("Connection closed");
+        return read_result(NULL, rows);
+    }
+    
+    const string& error_message() const{
+        return error;
+    }
+};
+
+
+// Load generator for the server: clients on threads of their own prepare a statement once and execute it
+// over and over, each ? bound to a random whole number from 1 to max_value, then throughput and latencies
+// are printed.
+class load_client{
+    static double percentile(const vector<double> &sorted, double fraction){
+        if(sorted.empty())
+            return 0;
+        size_t index = (size_t) (fraction * (sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+
+public:
+    static bool run(const string &address, size_t clients, size_t requests, const string &statement_text, long max_value){
+        vector<vector<double> > latencies(clients);
+        atomic<size_t> failed(0);
+        atomic<size_t> rows_read(0);
+        vector<thread> threads;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(size_t c = 0; c < clients; c++){
+            threads.push_back(thread([&, c](){
+                sql_client client;
+                uint32_t statement_id;
+                size_t parameter_count;
+                if(!client.connect(address) || !client.prepare(statement_text, statement_id, parameter_count)){
+                    cout << "[Error] Client " << c << ": " << client.error_message() << "\n";
+                    failed += requests;
+                    return;
+                }
+                mt19937_64 random(c + 1);
+                uniform_int_distribution<long> values(1, max_value);
+                vector<wire_value> arguments(parameter_count);
+                vector<vector<wire_value> > rows;
+                latencies[c].reserve(requests);
+                for(size_t r = 0; r < requests; r++){
+                    for(size_t i = 0; i < parameter_count; i++){
+                        arguments[i].kind = WIRE_INT;
+                        arguments[i].int_value = values(random);
+                    }
+                    chrono::steady_clock::time_point sent = chrono::steady_clock::now();
+                    if(!client.execute(statement_id, arguments, &rows))
+                        failed++;
+                    latencies[c].push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sent).count() / 1e3);
+                    rows_read += rows.size();
+                }
+            }));
+        }
+        for(size_t c = 0; c < threads.size(); c++){
+            threads[c].join();
+        }
+        double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e6;
+        
+        vector<double> all;
+        for(size_t c = 0; c < clients; c++){
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        }
+        sort(all.begin(), all.end());
+        double total = 0;
+        for(size_t i = 0; i < all.size(); i++){
+            total += all[i];
+        }
+        char line[200];
+        snprintf(line, sizeof(line), "%zu clients, %zu requests (%zu failed), %zu rows in %.3f s, %.0f requests/s\n", clients, all.size(), (size_t) failed, (size_t) rows_read, seconds, all.size() / seconds);
+        cout << line;
+        snprintf(line, sizeof(line), "latency (us): mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n", all.empty() ? 0 : total / all.size(), percentile(all, 0.50), percentile(all, 0.99), all.empty() ? 0 : all.back());
+        cout << line;
+        return failed == 0;
+    }
+};
+
+
+#endif /* load_client_h */
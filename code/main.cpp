@@ -1,5 +1,12 @@
 #include <iostream>
+#include <unistd.h>
 #include "parser.h"
+#include "parse_benchmark.h"
+#include "sql_server.h"
+#include "load_client.h"
+#include "async_benchmark.h"
+#include "engine_benchmark.h"
+#include "ycsb_workload.h"
 #include "file_utils.h"
 
 int main(int argc, const char * argv[]) {
@@ -9,7 +16,154 @@ int main(int argc, const char * argv[]) {
         return 0;
     }
     
+    // ./ultralitesql load table_name rows_file [fill_factor], rows_file "-" reads stdin
+    if(argc > 1 && strcmp(argv[1], "load") == 0){
+        if(argc < 4){
+            cout << "Usage: " << argv[0] << " load table_name rows_file [fill_factor]\n";
+            return 1;
+        }
+        Abhi_sql_engine ase;
+        double fill_factor = (argc > 4) ? atof(argv[4]) : 1.0;
+        bool loaded;
+        if(strcmp(argv[3], "-") == 0){
+            loaded = ase.load_table(argv[2], cin, fill_factor);
+        }
+        else{
+            ifstream rows(argv[3]);
+            if(!rows.is_open()){
+                cout << "[Error] Cannot open rows file \'" << argv[3] << "\'\n";
+                return 1;
+            }
+            loaded = ase.load_table(argv[2], rows, fill_factor);
+        }
+        return loaded ? 0 : 1;
+    }
+    
+    // ./ultralitesql parse_bench [statements] [script_file], parses a generated script or the one given
+    if(argc > 1 && strcmp(argv[1], "parse_bench") == 0){
+        size_t statements = (argc > 2) ? atol(argv[2]) : PARSE_BENCH_STATEMENTS;
+        parse_benchmark::run(statements, (argc > 3) ? argv[3] : "");
+        return 0;
+    }
+    
+    // ./ultralitesql serve [socket_path] [--port port] [--workers workers], serves until SIGINT or SIGTERM
+    if(argc > 1 && strcmp(argv[1], "serve") == 0){
+        string socket_path = SERVER_SOCKET;
+        int port = 0;
+        size_t workers = SERVER_WORKERS;
+        for(int i = 2; i < argc; i++){
+            if(strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+                port = atoi(argv[++i]);
+            else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+                workers = max(atoi(argv[++i]), 1);
+            else
+                socket_path = argv[i];
+        }
+        sql_server server;
+        return server.run(socket_path, port, workers) ? 0 : 1;
+    }
+    
+    // ./ultralitesql load_client address clients [requests] "statement" [max_value], address a socket path or
+    // tcp:port
+    if(argc > 1 && strcmp(argv[1], "load_client") == 0){
+        if(argc < 5){
+            cout << "Usage: " << argv[0] << " load_client address clients [requests] \"statement\" [max_value]\n";
+            return 1;
+        }
+        bool requests_given = (argc > 5);
+        size_t requests = requests_given ? atol(argv[4]) : LOAD_CLIENT_REQUESTS;
+        const char *statement = requests_given ? argv[5] : argv[4];
+        long max_value = (argc > 6) ? atol(argv[6]) : 1000;
+        return load_client::run(argv[2], max(atoi(argv[3]), 1), requests, statement, max_value) ? 0 : 1;
+    }
+    
+    // ./ultralitesql async_bench table rows [clients] [scanners], point lookups on the async executor while full
+    // scans of the table run
+    if(argc > 1 && strcmp(argv[1], "async_bench") == 0){
+        if(argc < 4){
+            cout << "Usage: " << argv[0] << " async_bench table rows [clients] [scanners]\n";
+            return 1;
+        }
+        size_t clients = (argc > 4) ? atol(argv[4]) : ASYNC_BENCH_CLIENTS;
+        size_t scanners = (argc > 5) ? atol(argv[5]) : 2;
+        async_benchmark::run(argv[2], max(atol(argv[3]), 1L), clients, scanners);
+        return 0;
+    }
+    
+    // ./ultralitesql bench [rows ...] [--json results_file], the engine benchmark at each table size given
+    if(argc > 1 && strcmp(argv[1], "bench") == 0){
+        vector<long> table_sizes;
+        string json_path;
+        for(int i = 2; i < argc; i++){
+            if(strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+                json_path = argv[++i];
+            else
+                table_sizes.push_back(max(atol(argv[i]), 1L));
+        }
+        if(table_sizes.empty())
+            table_sizes = {1000, 100000, 10000000};
+        engine_benchmark benchmark;
+        return benchmark.run(table_sizes, json_path) ? 0 : 1;
+    }
+    
+    // ./ultralitesql bench_ycsb [workloads] [--uniform] [--threads threads] [--records records]
+    // [--operations operations], YCSB-style workloads a, b, d and e, or those named as in "ab"
+    if(argc > 1 && strcmp(argv[1], "bench_ycsb") == 0){
+        string workloads = "abde";
+        bool zipfian = true;
+        size_t threads = YCSB_THREADS;
+        long records = YCSB_RECORDS, operations = YCSB_OPERATIONS;
+        for(int i = 2; i < argc; i++){
+            if(strcmp(argv[i], "--uniform") == 0)
+                zipfian = false;
+            else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                threads = max(atoi(argv[++i]), 1);
+            else if(strcmp(argv[i], "--records") == 0 && i + 1 < argc)
+                records = atol(argv[++i]);
+            else if(strcmp(argv[i], "--operations") == 0 && i + 1 < argc)
+                operations = atol(argv[++i]);
+            else
+                workloads = argv[i];
+        }
+        return ycsb_workload::run(workloads, zipfian, threads, records, operations) ? 0 : 1;
+    }
+    
+    // ./ultralitesql replay trace_file [--paced], runs a captured workload again and reports divergences
+    if(argc > 2 && strcmp(argv[1], "replay") == 0){
+        bool paced = (argc > 3 && strcmp(argv[3], "--paced") == 0);
+        as_parser asp;
+        return asp.replay(argv[2], paced) ? 0 : 1;
+    }
+    
+    // ./ultralitesql -f script_file [--stop-on-error], or a script piped to stdin: batch mode; --capture
+    // trace_file records the statements run, in batch mode or not
+    const char *script_path = NULL;
+    const char *trace_path = NULL;
+    bool stop_on_error = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            script_path = argv[++i];
+        else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if(strcmp(argv[i], "--stop-on-error") == 0)
+            stop_on_error = true;
+    }
     as_parser asp;
+    if(trace_path != NULL && !asp.capture(trace_path))
+        return 1;
+    if(script_path != NULL){
+        ifstream script(script_path);
+        if(!script.is_open()){
+            cout << "[Error] Cannot open script file \'" << script_path << "\'\n";
+            return 1;
+        }
+        return asp.run_script(script, stop_on_error) ? 0 : 1;
+    }
+    if(!isatty(STDIN_FILENO)){
+        ios::sync_with_stdio(false);
+        return asp.run_script(cin, stop_on_error) ? 0 : 1;
+    }
+    
     asp.launch();
     return 0;
 }
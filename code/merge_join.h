@@ -0,0 +1,142 @@
+#ifndef merge_join_h
+#define merge_join_h
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include "file_utils.h"
+#include "bplus_tree.h"
+#include "thread_pool.h"
+#include "parallel_scan.h"
+using namespace std;
+
+
+// A position among the rows of a table in row_id order, moving along the leaf chain. Only the rows of the
+// current leaf are held, whatever the size of the table.
+class leaf_cursor{
+    uint32_t root_page_addr;
+    page_reader reader;
+    uint8_t page[PAGE_SIZE];
+    vector<record_type> records;        // of the current leaf
+    size_t position;
+    uint32_t next_leaf_addr;
+    
+    
+    // read leaf_addr, or the first leaf after it that has rows
+    void load(uint32_t leaf_addr){
+        records.clear();
+        position = 0;
+        while(leaf_addr != 0xffffffff && reader.read(leaf_addr, page) && page[0] == 0x0d){
+            file_utils::read_records_from_page(page, records);
+            file_utils::page_read(page, 4, next_leaf_addr);
+            if(records.size() > 0)
+                return;
+            leaf_addr = next_leaf_addr;
+        }
+        records.clear();
+        next_leaf_addr = 0xffffffff;
+    }
+
+public:
+    leaf_cursor(string table_file_path, uint32_t root) : root_page_addr(root), reader(table_file_path), position(0), next_leaf_addr(0xffffffff){}
+    
+    
+    // start at the first row of a leaf
+    void start(uint32_t leaf_addr){
+        load(leaf_addr);
+    }
+    
+    
+    // Go down from the root to the leaf that would hold key and stop at the first row from key on
+    void seek(uint32_t key){
+        uint32_t page_addr = root_page_addr;
+        while(reader.read(page_addr, page) && page[0] == 0x05){
+            vector<uint32_t> children, keys;
+            btree_utils::read_interior_cells(page, children, keys);
+            page_addr = children[lower_bound(keys.begin(), keys.end(), key) - keys.begin()];
+        }
+        load(page_addr);
+        advance_to(key);
+    }
+    
+    
+    bool valid(){
+        return position < records.size();
+    }
+    
+    record_type& current(){
+        return records[position];
+    }
+    
+    void next(){
+        if(++position == records.size())
+            load(next_leaf_addr);
+    }
+    
+    
+    // Move on to the first row from key on. A key in the next leaf is reached along the chain, one further on
+    // from the root, so a gap costs at most the depth of the tree in pages.
+    void advance_to(uint32_t key){
+        if(!valid() || records.back().first < key){
+            load(next_leaf_addr);
+            if(valid() && records.back().first < key){
+                seek(key);
+                return;
+            }
+        }
+        
+        // binary search within the leaf
+        size_t low = position, high = records.size();
+        while(low < high){
+            size_t mid = (low + high) / 2;
+            if(records[mid].first < key)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        position = low;
+    }
+};
+
+
+// Joins two tables on row_id. Both trees keep their rows in row_id order, so walking the two leaf chains in
+// lockstep pairs up equal row_ids with no hash table, no sort, and a leaf of each table in memory per thread.
+// The outer table is cut into morsels; a thread seeks the inner table to the start of its morsel and walks
+// both from there, seeking again over gaps of more than a leaf.
+class merge_join{
+public:
+    
+    // Call match with every pair of rows with the same row_id in [low_key, high_key], from several threads at once
+    static void join(string outer_file_path, uint32_t outer_root_addr, string inner_file_path, uint32_t inner_root_addr, work_stealing_pool &pool, uint32_t low_key, uint32_t high_key, const function<void(record_type&, record_type&)> &match){
+        vector<leaf_morsel> morsels = parallel_scan::leaf_morsels(outer_file_path, outer_root_addr, SCAN_MORSEL_LEAVES, pool, low_key, high_key);
+        pool.run(morsels.size(), [&](size_t m){
+            uint32_t last_key = morsels[m].last_key;
+            leaf_cursor outer(outer_file_path, outer_root_addr), inner(inner_file_path, inner_root_addr);
+            outer.start(morsels[m].first_leaf_addr);
+            if(!outer.valid())
+                return;
+            inner.seek(outer.current().first);
+            
+            while(outer.valid() && inner.valid()){
+                uint32_t outer_key = outer.current().first, inner_key = inner.current().first;
+                if(outer_key > last_key || inner_key > last_key)
+                    break;
+                if(outer_key < inner_key){
+                    outer.advance_to(inner_key);
+                }
+                else if(inner_key < outer_key){
+                    inner.advance_to(outer_key);
+                }
+                else{
+                    match(outer.current(), inner.current());
+                    outer.next();
+                    inner.next();
+                }
+            }
+        });
+    }
+};
+
+
+#endif /* merge_join_h */
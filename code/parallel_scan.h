@@ -0,0 +1,161 @@
+#ifndef parallel_scan_h
+#define parallel_scan_h
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <functional>
+#include "file_utils.h"
+#include "bplus_tree.h"
+#include "thread_pool.h"
+using namespace std;
+
+// leaves handed to a thread at a time by a parallel scan
+#ifndef SCAN_MORSEL_LEAVES
+#define SCAN_MORSEL_LEAVES 64
+#endif
+
+// interior pages read by a thread at a time while the morsels are laid out
+#define SCAN_INTERIOR_CHUNK 64
+
+
+// A run of consecutive leaves: the rows from first_leaf_addr on, up to and including last_key.
+// Splits only move rows to the right along the leaf chain, so following the chain from the first leaf
+// until a larger key turns up still finds every row of the range while writers split pages.
+struct leaf_morsel{
+    uint32_t first_leaf_addr;
+    uint32_t last_key;                  // 0xffffffff for the last morsel of the table
+};
+
+
+// pages of a table file read by one thread, each copied under a shared latch
+class page_reader{
+    string table_file_path;
+    FILE *table_file;
+
+public:
+    page_reader(string path) : table_file_path(path){
+        table_file = fopen(table_file_path.c_str(), "r");
+        if(table_file != NULL)
+            setvbuf(table_file, NULL, _IONBF, 0);
+    }
+    
+    ~page_reader(){
+        if(table_file != NULL)
+            fclose(table_file);
+    }
+    
+    // false if the page is not in the file
+    bool read(uint32_t page_addr, uint8_t *page){
+        if(table_file == NULL)
+            return false;
+        shared_latch page_latch(table_file_path, page_addr);
+        fseek(table_file, page_addr, SEEK_SET);
+        query_profile::count_page(false);
+        return fread(page, sizeof(uint8_t), PAGE_SIZE, table_file) == PAGE_SIZE;
+    }
+};
+
+
+// Morsel-driven full table scans: the interior pages tell how to cut the leaf level into runs of leaves,
+// which the worker threads of a pool then read independently of each other.
+class parallel_scan{
+public:
+    
+    // Cut the leaves under the root into morsels of leaves_per_morsel leaves, in key order. Subtrees whose keys
+    // all fall outside [low_key, high_key] are left out.
+    static vector<leaf_morsel> leaf_morsels(string table_file_path, uint32_t root_page_addr, size_t leaves_per_morsel, work_stealing_pool &pool, uint32_t low_key = 0, uint32_t high_key = 0xffffffff){
+        profile_scope descent(STAGE_DESCENT);
+        vector<leaf_morsel> morsels;
+        page_reader reader(table_file_path);
+        uint8_t page[PAGE_SIZE];
+        if(!reader.read(root_page_addr, page))
+            return morsels;
+        
+        // (page address, largest key under the page) for every page of the current level
+        vector<pair<uint32_t, uint32_t> > level(1, make_pair(root_page_addr, (uint32_t) 0xffffffff));
+        while(page[0] == 0x05){
+            size_t chunks = (level.size() + SCAN_INTERIOR_CHUNK - 1) / SCAN_INTERIOR_CHUNK;
+            vector<vector<pair<uint32_t, uint32_t> > > next_level(chunks);
+            pool.run(chunks, [&](size_t c){
+                profile_scope chunk_descent(STAGE_DESCENT);
+                page_reader chunk_reader(table_file_path);
+                uint8_t interior_page[PAGE_SIZE];
+                for(size_t i = c * SCAN_INTERIOR_CHUNK; i < min(level.size(), (c + 1) * SCAN_INTERIOR_CHUNK); i++){
+                    if(!chunk_reader.read(level[i].first, interior_page) || interior_page[0] != 0x05)
+                        continue;
+                    
+                    // the right pointer inherits the bound of its parent, a child holds the keys above its left neighbour's
+                    vector<uint32_t> children, keys;
+                    btree_utils::read_interior_cells(interior_page, children, keys);
+                    for(size_t j = 0; j < children.size(); j++){
+                        uint32_t bound = j < keys.size() ? keys[j] : level[i].second;
+                        if(bound < low_key || (j > 0 && keys[j - 1] >= high_key))
+                            continue;
+                        next_level[c].push_back(make_pair(children[j], bound));
+                    }
+                }
+            });
+            
+            level.clear();
+            for(size_t c = 0; c < chunks; c++){
+                level.insert(level.end(), next_level[c].begin(), next_level[c].end());
+            }
+            if(level.empty() || !reader.read(level[0].first, page))
+                return morsels;
+        }
+        
+        for(size_t i = 0; i < level.size(); i += leaves_per_morsel){
+            leaf_morsel m;
+            m.first_leaf_addr = level[i].first;
+            m.last_key = level[min(level.size(), i + leaves_per_morsel) - 1].second;
+            morsels.push_back(m);
+        }
+        return morsels;
+    }
+    
+    
+    // Hand the rows of a morsel to visit one leaf at a time, in row_id order: the leaf's address, its rows that
+    // belong to the morsel, and whether that is all of the leaf's rows
+    static void scan_morsel_leaves(string table_file_path, const leaf_morsel &morsel, const function<void(uint32_t, vector<record_type>&, bool)> &visit){
+        profile_scope leaf_scan(STAGE_LEAF_SCAN);
+        page_reader reader(table_file_path);
+        uint8_t leaf_page[PAGE_SIZE];
+        vector<record_type> records;
+        uint32_t leaf_addr = morsel.first_leaf_addr;
+        while(leaf_addr != 0xffffffff && reader.read(leaf_addr, leaf_page) && leaf_page[0] == 0x0d){
+            records.clear();
+            file_utils::read_records_from_page(leaf_page, records);
+            
+            // rows past the end of the morsel belong to the next one
+            size_t in_morsel = 0;
+            while(in_morsel < records.size() && records[in_morsel].first <= morsel.last_key){
+                in_morsel++;
+            }
+            bool past_end = (in_morsel < records.size());
+            records.resize(in_morsel);
+            query_profile::count_rows(STAGE_LEAF_SCAN, 0, in_morsel);
+            {
+                // what the caller makes of the rows is not part of the scan
+                profile_scope caller(STAGE_NONE);
+                visit(leaf_addr, records, !past_end);
+            }
+            if(past_end)
+                break;
+            file_utils::page_read(leaf_page, 4, leaf_addr);
+        }
+    }
+    
+    
+    // Hand every row of a morsel to emit, in row_id order
+    static void scan_morsel(string table_file_path, const leaf_morsel &morsel, const function<void(record_type&)> &emit){
+        scan_morsel_leaves(table_file_path, morsel, [&emit](uint32_t, vector<record_type> &records, bool){
+            for(size_t i = 0; i < records.size(); i++){
+                emit(records[i]);
+            }
+        });
+    }
+};
+
+
+#endif /* parallel_scan_h */
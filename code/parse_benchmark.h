@@ -0,0 +1,129 @@
+#ifndef parse_benchmark_h
+#define parse_benchmark_h
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include "sql_lexer.h"
+#include "sql_parser.h"
+using namespace std;
+
+// statements in the generated script, unless given
+#ifndef PARSE_BENCH_STATEMENTS
+#define PARSE_BENCH_STATEMENTS 1000000
+#endif
+
+
+// Throughput of the lexer and the parser over a script, without running any of it: a script given as a file,
+// or one generated with a mix of the statements an OLTP workload repeats.
+class parse_benchmark{
+    
+    // the i-th statement of the generated script
+    static void append_statement(string &script, size_t i){
+        char statement[512];
+        switch(i % 8){
+            case 0:
+            case 1:
+                snprintf(statement, sizeof(statement), "select name, marks from students where row_id = %zu;\n", i);
+                break;
+            case 2:
+                snprintf(statement, sizeof(statement), "SELECT * FROM orders WHERE (qty > %zu AND price <= %zu.5) OR NOT status = 'Shipped' ORDER BY qty DESC, row_id LIMIT 20;\n", i % 50, i % 997);
+                break;
+            case 3:
+                snprintf(statement, sizeof(statement), "insert into table orders (row_id, item, qty, price, status, placed) values (%zu, 'Item %zu', %zu, %zu.25, 'Open', 2018-03-17_05:23:56), (%zu, 'Item %zu', 1, 0.5, NULL, 2018-03-18_11:02:07);\n", 2 * i, i, i % 31, i % 450, 2 * i + 1, i + 1);
+                break;
+            case 4:
+                snprintf(statement, sizeof(statement), "update orders set status = 'Closed' where row_id >= %zu and qty < 5 and placed is not null;\n", i);
+                break;
+            case 5:
+                snprintf(statement, sizeof(statement), "delete from orders where row_id = %zu;\n", i);
+                break;
+            case 6:
+                snprintf(statement, sizeof(statement), "select status, count(*), avg(price), max(qty) from orders where qty > %zu group by status;\n", i % 7);
+                break;
+            default:
+                snprintf(statement, sizeof(statement), "select orders.item, items.name from orders join items on orders.item_id = items.row_id where orders.qty > %zu;\n", i % 11);
+                break;
+        }
+        script += statement;
+    }
+    
+    // the statements of a script, up to each ;
+    static vector<string_view> split_statements(string_view script){
+        vector<string_view> statements;
+        size_t begin = 0, end;
+        while((end = script.find(';', begin)) != string_view::npos){
+            statements.push_back(script.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        if(script.find_first_not_of(" \n\t\r", begin) != string_view::npos)
+            statements.push_back(script.substr(begin));
+        return statements;
+    }
+    
+    static double seconds_since(chrono::steady_clock::time_point start){
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e6;
+    }
+
+public:
+    
+    // Lex and then parse every statement of the script, printing the rate of each
+    static void run(size_t statement_count, string script_path = ""){
+        string script;
+        if(script_path != ""){
+            ifstream script_file(script_path);
+            if(!script_file.is_open()){
+                cout << "[Error] Cannot open script file \'" << script_path << "\'\n";
+                return;
+            }
+            stringstream contents;
+            contents << script_file.rdbuf();
+            script = contents.str();
+        }
+        else{
+            script.reserve(statement_count * 120);
+            for(size_t i = 0; i < statement_count; i++){
+                append_statement(script, i);
+            }
+        }
+        vector<string_view> statements = split_statements(script);
+        double megabytes = script.size() / 1e6;
+        char line[160];
+        snprintf(line, sizeof(line), "%zu statements, %.1f MB\n", statements.size(), megabytes);
+        cout << line;
+        
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        size_t tokens = 0;
+        for(size_t i = 0; i < statements.size(); i++){
+            sql_lexer lexer(statements[i]);
+            while(lexer.next().type != TOKEN_END){
+                tokens++;
+            }
+        }
+        double lex_seconds = seconds_since(start);
+        snprintf(line, sizeof(line), "lexer:  %zu tokens in %.3f s, %.0f tokens/s, %.1f MB/s\n", tokens, lex_seconds, tokens / lex_seconds, megabytes / lex_seconds);
+        cout << line;
+        
+        start = chrono::steady_clock::now();
+        sql_parser parser;
+        size_t parsed = 0;
+        for(size_t i = 0; i < statements.size(); i++){
+            sql_statement statement;
+            if(parser.parse(statements[i], statement))
+                parsed++;
+        }
+        double parse_seconds = seconds_since(start);
+        snprintf(line, sizeof(line), "parser: %zu statements in %.3f s, %.0f statements/s, %.1f MB/s\n", parsed, parse_seconds, parsed / parse_seconds, megabytes / parse_seconds);
+        cout << line;
+        if(parsed < statements.size())
+            cout << "[Warning] " << statements.size() - parsed << " statements did not parse\n";
+    }
+};
+
+
+#endif /* parse_benchmark_h */
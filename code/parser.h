@@ -4,811 +4,386 @@
 #include <iostream>
 #include <unordered_map>
 #include <vector>
-#include <sstream>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdio>
 #include "abhisql.h"
+#include "sql_parser.h"
+#include "statement_cache.h"
+#include "workload_trace.h"
 using namespace std;
 
 
 class as_parser{
     string prompt;
     string command;
-    unordered_map<string, vector<string> > command_ex_keywords;
-    vector<string> ex_keywords;
-    vector<string> valid_data_types;
+    sql_parser parser;
+    statement_cache statements;     // statements parsed before, by their text
+    unordered_map<string, shared_ptr<const sql_statement> > prepared;     // by the name PREPARE gave them
     Abhi_sql_engine engine;
+    unique_ptr<trace_writer> trace;         // where process records the statements it runs, if capturing
+    bool output_varies;                     // set by a statement whose output may differ between runs
     
-public:
-    as_parser(){
-        prompt = string("\nultralitesql> ");
-        
-        // keywords
-        ex_keywords.clear();
-        command_ex_keywords["show"] = vector<string>();
-        command_ex_keywords["show"].push_back("tables");
-        
-        command_ex_keywords["create1"] = vector<string>();
-        command_ex_keywords["create1"].push_back("table");
-        
-        command_ex_keywords["create2"] = vector<string>();
-        command_ex_keywords["create2"].push_back("row_id");
-        command_ex_keywords["create2"].push_back("int");
-        command_ex_keywords["create2"].push_back("primary");
-        command_ex_keywords["create2"].push_back("key");
-        
-        command_ex_keywords["notnull"] = vector<string>();
-        command_ex_keywords["notnull"].push_back("not");
-        command_ex_keywords["notnull"].push_back("null");
         
-        command_ex_keywords["drop"] = vector<string>();
-        command_ex_keywords["drop"].push_back("table");
-        
-        command_ex_keywords["insert1"] = vector<string>();
-        command_ex_keywords["insert1"].push_back("into");
-        command_ex_keywords["insert1"].push_back("table");
-        
-        command_ex_keywords["insert2"] = vector<string>();
-        command_ex_keywords["insert2"].push_back("values");
-        
-        command_ex_keywords["update"] = vector<string>();
-        command_ex_keywords["select"] = vector<string>();
-        
-        
-        //Valid data types
-        valid_data_types.push_back("tinyint");
-        valid_data_types.push_back("smallint");
-        valid_data_types.push_back("int");
-        valid_data_types.push_back("bigint");
-        valid_data_types.push_back("real");
-        valid_data_types.push_back("double");
-        valid_data_types.push_back("datetime");
-        valid_data_types.push_back("date");
-        valid_data_types.push_back("text");
-    }
-    
-    
-    // Split based on character
-    vector<string> split(string str, char sp){
-        vector<string> out;
-        stringstream str_s(str);
-        while(!str_s.eof()){
-            string tmp;
-            getline(str_s, tmp, sp);
-            out.push_back(tmp);
-        }
-        return out;
-    }
-    
-    
-    
-    // Pass list of words that need to be passed
-    bool pass_words(stringstream &ss, vector<string> &words, char delim = ' '){
-        for(int i = 0; i < words.size(); i++){
-            char current_delim = (i == words.size() - 1) ? delim : ' ';
-            if(words[i] != extract_word(ss, current_delim))
+    // SELECT: join records are printed as they are found, other results once they are complete. False once
+    // an error is printed.
+    bool run_select(const select_statement &select){
+        if(select.join_table != ""){
+            // join records come from several threads, in no fixed order
+            output_varies = true;
+            record_printer printer(select.limit);
+            if(!engine.query_join(select, [&printer](record_type &record){
+                printer.add(record);
+            }))
                 return false;
+            printer.finish();
+            return true;
         }
+        vector<record_type> records = engine.query_records(select);
+        if(records.empty())
+            return false;
+        engine.display_records(records);
         return true;
     }
     
     
-    // Reads leading ws
-    // Stops before either first ws or first delim
-    // Returns "" if delim was not encountered and entire stream was read
-    string extract_word(stringstream &ss, char delim = ' '){
-        string word("");
-        ss >> ws;           // eat leading whitespace
-        
-        // read till end of file
-        while(ss.peek() != EOF){
-            // done reading if any of these happens
-            if(isspace(ss.peek()) || ss.peek() == delim)
-                break;
-            word = word + char(ss.get());
+    // EXPLAIN prints the plan of a SELECT; EXPLAIN ANALYZE then runs it too, with its rows formatted but not
+    // printed, and counts each stage
+    bool run_explain(const sql_statement &statement){
+        if(!engine.explain_select(statement.inner->select))
+            return false;
+        if(!statement.analyze)
+            return true;
+        output_varies = true;
+        discard_buffer discarded;
+        ostream discard_stream(&discarded);
+        query_profile profile;
+        bool succeeded;
+        {
+            printer_redirect discard(&discard_stream);
+            profile.start();
+            succeeded = run_select(statement.inner->select);
+            profile.stop();
         }
-        if(ss.peek() == EOF && delim != ' ')
-            return string("");
-        
-        ss >> ws;           // eat trailing whitespace
-        //cout << "\nExtracted #" << word << "#\n";
-        return word;
+        profile.print();
+        return succeeded;
     }
     
     
-    
-    string extract_value(string text){
-        size_t first_valid = text.find_first_not_of(" \n\t");
-        if(first_valid == string::npos) return "";
-        
-        // remove leading and trailing whitespace
-        text = text.substr(first_valid);
-        text = text.substr(0, text.size() - string(text.rbegin(), text.rend()).find_first_not_of(" \n\t"));
-        
-        if(text[0] == '\''){
-            if(text[text.size() - 1] == '\''){
-                return text.substr(1, text.size() - 2);
-            }
-            else{
-                size_t value_end = text.find_last_of("\'");
-                if(value_end == string::npos){
-                    cout << "[Error] Closing quote not found for value\n";
-                    return "";
-                }
-                cout << "[Warning] Trailing text after closing of quotes ignored\n";
-                return text.substr(0, value_end);
+    // Run a parsed statement, its placeholders bound; false once an error is printed. running turns false
+    // for EXIT.
+    bool run_statement(const sql_statement &statement, bool &running){
+        const string &action = statement.action;
+        if(action == "exit"){
+            if(engine.in_transaction()){
+                cout << "[Warning] Rolling back the open transaction\n";
+                engine.rollback_transaction();
             }
+            cout << "Bye!\n";
+            running = false;
+            return true;
         }
-        
-        size_t first_ws = text.find_first_of(" \n\t");
-        if(first_ws == string::npos){
-            return text;
+        else if(action == "begin"){
+            return engine.begin_transaction();
         }
-        else{
-            cout << "[Warning] Trailing text after first string expression within value ignored\n";
-            return text.substr(0, first_ws);
+        else if(action == "commit"){
+            return engine.commit_transaction();
         }
-    }
-    
-    
-    
-    
-    void launch(){
-        cout << "Launching Abhi SQL...\n";
-        while(true){
-            // Display prompt and take the command as input until the user hits return
-            cout << prompt;
-            getline(cin, command, ';');
-            transform(command.begin(), command.end(), command.begin(), ::tolower);
-            
-            size_t command_begin = command.find_first_of("abcdefghijklmnopqrstuvwxyz");
-            if(command_begin == string::npos){
-                cout << "\n";
-                continue;
-            }
-            command = command.substr(command_begin);
-            
-            // Process the command
-            if(!process(command))
-                break;
-        }
-    }
-    
-    bool process(string command){
-        //size_t first_word_begin = command.find_first_not_of(" ");
-        //size_t first_word_end = command.find_first_of(" ");
-        
-        stringstream ss(command);
-        string action = extract_word(ss);
-        //cout << "Action was #" << action << "#\n";
-        
-        if(action == string("exit")){
-            cout << "Bye!\n";
-            return false;
+        else if(action == "rollback"){
+            return engine.rollback_transaction();
         }
         else if(action == "show"){
-            if(!pass_words(ss, command_ex_keywords["show"])){
-                cout << "Incorrect syntax. Did you mean \'SHOW TABLES\'?\n";
-                return true;
-            }
             engine.show_tables();
         }
         else if(action == "create"){
-            // parse initial syntax
-            if(!pass_words(ss, command_ex_keywords["create1"])){
-                cout << "[Syntax error] Did you mean \'CREATE TABLE table_name (...)\'?\n";
-                return true;
-            }
-            
-            // Extract table name
-            string table_name = extract_word(ss, '(');
-            if(table_name == string("")){
-                cout << "[Error] Table name not provided or left parenthesis is missing\n";
-                return true;
-            }
-            
-            ss.get();       // eat left parenthesis
-            string within_paren;
-            getline(ss, within_paren, ')');
-            if(ss.eof()){
-                cout << "[Error] Right matching parenthesis not found\n";
-                return true;
-            }
-            vector<string> column_info = split(within_paren, ',');
-            
-            // Read remaining columns info
-            vector<column_type> columns;
-            for(int i = 0; i < column_info.size(); i++){
-                // read in to a stream
-                stringstream css(column_info[i]);
-                
-                // parse first line
-                if(i == 0){
-                    if(!pass_words(css, command_ex_keywords["create2"])){
-                        cout << "[Syntax error] First column should always be 'row_id int primary key'\n";
-                        return true;
-                    }
-                    continue;
-                }
-                
-                column_type ct;
-                
-                // column name
-                ct.column_name = extract_word(css);
-                if(ct.column_name == ""){
-                    cout << "[Error] No column name provided for column number " << i + 1 << "\n";
-                    return true;
-                }
-                
-                // column data type
-                ct.data_type = extract_word(css);
-                if(ct.data_type == ""){
-                    cout << "[Error] No column data type provided for column number " << i + 1 << "\n";
-                    return true;
-                }
-                bool valid_data_type = false;
-                for(int i = 0; i < valid_data_types.size(); i++){
-                    if(valid_data_types[i] == ct.data_type){
-                        valid_data_type = true;
-                        break;
-                    }
-                }
-                if(!valid_data_type){
-                    cout << "[Error] \'" << ct.data_type << "\' is not a valid data type\n";
-                    return true;
-                }
-                
-                // not null
-                if(!css.eof()){
-                    if(pass_words(css, command_ex_keywords["notnull"])){
-                        ct.not_null = true;
-                    }
-                    else{
-                        cout << "[Error] Invalid column specifier. Did you mean \'not null\'\n";
-                        return true;
-                    }
-                }
-                columns.push_back(ct);
-            }
-            
-            engine.create_table(table_name, columns);
+            vector<column_type> columns = statement.columns;
+            return engine.create_table(statement.table_name, columns);
         }
         else if(action == "drop"){
-            if(!pass_words(ss, command_ex_keywords["drop"])){
-                cout << "Incorrect syntax. Did you mean \"DROP TABLES table_name;\"?\n";
-                return true;
-            }
-            string table_name = extract_word(ss);
-            engine.drop_table(table_name);
+            return engine.drop_table(statement.table_name);
         }
         else if(action == "insert"){
-            // parse initial syntax
-            if(!pass_words(ss, command_ex_keywords["insert1"])){
-                cout << "[Syntax error] Correct syntax is \"INSERT INTO TABLE table_name [columns] values(..)\"?\n";
-                return true;
-            }
-            string table_name = extract_word(ss, '(');
-            
-            
-            // find which params to insert
-            vector<string> insert_columns;
-            if(ss.peek() == '('){
-                ss.get();
-                string within_paren;
-                getline(ss, within_paren, ')');
-                vector<string> parts = split(within_paren, ',');
-                for(int i = 0; i < parts.size(); i++){
-                    stringstream iss(parts[i]);
-                    insert_columns.push_back(extract_word(iss));
-                }
-            }
-            
-            // parse later syntax
-            string values_keyword = extract_word(ss, '(');
-            if(values_keyword != "values"){
-                cout << "[Syntax error] Use keyword VALUES in place of \'" << values_keyword << "\'\n";
-                return true;
-            }
-            
-            // find which values to insert
-            vector<string> insert_values;
-            if(ss.peek() == '('){
-                ss.get();
-                string within_paren;
-                getline(ss, within_paren, ')');
-                
-                if(ss.eof()){
-                    cout << "[Syntax error] Missing closing parenthesis\n";
-                    return true;
-                }
-                
-                vector<string> parts = split(within_paren, ',');
-                for(int i = 0; i < parts.size(); i++){
-                    //stringstream iss(parts[i]);
-                    //string column_val = extract_word(iss);
-                    string column_val = extract_value(parts[i]);
-                    if(column_val == ""){
-                        cout << "[Error] Missing value for a column\n";
-                        return true;
-                    }
-                    insert_values.push_back(column_val);
-                }
-            }
-            if(insert_values.size() == 0){
-                cout << "[Error] No values were specified for insertion\n";
-                return true;
-            }
-            
-            if(insert_columns.size() > 0 && insert_values.size() != insert_columns.size()){
-                cout << "[Error] Mismatched number of columns and values\n";
-                return true;
+            vector<vector<string> > insert_values_list = statement.insert_values_list;
+            vector<string> insert_columns = statement.insert_columns;
+            return engine.insert(statement.table_name, insert_values_list, insert_columns);
+        }
+        else if(action == "load"){
+            ifstream rows(statement.rows_path);
+            if(!rows.is_open()){
+                cout << "[Error] Cannot open rows file \'" << statement.rows_path << "\'\n";
+                return false;
             }
-            
-            // insert values into table
-            engine.insert(table_name, insert_values, insert_columns);
+            return engine.load_table(statement.table_name, rows, statement.fill_factor);
         }
         else if(action == "update"){
-            string table_name = extract_word(ss);
-            
-            string set_keyword = extract_word(ss);
-            if(set_keyword != "set"){
-                cout << "[Error]: Incorrect syntax. Did you forget the SET keyword?\n";
-                return true;
-            }
-            
-            size_t where_loc = command.find("where ");
-            string column_name = extract_word(ss, '=');
-            ss.get();
-            string value = extract_word(ss);
-            value = extract_value(value);
-            
-            
-            string where = "";
-            where_condition cond;
-            if(where_loc != string::npos){
-                where = command.substr(where_loc);
-            }
-            if(where.size() > 0){
-                // eat where keyword
-                where = where.substr(6);
-                
-                // find comparison operator
-                size_t loc = min(where.find_first_of("=!<>"), where.find(" is "));
-                if(loc == string::npos){
-                    cout << "[Error] No valid comparison operator found\n";
-                    return true;
-                }
-                
-                // extract comparison variable
-                ss.str(where.substr(0, loc));
-                string comp_variable = extract_word(ss);
-                if(comp_variable == ""){
-                    cout << "[Error] No column name specified before the comparison operator\n";
-                    return true;
-                }
-                cond.column_name = comp_variable;
-                
-                // extract remaining values
-                where = where.substr(loc);
-                switch(where[0]){
-                    case '=':{
-                        cond.comp_code = 0;
-                        cond.value_is_null = false;
-                        
-                        cond.value = extract_value(where.substr(1));
-                        if(cond.value == ""){
-                            return true;
-                        }
-                        break;
-                    }
-                    case '!':{
-                        if(where[1] != '='){
-                            cout << "[Error] Syntax error for comparison operator, try using \'var != value\'\n";
-                            return true;
-                        }
-                        cond.comp_code = 1;
-                        cond.value_is_null = false;
-                        
-                        cond.value = extract_value(where.substr(2));
-                        if(cond.value == ""){
-                            return true;
-                        }
-                        break;
-                    }
-                    case '<':{
-                        if(where[1] == '='){
-                            cond.comp_code = 4;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(2));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        else{
-                            cond.comp_code = 2;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(1));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        break;
-                    }
-                    case '>':{
-                        if(where[1] == '='){
-                            cond.comp_code = 5;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(2));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        else{
-                            cond.comp_code = 3;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(1));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        break;
-                    }
-                    case ' ':{
-                        cond.value_is_null = true;
-                        cond.value = "null";
-                        
-                        stringstream where_ss(where);
-                        string is_keyword = extract_word(where_ss);
-                        string value_keyword = extract_word(where_ss);
-                        if(value_keyword == "null"){
-                            cond.comp_code = 6;
-                        }
-                        else if(value_keyword == "not"){
-                            value_keyword = extract_word(where_ss);
-                            if(value_keyword == "null"){
-                                cond.comp_code = 7;
-                            }
-                            else{
-                                cout << "[Error] Did you mean 'is not null'?\n";
-                                return true;
-                            }
-                        }
-                        else{
-                            cout << "[Error] Did you mean 'is null'?\n";
-                            return true;
-                        }
-                        break;
-                    }
-                    default:{
-                        cout << where;
-                        cout << "[Error] Comparison operator not recognized\n";
-                        return true;
-                    }
-                }
-            }
-            
-            engine.update_records(table_name, column_name, value, cond);
-            
+            return engine.update_records(statement.table_name, statement.set_column, statement.set_value, statement.cond);
+        }
+        else if(action == "delete"){
+            return engine.update_records(statement.table_name, "-", "0", statement.cond, true);
         }
         else if(action == "select"){
-            
-            // Obtain select
-            size_t curr_loc = 6;
-            size_t from_loc = command.find("from");
-            if(from_loc == string::npos || !isspace(command[from_loc - 1]) || !isspace(command[from_loc + 4])){
-                cout << "[Error] Invalid syntax, could not find the 'from' keyword\n";
-                return true;
-            }
-            string select = command.substr(curr_loc, from_loc - curr_loc);
-            
-            // Obtain from
-            size_t where_loc = command.find("where ");
-            string from = command.substr(from_loc, where_loc - from_loc);
-            //cout << "from #" << from << "#\n";
-            
-            // Obtain where
-            string where = "";
-            if(where_loc != string::npos){
-                where = command.substr(where_loc);
-            }
-            //cout << "where #" << where << "#\n";
-            
-            
-            // Parse select, obtain columns
-            vector<string> proj_columns = split(select, ',');
-            for(int i = 0; i < proj_columns.size(); i++){
-                stringstream tmp(proj_columns[i]);
-                string column_name_word = extract_word(tmp);
-                // TODO: "", special chars except *, repeated columns - handle all
-                proj_columns[i] = column_name_word;
+            return run_select(statement.select);
+        }
+        else if(action == "explain"){
+            return run_explain(statement);
+        }
+        else if(action == "analyze"){
+            if(statement.table_name == "")
+                return engine.analyze_all_tables();
+            return engine.analyze_table(statement.table_name);
+        }
+        else if(action == "prepare"){
+            prepared[statement.name] = statement.inner;
+            cout << "Prepared statement \'" << statement.name << "\' with " << statement.inner->parameter_count << " parameters\n";
+        }
+        else if(action == "execute"){
+            unordered_map<string, shared_ptr<const sql_statement> >::iterator found = prepared.find(statement.name);
+            if(found == prepared.end()){
+                cout << "[Error] No prepared statement named \'" << statement.name << "\'\n";
+                return false;
             }
-            if(proj_columns.size() == 0 || proj_columns[0] == ""){
-                cout << "[Error] No projected columns specified in command\n";
-                return true;
+            return execute(*found->second, statement.arguments);
+        }
+        else if(action == "deallocate"){
+            if(prepared.erase(statement.name) == 0){
+                cout << "[Error] No prepared statement named \'" << statement.name << "\'\n";
+                return false;
             }
+        }
+        return true;
+    }
             
-            // Parse from, obtain table_name
-            stringstream from_ss(from);
-            string from_keyword = extract_word(from_ss);
-            string table_name = extract_word(from_ss);
-            if(table_name == ""){
-                cout << "[Error] No table to select records from\n";
+    // The next statement of a script, up to a ; not within quotes. False at the end of the script.
+    static bool read_statement(istream &input, string &statement){
+        statement.clear();
+        string part;
+        size_t quotes = 0;
+        while(getline(input, part, ';')){
+            statement += part;
+            quotes += count(part.begin(), part.end(), '\'');
+            if(quotes % 2 == 0 || input.eof())
                 return true;
-            }
-            
-            // Parse where condition
-            where_condition cond;
-            if(where.size() > 0){
-                // eat where keyword
-                where = where.substr(6);
-                
-                // find comparison operator
-                size_t loc = min(where.find_first_of("=!<>"), where.find(" is "));
-                if(loc == string::npos){
-                    cout << "[Error] No valid comparison operator found\n";
-                    return true;
-                }
-                
-                // extract comparison variable
-                ss.str(where.substr(0, loc));
-                string comp_variable = extract_word(ss);
-                if(comp_variable == ""){
-                    cout << "[Error] No column name specified before the comparison operator\n";
-                    return true;
-                }
-                cond.column_name = comp_variable;
-                
-                // extract remaining values
-                where = where.substr(loc);
-                switch(where[0]){
-                    case '=':{
-                        cond.comp_code = 0;
-                        cond.value_is_null = false;
-                        
-                        cond.value = extract_value(where.substr(1));
-                        if(cond.value == ""){
-                            return true;
-                        }
-                        break;
-                    }
-                    case '!':{
-                        if(where[1] != '='){
-                            cout << "[Error] Syntax error for comparison operator, try using \'var != value\'\n";
-                            return true;
-                        }
-                        cond.comp_code = 1;
-                        cond.value_is_null = false;
-                        
-                        cond.value = extract_value(where.substr(2));
-                        if(cond.value == ""){
-                            return true;
-                        }
-                        break;
-                    }
-                    case '<':{
-                        if(where[1] == '='){
-                            cond.comp_code = 4;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(2));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        else{
-                            cond.comp_code = 2;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(1));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        break;
-                    }
-                    case '>':{
-                        if(where[1] == '='){
-                            cond.comp_code = 5;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(2));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        else{
-                            cond.comp_code = 3;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(1));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        break;
-                    }
-                    case ' ':{
-                        cond.value_is_null = true;
-                        cond.value = "null";
-                        
-                        stringstream where_ss(where);
-                        string is_keyword = extract_word(where_ss);
-                        string value_keyword = extract_word(where_ss);
-                        if(value_keyword == "null"){
-                            cond.comp_code = 6;
-                        }
-                        else if(value_keyword == "not"){
-                            value_keyword = extract_word(where_ss);
-                            if(value_keyword == "null"){
-                                cond.comp_code = 7;
-                            }
-                            else{
-                                cout << "[Error] Did you mean 'is not null'?\n";
-                                return true;
-                            }
-                        }
-                        else{
-                            cout << "[Error] Did you mean 'is null'?\n";
-                            return true;
-                        }
-                        break;
-                    }
-                    default:{
-                        cout << where;
-                        cout << "[Error] Comparison operator not recognized\n";
-                        return true;
-                    }
-                }
-            }
-            
-            engine.display_records(engine.select_records(engine.get_all_records(table_name, true), table_name, cond, proj_columns));
+            statement += ';';
         }
-        else if(action == "delete"){
-            string from_keyword = extract_word(ss);
-            if(from_keyword != "from"){
-                cout << "[Error]: Incorrect syntax. Did you forget the FROM keyword?\n";
-                return true;
+        return statement.size() > 0;
+    }
+    
+    // Parse and run a statement; false if it does not parse or fails, running turns false for EXIT. SELECT,
+    // INSERT, UPDATE and DELETE statements seen before are run as they were parsed then.
+    bool run_command(const string &command, bool &running){
+        shared_ptr<const sql_statement> statement = statements.find(command);
+        if(!statement){
+            sql_statement parsed;
+            if(!parser.parse(command, parsed))
+                return false;
+            if(parsed.parameter_count > 0 && parsed.action != "prepare"){
+                cout << "[Error] ? placeholders can only be used in a prepared statement\n";
+                return false;
             }
-            string table_name = extract_word(ss);
+            statement = make_shared<const sql_statement>(parsed);
+            if(parsed.action == "select" || parsed.action == "insert" || parsed.action == "update" || parsed.action == "delete")
+                statements.add(command, statement);
+        }
+        return run_statement(*statement, running);
+    }
+    
+    // Run a statement with its output passed on to output (dropped if NULL), noting in entry how long it ran,
+    // the records it returned and a digest of what it printed. Returns and sets running as run_command.
+    bool run_traced(const string &command, streambuf *output, trace_entry &entry, bool &running){
+        digest_buffer digest(output);
+        streambuf *console = cout.rdbuf(&digest);
+        record_printer::rows_returned() = 0;
+        output_varies = false;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool succeeded = run_command(command, running);
+        entry.duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        cout.rdbuf(console);
+        entry.text = command;
+        entry.rows = record_printer::rows_returned();
+        entry.compared = !output_varies;
+        entry.digest = digest.digest();
+        return succeeded;
+    }
+    
+    // where a statement's first word starts, its size if it has none
+    static size_t statement_begin(const string &statement){
+        size_t begin = 0;
+        while(begin < statement.size() && !isalpha((unsigned char) statement[begin])){
+            begin++;
+        }
+        return begin;
+    }
+
+public:
+    as_parser(){
+        prompt = string("\nultralitesql> ");
+        output_varies = false;
+    }
+    
+    
+    // C++ API: parse a SELECT, INSERT, UPDATE or DELETE once, with ? placeholders for values, to execute any
+    // number of times. NULL once an error is printed.
+    shared_ptr<const sql_statement> prepare(string statement_text){
+        shared_ptr<const sql_statement> statement = statements.find(statement_text);
+        if(statement)
+            return statement;
+        sql_statement parsed;
+        if(!parser.parse(statement_text, parsed))
+            return statement;
+        if(parsed.action != "select" && parsed.action != "insert" && parsed.action != "update" && parsed.action != "delete"){
+            cout << "[Error] Only SELECT, INSERT, UPDATE and DELETE statements can be prepared\n";
+            return statement;
+        }
+        statement = make_shared<const sql_statement>(parsed);
+        statements.add(statement_text, statement);
+        return statement;
+    }
+    
+    // C++ API: run a prepared statement with its placeholders bound to arguments, in order; false once an
+    // error is printed
+    bool execute(const sql_statement &statement, const vector<string> &arguments){
+        sql_statement bound;
+        if(!statement.bind(arguments, bound))
+            return false;
+        bool running = true;
+        return run_statement(bound, running);
+    }
             
-            size_t where_loc = command.find("where ");
+    
+    void launch(){
+        cout << "Launching Abhi SQL...\n";
+        bool running = true;
+        while(running){
+            // Display prompt and take the command as input until the user hits return
+            cout << prompt;
+            if(!read_statement(cin, command)){
+                cout << "\n";
+                process("exit", running);
+                break;
+            }
             
-            string where = "";
-            where_condition cond;
-            if(where_loc != string::npos){
-                where = command.substr(where_loc);
+            size_t command_begin = statement_begin(command);
+            if(command_begin == command.size()){
+                cout << "\n";
+                continue;
             }
-            if(where.size() > 0){
-                // eat where keyword
-                where = where.substr(6);
-                
-                // find comparison operator
-                size_t loc = min(where.find_first_of("=!<>"), where.find(" is "));
-                if(loc == string::npos){
-                    cout << "[Error] No valid comparison operator found\n";
-                    return true;
-                }
-                
-                // extract comparison variable
-                ss.str(where.substr(0, loc));
-                string comp_variable = extract_word(ss);
-                if(comp_variable == ""){
-                    cout << "[Error] No column name specified before the comparison operator\n";
-                    return true;
-                }
-                cond.column_name = comp_variable;
+            command = command.substr(command_begin);
                 
-                // extract remaining values
-                where = where.substr(loc);
-                switch(where[0]){
-                    case '=':{
-                        cond.comp_code = 0;
-                        cond.value_is_null = false;
-                        
-                        cond.value = extract_value(where.substr(1));
-                        if(cond.value == ""){
-                            return true;
-                        }
-                        break;
-                    }
-                    case '!':{
-                        if(where[1] != '='){
-                            cout << "[Error] Syntax error for comparison operator, try using \'var != value\'\n";
-                            return true;
-                        }
-                        cond.comp_code = 1;
-                        cond.value_is_null = false;
-                        
-                        cond.value = extract_value(where.substr(2));
-                        if(cond.value == ""){
-                            return true;
-                        }
-                        break;
-                    }
-                    case '<':{
-                        if(where[1] == '='){
-                            cond.comp_code = 4;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(2));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        else{
-                            cond.comp_code = 2;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(1));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        break;
-                    }
-                    case '>':{
-                        if(where[1] == '='){
-                            cond.comp_code = 5;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(2));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        else{
-                            cond.comp_code = 3;
-                            cond.value_is_null = false;
-                            
-                            cond.value = extract_value(where.substr(1));
-                            if(cond.value == ""){
-                                return true;
-                            }
-                        }
-                        break;
-                    }
-                    case ' ':{
-                        cond.value_is_null = true;
-                        cond.value = "null";
-                        
-                        stringstream where_ss(where);
-                        string is_keyword = extract_word(where_ss);
-                        string value_keyword = extract_word(where_ss);
-                        if(value_keyword == "null"){
-                            cond.comp_code = 6;
-                        }
-                        else if(value_keyword == "not"){
-                            value_keyword = extract_word(where_ss);
-                            if(value_keyword == "null"){
-                                cond.comp_code = 7;
-                            }
-                            else{
-                                cout << "[Error] Did you mean 'is not null'?\n";
-                                return true;
-                            }
-                        }
-                        else{
-                            cout << "[Error] Did you mean 'is null'?\n";
-                            return true;
-                        }
-                        break;
-                    }
-                    default:{
-                        cout << where;
-                        cout << "[Error] Comparison operator not recognized\n";
-                        return true;
-                    }
+            // Process the command
+            process(command, running);
+        }
+    }
+    
+    
+    // Batch mode: run the statements of a script with no prompts and the output collected in a large buffer,
+    // then print how many ran and how fast. Stops at EXIT, or at the first statement that fails if
+    // stop_on_error; an open transaction left at the end is rolled back. False if any statement failed.
+    bool run_script(istream &script, bool stop_on_error){
+        batch_buffer output;
+        streambuf *console = cout.rdbuf(&output);
+        ostream *tied = script.tie(NULL);
+        size_t statements = 0, failed = 0;
+        bool running = true;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        while(running && read_statement(script, command)){
+            size_t command_begin = statement_begin(command);
+            if(command_begin == command.size())
+                continue;
+            statements++;
+            if(!process(command.substr(command_begin), running)){
+                failed++;
+                if(stop_on_error){
+                    cout << "[Error] Stopped at statement " << statements << "\n";
+                    running = false;
                 }
             }
-            
-            engine.update_records(table_name, "-", "0", cond, true);
         }
-        else{
-            cout << "[Error] Invalid command\n";
+        if(engine.in_transaction()){
+            cout << "[Warning] Rolling back the open transaction\n";
+            engine.rollback_transaction();
         }
-        return true;
+        double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e6;
+        cout.flush();
+        cout.rdbuf(console);
+        script.tie(tied);
+        
+        char summary[200];
+        snprintf(summary, sizeof(summary), "%zu statements run, %zu succeeded, %zu failed in %.3f s, %.0f statements/s\n", statements, statements - failed, failed, seconds, seconds > 0 ? statements / seconds : 0.0);
+        cout << summary;
+        return failed == 0;
+    }
+    
+    
+    // Run a statement, recorded to the trace if capturing; false if it does not parse or fails, running
+    // turns false for EXIT
+    bool process(string command, bool &running){
+        if(!trace)
+            return run_command(command, running);
+        trace_entry entry;
+        entry.offset = trace->now();
+        bool succeeded = run_traced(command, cout.rdbuf(), entry, running);
+        trace->add(entry);
+        return succeeded;
+    }
+    
+    
+    // Record every statement process runs from now on to a trace file, with when it started, how long it
+    // took, the records it returned and a digest of its output. False if the file cannot be written.
+    bool capture(const string &trace_path){
+        trace.reset(new trace_writer());
+        if(trace->open(trace_path))
+            return true;
+        trace.reset();
+        cout << "[Error] Cannot write trace file \'" << trace_path << "\'\n";
+        return false;
+    }
+    
+    
+    // Run the statements of a trace again, as fast as they come or paced as they were captured, with their
+    // output dropped, and print each one whose records or output differ from the capture. Meant for a fresh
+    // database holding what the captured one held when the capture began. False if any differed or the trace
+    // cannot be read to its end.
+    bool replay(const string &trace_path, bool paced){
+        trace_reader trace_file;
+        if(!trace_file.open(trace_path)){
+            cout << "[Error] Cannot read trace file \'" << trace_path << "\'\n";
+            return false;
+        }
+        size_t statements = 0, diverged = 0;
+        uint64_t captured_time = 0, replayed_time = 0;
+        trace_entry captured, replayed;
+        bool running = true;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        while(running && trace_file.next(captured)){
+            if(paced)
+                this_thread::sleep_until(start + chrono::microseconds(captured.offset));
+            run_traced(captured.text, NULL, replayed, running);
+            statements++;
+            captured_time += captured.duration;
+            replayed_time += replayed.duration;
+            bool same_output = !captured.compared || !replayed.compared || captured.digest == replayed.digest;
+            if(captured.rows == replayed.rows && same_output)
+                continue;
+            diverged++;
+            cout << "[Error] Statement " << statements << " diverged: " << captured.text.substr(0, 80) << "\n";
+            if(captured.rows != replayed.rows)
+                cout << "        " << captured.rows << " records captured, " << replayed.rows << " replayed\n";
+            else
+                cout << "        its output differs\n";
+        }
+        if(trace_file.broken())
+            cout << "[Error] The trace is cut short after statement " << statements << "\n";
+        if(engine.in_transaction()){
+            cout << "[Warning] Rolling back the open transaction\n";
+            engine.rollback_transaction();
+        }
+        double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e6;
+        char summary[240];
+        snprintf(summary, sizeof(summary), "%zu statements replayed, %zu diverged in %.3f s; statement time %.3f s captured, %.3f s replayed\n", statements, diverged, seconds, captured_time / 1e6, replayed_time / 1e6);
+        cout << summary;
+        return diverged == 0 && !trace_file.broken();
     }
 };
 
@@ -0,0 +1,223 @@
+#ifndef query_planner_h
+#define query_planner_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include "file_utils.h"
+#include "table_statistics.h"
+using namespace std;
+
+// cost of a page reached by following a pointer down a tree, a page read next along a leaf chain costing 1
+#ifndef PLAN_RANDOM_PAGE_COST
+#define PLAN_RANDOM_PAGE_COST 4.0
+#endif
+
+#define PLAN_ROW_COST 0.01              // checking a row and passing it on, in pages
+#define PLAN_HASH_ROW_COST 0.02         // adding a row to a hash table, or looking one up
+#define PLAN_INTERIOR_FANOUT 50         // children of an interior page, for the depth of a tree
+#define PLAN_DEFAULT_ROWS_PER_LEAF 10   // for tables that were never analyzed
+
+
+// An operator of a query plan, over the operators that feed it rows
+struct plan_node{
+    string operator_name;
+    string detail;
+    double rows;                        // estimated rows out of the operator
+    double pages;                       // estimated pages read by the operator and those under it
+    double cost;                        // of the operator and those under it
+    vector<plan_node> children;
+    
+    plan_node(){
+        rows = pages = cost = 0;
+    }
+    
+    plan_node(string name, string text, double estimated_rows, double estimated_pages, double estimated_cost){
+        operator_name = name;
+        detail = text;
+        rows = estimated_rows;
+        pages = estimated_pages;
+        cost = estimated_cost;
+    }
+    
+    
+    // this operator on top of a child, adding its own cost
+    static plan_node over(const plan_node &child, string name, string text, double estimated_rows, double own_cost){
+        plan_node node(name, text, estimated_rows, child.pages, child.cost + own_cost);
+        node.children.push_back(child);
+        return node;
+    }
+};
+
+
+// Prices the ways of reading a table from its statistics. Tables never analyzed are priced by the size of
+// their file, with fixed guesses for the fraction of rows a condition selects.
+class query_planner{
+    
+    // compare a value with a histogram bound, as numbers for number columns
+    static bool less_than(uint8_t data_type, const string &a, const string &b){
+        if(data_type >= 0x04 && data_type <= 0x09)
+            return atof(a.c_str()) < atof(b.c_str());
+        return a < b;
+    }
+
+public:
+    
+    // Statistics that stand in for those of a table never analyzed
+    static table_statistics default_statistics(size_t file_bytes){
+        table_statistics stats;
+        stats.leaf_pages = max((size_t) 1, file_bytes / PAGE_SIZE);
+        stats.row_count = (uint64_t) stats.leaf_pages * PLAN_DEFAULT_ROWS_PER_LEAF;
+        return stats;
+    }
+    
+    
+    // statistics of a column, NULL if the table was not analyzed
+    static const column_statistics* column(const table_statistics &stats, string column_name){
+        for(size_t i = 0; i < stats.columns.size(); i++){
+            if(stats.columns[i].column_name == column_name)
+                return &stats.columns[i];
+        }
+        return NULL;
+    }
+    
+    
+    // levels of interior pages above leaf_pages leaves
+    static uint32_t tree_depth(uint32_t leaf_pages){
+        uint32_t depth = 0;
+        while(leaf_pages > 1){
+            leaf_pages = (leaf_pages + PLAN_INTERIOR_FANOUT - 1) / PLAN_INTERIOR_FANOUT;
+            depth++;
+        }
+        return depth;
+    }
+    
+    
+    // Fraction of the values of a column below value, going by its histogram: whole buckets below, and the part
+    // of the bucket the value falls in (half of it for text). -1 if there is no histogram.
+    static double fraction_below(const column_statistics &column, uint8_t data_type, const string &value){
+        const vector<string> &bounds = column.histogram;
+        if(bounds.size() == 0)
+            return -1;
+        bool numbers = (data_type >= 0x04 && data_type <= 0x09);
+        double buckets = 0;
+        for(size_t i = 0; i < bounds.size(); i++){
+            const string &low = (i == 0) ? column.min_value : bounds[i - 1];
+            if(!less_than(data_type, value, bounds[i])){
+                buckets += 1;
+                continue;
+            }
+            if(less_than(data_type, low, value)){
+                if(numbers){
+                    double low_value = atof(low.c_str()), high_value = atof(bounds[i].c_str());
+                    buckets += (atof(value.c_str()) - low_value) / (high_value - low_value);
+                }
+                else{
+                    buckets += 0.5;
+                }
+            }
+            break;
+        }
+        return buckets / bounds.size();
+    }
+    
+    
+    // Fraction of the rows a comparison selects, comp_code as in where_condition. Without statistics of the
+    // column, fixed guesses stand in.
+    static double comparison_selectivity(const column_statistics *column, uint8_t data_type, bool row_id, uint8_t comp_code, const string &value){
+        if(comp_code == 6)
+            return column ? column->null_fraction : 0.1;
+        if(comp_code == 7)
+            return column ? 1 - column->null_fraction : 0.9;
+        
+        double not_null = column ? 1 - column->null_fraction : 1;
+        double equal = row_id ? 0.001 : 0.1;
+        if(column)
+            equal = (column->distinct_count > 0) ? not_null / column->distinct_count : 0;
+        if(comp_code == 0)
+            return equal;
+        if(comp_code == 1)
+            return column ? not_null - equal : 0.9;
+        
+        double below = column ? fraction_below(*column, data_type, value) : -1;
+        if(below < 0)
+            return 0.33;
+        double selectivity = 0;
+        switch(comp_code){
+            case 2:
+                selectivity = not_null * below;
+                break;
+            case 3:
+                selectivity = not_null * (1 - below) - equal;
+                break;
+            case 4:
+                selectivity = not_null * below + equal;
+                break;
+            case 5:
+                selectivity = not_null * (1 - below);
+                break;
+        }
+        return min(not_null, max(0.0, selectivity));
+    }
+    
+    
+    // Fraction of the rows with a row_id in [low_key, high_key]
+    static double row_id_fraction(const table_statistics &stats, uint32_t low_key, uint32_t high_key){
+        if(low_key <= 1 && high_key == 0xffffffff)
+            return 1;
+        double rows = max((double) stats.row_count, 1.0);
+        const column_statistics *row_ids = column(stats, "row_id");
+        double fraction;
+        if(low_key == high_key){
+            fraction = row_ids ? 1 / rows : 0.001;
+        }
+        else if(row_ids && row_ids->histogram.size() > 0){
+            double high = (high_key == 0xffffffff) ? 1 : fraction_below(*row_ids, 0x06, to_string(high_key + 0.5));
+            double low = (low_key <= 1) ? 0 : fraction_below(*row_ids, 0x06, to_string(low_key - 0.5));
+            fraction = high - low;
+        }
+        else{
+            fraction = ((low_key <= 1 || high_key == 0xffffffff) ? 0.33 : 0.33 * 0.33);
+        }
+        return min(1.0, max(fraction, 1 / rows));
+    }
+    
+    
+    // The cheaper of reading every leaf of a table and reading only the leaves of [low_key, high_key]. Either way
+    // starts by going down the tree to the first leaf it reads.
+    static plan_node access_path(string table_name, const table_statistics &stats, uint32_t low_key, uint32_t high_key){
+        double depth = tree_depth(stats.leaf_pages);
+        double leaves = max(stats.leaf_pages, (uint32_t) 1);
+        plan_node full("Full scan", table_name, stats.row_count, depth + leaves,
+                       depth * PLAN_RANDOM_PAGE_COST + leaves + stats.row_count * PLAN_ROW_COST);
+        if(low_key <= 1 && high_key == 0xffffffff)
+            return full;
+        
+        double fraction = row_id_fraction(stats, low_key, high_key);
+        double range_leaves = max(1.0, ceil(fraction * leaves));
+        string range = "[" + to_string(low_key) + ", " + (high_key == 0xffffffff ? string("end") : to_string(high_key)) + "]";
+        plan_node range_scan("Row_id range scan", table_name + " " + range, fraction * stats.row_count, depth + range_leaves,
+                             depth * PLAN_RANDOM_PAGE_COST + range_leaves + fraction * stats.row_count * PLAN_ROW_COST);
+        return (range_scan.cost <= full.cost) ? range_scan : full;
+    }
+    
+    
+    // Print a plan as an indented tree, each operator with its estimates
+    static void print(const plan_node &node, int level = 0){
+        char estimates[128];
+        snprintf(estimates, sizeof(estimates), "  (rows=%.0f pages=%.0f cost=%.2f)", ceil(node.rows), ceil(node.pages), node.cost);
+        console::out() << string(3 * level, ' ') << "-> " << node.operator_name;
+        if(node.detail.size() > 0)
+            console::out() << ' ' << node.detail;
+        console::out() << estimates << '\n';
+        for(size_t i = 0; i < node.children.size(); i++){
+            print(node.children[i], level + 1);
+        }
+    }
+};
+
+
+#endif /* query_planner_h */
@@ -0,0 +1,182 @@
+#ifndef query_profile_h
+#define query_profile_h
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include "console.h"
+
+// stages of a query that EXPLAIN ANALYZE counts separately
+#define STAGE_NONE -1                   // work outside of the stages, not counted
+#define STAGE_CATALOG 0                 // reading the catalog tables
+#define STAGE_DESCENT 1                 // reading interior pages to find the leaves
+#define STAGE_LEAF_SCAN 2               // reading and decoding leaves
+#define STAGE_PREDICATE 3               // checking rows against the condition
+#define STAGE_PROJECTION 4              // keeping the asked for columns of a row
+#define STAGE_OUTPUT 5                  // formatting the result
+#define PROFILE_STAGES 6
+
+
+// Counters of a query run under EXPLAIN ANALYZE. The profile belongs to the thread running the query and to
+// the pool threads working on its batches, so queries of other threads are not counted in; while a thread has
+// none, the counting calls return straight away. Time is counted per thread and stage, exclusive of the stages
+// a stage calls into, and summed over the threads.
+class query_profile{
+    struct stage_counters{
+        std::atomic<uint64_t> rows_in, rows_out, disk_pages, cached_pages, bytes_decoded, nanoseconds;
+        stage_counters() : rows_in(0), rows_out(0), disk_pages(0), cached_pages(0), bytes_decoded(0), nanoseconds(0){}
+    };
+    
+    // the stage a thread is in, -1 outside of any, and since when
+    struct thread_stage{
+        int stage;
+        std::chrono::steady_clock::time_point since;
+    };
+    
+    stage_counters stages[PROFILE_STAGES];
+    std::chrono::steady_clock::time_point started;
+    query_profile *outer;               // the profile of the thread before start
+    
+    static query_profile*& profiling(){
+        static thread_local query_profile *profile = NULL;
+        return profile;
+    }
+    
+    static thread_stage& this_thread(){
+        static thread_local thread_stage current = {-1, std::chrono::steady_clock::time_point()};
+        return current;
+    }
+    
+    // charge the time since the thread's stage was entered or resumed to the stage
+    void charge(thread_stage &current, std::chrono::steady_clock::time_point now){
+        if(current.stage != -1)
+            stages[current.stage].nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - current.since).count();
+        current.since = now;
+    }
+
+public:
+    
+    // the profile the calling thread counts into, NULL if none
+    static query_profile* active(){
+        return profiling();
+    }
+    
+    static void bind(query_profile *profile){
+        profiling() = profile;
+    }
+    
+    // count what the following queries of the calling thread do, until stop
+    void start(){
+        started = std::chrono::steady_clock::now();
+        outer = active();
+        bind(this);
+    }
+    
+    void stop(){
+        bind(outer);
+    }
+    
+    
+    // The calling thread enters a stage; returns the stage it was in, to get back to on leave
+    int enter(int stage){
+        thread_stage &current = this_thread();
+        int previous = current.stage;
+        charge(current, std::chrono::steady_clock::now());
+        current.stage = stage;
+        return previous;
+    }
+    
+    void leave(int previous){
+        thread_stage &current = this_thread();
+        charge(current, std::chrono::steady_clock::now());
+        current.stage = previous;
+    }
+    
+    
+    static void count_rows(int stage, uint64_t rows_in, uint64_t rows_out){
+        query_profile *profile = active();
+        if(profile == NULL)
+            return;
+        profile->stages[stage].rows_in += rows_in;
+        profile->stages[stage].rows_out += rows_out;
+    }
+    
+    // a page read by the calling thread, from the file or from memory
+    static void count_page(bool cached){
+        query_profile *profile = active();
+        int stage = this_thread().stage;
+        if(profile == NULL || stage == -1)
+            return;
+        if(cached)
+            profile->stages[stage].cached_pages++;
+        else
+            profile->stages[stage].disk_pages++;
+    }
+    
+    static void count_bytes(uint64_t bytes){
+        query_profile *profile = active();
+        int stage = this_thread().stage;
+        if(profile == NULL || stage == -1)
+            return;
+        profile->stages[stage].bytes_decoded += bytes;
+    }
+    
+    
+    // Print the counters of every stage and the wall time since start
+    void print(){
+        const char *names[PROFILE_STAGES] = {"catalog lookup", "tree descent", "leaf scan", "predicate evaluation", "projection", "output"};
+        double wall_ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count() / 1000.0;
+        char line[160];
+        snprintf(line, sizeof(line), "%-22s %10s %10s %10s %10s %14s %10s\n", "stage", "rows in", "rows out", "disk pages", "cached", "bytes decoded", "time (ms)");
+        console::out() << '\n' << line;
+        for(int s = 0; s < PROFILE_STAGES; s++){
+            snprintf(line, sizeof(line), "%-22s %10llu %10llu %10llu %10llu %14llu %10.3f\n", names[s],
+                     (unsigned long long) stages[s].rows_in, (unsigned long long) stages[s].rows_out, (unsigned long long) stages[s].disk_pages,
+                     (unsigned long long) stages[s].cached_pages, (unsigned long long) stages[s].bytes_decoded, stages[s].nanoseconds / 1e6);
+            console::out() << line;
+        }
+        snprintf(line, sizeof(line), "%.3f ms in all\n", wall_ms);
+        console::out() << line;
+    }
+};
+
+
+// The calling thread counts into a profile (NULL for none) for the lifetime of the object, as a pool thread
+// working for a profiled query does, and back into its own at the end
+class profile_binding{
+    query_profile *previous;
+
+public:
+    profile_binding(query_profile *profile){
+        previous = query_profile::active();
+        query_profile::bind(profile);
+    }
+    
+    ~profile_binding(){
+        query_profile::bind(previous);
+    }
+};
+
+
+// The calling thread is in a stage for the lifetime of the object, if a query is being profiled
+class profile_scope{
+    query_profile *profile;
+    int previous;
+
+public:
+    profile_scope(int stage){
+        profile = query_profile::active();
+        if(profile != NULL)
+            previous = profile->enter(stage);
+    }
+    
+    ~profile_scope(){
+        if(profile != NULL)
+            profile->leave(previous);
+    }
+};
+
+
+#endif /* query_profile_h */
@@ -0,0 +1,236 @@
+#ifndef record_printer_h
+#define record_printer_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include "file_utils.h"
+#include "query_profile.h"
+using namespace std;
+
+// records a streamed result is held back for to size its columns
+#ifndef PRINT_WIDTH_ROWS
+#define PRINT_WIDTH_ROWS 1000
+#endif
+
+// bytes of output a script run in batch mode collects before writing them out
+#ifndef BATCH_OUTPUT_BUFFER
+#define BATCH_OUTPUT_BUFFER (1 << 20)
+#endif
+
+
+// Prints records to the console as a table, the header record first. The first width_rows records set the
+// column widths and are held back until then; a later value wider than its column pushes the rest of its row
+// out. Records may come from several threads at once.
+class record_printer{
+    long limit;                         // records to print at most, -1 for all of them
+    size_t width_rows;
+    vector<record_type> pending;        // held back until the widths are known
+    vector<size_t> col_widths;
+    size_t width;
+    bool laid_out;
+    size_t rows;                        // records taken, not counting the header
+    ostream *stream;
+    mutex print_mutex;
+    
+    static string tabulate_entry(string entry, size_t width){
+        if(entry.size() >= width){
+            return entry;
+        }
+        size_t before = 1;
+        return string(before, ' ') + entry + string(width - before - entry.size(), ' ');
+    }
+    
+    ostream& out(){
+        return *stream;
+    }
+    
+    void print(const record_type &record){
+        out() << '|';
+        if(record.first == (uint32_t) -1)
+            out() << tabulate_entry("id", 5) << '|';
+        else
+            out() << tabulate_entry(to_string(record.first), 5) << '|';
+        for(size_t j = 0; j < record.second.size(); j++){
+            out() << tabulate_entry(record.second[j].second, col_widths[j] + 2) << '|';
+        }
+        out() << '\n';
+        
+        if(record.first == (uint32_t) -1){
+            out() << '|';
+            out() << string(width, '-');
+            out() << "|\n";
+        }
+    }
+    
+    // size the columns after the records held back and print them
+    void lay_out(){
+        out() << '\n';
+        col_widths.assign(pending[0].second.size(), 0);
+        width = 5;
+        for(size_t j = 0; j < col_widths.size(); j++){
+            for(size_t i = 0; i < pending.size(); i++){
+                if(pending[i].second[j].second.size() > col_widths[j]){
+                    col_widths[j] = pending[i].second[j].second.size();
+                }
+            }
+            width += (col_widths[j] + 3);
+        }
+        
+        out() << ' ';
+        out() << string(width, '-');
+        out() << '\n';
+        for(size_t i = 0; i < pending.size(); i++){
+            print(pending[i]);
+        }
+        pending.clear();
+        laid_out = true;
+    }
+
+public:
+    
+    // where the records of the printers this thread makes go, NULL for its console; EXPLAIN ANALYZE sets them
+    // aside through a printer_redirect
+    static ostream*& output(){
+        static thread_local ostream *stream = NULL;
+        return stream;
+    }
+    
+    // records the printers of this thread have finished with, for a workload capture to count
+    static size_t& rows_returned(){
+        static thread_local size_t returned = 0;
+        return returned;
+    }
+    
+    record_printer(long max_records = -1, size_t rows_for_widths = PRINT_WIDTH_ROWS){
+        limit = max_records;
+        width_rows = rows_for_widths;
+        width = 0;
+        laid_out = false;
+        rows = 0;
+        stream = output() ? output() : &console::out();
+    }
+    
+    
+    void add(const record_type &record){
+        profile_scope output_stage(STAGE_OUTPUT);
+        lock_guard<mutex> guard(print_mutex);
+        if(record.first != (uint32_t) -1){
+            if(limit != -1 && rows >= (size_t) limit){
+                query_profile::count_rows(STAGE_OUTPUT, 1, 0);
+                return;
+            }
+            ++rows;
+            query_profile::count_rows(STAGE_OUTPUT, 1, 1);
+        }
+        if(laid_out){
+            print(record);
+            return;
+        }
+        pending.push_back(record);
+        if(pending.size() >= width_rows && rows > 0)
+            lay_out();
+    }
+    
+    
+    // print whatever is held back and the count of records
+    void finish(){
+        profile_scope output_stage(STAGE_OUTPUT);
+        lock_guard<mutex> guard(print_mutex);
+        rows_returned() += rows;
+        if(!laid_out){
+            if(rows == 0){
+                out() << "0 records to display\n\n";
+                return;
+            }
+            lay_out();
+        }
+        out() << ' ';
+        out() << string(width, '-');
+        out() << '\n' << rows << " records returned.\n";
+    }
+};
+
+
+// The printers the calling thread makes send their records to a stream (NULL for the console) for the lifetime
+// of the object, and to where they went before at the end
+class printer_redirect{
+    ostream *previous;
+
+public:
+    printer_redirect(ostream *stream){
+        previous = record_printer::output();
+        record_printer::output() = stream;
+    }
+    
+    ~printer_redirect(){
+        record_printer::output() = previous;
+    }
+};
+
+
+// A stream buffer that takes whatever is written to it and keeps none of it
+class discard_buffer : public streambuf{
+protected:
+    int overflow(int c){
+        return traits_type::not_eof(c);
+    }
+    
+    streamsize xsputn(const char *, streamsize n){
+        return n;
+    }
+};
+
+
+// A stream buffer for the console output of a script run in batch mode: collected in one large buffer that
+// is written to stdout only once it is full or synced
+class batch_buffer : public streambuf{
+    vector<char> buffer;
+    size_t used;
+    
+    void write_out(){
+        if(used > 0)
+            fwrite(&buffer[0], 1, used, stdout);
+        used = 0;
+    }
+
+protected:
+    int overflow(int c){
+        if(traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        char character = traits_type::to_char_type(c);
+        xsputn(&character, 1);
+        return c;
+    }
+    
+    streamsize xsputn(const char *s, streamsize n){
+        if(used + n > buffer.size())
+            write_out();
+        if((size_t) n >= buffer.size()){
+            fwrite(s, 1, n, stdout);
+            return n;
+        }
+        memcpy(&buffer[used], s, n);
+        used += n;
+        return n;
+    }
+    
+    int sync(){
+        write_out();
+        fflush(stdout);
+        return 0;
+    }
+
+public:
+    batch_buffer() : buffer(BATCH_OUTPUT_BUFFER), used(0){}
+    
+    ~batch_buffer(){
+        sync();
+    }
+};
+
+
+#endif /* record_printer_h */
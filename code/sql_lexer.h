@@ -0,0 +1,124 @@
+#ifndef sql_lexer_h
+#define sql_lexer_h
+
+#include <string>
+#include <string_view>
+#include <cctype>
+#include <cstring>
+using namespace std;
+
+// kinds of tokens
+#define TOKEN_END 0                     // past the last token
+#define TOKEN_WORD 1                    // keywords, names and unquoted values
+#define TOKEN_STRING 2                  // a quoted value, without its quotes; a quote in it is written twice
+#define TOKEN_SYMBOL 3                  // ( ) , ; * ? and the comparison operators
+#define TOKEN_UNTERMINATED 4            // a quoted value missing its closing quote
+
+
+// A token of a statement, a view into the statement's text
+struct sql_token{
+    uint8_t type;
+    string_view text;
+    size_t position;                    // where the token starts in the statement
+    
+    sql_token() : type(TOKEN_END), position(0){}
+    
+    sql_token(uint8_t token_type, string_view token_text, size_t token_position) : type(token_type), text(token_text), position(token_position){}
+    
+    
+    // whether the token is word or symbol, keywords being compared without regard to case
+    bool is(const char *word) const{
+        if(type != TOKEN_WORD && type != TOKEN_SYMBOL)
+            return false;
+        size_t length = strlen(word);
+        if(text.size() != length)
+            return false;
+        for(size_t i = 0; i < length; i++){
+            if(tolower((unsigned char) text[i]) != word[i])
+                return false;
+        }
+        return true;
+    }
+    
+    // the text of a quoted value, with its doubled quotes made single
+    string unquoted() const{
+        string value;
+        value.reserve(text.size());
+        for(size_t i = 0; i < text.size(); i++){
+            value += text[i];
+            if(text[i] == '\'')
+                i++;
+        }
+        return value;
+    }
+    
+    // the token as a name: a word in lowercase
+    string lowercase() const{
+        string name(text);
+        for(size_t i = 0; i < name.size(); i++){
+            name[i] = tolower((unsigned char) name[i]);
+        }
+        return name;
+    }
+};
+
+
+// Splits a statement into tokens in one pass, without copying any of its text. Words run up to whitespace or
+// a symbol, so unquoted values such as 1991-08-13 or 2018-03-17_05:23:56 are single words; the text of quoted
+// values is kept as it was typed.
+class sql_lexer{
+    string_view text;
+    size_t position;
+    
+    static bool is_symbol(char c){
+        return c == '(' || c == ')' || c == ',' || c == ';' || c == '*' || c == '?' || c == '\'';
+    }
+    
+    static bool is_operator(char c){
+        return c == '=' || c == '!' || c == '<' || c == '>';
+    }
+
+public:
+    sql_lexer(string_view statement_text = string_view()) : text(statement_text), position(0){}
+    
+    
+    sql_token next(){
+        while(position < text.size() && isspace((unsigned char) text[position])){
+            position++;
+        }
+        if(position == text.size())
+            return sql_token(TOKEN_END, string_view(), position);
+        
+        size_t start = position;
+        char c = text[position];
+        if(c == '\''){
+            size_t closing = text.find('\'', start + 1);
+            while(closing != string_view::npos && closing + 1 < text.size() && text[closing + 1] == '\''){
+                closing = text.find('\'', closing + 2);
+            }
+            if(closing == string_view::npos){
+                position = text.size();
+                return sql_token(TOKEN_UNTERMINATED, text.substr(start + 1), start);
+            }
+            position = closing + 1;
+            return sql_token(TOKEN_STRING, text.substr(start + 1, closing - start - 1), start);
+        }
+        if(is_operator(c)){
+            while(position < text.size() && is_operator(text[position])){
+                position++;
+            }
+            return sql_token(TOKEN_SYMBOL, text.substr(start, position - start), start);
+        }
+        if(is_symbol(c)){
+            position++;
+            return sql_token(TOKEN_SYMBOL, text.substr(start, 1), start);
+        }
+        while(position < text.size() && !isspace((unsigned char) text[position]) && !is_symbol(text[position]) && !is_operator(text[position])){
+            position++;
+        }
+        return sql_token(TOKEN_WORD, text.substr(start, position - start), start);
+    }
+};
+
+
+#endif /* sql_lexer_h */
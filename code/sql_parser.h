@@ -0,0 +1,668 @@
+#ifndef sql_parser_h
+#define sql_parser_h
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include "abhisql.h"
+#include "sql_lexer.h"
+using namespace std;
+
+
+// A parsed statement of any kind, the fields of its kind filled in. Values may be ? placeholders, numbered in
+// the order they appear in the text and bound to arguments on every run of a prepared statement.
+struct sql_statement{
+    string action;                                      // the statement's first keyword, in lowercase
+    string table_name;
+    select_statement select;                            // of a SELECT
+    vector<column_type> columns;                        // of a CREATE TABLE, row_id left out
+    vector<string> insert_columns;                      // of an INSERT, empty for all of them in order
+    vector<vector<string> > insert_values_list;
+    vector<pair<size_t, size_t> > value_parameters;     // (tuple, value) of each placeholder among the INSERT values
+    string set_column, set_value;                       // of an UPDATE
+    int set_parameter;                                  // placeholder standing for set_value, -1 for none
+    where_condition cond;                               // of an UPDATE or DELETE
+    string rows_path;                                   // of a LOAD
+    double fill_factor;
+    string name;                                        // of a PREPARE, EXECUTE or DEALLOCATE
+    vector<string> arguments;                           // of an EXECUTE
+    bool analyze;                                       // of an EXPLAIN ANALYZE
+    shared_ptr<const sql_statement> inner;              // the statement an EXPLAIN or a PREPARE is about
+    size_t parameter_count;
+    
+    sql_statement(){
+        select.has_aggregates = false;
+        select.limit = -1;
+        set_parameter = -1;
+        fill_factor = 1.0;
+        analyze = false;
+        parameter_count = 0;
+    }
+    
+    
+    // A copy of the statement with its placeholders replaced by arguments, in order. False once an error is
+    // printed.
+    bool bind(const vector<string> &arguments, sql_statement &bound) const{
+        if(arguments.size() != parameter_count){
+            console::out() << "[Error] Statement expects " << parameter_count << " parameters, " << arguments.size() << " given\n";
+            return false;
+        }
+        bound = *this;
+        for(size_t i = 0; i < value_parameters.size(); i++){
+            bound.insert_values_list[value_parameters[i].first][value_parameters[i].second] = arguments[i];
+        }
+        if(set_parameter != -1)
+            bound.set_value = arguments[set_parameter];
+        
+        where_condition &bound_cond = (action == "select") ? bound.select.cond : bound.cond;
+        bound_cond.each_comparison([&arguments](where_condition &comparison){
+            if(comparison.parameter != -1)
+                comparison.value = arguments[comparison.parameter];
+            return true;
+        });
+        return true;
+    }
+};
+
+
+// Recursive-descent parser from the tokens of a statement to a sql_statement, looking one token ahead. Names
+// are kept in lowercase and quoted values as they were typed. Errors are printed and make parse return false.
+class sql_parser{
+    sql_lexer lexer;
+    sql_token token;                    // the next token to parse
+    size_t parameters;                  // ? placeholders met so far
+    
+    void advance(){
+        token = lexer.next();
+    }
+    
+    // move past the next token if it is word
+    bool accept(const char *word){
+        if(!token.is(word))
+            return false;
+        advance();
+        return true;
+    }
+    
+    bool syntax_error(string expected){
+        if(token.type == TOKEN_END)
+            console::out() << "[Syntax error] Expected " << expected << " at the end of the statement\n";
+        else
+            console::out() << "[Syntax error] Expected " << expected << " in place of \'" << token.text << "\'\n";
+        return false;
+    }
+    
+    bool expect(const char *word){
+        return accept(word) || syntax_error(string("\'") + word + "\'");
+    }
+    
+    // a table or column name, possibly qualified by its table
+    bool name(string &text, const char *what){
+        if(token.type != TOKEN_WORD)
+            return syntax_error(what);
+        text = token.lowercase();
+        advance();
+        return true;
+    }
+    
+    
+    // A value: quoted ('' standing for a quote), unquoted (kept in lowercase, NULL among them) or a ? placeholder, whose number goes to
+    // parameter
+    bool value(string &text, int &parameter){
+        parameter = -1;
+        if(token.type == TOKEN_UNTERMINATED){
+            console::out() << "[Error] Closing quote not found for value\n";
+            return false;
+        }
+        if(token.type == TOKEN_STRING)
+            text = token.unquoted();
+        else if(token.type == TOKEN_WORD)
+            text = token.lowercase();
+        else if(token.is("?")){
+            text = "?";
+            parameter = parameters++;
+        }
+        else
+            return syntax_error("a value");
+        advance();
+        return true;
+    }
+    
+    
+    // comparison: column operator value, or column IS [NOT] NULL
+    bool comparison(where_condition &cond){
+        if(token.type != TOKEN_WORD){
+            console::out() << "[Error] No column name specified before the comparison operator\n";
+            return false;
+        }
+        cond = where_condition(token.lowercase(), 0, "");
+        advance();
+        
+        if(accept("is")){
+            cond.value_is_null = true;
+            cond.value = "null";
+            cond.comp_code = accept("not") ? 7 : 6;
+            if(!accept("null")){
+                console::out() << ((cond.comp_code == 7) ? "[Error] Did you mean 'is not null'?\n" : "[Error] Did you mean 'is null'?\n");
+                return false;
+            }
+            return true;
+        }
+        
+        const char *operators[] = {"=", "!=", "<", ">", "<=", ">="};
+        size_t code = 0;
+        while(code < 6 && !token.is(operators[code])){
+            code++;
+        }
+        if(code == 6){
+            if(token.type != TOKEN_SYMBOL || string("=!<>").find(token.text[0]) == string::npos)
+                console::out() << "[Error] No valid comparison operator found\n";
+            else if(token.text[0] == '!')
+                console::out() << "[Error] Syntax error for comparison operator, try using \'var != value\'\n";
+            else
+                console::out() << "[Error] Comparison operator not recognized\n";
+            return false;
+        }
+        cond.comp_code = code;
+        advance();
+        
+        if(token.type == TOKEN_END || token.is("(") || token.is(")") || token.is(";")){
+            console::out() << "[Error] No value to compare \'" << cond.column_name << "\' with\n";
+            return false;
+        }
+        return value(cond.value, cond.parameter);
+    }
+    
+    
+    // operand of AND: [NOT] comparison, or [NOT] ( condition )
+    bool condition_operand(where_condition &cond){
+        if(accept("not")){
+            where_condition operand;
+            if(!condition_operand(operand))
+                return false;
+            cond = where_condition(WHERE_NOT, vector<where_condition>(1, operand));
+            return true;
+        }
+        if(accept("(")){
+            if(!condition(cond))
+                return false;
+            if(!accept(")")){
+                console::out() << "[Error] Missing closing parenthesis in condition\n";
+                return false;
+            }
+            return true;
+        }
+        return comparison(cond);
+    }
+    
+    
+    // operands joined by keyword into one condition of logic_code, or the single operand
+    bool condition_list(where_condition &cond, const char *keyword, uint8_t logic_code){
+        vector<where_condition> operands(1);
+        bool parsed = (logic_code == WHERE_OR) ? condition_list(operands[0], "and", WHERE_AND) : condition_operand(operands[0]);
+        while(parsed && accept(keyword)){
+            operands.push_back(where_condition());
+            parsed = (logic_code == WHERE_OR) ? condition_list(operands.back(), "and", WHERE_AND) : condition_operand(operands.back());
+        }
+        if(!parsed)
+            return false;
+        
+        // nested lists of the same operator are flattened into this one
+        vector<where_condition> flat;
+        for(size_t i = 0; i < operands.size(); i++){
+            if(operands[i].logic_code == logic_code)
+                flat.insert(flat.end(), operands[i].operands.begin(), operands[i].operands.end());
+            else
+                flat.push_back(operands[i]);
+        }
+        cond = (flat.size() == 1) ? flat[0] : where_condition(logic_code, flat);
+        return true;
+    }
+    
+    // comparisons joined by AND and OR, AND binding tighter, each one possibly negated by NOT or grouped in
+    // parentheses
+    bool condition(where_condition &cond){
+        return condition_list(cond, "or", WHERE_OR);
+    }
+    
+    
+    // CREATE TABLE table_name (row_id int primary key, column data_type [NOT NULL], ...)
+    bool create_table(sql_statement &statement){
+        const char *data_types[] = {"tinyint", "smallint", "int", "bigint", "real", "double", "datetime", "date", "text"};
+        if(!accept("table")){
+            console::out() << "[Syntax error] Did you mean \'CREATE TABLE table_name (...)\'?\n";
+            return false;
+        }
+        if(token.type != TOKEN_WORD){
+            console::out() << "[Error] Table name not provided or left parenthesis is missing\n";
+            return false;
+        }
+        statement.table_name = token.lowercase();
+        advance();
+        if(!accept("(")){
+            console::out() << "[Error] Table name not provided or left parenthesis is missing\n";
+            return false;
+        }
+        if(!(accept("row_id") && accept("int") && accept("primary") && accept("key"))){
+            console::out() << "[Syntax error] First column should always be 'row_id int primary key'\n";
+            return false;
+        }
+        
+        while(accept(",")){
+            size_t column_number = statement.columns.size() + 2;
+            column_type ct;
+            if(token.type != TOKEN_WORD){
+                console::out() << "[Error] No column name provided for column number " << column_number << "\n";
+                return false;
+            }
+            ct.column_name = token.lowercase();
+            advance();
+            if(token.type != TOKEN_WORD){
+                console::out() << "[Error] No column data type provided for column number " << column_number << "\n";
+                return false;
+            }
+            ct.data_type = token.lowercase();
+            size_t type = 0;
+            while(type < 9 && ct.data_type != data_types[type]){
+                type++;
+            }
+            if(type == 9){
+                console::out() << "[Error] \'" << ct.data_type << "\' is not a valid data type\n";
+                return false;
+            }
+            advance();
+            if(accept("not")){
+                if(!accept("null")){
+                    console::out() << "[Error] Invalid column specifier. Did you mean \'not null\'\n";
+                    return false;
+                }
+                ct.not_null = true;
+            }
+            statement.columns.push_back(ct);
+        }
+        if(!accept(")")){
+            console::out() << "[Error] Right matching parenthesis not found\n";
+            return false;
+        }
+        return true;
+    }
+    
+    
+    // INSERT INTO TABLE table_name [(columns)] VALUES (...), ...
+    bool insert(sql_statement &statement){
+        if(!(accept("into") && accept("table")) || token.type != TOKEN_WORD){
+            console::out() << "[Syntax error] Correct syntax is \"INSERT INTO TABLE table_name [columns] values(..)\"?\n";
+            return false;
+        }
+        statement.table_name = token.lowercase();
+        advance();
+        
+        if(accept("(")){
+            do{
+                string column;
+                if(!name(column, "a column name"))
+                    return false;
+                statement.insert_columns.push_back(column);
+            } while(accept(","));
+            if(!expect(")"))
+                return false;
+        }
+        
+        if(!accept("values")){
+            console::out() << "[Syntax error] Use keyword VALUES in place of \'" << token.text << "\'\n";
+            return false;
+        }
+        
+        // one parenthesised tuple per record
+        while(accept("(")){
+            vector<string> insert_values;
+            do{
+                string column_value;
+                int parameter;
+                if(token.is(",") || token.is(")")){
+                    console::out() << "[Error] Missing value for a column\n";
+                    return false;
+                }
+                if(!value(column_value, parameter))
+                    return false;
+                if(column_value == "" && parameter == -1){
+                    console::out() << "[Error] Missing value for a column\n";
+                    return false;
+                }
+                if(parameter != -1)
+                    statement.value_parameters.push_back(make_pair(statement.insert_values_list.size(), insert_values.size()));
+                insert_values.push_back(column_value);
+            } while(accept(","));
+            if(!accept(")")){
+                console::out() << "[Syntax error] Missing closing parenthesis\n";
+                return false;
+            }
+            
+            if(statement.insert_columns.size() > 0 && insert_values.size() != statement.insert_columns.size()){
+                console::out() << "[Error] Mismatched number of columns and values\n";
+                return false;
+            }
+            statement.insert_values_list.push_back(insert_values);
+            
+            // tuples are separated by commas
+            if(!accept(","))
+                break;
+        }
+        if(statement.insert_values_list.size() == 0){
+            console::out() << "[Error] No values were specified for insertion\n";
+            return false;
+        }
+        return true;
+    }
+    
+    
+    // LOAD TABLE table_name FROM 'rows_file' [FILL fill_factor]
+    bool load(sql_statement &statement){
+        if(!accept("table") || token.type != TOKEN_WORD){
+            console::out() << "[Syntax error] Correct syntax is \"LOAD TABLE table_name FROM 'rows_file' [FILL fill_factor]\"\n";
+            return false;
+        }
+        statement.table_name = token.lowercase();
+        advance();
+        if(!accept("from")){
+            console::out() << "[Error]: Incorrect syntax. Did you forget the FROM keyword?\n";
+            return false;
+        }
+        if(token.type != TOKEN_STRING){
+            console::out() << "[Error] Rows file must be given within quotes\n";
+            return false;
+        }
+        statement.rows_path = string(token.text);
+        advance();
+        
+        if(accept("fill")){
+            string fill_text(token.text);
+            char *number_end;
+            statement.fill_factor = strtod(fill_text.c_str(), &number_end);
+            if(token.type != TOKEN_WORD || *number_end != '\0'){
+                console::out() << "[Error] FILL expects a number in (0, 1]\n";
+                return false;
+            }
+            advance();
+        }
+        return true;
+    }
+    
+    
+    // UPDATE table_name SET column = value [WHERE condition]
+    bool update(sql_statement &statement){
+        if(!name(statement.table_name, "a table name"))
+            return false;
+        if(!accept("set")){
+            console::out() << "[Error]: Incorrect syntax. Did you forget the SET keyword?\n";
+            return false;
+        }
+        if(!name(statement.set_column, "a column name") || !expect("=") || !value(statement.set_value, statement.set_parameter))
+            return false;
+        return !accept("where") || condition(statement.cond);
+    }
+    
+    
+    // DELETE FROM table_name [WHERE condition]
+    bool delete_records(sql_statement &statement){
+        if(!accept("from")){
+            console::out() << "[Error]: Incorrect syntax. Did you forget the FROM keyword?\n";
+            return false;
+        }
+        if(!name(statement.table_name, "a table name"))
+            return false;
+        return !accept("where") || condition(statement.cond);
+    }
+    
+    
+    // SELECT items FROM table_name [JOIN other_table ON column = column] [WHERE condition] [GROUP BY column]
+    // [ORDER BY column [ASC|DESC], ...] [LIMIT n]
+    bool select(sql_statement &statement){
+        select_statement &select = statement.select;
+        
+        // columns, * or aggregate functions such as count(*), kept without whitespace
+        do{
+            if(accept("*")){
+                select.projection_columns.push_back("*");
+                continue;
+            }
+            if(token.type != TOKEN_WORD || token.is("from")){
+                console::out() << "[Error] No projected columns specified in command\n";
+                return false;
+            }
+            string item = token.lowercase();
+            advance();
+            if(accept("(")){
+                string argument;
+                if(accept("*"))
+                    argument = "*";
+                else if(!name(argument, "a column or *"))
+                    return false;
+                if(!expect(")"))
+                    return false;
+                item += "(" + argument + ")";
+                select.has_aggregates = true;
+            }
+            select.projection_columns.push_back(item);
+        } while(accept(","));
+        
+        if(!accept("from")){
+            console::out() << "[Error] Invalid syntax, could not find the 'from' keyword\n";
+            return false;
+        }
+        if(token.type != TOKEN_WORD){
+            console::out() << "[Error] No table to select records from\n";
+            return false;
+        }
+        select.table_name = token.lowercase();
+        advance();
+        
+        bool inner_join = accept("inner");
+        if(accept("join")){
+            if(token.type == TOKEN_WORD){
+                select.join_table = token.lowercase();
+                advance();
+            }
+            if(select.join_table == "" || !accept("on") || token.type != TOKEN_WORD){
+                console::out() << "[Error] Invalid syntax, try 'FROM table JOIN other_table ON table.column = other_table.column'\n";
+                return false;
+            }
+            select.join_left_column = token.lowercase();
+            advance();
+            if(!accept("=") || token.type != TOKEN_WORD){
+                console::out() << "[Error] Invalid syntax, try 'FROM table JOIN other_table ON table.column = other_table.column'\n";
+                return false;
+            }
+            select.join_right_column = token.lowercase();
+            advance();
+        }
+        else if(inner_join){
+            return syntax_error("'join'");
+        }
+        
+        if(accept("where") && !condition(select.cond))
+            return false;
+        
+        if(accept("group")){
+            if(!expect("by"))
+                return false;
+            if(token.type != TOKEN_WORD){
+                console::out() << "[Error] No column to group by\n";
+                return false;
+            }
+            select.group_column = token.lowercase();
+            advance();
+        }
+        
+        if(accept("order")){
+            if(!expect("by"))
+                return false;
+            do{
+                if(token.type != TOKEN_WORD || token.is("limit")){
+                    console::out() << "[Error] Invalid syntax, try 'ORDER BY column [ASC|DESC], ...'\n";
+                    return false;
+                }
+                string order_column = token.lowercase();
+                advance();
+                bool descending = accept("desc");
+                if(!descending)
+                    accept("asc");
+                select.order_columns.push_back(make_pair(order_column, descending));
+            } while(accept(","));
+        }
+        
+        if(accept("limit")){
+            if(token.type != TOKEN_WORD || token.text.find_first_not_of("0123456789") != string_view::npos){
+                console::out() << "[Error] Invalid syntax, try 'LIMIT number_of_rows'\n";
+                return false;
+            }
+            select.limit = atol(string(token.text).c_str());
+            advance();
+        }
+        
+        if(select.order_columns.size() > 0 && (select.group_column != "" || select.has_aggregates)){
+            console::out() << "[Error] ORDER BY cannot be combined with GROUP BY or aggregate functions\n";
+            return false;
+        }
+        return true;
+    }
+    
+    
+    // EXPLAIN [ANALYZE] SELECT ...
+    bool explain(sql_statement &statement){
+        statement.analyze = accept("analyze");
+        if(!token.is("select")){
+            console::out() << "[Error] Only SELECT statements can be explained\n";
+            return false;
+        }
+        sql_statement inner;
+        if(!body(inner))
+            return false;
+        inner.parameter_count = parameters;
+        statement.inner = make_shared<const sql_statement>(inner);
+        return true;
+    }
+    
+    
+    // PREPARE name AS statement
+    bool prepare(sql_statement &statement){
+        if(!name(statement.name, "a name for the statement") || !accept("as")){
+            console::out() << "[Syntax error] Correct syntax is \"PREPARE name AS statement\"\n";
+            return false;
+        }
+        if(!(token.is("select") || token.is("insert") || token.is("update") || token.is("delete"))){
+            console::out() << "[Error] Only SELECT, INSERT, UPDATE and DELETE statements can be prepared\n";
+            return false;
+        }
+        sql_statement inner;
+        if(!body(inner))
+            return false;
+        inner.parameter_count = parameters;
+        statement.inner = make_shared<const sql_statement>(inner);
+        return true;
+    }
+    
+    
+    // EXECUTE name [(value, ...)]
+    bool execute(sql_statement &statement){
+        if(!name(statement.name, "the name of a prepared statement"))
+            return false;
+        if(!accept("("))
+            return true;
+        if(accept(")"))
+            return true;
+        do{
+            string argument;
+            int parameter;
+            if(!value(argument, parameter))
+                return false;
+            statement.arguments.push_back(argument);
+        } while(accept(","));
+        return expect(")");
+    }
+    
+    
+    // a statement from its first keyword on
+    bool body(sql_statement &statement){
+        if(token.type != TOKEN_WORD){
+            console::out() << "[Error] Invalid command\n";
+            return false;
+        }
+        statement.action = token.lowercase();
+        advance();
+        
+        const string &action = statement.action;
+        if(action == "exit" || action == "begin" || action == "commit" || action == "rollback")
+            return true;
+        if(action == "show"){
+            if(!accept("tables")){
+                console::out() << "Incorrect syntax. Did you mean \'SHOW TABLES\'?\n";
+                return false;
+            }
+            return true;
+        }
+        if(action == "create")
+            return create_table(statement);
+        if(action == "drop"){
+            if(!accept("table")){
+                console::out() << "Incorrect syntax. Did you mean \"DROP TABLES table_name;\"?\n";
+                return false;
+            }
+            return name(statement.table_name, "a table name");
+        }
+        if(action == "insert")
+            return insert(statement);
+        if(action == "load")
+            return load(statement);
+        if(action == "update")
+            return update(statement);
+        if(action == "delete")
+            return delete_records(statement);
+        if(action == "select")
+            return select(statement);
+        if(action == "explain")
+            return explain(statement);
+        if(action == "analyze"){
+            if(token.type == TOKEN_WORD){
+                statement.table_name = token.lowercase();
+                advance();
+            }
+            return true;
+        }
+        if(action == "prepare")
+            return prepare(statement);
+        if(action == "execute")
+            return execute(statement);
+        if(action == "deallocate")
+            return name(statement.name, "the name of a prepared statement");
+        
+        console::out() << "[Error] Invalid command\n";
+        return false;
+    }
+
+public:
+    sql_parser() : parameters(0){}
+    
+    
+    // Parse a statement, an optional ; and nothing after it
+    bool parse(string_view text, sql_statement &statement){
+        lexer = sql_lexer(text);
+        parameters = 0;
+        advance();
+        if(!body(statement))
+            return false;
+        accept(";");
+        if(token.type != TOKEN_END){
+            console::out() << "[Syntax error] Unexpected \'" << token.text << "\' after the end of the statement\n";
+            return false;
+        }
+        statement.parameter_count = parameters;
+        return true;
+    }
+};
+
+
+#endif /* sql_parser_h */
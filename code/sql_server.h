@@ -0,0 +1,426 @@
+#ifndef sql_server_h
+#define sql_server_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <poll.h>
+#include <fcntl.h>
+#include "ultralitesql.h"
+#include "wire_protocol.h"
+using namespace std;
+
+// socket the server listens on, in the database directory, unless given
+#ifndef SERVER_SOCKET
+#define SERVER_SOCKET "ultralitesql.sock"
+#endif
+
+// threads running the requests of the clients
+#ifndef SERVER_WORKERS
+#define SERVER_WORKERS 8
+#endif
+
+// rows sent in each WIRE_ROWS message
+#ifndef SERVER_BATCH_ROWS
+#define SERVER_BATCH_ROWS 512
+#endif
+
+
+// Serves any number of clients over a Unix socket, and over TCP on the loopback address if asked to, with one
+// engine shared by all of them. A poll loop waits for requests on the idle connections and hands a connection
+// with one to the next free worker of a fixed set; the worker runs the request and gives the connection back.
+// A transaction belongs to its connection, so one left open between requests holds no worker, only the write
+// gates of the tables it wrote.
+class sql_server{
+    struct connection{
+        int fd;
+        ultralite_db db;
+        unordered_map<uint32_t, unique_ptr<ultralite_statement> > statements;
+        uint32_t next_statement_id;
+        
+        connection(int socket_fd) : fd(socket_fd), next_statement_id(1){}
+    };
+    
+    vector<int> listeners;
+    int wake_pipe[2];                   // written to wake the poll loop
+    mutex queue_mutex;
+    condition_variable queue_ready;
+    deque<connection*> ready;           // connections with a request waiting, for the workers
+    vector<connection*> returned;       // connections the workers are done with, for the poll loop
+    unordered_set<connection*> connections;
+    bool stopping;
+    atomic<size_t> requests_served;
+    
+    static volatile sig_atomic_t& signalled(){
+        static volatile sig_atomic_t stop_signal = 0;
+        return stop_signal;
+    }
+    
+    static int& signal_pipe(){
+        static int fd = -1;
+        return fd;
+    }
+    
+    static void on_signal(int){
+        signalled() = 1;
+        if(signal_pipe() != -1){
+            char byte = 0;
+            ssize_t ignored = write(signal_pipe(), &byte, 1);
+            (void) ignored;
+        }
+    }
+    
+    void wake(){
+        char byte = 0;
+        ssize_t ignored = write(wake_pipe[1], &byte, 1);
+        (void) ignored;
+    }
+    
+    
+    static bool send_error(connection &client, int code, const string &message){
+        string response;
+        wire_writer writer(response);
+        writer.put_u8(code);
+        writer.put_text(message);
+        return wire_socket::write_frame(client.fd, WIRE_ERROR, response);
+    }
+    
+    // the value of a column of the current row, as its type is sent
+    static void put_column(wire_writer &writer, ultralite_statement &statement, size_t column){
+        uint8_t type = statement.column_type(column);
+        if(type == ULTRALITE_NULL)
+            writer.put_u8(WIRE_NULL);
+        else if(type <= 0x07){
+            writer.put_u8(WIRE_INT);
+            writer.put_u64(statement.column_int(column));
+        }
+        else if(type <= 0x09){
+            wire_value value;
+            value.kind = WIRE_DOUBLE;
+            value.double_value = statement.column_double(column);
+            writer.put_value(value);
+        }
+        else{
+            writer.put_u8(WIRE_TEXT);
+            writer.put_text(statement.column_text(column));
+        }
+    }
+    
+    // Run a statement and send its columns, its rows in batches and the count of them
+    static bool send_result(connection &client, ultralite_statement &statement){
+        int code = statement.step();
+        if(code != ULTRALITE_ROW && code != ULTRALITE_DONE)
+            return send_error(client, code, client.db.error_message());
+        
+        string response;
+        wire_writer writer(response);
+        writer.put_u16(statement.column_count());
+        for(size_t i = 0; i < statement.column_count(); i++){
+            writer.put_text(statement.column_name(i));
+        }
+        if(!wire_socket::write_frame(client.fd, WIRE_COLUMNS, response))
+            return false;
+        
+        uint64_t rows = 0;
+        while(code == ULTRALITE_ROW){
+            string batch;
+            wire_writer batch_writer(batch);
+            batch_writer.put_u32(0);
+            uint32_t batch_rows = 0;
+            while(code == ULTRALITE_ROW && batch_rows < SERVER_BATCH_ROWS){
+                batch_writer.put_u32(statement.row_id());
+                for(size_t i = 0; i < statement.column_count(); i++){
+                    put_column(batch_writer, statement, i);
+                }
+                batch_rows++;
+                code = statement.step();
+            }
+            for(size_t i = 0; i < 4; i++){
+                batch[i] = (char) (batch_rows >> (8 * i));
+            }
+            if(!wire_socket::write_frame(client.fd, WIRE_ROWS, batch))
+                return false;
+            rows += batch_rows;
+        }
+        response.clear();
+        writer.put_u64(rows);
+        return wire_socket::write_frame(client.fd, WIRE_DONE, response);
+    }
+    
+    // Read one request of a connection and answer it; false once the connection is closed or broken
+    bool serve_request(connection &client){
+        uint8_t type;
+        string request;
+        if(!wire_socket::read_frame(client.fd, type, request))
+            return false;
+        requests_served++;
+        wire_reader reader(request);
+        if(type == WIRE_QUERY || type == WIRE_PREPARE){
+            string text(reader.get_text());
+            if(!reader.ok())
+                return false;
+            unique_ptr<ultralite_statement> statement(new ultralite_statement());
+            int code = client.db.prepare(text, *statement);
+            if(code != ULTRALITE_OK)
+                return send_error(client, code, client.db.error_message());
+            if(type == WIRE_QUERY)
+                return send_result(client, *statement);
+            
+            uint32_t id = client.next_statement_id++;
+            string response;
+            wire_writer writer(response);
+            writer.put_u32(id);
+            writer.put_u16(statement->parameter_count());
+            client.statements[id] = move(statement);
+            return wire_socket::write_frame(client.fd, WIRE_PREPARED, response);
+        }
+        if(type == WIRE_EXECUTE){
+            uint32_t id = reader.get_u32();
+            uint16_t count = reader.get_u16();
+            unordered_map<uint32_t, unique_ptr<ultralite_statement> >::iterator found = client.statements.find(id);
+            if(!reader.ok())
+                return false;
+            if(found == client.statements.end())
+                return send_error(client, ULTRALITE_MISUSE, string("No prepared statement ") + to_string(id));
+            ultralite_statement &statement = *found->second;
+            statement.reset();
+            for(uint16_t i = 0; i < count; i++){
+                wire_value value;
+                if(!reader.get_value(value))
+                    return false;
+                int code;
+                if(value.kind == WIRE_INT)
+                    code = statement.bind(i, value.int_value);
+                else if(value.kind == WIRE_DOUBLE)
+                    code = statement.bind(i, value.double_value);
+                else if(value.kind == WIRE_TEXT)
+                    code = statement.bind(i, value.text);
+                else
+                    code = statement.bind_null(i);
+                if(code != ULTRALITE_OK)
+                    return send_error(client, code, client.db.error_message());
+            }
+            return send_result(client, statement);
+        }
+        if(type == WIRE_CLOSE){
+            uint32_t id = reader.get_u32();
+            if(!reader.ok())
+                return false;
+            client.statements.erase(id);
+            string response;
+            wire_writer writer(response);
+            writer.put_u64(0);
+            return wire_socket::write_frame(client.fd, WIRE_DONE, response);
+        }
+        send_error(client, ULTRALITE_MISUSE, string("Unknown request type ") + to_string(type));
+        return false;
+    }
+    
+    void work(){
+        while(true){
+            connection *client;
+            {
+                unique_lock<mutex> lock(queue_mutex);
+                queue_ready.wait(lock, [this](){ return stopping || !ready.empty(); });
+                if(ready.empty())
+                    return;
+                client = ready.front();
+                ready.pop_front();
+            }
+            
+            if(!serve_request(*client)){
+                {
+                    lock_guard<mutex> guard(queue_mutex);
+                    connections.erase(client);
+                }
+                close(client->fd);
+                delete client;
+                continue;
+            }
+            lock_guard<mutex> guard(queue_mutex);
+            returned.push_back(client);
+            wake();
+        }
+    }
+    
+    
+    bool listen_unix(const string &socket_path){
+        sockaddr_un address;
+        if(socket_path.size() >= sizeof(address.sun_path)){
+            cout << "[Error] Socket path \'" << socket_path << "\' is too long\n";
+            return false;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, socket_path.c_str());
+        unlink(socket_path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0 || ::bind(fd, (sockaddr*) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0){
+            cout << "[Error] Cannot listen on \'" << socket_path << "\': " << strerror(errno) << "\n";
+            if(fd >= 0)
+                close(fd);
+            return false;
+        }
+        listeners.push_back(fd);
+        return true;
+    }
+    
+    bool listen_tcp(int port){
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if(fd >= 0)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if(fd < 0 || ::bind(fd, (sockaddr*) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0){
+            cout << "[Error] Cannot listen on port " << port << ": " << strerror(errno) << "\n";
+            if(fd >= 0)
+                close(fd);
+            return false;
+        }
+        listeners.push_back(fd);
+        return true;
+    }
+    
+    void accept_connection(int listener){
+        int fd = accept(listener, NULL, NULL);
+        if(fd < 0)
+            return;
+        int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        connection *client = new connection(fd);
+        if(client->db.open(".") != ULTRALITE_OK){
+            send_error(*client, ULTRALITE_CANTOPEN, client->db.error_message());
+            close(fd);
+            delete client;
+            return;
+        }
+        lock_guard<mutex> guard(queue_mutex);
+        connections.insert(client);
+        returned.push_back(client);
+    }
+
+public:
+    sql_server() : stopping(false), requests_served(0){
+        wake_pipe[0] = wake_pipe[1] = -1;
+    }
+    
+    
+    // Serve the database of the working directory at socket_path, and at the TCP port unless it is 0, until
+    // SIGINT or SIGTERM. False if it cannot listen.
+    bool run(const string &socket_path, int tcp_port, size_t worker_count){
+        if(!listen_unix(socket_path) || (tcp_port != 0 && !listen_tcp(tcp_port)))
+            return false;
+        if(pipe(wake_pipe) != 0){
+            cout << "[Error] Cannot create a pipe: " << strerror(errno) << "\n";
+            return false;
+        }
+        fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+        signal_pipe() = wake_pipe[1];
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+        signal(SIGPIPE, SIG_IGN);
+        
+        vector<thread> workers;
+        for(size_t i = 0; i < worker_count; i++){
+            workers.push_back(thread(&sql_server::work, this));
+        }
+        cout << "Serving on " << socket_path;
+        if(tcp_port != 0)
+            cout << " and 127.0.0.1:" << tcp_port;
+        cout << " with " << worker_count << " workers\n";
+        cout.flush();
+        
+        // connections waiting for a request, polled after the wake pipe and the listeners
+        vector<connection*> idle;
+        vector<pollfd> polled;
+        while(!signalled()){
+            {
+                lock_guard<mutex> guard(queue_mutex);
+                idle.insert(idle.end(), returned.begin(), returned.end());
+                returned.clear();
+            }
+            polled.clear();
+            pollfd entry;
+            entry.events = POLLIN;
+            entry.revents = 0;
+            entry.fd = wake_pipe[0];
+            polled.push_back(entry);
+            for(size_t i = 0; i < listeners.size(); i++){
+                entry.fd = listeners[i];
+                polled.push_back(entry);
+            }
+            for(size_t i = 0; i < idle.size(); i++){
+                entry.fd = idle[i]->fd;
+                polled.push_back(entry);
+            }
+            if(poll(&polled[0], polled.size(), -1) < 0)
+                continue;
+            
+            if(polled[0].revents != 0){
+                char bytes[64];
+                while(read(wake_pipe[0], bytes, sizeof(bytes)) > 0){
+                }
+            }
+            for(size_t i = 0; i < listeners.size(); i++){
+                if(polled[1 + i].revents != 0)
+                    accept_connection(listeners[i]);
+            }
+            size_t kept = 0;
+            lock_guard<mutex> guard(queue_mutex);
+            for(size_t i = 0; i < idle.size(); i++){
+                if(polled[1 + listeners.size() + i].revents != 0)
+                    ready.push_back(idle[i]);
+                else
+                    idle[kept++] = idle[i];
+            }
+            if(kept < idle.size())
+                queue_ready.notify_all();
+            idle.resize(kept);
+        }
+        
+        // workers in the middle of a request see their connection closed; the transactions left open are rolled
+        // back as the connections are deleted
+        {
+            lock_guard<mutex> guard(queue_mutex);
+            stopping = true;
+            for(unordered_set<connection*>::iterator it = connections.begin(); it != connections.end(); ++it){
+                shutdown((*it)->fd, SHUT_RDWR);
+            }
+        }
+        queue_ready.notify_all();
+        for(size_t i = 0; i < workers.size(); i++){
+            workers[i].join();
+        }
+        for(unordered_set<connection*>::iterator it = connections.begin(); it != connections.end(); ++it){
+            close((*it)->fd);
+            delete *it;
+        }
+        connections.clear();
+        for(size_t i = 0; i < listeners.size(); i++){
+            close(listeners[i]);
+        }
+        unlink(socket_path.c_str());
+        signal_pipe() = -1;
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        cout << "Served " << requests_served << " requests\n";
+        return true;
+    }
+};
+
+
+#endif /* sql_server_h */
@@ -0,0 +1,49 @@
+#ifndef statement_cache_h
+#define statement_cache_h
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "sql_parser.h"
+using namespace std;
+
+// parsed statements kept by the text they were parsed from
+#ifndef STATEMENT_CACHE_SIZE
+#define STATEMENT_CACHE_SIZE 256
+#endif
+
+
+// The statements parsed most recently, by their text. A statement found here is run without being lexed or
+// parsed again; the least recently used one makes way once STATEMENT_CACHE_SIZE are kept.
+class statement_cache{
+    typedef pair<string, shared_ptr<const sql_statement> > cache_entry;
+    list<cache_entry> entries;                          // most recently used first
+    unordered_map<string, list<cache_entry>::iterator> positions;
+
+public:
+    
+    // the statement parsed from text, NULL if it is not kept
+    shared_ptr<const sql_statement> find(const string &text){
+        unordered_map<string, list<cache_entry>::iterator>::iterator found = positions.find(text);
+        if(found == positions.end())
+            return shared_ptr<const sql_statement>();
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->second;
+    }
+    
+    void add(const string &text, shared_ptr<const sql_statement> statement){
+        if(positions.find(text) != positions.end())
+            return;
+        entries.push_front(make_pair(text, statement));
+        positions[text] = entries.begin();
+        if(entries.size() > STATEMENT_CACHE_SIZE){
+            positions.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+};
+
+
+#endif /* statement_cache_h */
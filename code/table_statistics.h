@@ -0,0 +1,158 @@
+#ifndef table_statistics_h
+#define table_statistics_h
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "file_utils.h"
+#include "external_sort.h"
+using namespace std;
+
+// leaves ANALYZE reads from a table at most, spread evenly over the leaf level
+#ifndef STATS_SAMPLE_LEAVES
+#define STATS_SAMPLE_LEAVES 256
+#endif
+
+#define STATS_HISTOGRAM_BUCKETS 8       // equi-depth buckets per column
+#define STATS_VALUE_BYTES 24            // text values are kept cut to this many bytes, bucket bounds to half
+
+
+// what ANALYZE learned about a column
+struct column_statistics{
+    string column_name;
+    double null_fraction;
+    string min_value, max_value;        // empty if no sampled row has a value
+    uint64_t distinct_count;
+    vector<string> histogram;           // upper bound of every bucket, each holding an equal share of the rows
+};
+
+
+// what ANALYZE learned about a table, row_id first among the columns
+struct table_statistics{
+    uint64_t row_count;
+    uint32_t leaf_pages;
+    vector<column_statistics> columns;
+};
+
+
+// Statistics estimated from the rows of a sample of leaves
+class statistics_sampler{
+    static string value_text(const sort_column &column, const record_type &row, size_t max_bytes){
+        if(column.ordinal_position == -1)
+            return to_string(row.first);
+        const string &value = row.second[column.ordinal_position].second;
+        return (column.data_type >= 0x0c && value.size() > max_bytes) ? value.substr(0, max_bytes) : value;
+    }
+    
+    // as IS NULL sees it: text columns hold NULL as an empty value of type 0x0c
+    static bool is_null(const sort_column &column, const record_type &row){
+        if(column.ordinal_position == -1)
+            return false;
+        uint8_t type_code = row.second[column.ordinal_position].first;
+        return type_code <= 0x03 || (column.data_type >= 0x0c && type_code == 0x0c);
+    }
+
+public:
+    
+    // Positions of the leaves to read among leaf_count of them, evenly spread, the first and last one included
+    static vector<size_t> sample_leaves(size_t leaf_count, size_t sample_size){
+        vector<size_t> leaves;
+        if(leaf_count <= sample_size){
+            for(size_t i = 0; i < leaf_count; i++){
+                leaves.push_back(i);
+            }
+            return leaves;
+        }
+        for(size_t i = 0; i + 1 < sample_size; i++){
+            leaves.push_back(i * (leaf_count - 1) / (sample_size - 1));
+        }
+        leaves.push_back(leaf_count - 1);
+        return leaves;
+    }
+    
+    
+    // Statistics of a column from the sampled rows of a table of row_count rows. Distinct values are estimated
+    // with the Haas-Stokes Duj1 estimator, from those seen in the sample and those seen only once.
+    static column_statistics column_from_sample(string column_name, const sort_column &column, const vector<record_type> &rows, uint64_t row_count){
+        column_statistics stats;
+        stats.column_name = column_name;
+        stats.null_fraction = 0;
+        stats.distinct_count = 0;
+        
+        // the values in order, through their sort keys
+        vector<pair<string, size_t> > keys;
+        size_t nulls = 0;
+        for(size_t r = 0; r < rows.size(); r++){
+            if(is_null(column, rows[r])){
+                nulls++;
+                continue;
+            }
+            string key;
+            sort_key::append_column(key, column, rows[r]);
+            keys.push_back(make_pair(key, r));
+        }
+        if(rows.size() > 0)
+            stats.null_fraction = (double) nulls / rows.size();
+        if(keys.size() == 0)
+            return stats;
+        sort(keys.begin(), keys.end());
+        stats.min_value = value_text(column, rows[keys.front().second], STATS_VALUE_BYTES);
+        stats.max_value = value_text(column, rows[keys.back().second], STATS_VALUE_BYTES);
+        
+        size_t distinct = 0, seen_once = 0;
+        for(size_t i = 0, j; i < keys.size(); i = j){
+            j = i + 1;
+            while(j < keys.size() && keys[j].first == keys[i].first){
+                j++;
+            }
+            distinct++;
+            if(j - i == 1)
+                seen_once++;
+        }
+        double n = keys.size(), values = row_count * (1 - stats.null_fraction);
+        if(n >= values){
+            stats.distinct_count = distinct;
+        }
+        else{
+            double estimate = n * distinct / (n - seen_once + seen_once * n / values);
+            stats.distinct_count = (uint64_t) min(values, max((double) distinct, estimate));
+        }
+        
+        size_t buckets = min((size_t) STATS_HISTOGRAM_BUCKETS, keys.size());
+        for(size_t b = 1; b <= buckets; b++){
+            stats.histogram.push_back(value_text(column, rows[keys[b * keys.size() / buckets - 1].second], STATS_VALUE_BYTES / 2));
+        }
+        return stats;
+    }
+    
+    
+    // Bucket bounds as stored in the catalog: separated by '|', which is left out of text bounds
+    static string histogram_text(const vector<string> &bounds){
+        string text;
+        for(size_t i = 0; i < bounds.size(); i++){
+            if(i > 0)
+                text += '|';
+            for(size_t j = 0; j < bounds[i].size(); j++){
+                if(bounds[i][j] != '|')
+                    text += bounds[i][j];
+            }
+        }
+        return text;
+    }
+    
+    static vector<string> parse_histogram(const string &text){
+        vector<string> bounds;
+        if(text.size() == 0)
+            return bounds;
+        size_t begin = 0, end;
+        while((end = text.find('|', begin)) != string::npos){
+            bounds.push_back(text.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        bounds.push_back(text.substr(begin));
+        return bounds;
+    }
+};
+
+
+#endif /* table_statistics_h */
@@ -0,0 +1,225 @@
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include "query_profile.h"
+#include "record_printer.h"
+using namespace std;
+
+// number of pool threads, 0 for one per hardware thread
+#ifndef POOL_THREADS
+#define POOL_THREADS 0
+#endif
+
+
+// Fixed set of worker threads with one task deque each. A worker takes tasks from the front of its own
+// deque and, once that runs dry, steals from the back of the others, so uneven tasks even out by themselves.
+// A task counts into the profile, and prints to the printer output, of the thread that handed out its batch.
+class work_stealing_pool{
+    // tasks handed to the pool by one call to run()
+    struct batch{
+        const function<void(size_t)> *task;
+        query_profile *profile;
+        ostream *printer_output;
+        atomic<size_t> remaining;
+        mutex done_mutex;
+        condition_variable done;
+    };
+    
+    struct worker_queue{
+        mutex queue_mutex;
+        deque<pair<batch*, size_t> > items;
+    };
+    
+    deque<worker_queue> queues;
+    vector<thread> workers;
+    mutex wake_mutex;
+    condition_variable wake;
+    atomic<long> queued;                // items in all the queues
+    bool stopping;
+    
+    
+    // own deque first, then steal from the others
+    bool take(size_t self, pair<batch*, size_t> &item){
+        for(size_t k = 0; k < queues.size(); k++){
+            worker_queue &q = queues[(self + k) % queues.size()];
+            lock_guard<mutex> guard(q.queue_mutex);
+            if(q.items.empty())
+                continue;
+            if(k == 0){
+                item = q.items.front();
+                q.items.pop_front();
+            }
+            else{
+                item = q.items.back();
+                q.items.pop_back();
+            }
+            --queued;
+            return true;
+        }
+        return false;
+    }
+    
+    
+    void execute(pair<batch*, size_t> &item){
+        batch *b = item.first;
+        {
+            profile_binding profiled(b->profile);
+            printer_redirect redirect(b->printer_output);
+            (*b->task)(item.second);
+        }
+        
+        // the batch lives on the stack of run(), which may return as soon as the count reaches zero
+        lock_guard<mutex> guard(b->done_mutex);
+        if(--b->remaining == 0)
+            b->done.notify_all();
+    }
+    
+    
+    void work(size_t self){
+        while(true){
+            pair<batch*, size_t> item;
+            if(take(self, item)){
+                execute(item);
+                continue;
+            }
+            unique_lock<mutex> lock(wake_mutex);
+            wake.wait(lock, [this]{ return stopping || queued.load() > 0; });
+            if(stopping)
+                return;
+        }
+    }
+
+public:
+    work_stealing_pool(size_t threads){
+        queued = 0;
+        stopping = false;
+        queues.resize(max((size_t) 1, threads));
+        for(size_t i = 0; i < threads; i++){
+            workers.push_back(thread(&work_stealing_pool::work, this, i));
+        }
+    }
+    
+    ~work_stealing_pool(){
+        {
+            lock_guard<mutex> guard(wake_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(size_t i = 0; i < workers.size(); i++){
+            workers[i].join();
+        }
+    }
+    
+    
+    // the pool shared by the engine, the calling thread makes up for the one hardware thread left out
+    static work_stealing_pool& shared(){
+        size_t threads = POOL_THREADS;
+        if(threads == 0)
+            threads = max(1u, thread::hardware_concurrency()) - 1;
+        static work_stealing_pool pool(threads);
+        return pool;
+    }
+    
+    
+    // threads that work on a batch, counting the caller
+    size_t size(){
+        return workers.size() + 1;
+    }
+    
+    
+    // Run task(0) ... task(count - 1) and return once all of them are done. The tasks are dealt out in
+    // contiguous blocks, and the calling thread works on them too.
+    void run(size_t count, const function<void(size_t)> &task){
+        if(count == 0)
+            return;
+        if(workers.size() == 0 || count == 1){
+            for(size_t i = 0; i < count; i++){
+                task(i);
+            }
+            return;
+        }
+        
+        batch b;
+        b.task = &task;
+        b.profile = query_profile::active();
+        b.printer_output = record_printer::output();
+        b.remaining = count;
+        size_t block = (count + queues.size() - 1) / queues.size();
+        for(size_t q = 0; q < queues.size(); q++){
+            lock_guard<mutex> guard(queues[q].queue_mutex);
+            for(size_t i = q * block; i < min(count, (q + 1) * block); i++){
+                queues[q].items.push_back(make_pair(&b, i));
+                ++queued;
+            }
+        }
+        {
+            lock_guard<mutex> guard(wake_mutex);
+        }
+        wake.notify_all();
+        
+        // help out until every task of the batch has finished
+        pair<batch*, size_t> item;
+        while(b.remaining > 0 && take(0, item)){
+            execute(item);
+        }
+        unique_lock<mutex> lock(b.done_mutex);
+        b.done.wait(lock, [&b]{ return b.remaining == 0; });
+    }
+};
+
+
+// State of its own for every thread taking part in a scan, such as a partial aggregate. A morsel is scanned by
+// a single thread, so the state is looked up once per morsel and not once per row.
+template<typename T>
+class thread_states{
+    function<T*()> make;
+    mutex states_mutex;
+    vector<T*> states;
+    unordered_map<thread::id, T*> thread_state;
+    vector<T*> morsel_state;
+
+public:
+    thread_states(function<T*()> make_state) : make(make_state){}
+    
+    ~thread_states(){
+        for(size_t i = 0; i < states.size(); i++){
+            delete states[i];
+        }
+    }
+    
+    // the scan is about to visit this many morsels
+    void start(size_t morsels){
+        morsel_state.assign(morsels, NULL);
+    }
+    
+    // state of the thread scanning a morsel
+    T& of_morsel(size_t morsel){
+        T *&state = morsel_state[morsel];
+        if(state == NULL){
+            lock_guard<mutex> guard(states_mutex);
+            T *&own = thread_state[this_thread::get_id()];
+            if(own == NULL){
+                own = make();
+                states.push_back(own);
+            }
+            state = own;
+        }
+        return *state;
+    }
+    
+    // every state made, once the scan is over
+    vector<T*>& all(){
+        return states;
+    }
+};
+
+
+#endif /* thread_pool_h */
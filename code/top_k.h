@@ -0,0 +1,175 @@
+#ifndef top_k_h
+#define top_k_h
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include "file_utils.h"
+#include "thread_pool.h"
+#include "external_sort.h"
+using namespace std;
+
+// largest LIMIT kept in heaps, an ORDER BY with a larger one sorts all the rows and cuts the result
+#ifndef TOP_K_MAX_ROWS
+#define TOP_K_MAX_ROWS 100000
+#endif
+
+
+// Smallest and largest value of a column among the rows of a leaf, as ascending sort_key column bytes
+struct leaf_zone{
+    uint32_t leaf_addr;
+    string min_value, max_value;
+};
+
+
+// Zone maps of table columns: the leaves of a table in row_id order, each with the range of a column's values.
+// A full scan lays them out on the side; they are good for as long as the table file keeps its version.
+class zone_maps{
+    struct zone_map{
+        uint64_t version;
+        shared_ptr<const vector<leaf_zone> > zones;
+    };
+    
+    static mutex& zone_mutex(){
+        static mutex zone_lock;
+        return zone_lock;
+    }
+    
+    // by (table file, 0-based column position, -1 for row_id)
+    static map<pair<string, int>, zone_map>& maps(){
+        static map<pair<string, int>, zone_map> zone_maps_by_column;
+        return zone_maps_by_column;
+    }
+
+public:
+    
+    // the zones of a column as of version, NULL if there are none
+    static shared_ptr<const vector<leaf_zone> > find(string table_file_path, int ordinal_position, uint64_t version){
+        lock_guard<mutex> guard(zone_mutex());
+        map<pair<string, int>, zone_map>::iterator it = maps().find(make_pair(table_file_path, ordinal_position));
+        if(it == maps().end())
+            return shared_ptr<const vector<leaf_zone> >();
+        if(it->second.version != version){
+            maps().erase(it);
+            return shared_ptr<const vector<leaf_zone> >();
+        }
+        return it->second.zones;
+    }
+    
+    static void store(string table_file_path, int ordinal_position, uint64_t version, shared_ptr<const vector<leaf_zone> > zones){
+        lock_guard<mutex> guard(zone_mutex());
+        zone_map &m = maps()[make_pair(table_file_path, ordinal_position)];
+        m.version = version;
+        m.zones = zones;
+    }
+    
+    
+    // Lowest key bytes any row of the zone can have on the column, in the column's direction
+    static string lowest_key(const leaf_zone &zone, const sort_column &column){
+        if(!column.descending)
+            return zone.min_value;
+        string key = zone.max_value;
+        for(size_t i = 0; i < key.size(); i++){
+            key[i] = ~key[i];
+        }
+        return key;
+    }
+};
+
+
+// ORDER BY ... LIMIT k over rows arriving from several scan threads. Every thread keeps the k smallest keys it
+// saw in a bounded max-heap, so a row only costs its key unless it beats the worst row kept; the heaps are
+// merged at the end. Memory stays at k rows per thread whatever the size of the table.
+class top_k_selector{
+    size_t k;
+    
+    struct bounded_heap{
+        vector<pair<string, string> > entries;          // (key, row bytes), largest key on top
+        string key;                                     // scratch for the key of the current row
+    };
+    
+    thread_states<bounded_heap> heaps;
+    
+    // worst key of a full heap: the k rows of the result all have smaller keys, whatever heap they are in
+    mutex bound_mutex;
+    string bound;
+    bool bounded;
+    
+    
+    static bool entry_less(const pair<string, string> &e1, const pair<string, string> &e2){
+        return e1.first < e2.first;
+    }
+
+public:
+    top_k_selector(size_t limit) : k(limit), heaps([]{ return new bounded_heap(); }), bounded(false){}
+    
+    
+    // the scan is about to visit this many morsels
+    void start(size_t morsels){
+        heaps.start(morsels);
+    }
+    
+    
+    // True if no row whose first key column is at least lowest can make it into the result, as the morsel
+    // thread or another one already holds k better rows. Column bytes never prefix one another, so a difference
+    // within the shorter one settles the order.
+    bool excludes(size_t morsel, const string &lowest){
+        if(k == 0)
+            return true;
+        bounded_heap &h = heaps.of_morsel(morsel);
+        lock_guard<mutex> guard(bound_mutex);
+        if(h.entries.size() == k && (!bounded || h.entries.front().first < bound)){
+            bound = h.entries.front().first;
+            bounded = true;
+        }
+        return bounded && memcmp(lowest.data(), bound.data(), min(lowest.size(), bound.size())) > 0;
+    }
+    
+    
+    // Offer a record of a morsel, only ever called by the thread scanning that morsel; make_row gives the row
+    // to keep for the record and is only called if the record gets in
+    void add(size_t morsel, const vector<sort_column> &columns, const record_type &record, const function<record_type(const record_type&)> &make_row){
+        bounded_heap &h = heaps.of_morsel(morsel);
+        if(k == 0)
+            return;
+        sort_key::make(h.key, columns, record);
+        if(h.entries.size() == k){
+            if(!(h.key < h.entries.front().first))
+                return;
+            pop_heap(h.entries.begin(), h.entries.end(), entry_less);
+            h.entries.pop_back();
+        }
+        pair<string, string> entry;
+        entry.first.swap(h.key);
+        file_utils::append_record_bytes(entry.second, make_row(record));
+        h.entries.push_back(move(entry));
+        push_heap(h.entries.begin(), h.entries.end(), entry_less);
+    }
+    
+    
+    // The k rows with the smallest keys, in key order
+    vector<record_type> finish(){
+        vector<bounded_heap*> &all = heaps.all();
+        vector<pair<string, string> > entries;
+        for(size_t i = 0; i < all.size(); i++){
+            entries.insert(entries.end(), make_move_iterator(all[i]->entries.begin()), make_move_iterator(all[i]->entries.end()));
+            all[i]->entries.clear();
+        }
+        size_t rows = min(k, entries.size());
+        partial_sort(entries.begin(), entries.begin() + rows, entries.end(), entry_less);
+        
+        vector<record_type> output(rows);
+        for(size_t i = 0; i < rows; i++){
+            file_utils::read_record_bytes(entries[i].second.data(), output[i]);
+        }
+        return output;
+    }
+};
+
+
+#endif /* top_k_h */
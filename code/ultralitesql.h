@@ -0,0 +1,549 @@
+#ifndef ultralitesql_h
+#define ultralitesql_h
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "abhisql.h"
+#include "sql_parser.h"
+#include "statement_cache.h"
+#include "console.h"
+using namespace std;
+
+// result codes of the library API
+#define ULTRALITE_OK 0
+#define ULTRALITE_ROW 1                 // step: a row of the result is ready to be read
+#define ULTRALITE_DONE 2                // step: the statement has run to its end
+#define ULTRALITE_ERROR 3               // the engine failed to run the statement
+#define ULTRALITE_SYNTAX 4              // the statement does not parse
+#define ULTRALITE_RANGE 5               // no placeholder with that index
+#define ULTRALITE_MISUSE 6              // a call the connection or the statement is not ready for
+#define ULTRALITE_CANTOPEN 7            // no database installed in that directory
+
+// data type code column_type gives for a NULL
+#define ULTRALITE_NULL 0x00
+
+
+// The console output of the calls of a connection. Whether a call failed comes from what the engine returns;
+// the first error it printed meanwhile becomes the message of the failure.
+class message_buffer : public streambuf{
+    string line;
+    bool failed;
+    string error;
+
+protected:
+    int overflow(int c){
+        if(traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        char character = traits_type::to_char_type(c);
+        xsputn(&character, 1);
+        return c;
+    }
+    
+    streamsize xsputn(const char *s, streamsize n){
+        for(streamsize i = 0; i < n; i++){
+            if(s[i] != '\n'){
+                line += s[i];
+                continue;
+            }
+            if(!failed && line.compare(0, 8, "[Error] ") == 0){
+                failed = true;
+                error = line.substr(8);
+            }
+            else if(!failed && line.compare(0, 15, "[Syntax error] ") == 0){
+                failed = true;
+                error = line.substr(15);
+            }
+            line.clear();
+        }
+        return n;
+    }
+
+public:
+    message_buffer() : failed(false){}
+    
+    void clear(){
+        line.clear();
+        failed = false;
+        error.clear();
+    }
+    
+    bool error_printed() const{
+        return failed;
+    }
+    
+    const string& error_message() const{
+        return error;
+    }
+};
+
+
+class ultralite_statement;
+
+
+// A connection to the database of a directory, for a program to run statements in-process and read their
+// results as values rather than as printed tables. Nothing reaches the console: the engine's messages are
+// kept and its first error of a call is given by error_message(). A connection is used by one thread at a
+// time, not always the same one; each connection has its own transaction, and connections run at once.
+class ultralite_db{
+    Abhi_sql_engine engine;
+    file_utils::transaction_state transaction;
+    sql_parser parser;
+    statement_cache statements;
+    message_buffer messages;
+    ostream message_stream;
+    string error;
+    bool opened;
+    
+    // the engine's console output on this thread goes to the connection while it is alive, and its statements
+    // run in the connection's transaction
+    class capture{
+        ultralite_db &db;
+        ostream *console_stream;
+        transaction_scope scope;
+    public:
+        capture(ultralite_db &connection) : db(connection), scope(connection.transaction){
+            db.messages.clear();
+            console_stream = console::stream();
+            console::stream() = &db.message_stream;
+        }
+        
+        ~capture(){
+            console::stream() = console_stream;
+        }
+    };
+    
+    int fail(int code, string message){
+        error = message;
+        return code;
+    }
+    
+    // the result of a call that ran the engine, failed_code if it did not succeed, with the error it printed
+    int finish(bool succeeded, int failed_code = ULTRALITE_ERROR){
+        if(succeeded){
+            error.clear();
+            return ULTRALITE_OK;
+        }
+        return fail(failed_code, messages.error_printed() ? messages.error_message() : "The statement failed");
+    }
+    
+    friend class ultralite_statement;
+
+public:
+    ultralite_db() : message_stream(&messages), opened(false){}
+    
+    ~ultralite_db(){
+        close();
+    }
+    
+    
+    // Work on the database installed in db_dir. The engine keeps its files relative to the working
+    // directory, so this changes it: a process works with one database directory at a time.
+    int open(const string &db_dir){
+        if(opened)
+            return fail(ULTRALITE_MISUSE, "The connection is already open");
+        struct stat catalog_stat;
+        if(chdir(db_dir.c_str()) != 0 || stat("catalog/database_tables.tbl", &catalog_stat) != 0)
+            return fail(ULTRALITE_CANTOPEN, string("No database installed in \'") + db_dir + "\'");
+        opened = true;
+        error.clear();
+        return ULTRALITE_OK;
+    }
+    
+    // Roll back a transaction left open on the connection
+    void close(){
+        if(!opened)
+            return;
+        capture captured(*this);
+        if(engine.in_transaction())
+            engine.rollback_transaction();
+        opened = false;
+    }
+    
+    // Parse a statement, with ? placeholders for values bound before each step. Statements with the same
+    // text share what was parsed.
+    int prepare(const string &text, ultralite_statement &statement);
+    
+    // Run a statement with no placeholders, its rows if any left unread
+    int exec(const string &text);
+    
+    // whether a transaction is open on the connection
+    bool in_transaction(){
+        return transaction.active;
+    }
+    
+    const string& error_message() const{
+        return error;
+    }
+};
+
+
+// A value of a result row, converted from its text once, when the cursor moves to its row
+struct ultralite_value{
+    uint8_t type;                       // data type code (0x04 tinyint to 0x0c text), ULTRALITE_NULL for a NULL
+    int64_t integer;
+    double real;
+    string text;
+    ultralite_value() : type(ULTRALITE_NULL), integer(0), real(0.0){}
+};
+
+
+// A prepared statement and the cursor over its result. step runs the statement the first time and then
+// moves to each row in turn; the getters read the columns of the current row, 0 being the first column
+// after row_id. A SELECT with no JOIN, ORDER BY, GROUP BY or aggregates reads its table a leaf at a time as
+// the steps go; the others are run to the end by the first step. Stepping again after ULTRALITE_DONE runs the
+// statement again with the values bound then.
+class ultralite_statement{
+    ultralite_db *db;
+    shared_ptr<const sql_statement> statement;
+    vector<string> arguments;
+    vector<bool> bound;
+    record_type header;
+    vector<record_type> rows;           // rows not yet stepped to: the whole result, or the last leaf scanned
+    size_t next_row;
+    bool scanning;                      // rows come from cursor
+    scan_cursor cursor;
+    long rows_left;                     // rows the LIMIT still lets through, -1 without one
+    uint32_t current_row_id;
+    vector<ultralite_value> current;    // the row last stepped to
+    bool running;
+    
+    static const string& no_text(){
+        static const string empty;
+        return empty;
+    }
+    
+    const ultralite_value* value(size_t column) const{
+        if(!running || column >= current.size())
+            return NULL;
+        return &current[column];
+    }
+    
+    int set_argument(size_t index, string argument){
+        if(!statement)
+            return db ? db->fail(ULTRALITE_MISUSE, "The statement is not prepared") : ULTRALITE_MISUSE;
+        if(index >= arguments.size())
+            return db->fail(ULTRALITE_RANGE, string("The statement has no placeholder ") + to_string(index));
+        arguments[index] = argument;
+        bound[index] = true;
+        return ULTRALITE_OK;
+    }
+    
+    // make a record the current row, its values converted once for the getters
+    void set_current(record_type &record){
+        current_row_id = record.first;
+        current.resize(record.second.size());
+        for(size_t i = 0; i < record.second.size(); i++){
+            ultralite_value &column = current[i];
+            uint8_t type_code = record.second[i].first;
+            column.text.swap(record.second[i].second);
+            if(type_code < 0x04){
+                column = ultralite_value();
+                continue;
+            }
+            column.type = min(type_code, (uint8_t) 0x0c);
+            if(type_code <= 0x07){
+                column.integer = strtoll(column.text.c_str(), NULL, 10);
+                column.real = (double) column.integer;
+            }
+            else if(type_code <= 0x09){
+                column.real = strtod(column.text.c_str(), NULL);
+                column.integer = (int64_t) column.real;
+            }
+            else{
+                column.integer = strtoll(column.text.c_str(), NULL, 10);
+                column.real = strtod(column.text.c_str(), NULL);
+            }
+        }
+    }
+    
+    // the next row of the result into rows[next_row], scanning on if need be; false past the last one
+    bool fetch(){
+        if(rows_left == 0)
+            return false;
+        while(next_row >= rows.size()){
+            if(!scanning)
+                return false;
+            ultralite_db::capture captured(*db);
+            next_row = 0;
+            if(!db->engine.next_scan_rows(cursor, rows))
+                return false;
+        }
+        if(rows_left > 0)
+            rows_left--;
+        return true;
+    }
+    
+    // run the bound statement: a SELECT that can be scanned is opened, any other one runs to its end with its
+    // records kept for the steps to come
+    int run(){
+        for(size_t i = 0; i < bound.size(); i++){
+            if(!bound[i])
+                return db->fail(ULTRALITE_MISUSE, string("No value bound to placeholder ") + to_string(i));
+        }
+        ultralite_db::capture captured(*db);
+        sql_statement bound_statement;
+        const sql_statement *run_statement = statement.get();
+        if(arguments.size() > 0){
+            if(!statement->bind(arguments, bound_statement))
+                return db->finish(false, ULTRALITE_MISUSE);
+            run_statement = &bound_statement;
+        }
+        
+        Abhi_sql_engine &engine = db->engine;
+        const string &action = run_statement->action;
+        header = record_type();
+        rows.clear();
+        next_row = 0;
+        scanning = false;
+        rows_left = -1;
+        bool succeeded = true;
+        if(action == "select"){
+            const select_statement &select = run_statement->select;
+            rows_left = select.limit;
+            if(select.join_table != ""){
+                mutex rows_mutex;
+                long limit = select.limit;
+                succeeded = engine.query_join(select, [&](record_type &record){
+                    lock_guard<mutex> guard(rows_mutex);
+                    if(record.first == (uint32_t) -1)
+                        header = record;
+                    else if(limit == -1 || (long) rows.size() < limit)
+                        rows.push_back(record);
+                });
+            }
+            else if(select.order_columns.empty() && select.group_column == "" && !select.has_aggregates){
+                cursor = scan_cursor();
+                succeeded = scanning = engine.open_scan(select, cursor, header);
+            }
+            else{
+                rows = engine.query_records(select);
+                succeeded = !rows.empty();
+                if(succeeded){
+                    header = rows[0];
+                    rows.erase(rows.begin());
+                }
+            }
+        }
+        else if(action == "insert"){
+            vector<vector<string> > insert_values_list = run_statement->insert_values_list;
+            vector<string> insert_columns = run_statement->insert_columns;
+            succeeded = engine.insert(run_statement->table_name, insert_values_list, insert_columns);
+        }
+        else if(action == "update"){
+            succeeded = engine.update_records(run_statement->table_name, run_statement->set_column, run_statement->set_value, run_statement->cond);
+        }
+        else if(action == "delete"){
+            succeeded = engine.update_records(run_statement->table_name, "-", "0", run_statement->cond, true);
+        }
+        else if(action == "create"){
+            vector< ::column_type> columns = run_statement->columns;
+            succeeded = engine.create_table(run_statement->table_name, columns);
+        }
+        else if(action == "drop"){
+            succeeded = engine.drop_table(run_statement->table_name);
+        }
+        else if(action == "load"){
+            ifstream rows_file(run_statement->rows_path);
+            if(!rows_file.is_open()){
+                console::out() << "[Error] Cannot open rows file \'" << run_statement->rows_path << "\'\n";
+                succeeded = false;
+            }
+            else
+                succeeded = engine.load_table(run_statement->table_name, rows_file, run_statement->fill_factor);
+        }
+        else if(action == "analyze"){
+            if(run_statement->table_name == "")
+                succeeded = engine.analyze_all_tables();
+            else
+                succeeded = engine.analyze_table(run_statement->table_name);
+        }
+        else if(action == "begin"){
+            succeeded = engine.begin_transaction();
+        }
+        else if(action == "commit"){
+            succeeded = engine.commit_transaction();
+        }
+        else if(action == "rollback"){
+            succeeded = engine.rollback_transaction();
+        }
+        return db->finish(succeeded);
+    }
+    
+    friend class ultralite_db;
+
+public:
+    ultralite_statement() : db(NULL), next_row(0), scanning(false), rows_left(-1), current_row_id(0), running(false){}
+    
+    
+    int step(){
+        if(!statement)
+            return db ? db->fail(ULTRALITE_MISUSE, "The statement is not prepared") : ULTRALITE_MISUSE;
+        if(!running){
+            int code = run();
+            if(code != ULTRALITE_OK)
+                return code;
+            running = true;
+        }
+        if(fetch()){
+            set_current(rows[next_row++]);
+            return ULTRALITE_ROW;
+        }
+        reset();
+        return ULTRALITE_DONE;
+    }
+    
+    // Back to before the first step, the values bound kept
+    void reset(){
+        running = false;
+        next_row = 0;
+        rows.clear();
+        scanning = false;
+        current.clear();
+        current_row_id = 0;
+    }
+    
+    
+    // Bind a value to placeholder index, counting the ?s from 0 in the order they appear. Values are bound as
+    // text, as if typed in place of the ?, and converted to the column's type when the statement runs.
+    template <typename T>
+    typename enable_if<is_integral<T>::value, int>::type bind(size_t index, T value){
+        return set_argument(index, to_string(value));
+    }
+    
+    int bind(size_t index, double value){
+        char text[32];
+        snprintf(text, sizeof(text), "%.17g", value);
+        return set_argument(index, text);
+    }
+    
+    int bind(size_t index, const string &value){
+        return set_argument(index, value);
+    }
+    
+    int bind_null(size_t index){
+        return set_argument(index, "null");
+    }
+    
+    size_t parameter_count() const{
+        return arguments.size();
+    }
+    
+    // the connection it was prepared on, NULL until then
+    ultralite_db* connection() const{
+        return db;
+    }
+    
+    // How many row_ids of its table the statement may read, by the row_id comparisons of its condition with
+    // the values bound: 0 for one that reads no table, such as an INSERT or a BEGIN, and 2^32 for a join or a
+    // statement that changes the schema or loads a table
+    uint64_t row_id_span() const{
+        if(!statement)
+            return 0;
+        const string &action = statement->action;
+        if(action == "insert" || action == "begin" || action == "commit" || action == "rollback")
+            return 0;
+        if((action != "select" && action != "update" && action != "delete") || statement->select.join_table != "")
+            return (uint64_t) 1 << 32;
+        
+        where_condition bounds = (action == "select") ? statement->select.cond : statement->cond;
+        const vector<string> &values = arguments;
+        bounds.each_comparison([&values](where_condition &comparison){
+            comparison.ordinal_position = 0;
+            if(comparison.column_name == "row_id" && !comparison.value_is_null){
+                const string &value = (comparison.parameter != -1) ? values[comparison.parameter] : comparison.value;
+                comparison.ordinal_position = -1;
+                comparison.row_id_value = strtoll(value.c_str(), NULL, 10);
+            }
+            return true;
+        });
+        int64_t low = 0, high = 0xffffffff;
+        bounds.row_id_range(low, high);
+        return (low > high) ? 0 : high - low + 1;
+    }
+    
+    
+    size_t column_count() const{
+        return header.second.size();
+    }
+    
+    const string& column_name(size_t column) const{
+        return column < header.second.size() ? header.second[column].second : no_text();
+    }
+    
+    // the row_id of the current row
+    uint32_t row_id() const{
+        return running ? current_row_id : 0;
+    }
+    
+    // data type code of a value of the current row (0x04 tinyint to 0x0c text), ULTRALITE_NULL for a NULL
+    uint8_t column_type(size_t column) const{
+        const ultralite_value *column_value = value(column);
+        return (column_value == NULL) ? ULTRALITE_NULL : column_value->type;
+    }
+    
+    bool column_is_null(size_t column) const{
+        return column_type(column) == ULTRALITE_NULL;
+    }
+    
+    int64_t column_int(size_t column) const{
+        const ultralite_value *column_value = value(column);
+        return (column_value == NULL) ? 0 : column_value->integer;
+    }
+    
+    double column_double(size_t column) const{
+        const ultralite_value *column_value = value(column);
+        return (column_value == NULL) ? 0.0 : column_value->real;
+    }
+    
+    const string& column_text(size_t column) const{
+        const ultralite_value *column_value = value(column);
+        return (column_value == NULL || column_value->type == ULTRALITE_NULL) ? no_text() : column_value->text;
+    }
+};
+
+
+int ultralite_db::prepare(const string &text, ultralite_statement &statement){
+    statement = ultralite_statement();
+    statement.db = this;
+    if(!opened)
+        return fail(ULTRALITE_MISUSE, "The connection is not open");
+    shared_ptr<const sql_statement> parsed_statement = statements.find(text);
+    if(!parsed_statement){
+        capture captured(*this);
+        sql_statement parsed;
+        if(!parser.parse(text, parsed))
+            return finish(false, ULTRALITE_SYNTAX);
+        const string &action = parsed.action;
+        if(action != "select" && action != "insert" && action != "update" && action != "delete" && action != "create" && action != "drop" && action != "load" && action != "analyze" && action != "begin" && action != "commit" && action != "rollback")
+            return fail(ULTRALITE_MISUSE, string("The library API does not run ") + action + " statements");
+        parsed_statement = make_shared<const sql_statement>(parsed);
+        statements.add(text, parsed_statement);
+    }
+    statement.statement = parsed_statement;
+    statement.arguments.assign(parsed_statement->parameter_count, "");
+    statement.bound.assign(parsed_statement->parameter_count, false);
+    error.clear();
+    return ULTRALITE_OK;
+}
+
+
+int ultralite_db::exec(const string &text){
+    ultralite_statement statement;
+    int code = prepare(text, statement);
+    if(code != ULTRALITE_OK)
+        return code;
+    code = statement.step();
+    return (code == ULTRALITE_ROW || code == ULTRALITE_DONE) ? ULTRALITE_OK : code;
+}
+
+
+#endif /* ultralitesql_h */
@@ -0,0 +1,271 @@
+#ifndef wire_protocol_h
+#define wire_protocol_h
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+using namespace std;
+
+// Messages between the server and its clients, each sent as a frame: a 4-byte length, then the message type
+// and its fields, which that length counts. Integers are little-endian; a text is a 4-byte length and its
+// bytes.
+
+// requests
+#define WIRE_QUERY 0x01                 // text: run a statement with no placeholders
+#define WIRE_PREPARE 0x02               // text: prepare a statement, answered by WIRE_PREPARED
+#define WIRE_EXECUTE 0x03               // 4-byte statement id, 2-byte value count, values: run a prepared statement
+#define WIRE_CLOSE 0x04                 // 4-byte statement id: forget a prepared statement, answered by WIRE_DONE
+
+// responses; a statement run is answered by WIRE_COLUMNS, any number of WIRE_ROWS and WIRE_DONE, or by WIRE_ERROR
+#define WIRE_COLUMNS 0x81               // 2-byte column count, their names as texts
+#define WIRE_ROWS 0x82                  // 4-byte row count, each row its 4-byte row_id and a value per column
+#define WIRE_DONE 0x83                  // 8-byte count of the rows sent
+#define WIRE_PREPARED 0x84              // 4-byte statement id, 2-byte placeholder count
+#define WIRE_ERROR 0x85                 // 1-byte ULTRALITE_ code, text message
+
+// kinds of values, each written as this 1-byte kind and then the value
+#define WIRE_NULL 0x00                  // nothing follows
+#define WIRE_INT 0x01                   // 8 bytes
+#define WIRE_DOUBLE 0x02                // 8 bytes, IEEE 754
+#define WIRE_TEXT 0x03                  // a text
+
+// frames longer than this are taken for a broken stream
+#ifndef WIRE_MAX_FRAME
+#define WIRE_MAX_FRAME (64 << 20)
+#endif
+
+
+// A value of a request or a result
+struct wire_value{
+    uint8_t kind;
+    int64_t int_value;
+    double double_value;
+    string text;
+    
+    wire_value() : kind(WIRE_NULL), int_value(0), double_value(0){}
+};
+
+
+// Fields appended to a message
+class wire_writer{
+    string &bytes;
+
+public:
+    wire_writer(string &message) : bytes(message){}
+    
+    void put_u8(uint8_t value){
+        bytes += (char) value;
+    }
+    
+    void put_u16(uint16_t value){
+        put_unsigned(value, 2);
+    }
+    
+    void put_u32(uint32_t value){
+        put_unsigned(value, 4);
+    }
+    
+    void put_u64(uint64_t value){
+        put_unsigned(value, 8);
+    }
+    
+    void put_unsigned(uint64_t value, size_t size){
+        for(size_t i = 0; i < size; i++){
+            bytes += (char) (value >> (8 * i));
+        }
+    }
+    
+    void put_text(string_view text){
+        put_u32(text.size());
+        bytes.append(text.data(), text.size());
+    }
+    
+    void put_value(const wire_value &value){
+        put_u8(value.kind);
+        if(value.kind == WIRE_INT)
+            put_u64(value.int_value);
+        else if(value.kind == WIRE_DOUBLE){
+            uint64_t bits;
+            memcpy(&bits, &value.double_value, 8);
+            put_u64(bits);
+        }
+        else if(value.kind == WIRE_TEXT)
+            put_text(value.text);
+    }
+};
+
+
+// Fields read in order from a message; reading past its end makes ok() false
+class wire_reader{
+    string_view bytes;
+    size_t position;
+    bool valid;
+    
+    uint64_t get_unsigned(size_t size){
+        if(position + size > bytes.size()){
+            valid = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for(size_t i = 0; i < size; i++){
+            value |= (uint64_t) (uint8_t) bytes[position + i] << (8 * i);
+        }
+        position += size;
+        return value;
+    }
+
+public:
+    wire_reader(string_view message) : bytes(message), position(0), valid(true){}
+    
+    bool ok() const{
+        return valid;
+    }
+    
+    uint8_t get_u8(){
+        return get_unsigned(1);
+    }
+    
+    uint16_t get_u16(){
+        return get_unsigned(2);
+    }
+    
+    uint32_t get_u32(){
+        return get_unsigned(4);
+    }
+    
+    uint64_t get_u64(){
+        return get_unsigned(8);
+    }
+    
+    string_view get_text(){
+        uint32_t size = get_u32();
+        if(!valid || position + size > bytes.size()){
+            valid = false;
+            return string_view();
+        }
+        string_view text = bytes.substr(position, size);
+        position += size;
+        return text;
+    }
+    
+    bool get_value(wire_value &value){
+        value.kind = get_u8();
+        if(value.kind == WIRE_INT)
+            value.int_value = get_u64();
+        else if(value.kind == WIRE_DOUBLE){
+            uint64_t bits = get_u64();
+            memcpy(&value.double_value, &bits, 8);
+        }
+        else if(value.kind == WIRE_TEXT)
+            value.text = string(get_text());
+        else if(value.kind != WIRE_NULL)
+            valid = false;
+        return valid;
+    }
+};
+
+
+// Frames over a connected socket, and the sockets themselves
+class wire_socket{
+    static bool read_fully(int fd, char *bytes, size_t size){
+        while(size > 0){
+            ssize_t got = recv(fd, bytes, size, 0);
+            if(got < 0 && errno == EINTR)
+                continue;
+            if(got <= 0)
+                return false;
+            bytes += got;
+            size -= got;
+        }
+        return true;
+    }
+
+public:
+    
+    // Send a message as a frame, type first
+    static bool write_frame(int fd, uint8_t type, const string &message){
+        string frame;
+        frame.reserve(5 + message.size());
+        wire_writer writer(frame);
+        writer.put_u32(message.size() + 1);
+        writer.put_u8(type);
+        frame += message;
+        const char *bytes = frame.data();
+        size_t size = frame.size();
+        while(size > 0){
+            ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+            if(sent < 0 && errno == EINTR)
+                continue;
+            if(sent <= 0)
+                return false;
+            bytes += sent;
+            size -= sent;
+        }
+        return true;
+    }
+    
+    // Wait for the next frame; false once the connection is closed or the frame is broken
+    static bool read_frame(int fd, uint8_t &type, string &message){
+        char length_bytes[4];
+        if(!read_fully(fd, length_bytes, 4))
+            return false;
+        uint32_t length = wire_reader(string_view(length_bytes, 4)).get_u32();
+        if(length == 0 || length > WIRE_MAX_FRAME)
+            return false;
+        message.resize(length);
+        if(!read_fully(fd, &message[0], length))
+            return false;
+        type = message[0];
+        message.erase(0, 1);
+        return true;
+    }
+    
+    
+    // Connect to a server at a Unix socket path, or at tcp:port on the loopback address. -1 if it cannot.
+    static int connect_to(const string &address){
+        int fd;
+        if(address.compare(0, 4, "tcp:") == 0){
+            sockaddr_in tcp_address;
+            memset(&tcp_address, 0, sizeof(tcp_address));
+            tcp_address.sin_family = AF_INET;
+            tcp_address.sin_port = htons(atoi(address.c_str() + 4));
+            tcp_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if(fd < 0)
+                return -1;
+            int no_delay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            if(connect(fd, (sockaddr*) &tcp_address, sizeof(tcp_address)) != 0){
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        sockaddr_un unix_address;
+        if(address.size() >= sizeof(unix_address.sun_path))
+            return -1;
+        memset(&unix_address, 0, sizeof(unix_address));
+        unix_address.sun_family = AF_UNIX;
+        strcpy(unix_address.sun_path, address.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0)
+            return -1;
+        if(connect(fd, (sockaddr*) &unix_address, sizeof(unix_address)) != 0){
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+};
+
+
+#endif /* wire_protocol_h */
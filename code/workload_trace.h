@@ -0,0 +1,214 @@
+#ifndef workload_trace_h
+#define workload_trace_h
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+using namespace std;
+
+// the first bytes of a trace file
+#define TRACE_MAGIC "ULTRACE1"
+
+// statements longer than this are taken for a broken trace
+#define TRACE_MAX_TEXT (64 << 20)
+
+// A trace file is TRACE_MAGIC, the capture's start as 8 bytes of microseconds since the epoch, then an entry
+// per statement, its numbers written as varints (7 bits a byte, low bits first):
+//     microseconds from the start of the previous statement (of the capture, for the first) to its own
+//     microseconds it ran for
+//     its text: (length << 1) | 1 and the bytes the first time it is seen, or (index << 1) to repeat the
+//     index-th distinct text of the trace
+//     the records it returned
+//     1 and an 8-byte digest of what it printed, or 0 if its output may differ between runs
+
+
+// A statement of a trace
+struct trace_entry{
+    uint64_t offset;                // microseconds from the start of the capture
+    uint64_t duration;              // microseconds
+    string text;
+    uint64_t rows;
+    bool compared;                  // false if digest is not to be compared
+    uint64_t digest;
+    
+    trace_entry() : offset(0), duration(0), rows(0), compared(false), digest(0){}
+};
+
+
+// Passes output on to another stream buffer, or drops it if there is none, keeping an FNV-1a digest of it
+class digest_buffer : public streambuf{
+    streambuf *next;
+    uint64_t hash;
+
+protected:
+    int overflow(int c){
+        if(traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        char character = traits_type::to_char_type(c);
+        xsputn(&character, 1);
+        return c;
+    }
+    
+    streamsize xsputn(const char *s, streamsize n){
+        for(streamsize i = 0; i < n; i++){
+            hash = (hash ^ (uint8_t) s[i]) * 1099511628211ULL;
+        }
+        return (next != NULL) ? next->sputn(s, n) : n;
+    }
+    
+    int sync(){
+        return (next != NULL) ? next->pubsync() : 0;
+    }
+
+public:
+    digest_buffer(streambuf *passed_to) : next(passed_to), hash(14695981039346656037ULL){}
+    
+    uint64_t digest() const{
+        return hash;
+    }
+};
+
+
+// Appends the statements run to a trace file
+class trace_writer{
+    ofstream file;
+    chrono::steady_clock::time_point start;
+    uint64_t last_offset;
+    unordered_map<string, uint64_t> texts;      // index of each distinct text written
+    string entry;
+    
+    void put_varint(uint64_t value){
+        while(value >= 0x80){
+            entry += (char) (value | 0x80);
+            value >>= 7;
+        }
+        entry += (char) value;
+    }
+
+public:
+    trace_writer() : last_offset(0){}
+    
+    bool open(const string &path){
+        file.open(path, ios::out | ios::binary | ios::trunc);
+        if(!file.is_open())
+            return false;
+        start = chrono::steady_clock::now();
+        uint64_t epoch = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        file.write(TRACE_MAGIC, 8);
+        for(size_t i = 0; i < 8; i++){
+            file.put((char) (epoch >> (8 * i)));
+        }
+        return file.good();
+    }
+    
+    // microseconds since the capture started
+    uint64_t now() const{
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+    
+    void add(const trace_entry &statement){
+        entry.clear();
+        put_varint(statement.offset - last_offset);
+        put_varint(statement.duration);
+        last_offset = statement.offset;
+        unordered_map<string, uint64_t>::iterator seen = texts.find(statement.text);
+        if(seen != texts.end())
+            put_varint(seen->second << 1);
+        else{
+            uint64_t index = texts.size();
+            texts[statement.text] = index;
+            put_varint((statement.text.size() << 1) | 1);
+            entry += statement.text;
+        }
+        put_varint(statement.rows);
+        entry += (char) statement.compared;
+        if(statement.compared){
+            for(size_t i = 0; i < 8; i++){
+                entry += (char) (statement.digest >> (8 * i));
+            }
+        }
+        file.write(entry.data(), entry.size());
+    }
+};
+
+
+// Reads the statements of a trace file back in order
+class trace_reader{
+    ifstream file;
+    vector<string> texts;
+    uint64_t last_offset;
+    bool cut_short;
+    
+    bool get_varint(uint64_t &value){
+        value = 0;
+        for(size_t shift = 0; shift < 64; shift += 7){
+            int byte = file.get();
+            if(byte == EOF)
+                return false;
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+public:
+    trace_reader() : last_offset(0), cut_short(false){}
+    
+    // false if the file cannot be read or is not a trace
+    bool open(const string &path){
+        file.open(path, ios::in | ios::binary);
+        char magic[16];
+        return file.is_open() && file.read(magic, 16) && string(magic, 8) == TRACE_MAGIC;
+    }
+    
+    // The next statement; false at the end of the trace, or where it is cut short (then broken() is true)
+    bool next(trace_entry &statement){
+        uint64_t gap, text_tag;
+        if(!get_varint(gap))
+            return false;
+        cut_short = true;
+        if(!get_varint(statement.duration) || !get_varint(text_tag))
+            return false;
+        statement.offset = last_offset + gap;
+        last_offset = statement.offset;
+        if((text_tag >> 1) > TRACE_MAX_TEXT)
+            return false;
+        if(text_tag & 1){
+            statement.text.resize(text_tag >> 1);
+            if(!file.read(&statement.text[0], statement.text.size()))
+                return false;
+            texts.push_back(statement.text);
+        }
+        else if((text_tag >> 1) < texts.size())
+            statement.text = texts[text_tag >> 1];
+        else
+            return false;
+        int compared = EOF;
+        if(!get_varint(statement.rows) || (compared = file.get()) == EOF)
+            return false;
+        statement.compared = (compared == 1);
+        statement.digest = 0;
+        if(statement.compared){
+            for(size_t i = 0; i < 8; i++){
+                int byte = file.get();
+                if(byte == EOF)
+                    return false;
+                statement.digest |= (uint64_t) (uint8_t) byte << (8 * i);
+            }
+        }
+        cut_short = false;
+        return true;
+    }
+    
+    bool broken() const{
+        return cut_short;
+    }
+};
+
+
+#endif /* workload_trace_h */
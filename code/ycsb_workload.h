@@ -0,0 +1,342 @@
+#ifndef ycsb_workload_h
+#define ycsb_workload_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "abhisql.h"
+#include "ultralitesql.h"
+#include "engine_benchmark.h"
+#include "console.h"
+using namespace std;
+
+// the table the workloads are run on, created and loaded in the current database, and dropped at the end
+#ifndef YCSB_TABLE
+#define YCSB_TABLE "ycsb_students"
+#endif
+
+// records loaded before the workloads, operations of each workload and the threads running them, unless given
+#ifndef YCSB_RECORDS
+#define YCSB_RECORDS 100000
+#endif
+
+#ifndef YCSB_OPERATIONS
+#define YCSB_OPERATIONS 100000
+#endif
+
+#ifndef YCSB_THREADS
+#define YCSB_THREADS 4
+#endif
+
+// the longest short-range scan, in rows
+#ifndef YCSB_MAX_SCAN
+#define YCSB_MAX_SCAN 100
+#endif
+
+// skew of the Zipfian distribution, as in YCSB
+#define YCSB_ZIPFIAN_CONSTANT 0.99
+
+// kinds of operations
+#define YCSB_READ 0
+#define YCSB_UPDATE 1
+#define YCSB_INSERT 2
+#define YCSB_SCAN 3
+
+
+// Ranks from 0 to items - 1 drawn with a Zipfian distribution, rank 0 the most frequent: the generator of
+// Gray et al., "Quickly Generating Billion-Record Synthetic Databases", which YCSB uses. It is read-only once
+// made, so threads share one, each drawing with its own random numbers.
+class zipfian_generator{
+    long items;
+    double theta, alpha, zetan, eta;
+    
+    static double zeta(long n, double theta){
+        double sum = 0;
+        for(long i = 1; i <= n; i++){
+            sum += 1 / pow((double) i, theta);
+        }
+        return sum;
+    }
+
+public:
+    zipfian_generator(long item_count, double skew = YCSB_ZIPFIAN_CONSTANT) : items(max(item_count, 2L)), theta(skew){
+        alpha = 1 / (1 - theta);
+        zetan = zeta(items, theta);
+        eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+    }
+    
+    template<typename R>
+    long next(R &random) const{
+        double u = uniform_real_distribution<double>(0, 1)(random);
+        double uz = u * zetan;
+        if(uz < 1)
+            return 0;
+        if(uz < 1 + pow(0.5, theta))
+            return 1;
+        return min((long) (items * pow(eta * u - eta + 1, alpha)), items - 1);
+    }
+};
+
+
+// One of the YCSB core workloads: the share of each kind of operation, and whether reads favor the records
+// inserted last
+struct ycsb_mix{
+    char name;
+    const char *title;
+    double shares[4];           // by YCSB_READ, YCSB_UPDATE, YCSB_INSERT and YCSB_SCAN
+    bool latest;
+};
+
+
+// YCSB-style mixed workloads on a students-like table (the schema of the ReadMe examples): workload a is
+// update heavy (50% reads, 50% updates), b read heavy (95/5), d read latest (95% reads, 5% inserts, reads
+// favoring new records) and e short ranges (95% scans of up to YCSB_MAX_SCAN rows, 5% inserts). Keys are
+// drawn Zipfian, scrambled so that the hot records are spread over the table, or uniform. Each thread has its
+// own connection and prepared statements; throughput and latency percentiles are printed by operation.
+class ycsb_workload{
+    static const ycsb_mix& mix(size_t index){
+        static const ycsb_mix mixes[] = {
+            {'a', "update heavy", {0.50, 0.50, 0, 0}, false},
+            {'b', "read heavy", {0.95, 0.05, 0, 0}, false},
+            {'d', "read latest", {0.95, 0, 0.05, 0}, true},
+            {'e', "short ranges", {0, 0, 0.05, 0.95}, false}
+        };
+        return mixes[index];
+    }
+    
+    static double percentile(const vector<double> &sorted, double fraction){
+        if(sorted.empty())
+            return 0;
+        return sorted[(size_t) (fraction * (sorted.size() - 1) + 0.5)];
+    }
+    
+    // FNV-1a of a rank, to scatter the ranks of the Zipfian distribution over the keys
+    static uint64_t scramble(uint64_t rank){
+        uint64_t hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < 8; i++){
+            hash = (hash ^ ((rank >> (8 * i)) & 0xff)) * 1099511628211ULL;
+        }
+        return hash;
+    }
+    
+    // the values of a record, texts unquoted: the student's name, marks and the rest
+    static void record_values(long row_id, vector<string> &values){
+        char text[160];
+        values.clear();
+        values.push_back(to_string(row_id));
+        snprintf(text, sizeof(text), "Student %ld", row_id);
+        values.push_back(text);
+        values.push_back(to_string(row_id % 5));
+        values.push_back(to_string(row_id % 101));
+        values.push_back(to_string(150 + row_id % 50));
+        values.push_back(to_string(100000000 + row_id));
+        values.push_back(to_string(4690000000L + row_id));
+        values.push_back("2018-03-17_05:23:56");
+        snprintf(text, sizeof(text), "%ld-%02ld-%02ld", 1985 + row_id % 15, row_id % 12 + 1, row_id % 28 + 1);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "%.1f", 45 + (row_id % 500) / 10.0);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "%.4f", 9 + (row_id % 10000) / 1000.0);
+        values.push_back(text);
+        snprintf(text, sizeof(text), "Remarks on student %ld kept to fill the record to about the size of a typical row", row_id);
+        values.push_back(text);
+    }
+    
+    static void record_line(long row_id, string &line){
+        vector<string> values;
+        record_values(row_id, values);
+        for(size_t v = 0; v < values.size(); v++){
+            bool text = (v == 1 || v == values.size() - 1);
+            line += (v == 0) ? "" : ", ";
+            line += text ? "'" + values[v] + "'" : values[v];
+        }
+    }
+    
+    // Create the table afresh and bulk load records into it
+    static bool load(long records){
+        Abhi_sql_engine engine;
+        message_buffer messages;
+        ostream message_stream(&messages);
+        ostream *console_stream = console::stream();
+        console::stream() = &message_stream;
+        FILE *table_file = fopen((string("user_data/") + YCSB_TABLE + ".tbl").c_str(), "r");
+        if(table_file){
+            fclose(table_file);
+            engine.drop_table(YCSB_TABLE);
+        }
+        static const char *columns[][3] = {{"name", "text", "1"}, {"tag", "tinyint", "0"}, {"marks", "smallint", "0"}, {"height", "int", "0"}, {"ssn", "bigint", "1"}, {"phone", "bigint", "0"}, {"submission", "datetime", "0"}, {"birthday", "date", "0"}, {"weight", "real", "0"}, {"best_time", "double", "0"}, {"remarks", "text", "0"}};
+        vector<column_type> table_columns;
+        for(size_t i = 0; i < 11; i++){
+            column_type column;
+            column.column_name = columns[i][0];
+            column.data_type = columns[i][1];
+            column.not_null = (columns[i][2][0] == '1');
+            table_columns.push_back(column);
+        }
+        bool loaded = engine.create_table(YCSB_TABLE, table_columns);
+        if(loaded){
+            bench_row_source source(1, records, record_line);
+            istream lines(&source);
+            loaded = engine.load_table(YCSB_TABLE, lines);
+        }
+        console::stream() = console_stream;
+        if(!loaded)
+            cout << "[Error] Cannot load " << YCSB_TABLE << ": " << messages.error_message() << "\n";
+        return loaded;
+    }
+    
+    static void drop(){
+        Abhi_sql_engine engine;
+        ostream discard(NULL);
+        ostream *console_stream = console::stream();
+        console::stream() = &discard;
+        engine.drop_table(YCSB_TABLE);
+        console::stream() = console_stream;
+    }
+    
+    // Run operations of a workload on threads, latencies in microseconds by kind of operation
+    static void run_mix(const ycsb_mix &workload, bool zipfian, size_t threads, long operations, atomic<long> &inserted, const zipfian_generator &ranks, vector<vector<double> > &latencies, size_t &failed){
+        vector<vector<vector<double> > > thread_latencies(threads, vector<vector<double> >(4));
+        atomic<size_t> failures(0);
+        atomic<long> next_operation(0);
+        vector<thread> workers;
+        for(size_t t = 0; t < threads; t++){
+            workers.push_back(thread([&, t](){
+                ultralite_db db;
+                ultralite_statement read, update, insert, scan;
+                string values_list = "?";
+                for(size_t i = 1; i < 12; i++){
+                    values_list += ", ?";
+                }
+                bool prepared = (db.open(".") == ULTRALITE_OK);
+                prepared = prepared && db.prepare(string("select * from ") + YCSB_TABLE + " where row_id = ?", read) == ULTRALITE_OK;
+                prepared = prepared && db.prepare(string("update ") + YCSB_TABLE + " set marks = ? where row_id = ?", update) == ULTRALITE_OK;
+                prepared = prepared && db.prepare(string("insert into table ") + YCSB_TABLE + " values (" + values_list + ")", insert) == ULTRALITE_OK;
+                prepared = prepared && db.prepare(string("select * from ") + YCSB_TABLE + " where row_id >= ? and row_id < ?", scan) == ULTRALITE_OK;
+                if(!prepared){
+                    console::out() << "[Error] " << db.error_message() << "\n";
+                    failures += operations;
+                    return;
+                }
+                mt19937_64 random(t + 1);
+                uniform_real_distribution<double> kinds(0, 1);
+                uniform_int_distribution<long> scan_lengths(1, YCSB_MAX_SCAN);
+                vector<string> values;
+                while(next_operation++ < operations){
+                    double draw = kinds(random);
+                    int kind = YCSB_READ;
+                    while(kind < YCSB_SCAN && draw >= workload.shares[kind]){
+                        draw -= workload.shares[kind];
+                        kind++;
+                    }
+                    long records = inserted;
+                    long key;
+                    if(workload.latest)
+                        key = max(records - ranks.next(random) % records, 1L);
+                    else if(zipfian)
+                        key = 1 + scramble(ranks.next(random)) % records;
+                    else
+                        key = uniform_int_distribution<long>(1, records)(random);
+                    
+                    ultralite_statement *statement = &read;
+                    if(kind == YCSB_READ)
+                        read.bind(0, (int64_t) key);
+                    else if(kind == YCSB_UPDATE){
+                        update.bind(0, (int64_t) (random() % 101));
+                        update.bind(1, (int64_t) key);
+                        statement = &update;
+                    }
+                    else if(kind == YCSB_INSERT){
+                        record_values(inserted.fetch_add(1) + 1, values);
+                        for(size_t i = 0; i < values.size(); i++){
+                            insert.bind(i, values[i]);
+                        }
+                        statement = &insert;
+                    }
+                    else{
+                        scan.bind(0, (int64_t) key);
+                        scan.bind(1, (int64_t) (key + scan_lengths(random)));
+                        statement = &scan;
+                    }
+                    
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    int code = statement->step();
+                    while(code == ULTRALITE_ROW){
+                        code = statement->step();
+                    }
+                    thread_latencies[t][kind].push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / 1e3);
+                    if(code != ULTRALITE_DONE)
+                        failures++;
+                }
+            }));
+        }
+        for(size_t t = 0; t < workers.size(); t++){
+            workers[t].join();
+        }
+        latencies.assign(4, vector<double>());
+        for(size_t t = 0; t < threads; t++){
+            for(size_t kind = 0; kind < 4; kind++){
+                latencies[kind].insert(latencies[kind].end(), thread_latencies[t][kind].begin(), thread_latencies[t][kind].end());
+            }
+        }
+        failed = failures;
+    }
+
+public:
+    // Load records, then run each workload named in workloads (of "abde") with threads threads for operations
+    // operations, keys drawn Zipfian or uniform
+    static bool run(const string &workloads, bool zipfian, size_t threads, long records, long operations){
+        FILE *catalog = fopen("catalog/database_tables.tbl", "r");
+        if(!catalog){
+            cout << "[Error] No database here, run ultralitesql install first\n";
+            return false;
+        }
+        fclose(catalog);
+        
+        records = max(records, 1L);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if(!load(records))
+            return false;
+        char line[240];
+        snprintf(line, sizeof(line), "Loaded %ld records in %.3f s\n", records, chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e6);
+        cout << line;
+        
+        atomic<long> inserted(records);
+        zipfian_generator ranks(records);
+        bool all_ran = true;
+        for(size_t w = 0; w < 4; w++){
+            const ycsb_mix &workload = mix(w);
+            if(workloads.find(workload.name) == string::npos)
+                continue;
+            vector<vector<double> > latencies;
+            size_t failed = 0;
+            start = chrono::steady_clock::now();
+            run_mix(workload, zipfian, threads, operations, inserted, ranks, latencies, failed);
+            double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1e6;
+            
+            snprintf(line, sizeof(line), "workload %c (%s), %s keys, %zu threads: %ld operations (%zu failed) in %.3f s, %.0f operations/s\n", workload.name, workload.title, (zipfian && !workload.latest) ? "zipfian" : (workload.latest ? "latest" : "uniform"), threads, operations, failed, seconds, operations / seconds);
+            cout << line;
+            static const char *kinds[] = {"read", "update", "insert", "scan"};
+            for(size_t kind = 0; kind < 4; kind++){
+                if(latencies[kind].empty())
+                    continue;
+                sort(latencies[kind].begin(), latencies[kind].end());
+                snprintf(line, sizeof(line), "  %-6s %8zu  %9.0f/s  p50 %9.1f us  p99 %9.1f us  p999 %9.1f us  max %9.1f us\n", kinds[kind], latencies[kind].size(), latencies[kind].size() / seconds, percentile(latencies[kind], 0.50), percentile(latencies[kind], 0.99), percentile(latencies[kind], 0.999), latencies[kind].back());
+                cout << line;
+            }
+            all_ran = all_ran && failed == 0;
+        }
+        drop();
+        return all_ran;
+    }
+};
+
+
+#endif /* ycsb_workload_h */